@@ -0,0 +1,43 @@
+; IRQ entry stubs
+; Each stub saves the registers, passes its IRQ number to irq_dispatch
+; and returns from the interrupt.
+
+section .text
+extern irq_dispatch
+
+%macro IRQ_STUB 1
+irq_stub_%1:
+    pusha                ; Save general purpose registers
+    cld                  ; C code expects the direction flag clear
+    push dword %1
+    call irq_dispatch
+    add esp, 4
+    popa
+    iret
+%endmacro
+
+IRQ_STUB 0
+IRQ_STUB 1
+IRQ_STUB 2
+IRQ_STUB 3
+IRQ_STUB 4
+IRQ_STUB 5
+IRQ_STUB 6
+IRQ_STUB 7
+IRQ_STUB 8
+IRQ_STUB 9
+IRQ_STUB 10
+IRQ_STUB 11
+IRQ_STUB 12
+IRQ_STUB 13
+IRQ_STUB 14
+IRQ_STUB 15
+
+; Stub addresses, indexed by IRQ number
+section .data
+global irq_stub_table
+irq_stub_table:
+    dd irq_stub_0, irq_stub_1, irq_stub_2, irq_stub_3
+    dd irq_stub_4, irq_stub_5, irq_stub_6, irq_stub_7
+    dd irq_stub_8, irq_stub_9, irq_stub_10, irq_stub_11
+    dd irq_stub_12, irq_stub_13, irq_stub_14, irq_stub_15
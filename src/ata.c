@@ -0,0 +1,460 @@
+#include "ata.h"
+#include "interrupts.h" // For IRQ14
+#include "pci.h"        // For the bus master controller
+#include "utils.h"      // For port I/O
+#include "string.h"     // For string operations
+#include <stddef.h>
+
+// Physical Region Descriptor - one contiguous piece of a DMA buffer.
+// Memory is identity mapped, so buffer pointers are physical addresses.
+typedef struct
+{
+    uint32_t address;
+    uint16_t byte_count; // 0 means 64 KiB
+    uint16_t flags;
+} __attribute__((packed)) ata_prd_t;
+
+#define ATA_PRD_LAST 0x8000
+
+// Transfer states
+#define ATA_STATE_IDLE 0
+#define ATA_STATE_PIO_READ 1
+#define ATA_STATE_PIO_WRITE 2
+#define ATA_STATE_DMA 3
+#define ATA_STATE_FLUSH 4
+
+// Progress of the request being executed
+typedef struct
+{
+    blockdev_request_t *req;
+    uint8_t *buffer;       // Next byte to transfer
+    uint32_t lba;          // Next sector
+    uint32_t remaining;    // Sectors left in the request
+    uint32_t command_left; // Sectors left in the current command
+    int state;
+} ata_transfer_t;
+
+static blockdev_t ata_dev;
+static bool ata_present = false;
+static bool ata_lba48 = false;
+static uint32_t ata_multiple = 1; // Sectors moved per PIO interrupt
+static uint16_t ata_bm_base = 0;  // Bus master registers, 0 without DMA
+static ata_transfer_t transfer;
+
+// Page aligned so the table never crosses a 64 KiB boundary
+static ata_prd_t ata_prdt[ATA_PRD_ENTRIES] __attribute__((aligned(4096)));
+
+// Wait for BSY to clear; returns the final status or 0xFF on timeout
+static uint8_t ata_wait_ready(void)
+{
+    for (int i = 0; i < 1000000; i++)
+    {
+        uint8_t status = inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+        if (!(status & ATA_SR_BSY))
+        {
+            return status;
+        }
+    }
+    return 0xFF;
+}
+
+// Wait until the drive is ready to transfer a block of data
+static bool ata_wait_drq(void)
+{
+    uint8_t status = ata_wait_ready();
+    if (status == 0xFF || (status & (ATA_SR_ERR | ATA_SR_DF)))
+    {
+        return false;
+    }
+    return (status & ATA_SR_DRQ) != 0;
+}
+
+// Give the drive 400ns to settle after selecting it
+static void ata_delay_400ns(void)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        inb(ATA_PRIMARY_CTRL);
+    }
+}
+
+// Load the task file and issue a command for `count` sectors at `lba`
+static void ata_issue(uint32_t lba, uint32_t count, uint8_t command)
+{
+    if (ata_lba48)
+    {
+        outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0x40);
+        ata_delay_400ns();
+
+        // High bytes first, then low bytes, through the same registers
+        outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, (count >> 8) & 0xFF);
+        outb(ATA_PRIMARY_IO + ATA_REG_LBA0, (lba >> 24) & 0xFF);
+        outb(ATA_PRIMARY_IO + ATA_REG_LBA1, 0);
+        outb(ATA_PRIMARY_IO + ATA_REG_LBA2, 0);
+        outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, count & 0xFF);
+    }
+    else
+    {
+        outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
+        ata_delay_400ns();
+        outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, count & 0xFF); // 0 means 256
+    }
+
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA0, lba & 0xFF);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA1, (lba >> 8) & 0xFF);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA2, (lba >> 16) & 0xFF);
+    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, command);
+}
+
+// Describe a buffer in the PRD table, splitting at 64 KiB boundaries
+static bool ata_build_prdt(uint8_t *buffer, uint32_t bytes)
+{
+    uint32_t address = (uint32_t)(uintptr_t)buffer;
+    int n = 0;
+
+    while (bytes > 0)
+    {
+        if (n == ATA_PRD_ENTRIES)
+        {
+            return false;
+        }
+
+        uint32_t boundary = 0x10000 - (address & 0xFFFF);
+        uint32_t length = bytes < boundary ? bytes : boundary;
+
+        ata_prdt[n].address = address;
+        ata_prdt[n].byte_count = length & 0xFFFF;
+        ata_prdt[n].flags = 0;
+        address += length;
+        bytes -= length;
+        n++;
+    }
+
+    ata_prdt[n - 1].flags = ATA_PRD_LAST;
+    return true;
+}
+
+// Move one PIO data block between the drive and the request buffer
+static void ata_pio_block(bool write)
+{
+    uint32_t sectors = transfer.command_left < ata_multiple ? transfer.command_left : ata_multiple;
+
+    if (write)
+    {
+        outsw(ATA_PRIMARY_IO + ATA_REG_DATA, transfer.buffer, sectors * 256);
+    }
+    else
+    {
+        insw(ATA_PRIMARY_IO + ATA_REG_DATA, transfer.buffer, sectors * 256);
+    }
+
+    transfer.buffer += sectors * BLOCKDEV_SECTOR_SIZE;
+    transfer.lba += sectors;
+    transfer.remaining -= sectors;
+    transfer.command_left -= sectors;
+}
+
+// Finish the active request
+static void ata_finish(bool ok)
+{
+    blockdev_request_t *req = transfer.req;
+    transfer.state = ATA_STATE_IDLE;
+    transfer.req = NULL;
+    blockdev_complete(&ata_dev, req, ok);
+}
+
+// Issue the next command of the active request
+static void ata_start_command(void)
+{
+    uint32_t max = ata_lba48 ? ATA_MAX_SECTORS_LBA48 : ATA_MAX_SECTORS_LBA28;
+    uint32_t count = transfer.remaining < max ? transfer.remaining : max;
+    bool write = transfer.req->write;
+
+    transfer.command_left = count;
+
+    // DMA needs a word aligned buffer
+    if (ata_bm_base != 0 && ((uintptr_t)transfer.buffer & 1) == 0 &&
+        ata_build_prdt(transfer.buffer, count * BLOCKDEV_SECTOR_SIZE))
+    {
+        uint8_t direction = write ? 0 : ATA_BM_CMD_READ;
+
+        outl(ata_bm_base + ATA_BM_PRDT, (uint32_t)(uintptr_t)ata_prdt);
+        outb(ata_bm_base + ATA_BM_COMMAND, direction);
+        outb(ata_bm_base + ATA_BM_STATUS, ATA_BM_SR_ERR | ATA_BM_SR_IRQ); // Write 1 to clear
+
+        transfer.state = ATA_STATE_DMA;
+        if (write)
+        {
+            ata_issue(transfer.lba, count, ata_lba48 ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA);
+        }
+        else
+        {
+            ata_issue(transfer.lba, count, ata_lba48 ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA);
+        }
+        outb(ata_bm_base + ATA_BM_COMMAND, direction | ATA_BM_CMD_START);
+        return;
+    }
+
+    uint8_t command;
+    if (ata_multiple > 1)
+    {
+        command = write ? (ata_lba48 ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_WRITE_MULTIPLE)
+                        : (ata_lba48 ? ATA_CMD_READ_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE);
+    }
+    else
+    {
+        command = write ? (ata_lba48 ? ATA_CMD_WRITE_PIO_EXT : ATA_CMD_WRITE_PIO)
+                        : (ata_lba48 ? ATA_CMD_READ_PIO_EXT : ATA_CMD_READ_PIO);
+    }
+
+    ata_issue(transfer.lba, count, command);
+
+    if (!write)
+    {
+        transfer.state = ATA_STATE_PIO_READ;
+        return;
+    }
+
+    // The first block of a write is sent without waiting for an interrupt
+    transfer.state = ATA_STATE_PIO_WRITE;
+    if (!ata_wait_drq())
+    {
+        ata_finish(false);
+        return;
+    }
+    ata_pio_block(true);
+}
+
+// Start a queued request (blockdev start callback)
+static void ata_start(blockdev_t *dev, blockdev_request_t *req)
+{
+    (void)dev;
+    transfer.req = req;
+    transfer.buffer = (uint8_t *)req->buffer;
+    transfer.lba = req->lba;
+    transfer.remaining = req->count;
+    ata_start_command();
+}
+
+// IRQ14 handler - advance the active transfer
+static void ata_irq(int irq)
+{
+    (void)irq;
+    uint8_t bm_status = 0;
+
+    if (transfer.state == ATA_STATE_DMA)
+    {
+        bm_status = inb(ata_bm_base + ATA_BM_STATUS);
+        if (!(bm_status & ATA_BM_SR_IRQ))
+        {
+            return; // Not raised by the DMA engine
+        }
+        outb(ata_bm_base + ATA_BM_COMMAND, 0);
+        outb(ata_bm_base + ATA_BM_STATUS, ATA_BM_SR_ERR | ATA_BM_SR_IRQ);
+    }
+
+    // Reading the status register acknowledges the interrupt
+    uint8_t status = inb(ATA_PRIMARY_IO + ATA_REG_STATUS);
+    bool failed = (status & (ATA_SR_ERR | ATA_SR_DF)) != 0;
+
+    switch (transfer.state)
+    {
+    case ATA_STATE_IDLE:
+        return;
+
+    case ATA_STATE_DMA:
+        if (failed || (bm_status & ATA_BM_SR_ERR))
+        {
+            ata_finish(false);
+            return;
+        }
+        transfer.buffer += transfer.command_left * BLOCKDEV_SECTOR_SIZE;
+        transfer.lba += transfer.command_left;
+        transfer.remaining -= transfer.command_left;
+        transfer.command_left = 0;
+        break;
+
+    case ATA_STATE_PIO_READ:
+        if (failed || !(status & ATA_SR_DRQ))
+        {
+            ata_finish(false);
+            return;
+        }
+        ata_pio_block(false);
+        if (transfer.command_left > 0)
+        {
+            return; // More blocks in this command
+        }
+        break;
+
+    case ATA_STATE_PIO_WRITE:
+        if (failed)
+        {
+            ata_finish(false);
+            return;
+        }
+        if (transfer.command_left > 0)
+        {
+            ata_pio_block(true);
+            return;
+        }
+        break;
+
+    case ATA_STATE_FLUSH:
+        ata_finish(!failed);
+        return;
+    }
+
+    // The current command is complete
+    if (transfer.remaining > 0)
+    {
+        ata_start_command();
+    }
+    else if (transfer.req->write)
+    {
+        // Make sure the data reaches the platter before reporting success
+        transfer.state = ATA_STATE_FLUSH;
+        outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, ata_lba48 ? 0x40 : 0xE0);
+        outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ata_lba48 ? ATA_CMD_CACHE_FLUSH_EXT : ATA_CMD_CACHE_FLUSH);
+    }
+    else
+    {
+        ata_finish(true);
+    }
+}
+
+// Take the IDE controller's bus master registers (PCI driver probe)
+static bool ata_probe_controller(pci_device_t *dev)
+{
+    // Bit 7 of the programming interface advertises bus mastering
+    if (ata_bm_base != 0 || !(dev->prog_if & 0x80) || !dev->bars[4].io)
+    {
+        return false;
+    }
+
+    pci_enable_device(dev);
+    ata_bm_base = dev->bars[4].base;
+    return true;
+}
+
+static const pci_driver_t ata_driver = {
+    "ata", PCI_ANY_ID, PCI_ANY_ID, PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, ata_probe_controller,
+};
+
+// Find the IDE controller's bus master registers and enable DMA
+static void ata_init_dma(void)
+{
+    pci_register_driver(&ata_driver);
+}
+
+// Probe the primary master drive and register it as "hda"
+blockdev_t *ata_init(void)
+{
+    if (ata_present)
+    {
+        return &ata_dev;
+    }
+
+    // A floating bus reads back as 0xFF
+    if (inb(ATA_PRIMARY_IO + ATA_REG_STATUS) == 0xFF)
+    {
+        return NULL;
+    }
+
+    // Probe with interrupts off at the drive
+    outb(ATA_PRIMARY_CTRL, 0x02);
+
+    outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xA0);
+    ata_delay_400ns();
+    outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA0, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA1, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_LBA2, 0);
+    outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+
+    if (inb(ATA_PRIMARY_IO + ATA_REG_STATUS) == 0)
+    {
+        return NULL; // No drive
+    }
+
+    // ATAPI and SATA devices report a signature here instead of data
+    if (ata_wait_ready() == 0xFF ||
+        inb(ATA_PRIMARY_IO + ATA_REG_LBA1) != 0 || inb(ATA_PRIMARY_IO + ATA_REG_LBA2) != 0)
+    {
+        return NULL;
+    }
+
+    if (!ata_wait_drq())
+    {
+        return NULL;
+    }
+
+    uint16_t identify[256];
+    insw(ATA_PRIMARY_IO + ATA_REG_DATA, identify, 256);
+
+    // Word 83 bit 10: 48-bit addressing. Words 100-103 then hold the
+    // sector count; otherwise words 60-61 do.
+    uint32_t sectors;
+    ata_lba48 = (identify[83] & (1 << 10)) != 0;
+    if (ata_lba48)
+    {
+        sectors = identify[100] | ((uint32_t)identify[101] << 16);
+        if (identify[102] != 0 || identify[103] != 0)
+        {
+            sectors = 0xFFFFFFFF; // Cap at what a 32-bit LBA can reach
+        }
+    }
+    else
+    {
+        sectors = identify[60] | ((uint32_t)identify[61] << 16);
+    }
+    if (sectors == 0)
+    {
+        return NULL;
+    }
+
+    // Word 47: largest block for READ/WRITE MULTIPLE
+    uint32_t multiple = identify[47] & 0xFF;
+    if (multiple > 16)
+    {
+        multiple = 16;
+    }
+    if (multiple > 1)
+    {
+        outb(ATA_PRIMARY_IO + ATA_REG_DRIVE, 0xA0);
+        outb(ATA_PRIMARY_IO + ATA_REG_SECCOUNT, multiple);
+        outb(ATA_PRIMARY_IO + ATA_REG_COMMAND, ATA_CMD_SET_MULTIPLE);
+        uint8_t status = ata_wait_ready();
+        ata_multiple = (status == 0xFF || (status & ATA_SR_ERR)) ? 1 : multiple;
+    }
+
+    // Word 49 bit 8: DMA supported
+    if (identify[49] & (1 << 8))
+    {
+        ata_init_dma();
+    }
+
+    strcpy(ata_dev.name, "hda");
+    ata_dev.sector_count = sectors;
+    ata_dev.read = NULL;
+    ata_dev.write = NULL;
+    ata_dev.start = ata_start;
+    ata_dev.kick = NULL;
+    ata_dev.queue_depth = 1; // One command at a time on the channel
+    ata_dev.driver_data = NULL;
+    blockdev_register(&ata_dev);
+
+    // Transfers from here on are driven by IRQ14
+    transfer.state = ATA_STATE_IDLE;
+    outb(ATA_PRIMARY_CTRL, 0x00);
+    irq_register(IRQ_PRIMARY_ATA, ata_irq);
+
+    ata_present = true;
+    return &ata_dev;
+}
+
+// Whether transfers use bus-master DMA
+bool ata_dma_enabled(void)
+{
+    return ata_bm_base != 0;
+}
@@ -0,0 +1,70 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include "blockdev.h"
+
+// Primary ATA bus I/O ports
+#define ATA_PRIMARY_IO 0x1F0
+#define ATA_PRIMARY_CTRL 0x3F6
+
+// Task file register offsets from the I/O base
+#define ATA_REG_DATA 0
+#define ATA_REG_ERROR 1
+#define ATA_REG_SECCOUNT 2
+#define ATA_REG_LBA0 3
+#define ATA_REG_LBA1 4
+#define ATA_REG_LBA2 5
+#define ATA_REG_DRIVE 6
+#define ATA_REG_STATUS 7
+#define ATA_REG_COMMAND 7
+
+// Status register bits
+#define ATA_SR_ERR 0x01
+#define ATA_SR_DRQ 0x08
+#define ATA_SR_DF 0x20
+#define ATA_SR_DRDY 0x40
+#define ATA_SR_BSY 0x80
+
+// Commands
+#define ATA_CMD_READ_PIO 0x20
+#define ATA_CMD_READ_PIO_EXT 0x24
+#define ATA_CMD_READ_DMA_EXT 0x25
+#define ATA_CMD_READ_MULTIPLE_EXT 0x29
+#define ATA_CMD_WRITE_PIO 0x30
+#define ATA_CMD_WRITE_PIO_EXT 0x34
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_WRITE_MULTIPLE_EXT 0x39
+#define ATA_CMD_READ_MULTIPLE 0xC4
+#define ATA_CMD_WRITE_MULTIPLE 0xC5
+#define ATA_CMD_SET_MULTIPLE 0xC6
+#define ATA_CMD_READ_DMA 0xC8
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_CACHE_FLUSH 0xE7
+#define ATA_CMD_CACHE_FLUSH_EXT 0xEA
+#define ATA_CMD_IDENTIFY 0xEC
+
+// Bus master IDE registers, offsets from BAR4
+#define ATA_BM_COMMAND 0
+#define ATA_BM_STATUS 2
+#define ATA_BM_PRDT 4
+
+// Bus master command and status bits
+#define ATA_BM_CMD_START 0x01
+#define ATA_BM_CMD_READ 0x08 // Device to memory
+#define ATA_BM_SR_ACTIVE 0x01
+#define ATA_BM_SR_ERR 0x02
+#define ATA_BM_SR_IRQ 0x04
+
+// Sectors per command
+#define ATA_MAX_SECTORS_LBA28 256
+#define ATA_MAX_SECTORS_LBA48 1024 // Kept well below 65536 to bound the PRD table
+#define ATA_PRD_ENTRIES 16
+
+// Probe the primary master drive and register it as "hda".
+// Returns NULL if no ATA disk is present.
+blockdev_t *ata_init(void);
+
+// Whether transfers use bus-master DMA
+bool ata_dma_enabled(void);
+
+#endif // ATA_H
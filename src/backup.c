@@ -0,0 +1,560 @@
+#include "backup.h"
+#include "fs.h"
+#include "crc32c.h" // Chunk hashes
+#include "string.h" // For string operations
+
+#define BACKUP_PACK BACKUP_PREFIX "pack"
+#define BACKUP_INDEX BACKUP_PREFIX "index"
+
+#define BACKUP_INDEX_MAGIC 0x58494B42    // "BKIX"
+#define BACKUP_MANIFEST_MAGIC 0x464D4B42 // "BKMF"
+
+#define BACKUP_HASH_SIZE (BACKUP_MAX_CHUNKS * 2)
+#define BACKUP_CHUNK_MASK ((1u << BACKUP_CHUNK_BITS) - 1)
+
+// Chunk numbers moved between a manifest and memory at once
+#define BACKUP_ID_BATCH 128
+
+// Chunk table entry. A chunk is found by two independent hashes and its
+// length, and only taken as a duplicate once its content compares equal.
+typedef struct
+{
+    uint32_t crc; // CRC32C of the content
+    uint32_t fnv; // FNV-1a of the content
+    uint32_t offset;
+    uint32_t length;
+} backup_chunk_t;
+
+// Chunk table file header, followed by `count` entries
+typedef struct
+{
+    uint32_t magic;
+    uint32_t count;
+    uint32_t latest; // Newest complete snapshot
+    uint32_t reserved;
+} backup_index_header_t;
+
+// Manifest header, followed by `files` records
+typedef struct
+{
+    uint32_t magic;
+    uint32_t snapshot;
+    uint32_t files;
+    uint32_t reserved;
+} backup_manifest_header_t;
+
+// Manifest record, followed by `chunk_count` chunk numbers
+typedef struct
+{
+    char name[FS_MAX_FILENAME];
+    char owner[32];
+    uint32_t size;
+    uint32_t chunk_count;
+    uint16_t modified_date;
+    uint8_t type;
+    uint8_t permissions;
+} backup_record_t;
+
+// Manifest being written
+typedef struct
+{
+    int manifest_fd;
+    int pack_fd;
+    uint32_t batch; // Chunk numbers waiting in id_buffer
+    uint32_t count; // Chunks in the current file
+    backup_result_t *result;
+} backup_writer_t;
+
+// Chunk table, loaded from the index for each operation
+static backup_chunk_t chunks[BACKUP_MAX_CHUNKS];
+static int16_t chunk_slots[BACKUP_HASH_SIZE]; // Indexed by CRC, -1 if empty
+static uint32_t chunk_count = 0;
+static uint32_t latest_snapshot = 0;
+static uint32_t pack_size = 0;
+
+// Rolling hash table for finding chunk boundaries
+static uint32_t gear[256];
+static bool gear_ready = false;
+
+static uint8_t chunk_buffer[BACKUP_MAX_CHUNK];
+static uint8_t compare_buffer[BACKUP_MAX_CHUNK];
+static uint8_t read_buffer[4096];
+static uint32_t id_buffer[BACKUP_ID_BATCH];
+
+// Fill the rolling hash table with fixed pseudo-random values, so chunk
+// boundaries are the same on every boot
+static void backup_gear_init(void)
+{
+    if (gear_ready)
+    {
+        return;
+    }
+
+    uint32_t x = 0x9E3779B9;
+    for (int i = 0; i < 256; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        gear[i] = x;
+    }
+    gear_ready = true;
+}
+
+// FNV-1a hash of a buffer
+static uint32_t backup_fnv(const uint8_t *data, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+    while (len-- > 0)
+    {
+        hash ^= *data++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Build the name of a snapshot's manifest
+static void backup_manifest_name(int snapshot, char *name)
+{
+    strcpy(name, BACKUP_PREFIX);
+    itoa(snapshot, name + strlen(name), 10);
+}
+
+// Open a store file, hiding it from listings when it is created
+static int backup_open(const char *name, int flags)
+{
+    bool created = !fs_file_exists(name);
+    int fd = fs_open(name, flags);
+    if (fd >= 0 && created)
+    {
+        fs_set_type(name, FS_TYPE_HIDDEN);
+    }
+    return fd;
+}
+
+// Add a chunk table entry to the hash
+static void backup_hash_insert(uint32_t id)
+{
+    uint32_t slot = chunks[id].crc & (BACKUP_HASH_SIZE - 1);
+    while (chunk_slots[slot] >= 0)
+    {
+        slot = (slot + 1) & (BACKUP_HASH_SIZE - 1);
+    }
+    chunk_slots[slot] = id;
+}
+
+// Load the chunk table. A missing index means an empty store.
+static bool backup_load_index(void)
+{
+    backup_index_header_t header;
+
+    chunk_count = 0;
+    latest_snapshot = 0;
+    for (int i = 0; i < BACKUP_HASH_SIZE; i++)
+    {
+        chunk_slots[i] = -1;
+    }
+
+    int fd = fs_open(BACKUP_INDEX, FS_O_READ);
+    if (fd < 0)
+    {
+        return true;
+    }
+
+    bool ok = fs_read(fd, &header, sizeof(header)) == sizeof(header) &&
+              header.magic == BACKUP_INDEX_MAGIC && header.count <= BACKUP_MAX_CHUNKS;
+    if (ok && header.count > 0)
+    {
+        int bytes = header.count * sizeof(backup_chunk_t);
+        ok = fs_read(fd, chunks, bytes) == bytes;
+    }
+    fs_close(fd);
+
+    if (!ok)
+    {
+        return false;
+    }
+
+    chunk_count = header.count;
+    latest_snapshot = header.latest;
+    for (uint32_t i = 0; i < chunk_count; i++)
+    {
+        backup_hash_insert(i);
+    }
+    return true;
+}
+
+// Write the chunk table
+static bool backup_save_index(void)
+{
+    backup_index_header_t header = { BACKUP_INDEX_MAGIC, chunk_count, latest_snapshot, 0 };
+
+    int fd = backup_open(BACKUP_INDEX, FS_O_WRITE | FS_O_CREATE | FS_O_TRUNC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    int bytes = chunk_count * sizeof(backup_chunk_t);
+    bool ok = fs_write(fd, &header, sizeof(header)) == sizeof(header) &&
+              fs_write(fd, chunks, bytes) == bytes;
+    fs_close(fd);
+    return ok;
+}
+
+// Compare a stored chunk with the one in chunk_buffer, so two chunks whose
+// hashes collide are never merged
+static bool backup_same_chunk(backup_writer_t *w, const backup_chunk_t *chunk)
+{
+    return fs_pread(w->pack_fd, compare_buffer, chunk->length, chunk->offset) == (int)chunk->length &&
+           memcmp(compare_buffer, chunk_buffer, chunk->length) == 0;
+}
+
+// Find the chunk in chunk_buffer in the store, adding it if it is new.
+// Returns its number, or -1.
+static int backup_store_chunk(backup_writer_t *w, uint32_t len)
+{
+    uint32_t crc = crc32c(0, chunk_buffer, len);
+    uint32_t fnv = backup_fnv(chunk_buffer, len);
+
+    uint32_t slot = crc & (BACKUP_HASH_SIZE - 1);
+    while (chunk_slots[slot] >= 0)
+    {
+        backup_chunk_t *chunk = &chunks[chunk_slots[slot]];
+        if (chunk->crc == crc && chunk->fnv == fnv && chunk->length == len && backup_same_chunk(w, chunk))
+        {
+            return chunk_slots[slot];
+        }
+        slot = (slot + 1) & (BACKUP_HASH_SIZE - 1);
+    }
+
+    if (chunk_count == BACKUP_MAX_CHUNKS)
+    {
+        w->result->store_full = true;
+        return -1;
+    }
+    if (fs_write(w->pack_fd, chunk_buffer, len) != (int)len)
+    {
+        return -1;
+    }
+
+    backup_chunk_t *chunk = &chunks[chunk_count];
+    chunk->crc = crc;
+    chunk->fnv = fnv;
+    chunk->offset = pack_size;
+    chunk->length = len;
+    chunk_slots[slot] = chunk_count;
+    pack_size += len;
+
+    w->result->new_chunks++;
+    w->result->new_bytes += len;
+    return chunk_count++;
+}
+
+// Write the buffered chunk numbers to the manifest
+static bool backup_flush_ids(backup_writer_t *w)
+{
+    int bytes = w->batch * sizeof(uint32_t);
+    w->batch = 0;
+    return fs_write(w->manifest_fd, id_buffer, bytes) == bytes;
+}
+
+// Store the chunk in chunk_buffer and reference it from the manifest
+static bool backup_emit(backup_writer_t *w, uint32_t len)
+{
+    int id = backup_store_chunk(w, len);
+    if (id < 0)
+    {
+        return false;
+    }
+
+    id_buffer[w->batch++] = id;
+    w->count++;
+    w->result->chunks++;
+    return w->batch < BACKUP_ID_BATCH || backup_flush_ids(w);
+}
+
+// Add a file to the manifest, splitting its content into chunks
+static bool backup_file(backup_writer_t *w, const file_t *file)
+{
+    backup_record_t record;
+    memset(&record, 0, sizeof(record));
+    strcpy(record.name, file->filename);
+    strcpy(record.owner, fs_get_file_owner(file));
+    record.size = file->size;
+    record.modified_date = file->modified_date;
+    record.type = file->type;
+    record.permissions = file->permissions;
+
+    int record_offset = fs_lseek(w->manifest_fd, 0, FS_SEEK_CUR);
+    if (fs_write(w->manifest_fd, &record, sizeof(record)) != sizeof(record))
+    {
+        return false;
+    }
+    w->result->files++;
+    w->result->bytes += file->size;
+    if (file->type == FS_TYPE_DIRECTORY || file->size == 0)
+    {
+        return true;
+    }
+
+    int fd = fs_open(file->filename, FS_O_READ);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    // Cut wherever the rolling hash of the last 32 bytes has its low bits
+    // clear, so boundaries move with the content around an edit
+    bool ok = true;
+    uint32_t len = 0;
+    uint32_t hash = 0;
+    int got;
+    w->batch = 0;
+    w->count = 0;
+    while (ok && (got = fs_read(fd, read_buffer, sizeof(read_buffer))) > 0)
+    {
+        for (int i = 0; i < got && ok; i++)
+        {
+            uint8_t byte = read_buffer[i];
+            chunk_buffer[len++] = byte;
+            hash = (hash << 1) + gear[byte];
+            if (len == BACKUP_MAX_CHUNK || (len >= BACKUP_MIN_CHUNK && (hash & BACKUP_CHUNK_MASK) == 0))
+            {
+                ok = backup_emit(w, len);
+                len = 0;
+            }
+        }
+    }
+    fs_close(fd);
+
+    if (ok && len > 0)
+    {
+        ok = backup_emit(w, len);
+    }
+    ok = ok && backup_flush_ids(w);
+
+    // Now that the chunk count is known, complete the record
+    record.chunk_count = w->count;
+    return ok && fs_pwrite(w->manifest_fd, &record, sizeof(record), record_offset) == sizeof(record);
+}
+
+// Take a snapshot of every file
+int backup_create(backup_result_t *result)
+{
+    memset(result, 0, sizeof(*result));
+    if (fs_get_device() == NULL || !backup_load_index())
+    {
+        return -1;
+    }
+    backup_gear_init();
+
+    int snapshot = latest_snapshot + 1;
+    char name[FS_MAX_FILENAME];
+    backup_manifest_name(snapshot, name);
+
+    backup_writer_t w;
+    w.result = result;
+    w.manifest_fd = backup_open(name, FS_O_RDWR | FS_O_CREATE | FS_O_TRUNC);
+    w.pack_fd = backup_open(BACKUP_PACK, FS_O_RDWR | FS_O_CREATE | FS_O_APPEND);
+    pack_size = fs_get_file_size(BACKUP_PACK);
+
+    backup_manifest_header_t header = { BACKUP_MANIFEST_MAGIC, snapshot, 0, 0 };
+    bool ok = w.manifest_fd >= 0 && w.pack_fd >= 0 &&
+              fs_write(w.manifest_fd, &header, sizeof(header)) == sizeof(header);
+
+    for (int i = 0; i < FS_MAX_FILES && ok; i++)
+    {
+        file_t *file = fs_get_file_by_index(i);
+        if (file != NULL && strncmp(file->filename, BACKUP_PREFIX, strlen(BACKUP_PREFIX)) != 0)
+        {
+            ok = backup_file(&w, file);
+        }
+    }
+
+    header.files = result->files;
+    ok = ok && fs_pwrite(w.manifest_fd, &header, sizeof(header), 0) == sizeof(header);
+    fs_close(w.manifest_fd);
+    fs_close(w.pack_fd);
+
+    // The snapshot only counts once the index names it. Chunks appended to
+    // the pack by a failed run stay unreferenced.
+    if (ok)
+    {
+        latest_snapshot = snapshot;
+        ok = backup_save_index();
+    }
+    if (!ok)
+    {
+        fs_delete_file(name);
+        return -1;
+    }
+
+    fs_sync();
+    result->snapshot = snapshot;
+    return snapshot;
+}
+
+// Get the newest snapshot number
+int backup_latest(void)
+{
+    if (fs_get_device() == NULL || !backup_load_index())
+    {
+        return 0;
+    }
+    return latest_snapshot;
+}
+
+// Open a snapshot's manifest and read its header
+static int backup_open_manifest(int snapshot, backup_manifest_header_t *header)
+{
+    char name[FS_MAX_FILENAME];
+    backup_manifest_name(snapshot, name);
+
+    int fd = fs_open(name, FS_O_READ);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (fs_read(fd, header, sizeof(*header)) != sizeof(*header) ||
+        header->magic != BACKUP_MANIFEST_MAGIC || header->snapshot != (uint32_t)snapshot)
+    {
+        fs_close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Read a chunk into chunk_buffer and check it against its hash
+static bool backup_read_chunk(int pack_fd, uint32_t id)
+{
+    if (id >= chunk_count)
+    {
+        return false;
+    }
+
+    backup_chunk_t *chunk = &chunks[id];
+    return fs_pread(pack_fd, chunk_buffer, chunk->length, chunk->offset) == (int)chunk->length &&
+           crc32c(0, chunk_buffer, chunk->length) == chunk->crc;
+}
+
+// Recreate a file from its manifest record, whose chunk numbers follow at
+// the manifest's offset
+static bool backup_restore_record(int manifest_fd, int pack_fd, const backup_record_t *record,
+                                  const char *dest)
+{
+    if (record->type == FS_TYPE_DIRECTORY)
+    {
+        return fs_file_exists(dest) || fs_create_directory(dest);
+    }
+
+    // Writable while the content is replaced
+    if (!fs_file_exists(dest) && !fs_create_file(dest, record->owner))
+    {
+        return false;
+    }
+    fs_set_permission(dest, FS_PERM_READ | FS_PERM_WRITE);
+
+    int fd = fs_open(dest, FS_O_WRITE | FS_O_TRUNC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool ok = true;
+    uint32_t left = record->chunk_count;
+    while (ok && left > 0)
+    {
+        uint32_t batch = left < BACKUP_ID_BATCH ? left : BACKUP_ID_BATCH;
+        int bytes = batch * sizeof(uint32_t);
+        ok = fs_read(manifest_fd, id_buffer, bytes) == bytes;
+        for (uint32_t i = 0; i < batch && ok; i++)
+        {
+            ok = backup_read_chunk(pack_fd, id_buffer[i]) &&
+                 fs_write(fd, chunk_buffer, chunks[id_buffer[i]].length) == (int)chunks[id_buffer[i]].length;
+        }
+        left -= batch;
+    }
+    fs_close(fd);
+
+    fs_set_type(dest, record->type);
+    fs_set_permission(dest, record->permissions);
+    return ok && fs_get_file_size(dest) == (int)record->size;
+}
+
+// Restore every file in a snapshot
+bool backup_restore(int snapshot, backup_result_t *result)
+{
+    backup_manifest_header_t header;
+
+    memset(result, 0, sizeof(*result));
+    if (fs_get_device() == NULL || !backup_load_index())
+    {
+        return false;
+    }
+
+    int manifest_fd = backup_open_manifest(snapshot, &header);
+    int pack_fd = fs_open(BACKUP_PACK, FS_O_READ);
+    bool ok = manifest_fd >= 0 && pack_fd >= 0;
+
+    for (uint32_t i = 0; ok && i < header.files; i++)
+    {
+        backup_record_t record;
+        ok = fs_read(manifest_fd, &record, sizeof(record)) == sizeof(record);
+        if (ok)
+        {
+            int next = fs_lseek(manifest_fd, 0, FS_SEEK_CUR) + record.chunk_count * sizeof(uint32_t);
+            record.name[FS_MAX_FILENAME - 1] = '\0';
+            record.owner[31] = '\0';
+            ok = backup_restore_record(manifest_fd, pack_fd, &record, record.name);
+            fs_lseek(manifest_fd, next, FS_SEEK_SET);
+
+            result->files++;
+            result->bytes += record.size;
+            result->chunks += record.chunk_count;
+        }
+    }
+
+    fs_close(manifest_fd);
+    fs_close(pack_fd);
+    result->snapshot = snapshot;
+    return ok;
+}
+
+// Restore one file of a snapshot as `dest`
+bool backup_restore_file(int snapshot, const char *name, const char *dest)
+{
+    backup_manifest_header_t header;
+
+    if (fs_get_device() == NULL || !backup_load_index())
+    {
+        return false;
+    }
+
+    int manifest_fd = backup_open_manifest(snapshot, &header);
+    int pack_fd = fs_open(BACKUP_PACK, FS_O_READ);
+    bool found = false;
+    bool ok = manifest_fd >= 0 && pack_fd >= 0;
+
+    // Skip other files' chunk lists without reading them
+    for (uint32_t i = 0; ok && !found && i < header.files; i++)
+    {
+        backup_record_t record;
+        ok = fs_read(manifest_fd, &record, sizeof(record)) == sizeof(record);
+        record.name[FS_MAX_FILENAME - 1] = '\0';
+        record.owner[31] = '\0';
+        if (ok && strcmp(record.name, name) == 0)
+        {
+            found = true;
+            ok = backup_restore_record(manifest_fd, pack_fd, &record, dest);
+        }
+        else if (ok)
+        {
+            ok = fs_lseek(manifest_fd, record.chunk_count * sizeof(uint32_t), FS_SEEK_CUR) >= 0;
+        }
+    }
+
+    fs_close(manifest_fd);
+    fs_close(pack_fd);
+    return found && ok;
+}
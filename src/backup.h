@@ -0,0 +1,52 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Snapshots are kept in the file system itself, in files whose names
+// start with BACKUP_PREFIX (never backed up themselves):
+//   .bk.pack    chunk store: every distinct chunk, appended once
+//   .bk.index   chunk table: hash, length and pack offset of each chunk
+//   .bk.<n>     manifest of snapshot n: each file's attributes and the
+//               chunks its content is made of
+// Content is split at content-defined boundaries, so an edit only changes
+// the chunks around it, and a chunk already in the store is referenced
+// rather than written again.
+#define BACKUP_PREFIX ".bk."
+
+// Chunk sizes: boundaries fall where a rolling hash has BACKUP_CHUNK_BITS
+// zero bits, within the minimum and maximum
+#define BACKUP_MIN_CHUNK 512
+#define BACKUP_MAX_CHUNK 8192
+#define BACKUP_CHUNK_BITS 11 // ~2 KiB average
+
+// Distinct chunks the store can hold. Chunks are never evicted: once the
+// store is full, a snapshot that needs a new chunk fails.
+#define BACKUP_MAX_CHUNKS 4096
+
+// Summary of a backup or restore
+typedef struct
+{
+    int snapshot;
+    uint32_t files;
+    uint32_t bytes;      // File content covered
+    uint32_t chunks;     // Chunk references
+    uint32_t new_chunks; // Chunks added to the store
+    uint32_t new_bytes;
+    bool store_full; // Failed because the store holds BACKUP_MAX_CHUNKS
+} backup_result_t;
+
+// Take a snapshot of every file. Returns the snapshot number, or -1.
+int backup_create(backup_result_t *result);
+
+// Get the newest snapshot number, or 0 if there is none
+int backup_latest(void);
+
+// Restore every file in a snapshot. Files created since are left alone.
+bool backup_restore(int snapshot, backup_result_t *result);
+
+// Restore one file of a snapshot as `dest`, streaming it chunk by chunk
+bool backup_restore_file(int snapshot, const char *name, const char *dest);
+
+#endif // BACKUP_H
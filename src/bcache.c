@@ -0,0 +1,1000 @@
+#include "bcache.h"
+#include "string.h" // For memcpy
+#include "timer.h"  // For dirty block ages
+#include <stddef.h>
+
+// Remembered block of the A1out ghost list
+typedef struct
+{
+    blockdev_t *dev; // NULL if the entry is unused
+    uint32_t block;
+    int16_t hash_next;
+} bcache_ghost_t;
+
+// Doubly linked queue of buffers; head is the newest entry
+typedef struct
+{
+    int16_t head;
+    int16_t tail;
+    uint32_t count;
+} bcache_queue_t;
+
+static bcache_buf_t buffers[BCACHE_BUFFERS];
+static uint8_t buffer_data[BCACHE_BUFFERS][BLOCKDEV_SECTOR_SIZE];
+static int16_t hash_heads[BCACHE_HASH_SIZE];
+
+static bcache_queue_t queues[3]; // Indexed by BCACHE_QUEUE_*
+
+static bcache_ghost_t ghosts[BCACHE_GHOSTS];
+static int16_t ghost_heads[BCACHE_HASH_SIZE];
+static int ghost_next = 0; // Oldest entry, overwritten next
+
+static bcache_stats_t stats;
+static bool bcache_ready = false;
+
+// Multi-block request staged through a contiguous buffer, since cache
+// buffers are not adjacent in memory. Writeback copies dirty blocks in so
+// the cached copies stay usable while the write runs; readahead copies the
+// result out to the buffers it reserved.
+typedef struct
+{
+    bool busy;
+    blockdev_request_t req;
+    uint32_t count;
+    int16_t index[BCACHE_IO_MAX_BLOCKS];
+    uint32_t generation[BCACHE_IO_MAX_BLOCKS]; // Buffer generation when copied
+    uint8_t data[BCACHE_IO_MAX_BLOCKS * BLOCKDEV_SECTOR_SIZE] __attribute__((aligned(16)));
+} bcache_io_slot_t;
+
+static bcache_io_slot_t wb_slots[BCACHE_WB_SLOTS];
+static bcache_io_slot_t ra_slots[BCACHE_RA_SLOTS];
+static uint32_t dirty_ratio = BCACHE_DIRTY_RATIO;
+static uint32_t dirty_expire_ms = BCACHE_DIRTY_EXPIRE_MS;
+
+static bool bcache_wb_reap(bool wait);
+static void bcache_ra_reap(bool wait);
+static void bcache_ra_wait(int index);
+
+// Set up the buffer table on first use
+static void bcache_init(void)
+{
+    if (bcache_ready)
+    {
+        return;
+    }
+    bcache_ready = true;
+
+    for (int i = 0; i < BCACHE_HASH_SIZE; i++)
+    {
+        hash_heads[i] = -1;
+        ghost_heads[i] = -1;
+    }
+    for (int q = 0; q < 3; q++)
+    {
+        queues[q].head = -1;
+        queues[q].tail = -1;
+        queues[q].count = 0;
+    }
+
+    // Every buffer starts on the free list
+    for (int i = 0; i < BCACHE_BUFFERS; i++)
+    {
+        buffers[i].data = buffer_data[i];
+        buffers[i].dev = NULL;
+        buffers[i].hash_next = -1;
+        buffers[i].queue = BCACHE_QUEUE_FREE;
+        buffers[i].prev = i - 1;
+        buffers[i].next = i + 1 < BCACHE_BUFFERS ? i + 1 : -1;
+    }
+    queues[BCACHE_QUEUE_FREE].head = 0;
+    queues[BCACHE_QUEUE_FREE].tail = BCACHE_BUFFERS - 1;
+    queues[BCACHE_QUEUE_FREE].count = BCACHE_BUFFERS;
+
+    timer_init();
+}
+
+// Hash bucket for a block
+static uint32_t bcache_hash(blockdev_t *dev, uint32_t block)
+{
+    uint32_t key = block ^ ((uint32_t)(uintptr_t)dev >> 4);
+    return (key * 2654435761u) >> (32 - BCACHE_HASH_BITS);
+}
+
+// Take a buffer off its queue
+static void bcache_unlink(int index)
+{
+    bcache_buf_t *buf = &buffers[index];
+    bcache_queue_t *queue = &queues[buf->queue];
+
+    if (buf->prev >= 0)
+    {
+        buffers[buf->prev].next = buf->next;
+    }
+    else
+    {
+        queue->head = buf->next;
+    }
+    if (buf->next >= 0)
+    {
+        buffers[buf->next].prev = buf->prev;
+    }
+    else
+    {
+        queue->tail = buf->prev;
+    }
+    queue->count--;
+}
+
+// Put a buffer at the head of a queue
+static void bcache_push(int index, uint8_t which)
+{
+    bcache_buf_t *buf = &buffers[index];
+    bcache_queue_t *queue = &queues[which];
+
+    buf->queue = which;
+    buf->prev = -1;
+    buf->next = queue->head;
+    if (queue->head >= 0)
+    {
+        buffers[queue->head].prev = index;
+    }
+    else
+    {
+        queue->tail = index;
+    }
+    queue->head = index;
+    queue->count++;
+}
+
+// Find a cached block
+static int bcache_lookup(blockdev_t *dev, uint32_t block)
+{
+    for (int i = hash_heads[bcache_hash(dev, block)]; i >= 0; i = buffers[i].hash_next)
+    {
+        if (buffers[i].dev == dev && buffers[i].block == block)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Remove a buffer from the hash table
+static void bcache_hash_remove(int index)
+{
+    int16_t *link = &hash_heads[bcache_hash(buffers[index].dev, buffers[index].block)];
+    while (*link != index)
+    {
+        link = &buffers[*link].hash_next;
+    }
+    *link = buffers[index].hash_next;
+}
+
+// Unlink a ghost entry from its hash chain
+static void bcache_ghost_remove(int index)
+{
+    int16_t *link = &ghost_heads[bcache_hash(ghosts[index].dev, ghosts[index].block)];
+    while (*link != index)
+    {
+        link = &ghosts[*link].hash_next;
+    }
+    *link = ghosts[index].hash_next;
+    ghosts[index].dev = NULL;
+}
+
+// Remember an evicted A1in block, replacing the oldest ghost
+static void bcache_ghost_add(blockdev_t *dev, uint32_t block)
+{
+    int index = ghost_next;
+    ghost_next = (ghost_next + 1) % BCACHE_GHOSTS;
+
+    if (ghosts[index].dev != NULL)
+    {
+        bcache_ghost_remove(index);
+    }
+
+    uint32_t bucket = bcache_hash(dev, block);
+    ghosts[index].dev = dev;
+    ghosts[index].block = block;
+    ghosts[index].hash_next = ghost_heads[bucket];
+    ghost_heads[bucket] = index;
+}
+
+// Check for (and forget) a ghost entry
+static bool bcache_ghost_take(blockdev_t *dev, uint32_t block)
+{
+    for (int i = ghost_heads[bcache_hash(dev, block)]; i >= 0; i = ghosts[i].hash_next)
+    {
+        if (ghosts[i].dev == dev && ghosts[i].block == block)
+        {
+            bcache_ghost_remove(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Write a dirty buffer back to its device
+static bool bcache_write_back(bcache_buf_t *buf)
+{
+    if (!blockdev_write(buf->dev, buf->block, 1, buf->data))
+    {
+        return false;
+    }
+    buf->dirty = false;
+    stats.dirty--;
+    stats.writebacks++;
+    return true;
+}
+
+// Evict the oldest unpinned buffer of a queue, preferring clean ones so
+// the caller only stalls on a write when nothing else is left (or never,
+// without `allow_dirty`). Returns the buffer index or -1.
+static int bcache_evict_from(uint8_t which, bool allow_dirty)
+{
+    int victim = -1;
+
+    for (int i = queues[which].tail; i >= 0; i = buffers[i].prev)
+    {
+        bcache_buf_t *buf = &buffers[i];
+        if (buf->refcount > 0 || buf->writing || buf->loading)
+        {
+            continue;
+        }
+        if (buf->dirty)
+        {
+            if (victim < 0 && allow_dirty)
+            {
+                victim = i; // Fallback if no clean buffer turns up
+            }
+            continue;
+        }
+        victim = i;
+        break;
+    }
+
+    if (victim < 0 || (buffers[victim].dirty && !bcache_write_back(&buffers[victim])))
+    {
+        return -1;
+    }
+
+    bcache_buf_t *buf = &buffers[victim];
+    if (which == BCACHE_QUEUE_A1IN)
+    {
+        bcache_ghost_add(buf->dev, buf->block);
+    }
+    if (buf->prefetched)
+    {
+        stats.ra_wasted++;
+    }
+    bcache_hash_remove(victim);
+    bcache_unlink(victim);
+    buf->dev = NULL;
+    stats.evictions++;
+    stats.cached--;
+    return victim;
+}
+
+// Get an unused buffer, evicting one if needed
+static int bcache_alloc(void)
+{
+    int index = queues[BCACHE_QUEUE_FREE].head;
+    if (index >= 0)
+    {
+        bcache_unlink(index);
+        return index;
+    }
+
+    // 2Q: shrink A1in while it is over target, otherwise take the LRU end of Am
+    if (queues[BCACHE_QUEUE_A1IN].count > BCACHE_A1IN_TARGET)
+    {
+        index = bcache_evict_from(BCACHE_QUEUE_A1IN, true);
+    }
+    if (index < 0)
+    {
+        index = bcache_evict_from(BCACHE_QUEUE_AM, true);
+    }
+    if (index < 0)
+    {
+        index = bcache_evict_from(BCACHE_QUEUE_A1IN, true);
+    }
+    return index;
+}
+
+// Get a buffer for readahead: only free buffers or clean A1in ones, so
+// prefetching never displaces the working set or waits on a write
+static int bcache_alloc_prefetch(void)
+{
+    int index = queues[BCACHE_QUEUE_FREE].head;
+    if (index >= 0)
+    {
+        bcache_unlink(index);
+        return index;
+    }
+    return bcache_evict_from(BCACHE_QUEUE_A1IN, false);
+}
+
+// Enter a newly allocated buffer in the hash table
+static void bcache_insert(int index, blockdev_t *dev, uint32_t block)
+{
+    bcache_buf_t *buf = &buffers[index];
+    uint32_t bucket = bcache_hash(dev, block);
+    buf->dev = dev;
+    buf->block = block;
+    buf->refcount = 0;
+    buf->dirty = false;
+    buf->writing = false;
+    buf->loading = false;
+    buf->prefetched = false;
+    buf->hash_next = hash_heads[bucket];
+    hash_heads[bucket] = index;
+    stats.cached++;
+}
+
+// Look up or insert a block; `hit` reports whether it was already cached
+static bcache_buf_t *bcache_find(blockdev_t *dev, uint32_t block, bool *hit)
+{
+    bcache_init();
+
+    int index = bcache_lookup(dev, block);
+    if (index >= 0 && buffers[index].loading)
+    {
+        // Wait for the readahead; a failed one leaves the block uncached
+        bcache_ra_wait(index);
+        index = bcache_lookup(dev, block);
+    }
+    if (index >= 0)
+    {
+        if (buffers[index].prefetched)
+        {
+            buffers[index].prefetched = false;
+            stats.ra_hits++;
+        }
+
+        // A1in is a FIFO; only Am hits change the order
+        if (buffers[index].queue == BCACHE_QUEUE_AM)
+        {
+            bcache_unlink(index);
+            bcache_push(index, BCACHE_QUEUE_AM);
+        }
+        stats.hits++;
+        *hit = true;
+        buffers[index].refcount++;
+        return &buffers[index];
+    }
+
+    stats.misses++;
+    *hit = false;
+
+    index = bcache_alloc();
+    if (index < 0)
+    {
+        return NULL;
+    }
+
+    bcache_buf_t *buf = &buffers[index];
+    bcache_insert(index, dev, block);
+    buf->refcount = 1;
+
+    // Blocks seen again soon after leaving A1in are part of the working set
+    if (bcache_ghost_take(dev, block))
+    {
+        stats.ghost_hits++;
+        bcache_push(index, BCACHE_QUEUE_AM);
+    }
+    else
+    {
+        bcache_push(index, BCACHE_QUEUE_A1IN);
+    }
+    return buf;
+}
+
+// Drop a buffer whose contents could not be loaded, or are unwanted
+static void bcache_discard(bcache_buf_t *buf)
+{
+    int index = buf - buffers;
+    if (buf->prefetched)
+    {
+        stats.ra_wasted++;
+    }
+    bcache_hash_remove(index);
+    bcache_unlink(index);
+    buf->dev = NULL;
+    buf->refcount = 0;
+    stats.cached--;
+    bcache_push(index, BCACHE_QUEUE_FREE);
+}
+
+// Get a block, reading it on a miss
+bcache_buf_t *bcache_get(blockdev_t *dev, uint32_t block)
+{
+    bool hit;
+    bcache_buf_t *buf = bcache_find(dev, block, &hit);
+    if (buf != NULL && !hit && !blockdev_read(dev, block, 1, buf->data))
+    {
+        bcache_discard(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+// Get a buffer for a block that will be overwritten
+bcache_buf_t *bcache_get_new(blockdev_t *dev, uint32_t block)
+{
+    bool hit;
+    return bcache_find(dev, block, &hit);
+}
+
+// Unpin a buffer
+void bcache_release(bcache_buf_t *buf)
+{
+    if (buf->refcount > 0)
+    {
+        buf->refcount--;
+    }
+}
+
+// Mark a buffer as modified
+void bcache_mark_dirty(bcache_buf_t *buf)
+{
+    buf->generation++;
+    if (!buf->dirty)
+    {
+        buf->dirty = true;
+        buf->dirty_since = timer_ms();
+        stats.dirty++;
+    }
+}
+
+// Read blocks through the cache
+bool bcache_read(blockdev_t *dev, uint32_t block, uint32_t count, void *buffer)
+{
+    uint8_t *out = (uint8_t *)buffer;
+    bcache_init();
+
+    while (count > 0)
+    {
+        int index = bcache_lookup(dev, block);
+        if (index >= 0)
+        {
+            bcache_buf_t *buf = bcache_get(dev, block);
+            if (buf == NULL)
+            {
+                return false;
+            }
+            memcpy(out, buf->data, BLOCKDEV_SECTOR_SIZE);
+            bcache_release(buf);
+            block++;
+            out += BLOCKDEV_SECTOR_SIZE;
+            count--;
+            continue;
+        }
+
+        // Read the whole uncached run with one request, then cache it
+        uint32_t run = 1;
+        while (run < count && bcache_lookup(dev, block + run) < 0)
+        {
+            run++;
+        }
+        if (!blockdev_read(dev, block, run, out))
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < run; i++)
+        {
+            bool hit;
+            bcache_buf_t *buf = bcache_find(dev, block + i, &hit);
+            if (buf != NULL)
+            {
+                memcpy(buf->data, out + i * BLOCKDEV_SECTOR_SIZE, BLOCKDEV_SECTOR_SIZE);
+                bcache_release(buf);
+            }
+        }
+        block += run;
+        out += run * BLOCKDEV_SECTOR_SIZE;
+        count -= run;
+    }
+    return true;
+}
+
+// Write blocks through the cache
+bool bcache_write(blockdev_t *dev, uint32_t block, uint32_t count, const void *buffer)
+{
+    const uint8_t *in = (const uint8_t *)buffer;
+    bcache_init();
+
+    if (count >= BCACHE_WRITE_AROUND)
+    {
+        // An older copy still in flight must not land after this one, and
+        // a readahead of the old contents must not overwrite the new ones
+        // in the cache when it finishes
+        bcache_wb_reap(true);
+        bcache_ra_reap(true);
+        if (!blockdev_write(dev, block, count, buffer))
+        {
+            return false;
+        }
+
+        // Cached copies now match the device
+        for (uint32_t i = 0; i < count; i++)
+        {
+            int index = bcache_lookup(dev, block + i);
+            if (index >= 0)
+            {
+                memcpy(buffers[index].data, in + i * BLOCKDEV_SECTOR_SIZE, BLOCKDEV_SECTOR_SIZE);
+                if (buffers[index].dirty)
+                {
+                    buffers[index].dirty = false;
+                    stats.dirty--;
+                }
+            }
+        }
+        return true;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        bcache_buf_t *buf = bcache_get_new(dev, block + i);
+        if (buf == NULL)
+        {
+            // No buffer to hold it; write this block directly
+            if (!blockdev_write(dev, block + i, 1, in + i * BLOCKDEV_SECTOR_SIZE))
+            {
+                return false;
+            }
+            continue;
+        }
+        memcpy(buf->data, in + i * BLOCKDEV_SECTOR_SIZE, BLOCKDEV_SECTOR_SIZE);
+        bcache_mark_dirty(buf);
+        bcache_release(buf);
+    }
+
+    // Start flushing right away if this pushed the cache over its ratio
+    bcache_writeback_poll();
+    return true;
+}
+
+// Finish a completed readahead: copy the blocks into their buffers, or
+// drop the buffers if the read failed
+static void bcache_ra_finish(bcache_io_slot_t *slot)
+{
+    for (uint32_t i = 0; i < slot->count; i++)
+    {
+        bcache_buf_t *buf = &buffers[slot->index[i]];
+        buf->loading = false;
+        if (slot->req.ok)
+        {
+            memcpy(buf->data, slot->data + i * BLOCKDEV_SECTOR_SIZE, BLOCKDEV_SECTOR_SIZE);
+        }
+        else
+        {
+            buf->prefetched = false;
+            bcache_discard(buf);
+        }
+    }
+    slot->busy = false;
+}
+
+// Finish completed readaheads, waiting for all of them if `wait` is set
+static void bcache_ra_reap(bool wait)
+{
+    for (int i = 0; i < BCACHE_RA_SLOTS; i++)
+    {
+        bcache_io_slot_t *slot = &ra_slots[i];
+        if (!slot->busy)
+        {
+            continue;
+        }
+        if (wait)
+        {
+            blockdev_wait(&slot->req);
+        }
+        if (slot->req.done)
+        {
+            bcache_ra_finish(slot);
+        }
+    }
+}
+
+// Wait for the readahead that is loading one buffer
+static void bcache_ra_wait(int index)
+{
+    for (int i = 0; i < BCACHE_RA_SLOTS; i++)
+    {
+        bcache_io_slot_t *slot = &ra_slots[i];
+        if (!slot->busy)
+        {
+            continue;
+        }
+        for (uint32_t b = 0; b < slot->count; b++)
+        {
+            if (slot->index[b] == index)
+            {
+                blockdev_wait(&slot->req);
+                bcache_ra_finish(slot);
+                return;
+            }
+        }
+    }
+}
+
+// Start reading blocks into the cache without waiting
+uint32_t bcache_prefetch(blockdev_t *dev, uint32_t block, uint32_t count)
+{
+    uint32_t scheduled = 0;
+
+    bcache_init();
+    bcache_ra_reap(false);
+    blockdev_plug(dev);
+
+    while (count > 0)
+    {
+        if (bcache_lookup(dev, block) >= 0)
+        {
+            block++;
+            count--;
+            continue;
+        }
+
+        bcache_io_slot_t *slot = NULL;
+        for (int i = 0; i < BCACHE_RA_SLOTS && slot == NULL; i++)
+        {
+            if (!ra_slots[i].busy)
+            {
+                slot = &ra_slots[i];
+            }
+        }
+        if (slot == NULL)
+        {
+            break;
+        }
+
+        // Reserve buffers for the uncached run; stop early under memory pressure
+        uint32_t run = 0;
+        while (run < count && run < BCACHE_IO_MAX_BLOCKS && bcache_lookup(dev, block + run) < 0)
+        {
+            int index = bcache_alloc_prefetch();
+            if (index < 0)
+            {
+                break;
+            }
+            bcache_insert(index, dev, block + run);
+            buffers[index].loading = true;
+            buffers[index].prefetched = true;
+            bcache_push(index, BCACHE_QUEUE_A1IN);
+            slot->index[run++] = index;
+        }
+        if (run == 0)
+        {
+            break;
+        }
+
+        memset(&slot->req, 0, sizeof(slot->req));
+        slot->req.dev = dev;
+        slot->req.lba = block;
+        slot->req.count = run;
+        slot->req.buffer = slot->data;
+        slot->req.write = false;
+        slot->count = run;
+        slot->busy = true;
+
+        if (!blockdev_submit(&slot->req))
+        {
+            slot->req.ok = false;
+            bcache_ra_finish(slot);
+            break;
+        }
+
+        stats.ra_blocks += run;
+        scheduled += run;
+        block += run;
+        count -= run;
+    }
+
+    blockdev_unplug(dev);
+    return scheduled;
+}
+
+// Finish a completed writeback: blocks not modified since they were copied
+// are clean now
+static bool bcache_wb_finish(bcache_io_slot_t *slot)
+{
+    bool ok = slot->req.ok;
+
+    for (uint32_t i = 0; i < slot->count; i++)
+    {
+        bcache_buf_t *buf = &buffers[slot->index[i]];
+        buf->writing = false;
+        if (ok && buf->dirty && buf->generation == slot->generation[i])
+        {
+            buf->dirty = false;
+            stats.dirty--;
+            stats.writebacks++;
+        }
+    }
+    if (!ok)
+    {
+        stats.write_errors++;
+    }
+
+    slot->busy = false;
+    return ok;
+}
+
+// Finish completed writebacks, waiting for all of them if `wait` is set.
+// Returns false if any failed.
+static bool bcache_wb_reap(bool wait)
+{
+    bool ok = true;
+
+    for (int i = 0; i < BCACHE_WB_SLOTS; i++)
+    {
+        bcache_io_slot_t *slot = &wb_slots[i];
+        if (!slot->busy)
+        {
+            continue;
+        }
+        if (wait)
+        {
+            blockdev_wait(&slot->req);
+        }
+        if (slot->req.done && !bcache_wb_finish(slot))
+        {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Order two buffers by device, then block
+static bool bcache_before(const bcache_buf_t *a, const bcache_buf_t *b)
+{
+    if (a->dev != b->dev)
+    {
+        return (uintptr_t)a->dev < (uintptr_t)b->dev;
+    }
+    return a->block < b->block;
+}
+
+// Start writeback of the dirty blocks of `dev` (NULL = all devices) in
+// [first, first + count). Blocks are sorted and contiguous runs coalesced
+// into one request each. Unless `all` is set, only runs holding an expired
+// block are written, or every run once the cache is over its dirty ratio.
+// Returns the number of requests started, or -1 if one was rejected.
+static int bcache_wb_start(blockdev_t *dev, uint32_t first, uint32_t count, bool all)
+{
+    int16_t order[BCACHE_BUFFERS];
+    int n = 0;
+    uint32_t now = timer_ms();
+    bool expired = false;
+
+    if (!all && stats.dirty * 100 >= dirty_ratio * BCACHE_BUFFERS)
+    {
+        all = true;
+    }
+
+    for (int i = 0; i < BCACHE_BUFFERS; i++)
+    {
+        bcache_buf_t *buf = &buffers[i];
+        if (buf->dev == NULL || !buf->dirty || buf->writing || (dev != NULL && buf->dev != dev) ||
+            buf->block - first >= count)
+        {
+            continue;
+        }
+        if (now - buf->dirty_since >= dirty_expire_ms)
+        {
+            expired = true;
+        }
+        order[n++] = i;
+    }
+
+    if (n == 0 || (!all && !expired))
+    {
+        return 0; // Nothing due yet
+    }
+
+    // Insertion sort; the list is short and usually nearly ordered
+    for (int i = 1; i < n; i++)
+    {
+        int16_t index = order[i];
+        int j = i;
+        while (j > 0 && bcache_before(&buffers[index], &buffers[order[j - 1]]))
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = index;
+    }
+
+    int started = 0;
+    int slot_index = 0;
+    blockdev_t *plugged = NULL;
+
+    for (int i = 0; i < n;)
+    {
+        // Gather a run of consecutive blocks
+        int start = i;
+        bool run_expired = false;
+        do
+        {
+            if (now - buffers[order[i]].dirty_since >= dirty_expire_ms)
+            {
+                run_expired = true;
+            }
+            i++;
+        } while (i < n && i - start < BCACHE_IO_MAX_BLOCKS && buffers[order[i]].dev == buffers[order[start]].dev &&
+                 buffers[order[i]].block == buffers[order[i - 1]].block + 1);
+
+        if (!all && !run_expired)
+        {
+            continue;
+        }
+
+        while (slot_index < BCACHE_WB_SLOTS && wb_slots[slot_index].busy)
+        {
+            slot_index++;
+        }
+        if (slot_index == BCACHE_WB_SLOTS)
+        {
+            // Recycle slots whose writes already finished
+            bcache_wb_reap(false);
+            slot_index = 0;
+            while (slot_index < BCACHE_WB_SLOTS && wb_slots[slot_index].busy)
+            {
+                slot_index++;
+            }
+            if (slot_index == BCACHE_WB_SLOTS)
+            {
+                break; // The rest goes out on a later pass
+            }
+        }
+
+        // Hold the device's queue until the whole sorted batch is submitted
+        bcache_buf_t *head = &buffers[order[start]];
+        if (head->dev != plugged)
+        {
+            if (plugged != NULL)
+            {
+                blockdev_unplug(plugged);
+            }
+            plugged = head->dev;
+            blockdev_plug(plugged);
+        }
+
+        bcache_io_slot_t *slot = &wb_slots[slot_index];
+        slot->count = i - start;
+        for (uint32_t b = 0; b < slot->count; b++)
+        {
+            bcache_buf_t *buf = &buffers[order[start + b]];
+            memcpy(slot->data + b * BLOCKDEV_SECTOR_SIZE, buf->data, BLOCKDEV_SECTOR_SIZE);
+            slot->index[b] = order[start + b];
+            slot->generation[b] = buf->generation;
+            buf->writing = true;
+        }
+
+        memset(&slot->req, 0, sizeof(slot->req));
+        slot->req.dev = head->dev;
+        slot->req.lba = head->block;
+        slot->req.count = slot->count;
+        slot->req.buffer = slot->data;
+        slot->req.write = true;
+        slot->busy = true;
+
+        if (!blockdev_submit(&slot->req))
+        {
+            slot->req.ok = false;
+            bcache_wb_finish(slot);
+            started = -1;
+            break;
+        }
+        stats.flushes++;
+        if (started >= 0)
+        {
+            started++;
+        }
+    }
+
+    if (plugged != NULL)
+    {
+        blockdev_unplug(plugged);
+    }
+    return started;
+}
+
+// Run the writeback flusher once
+void bcache_writeback_poll(void)
+{
+    if (!bcache_ready)
+    {
+        return;
+    }
+
+    bcache_ra_reap(false);
+    bcache_wb_reap(false);
+    if (stats.dirty > 0)
+    {
+        bcache_wb_start(NULL, 0, 0xFFFFFFFF, false);
+    }
+}
+
+// Write the dirty blocks of a range and wait
+bool bcache_sync_range(blockdev_t *dev, uint32_t first, uint32_t count)
+{
+    if (!bcache_ready)
+    {
+        return true;
+    }
+
+    bool ok = bcache_wb_reap(true);
+    while (ok && stats.dirty > 0)
+    {
+        int started = bcache_wb_start(dev, first, count, true);
+        ok = bcache_wb_reap(true) && started >= 0;
+        if (started <= 0)
+        {
+            break;
+        }
+    }
+    return ok;
+}
+
+// Write every dirty block of a device and wait
+bool bcache_sync(blockdev_t *dev)
+{
+    return bcache_sync_range(dev, 0, 0xFFFFFFFF);
+}
+
+// Set the writeback thresholds
+void bcache_set_writeback(uint32_t ratio, uint32_t expire_ms)
+{
+    dirty_ratio = ratio > 100 ? 100 : ratio;
+    dirty_expire_ms = expire_ms;
+}
+
+// Get the writeback thresholds
+void bcache_get_writeback(uint32_t *ratio, uint32_t *expire_ms)
+{
+    *ratio = dirty_ratio;
+    *expire_ms = dirty_expire_ms;
+}
+
+// Drop every cached block of a device
+void bcache_invalidate(blockdev_t *dev)
+{
+    if (!bcache_ready || dev == NULL)
+    {
+        return;
+    }
+
+    bcache_ra_reap(true);
+    bcache_wb_reap(true);
+    for (int i = 0; i < BCACHE_BUFFERS; i++)
+    {
+        bcache_buf_t *buf = &buffers[i];
+        if (buf->dev != dev || buf->refcount > 0)
+        {
+            continue;
+        }
+        if (buf->dirty)
+        {
+            buf->dirty = false;
+            stats.dirty--;
+        }
+        bcache_discard(buf);
+    }
+
+    for (int i = 0; i < BCACHE_GHOSTS; i++)
+    {
+        if (ghosts[i].dev == dev)
+        {
+            bcache_ghost_remove(i);
+        }
+    }
+}
+
+// Get cache statistics
+void bcache_get_stats(bcache_stats_t *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,123 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "blockdev.h"
+
+// Cache geometry
+#define BCACHE_BUFFERS 256 // 128 KiB of cached blocks
+#define BCACHE_HASH_BITS 9
+#define BCACHE_HASH_SIZE (1 << BCACHE_HASH_BITS)
+
+// 2Q queue sizes: new blocks enter the A1in FIFO and are only promoted to
+// the Am LRU when referenced again after leaving it, which the A1out ghost
+// list (block numbers without data) remembers. Ghosts are cheap, so the
+// list covers twice the cache to survive long scans.
+#define BCACHE_A1IN_TARGET (BCACHE_BUFFERS / 4)
+#define BCACHE_GHOSTS (BCACHE_BUFFERS * 2)
+
+// Writes of at least this many blocks go straight to the device
+#define BCACHE_WRITE_AROUND 16
+
+// Writeback defaults: flush everything once this percentage of the cache
+// is dirty, and any block that has been dirty for longer than the deadline
+#define BCACHE_DIRTY_RATIO 20
+#define BCACHE_DIRTY_EXPIRE_MS 3000
+
+// Writeback and readahead requests in flight at once, and blocks per
+// request
+#define BCACHE_WB_SLOTS 4
+#define BCACHE_RA_SLOTS 4
+#define BCACHE_IO_MAX_BLOCKS 32
+
+// Cached block
+typedef struct
+{
+    blockdev_t *dev;
+    uint32_t block;
+    uint8_t *data;
+    uint16_t refcount; // Pinned buffers are never evicted
+    bool dirty;
+    bool writing;    // A writeback copy is in flight; not evictable
+    bool loading;    // Readahead in flight; contents not valid yet
+    bool prefetched; // Brought in by readahead and not used yet
+    uint8_t queue; // BCACHE_QUEUE_*
+    uint32_t generation;  // Bumped on every modification
+    uint32_t dirty_since; // timer_ms() when the block became dirty
+
+    int16_t hash_next;
+    int16_t prev; // Queue links
+    int16_t next;
+} bcache_buf_t;
+
+// Queue a buffer is on
+#define BCACHE_QUEUE_FREE 0
+#define BCACHE_QUEUE_A1IN 1
+#define BCACHE_QUEUE_AM 2
+
+// Cache statistics
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t ghost_hits; // Misses promoted straight to Am
+    uint32_t evictions;
+    uint32_t writebacks; // Dirty blocks written to the device
+    uint32_t flushes;    // Coalesced requests issued by the flusher
+    uint32_t write_errors;
+    uint32_t ra_blocks; // Blocks prefetched by readahead
+    uint32_t ra_hits;   // Prefetched blocks later read (useful)
+    uint32_t ra_wasted; // Prefetched blocks evicted unread
+    uint32_t cached;     // Buffers holding a block
+    uint32_t dirty;
+} bcache_stats_t;
+
+// Get a block, reading it on a miss. The buffer stays pinned until
+// bcache_release(). Returns NULL on an I/O error or if every buffer is pinned.
+bcache_buf_t *bcache_get(blockdev_t *dev, uint32_t block);
+
+// Get a buffer for a block the caller will overwrite entirely, without
+// reading it from the device
+bcache_buf_t *bcache_get_new(blockdev_t *dev, uint32_t block);
+
+// Unpin a buffer
+void bcache_release(bcache_buf_t *buf);
+
+// Mark a pinned buffer as modified
+void bcache_mark_dirty(bcache_buf_t *buf);
+
+// Read blocks through the cache
+bool bcache_read(blockdev_t *dev, uint32_t block, uint32_t count, void *buffer);
+
+// Write blocks through the cache. Short writes stay dirty in memory for
+// the writeback flusher; long ones are written to the device at once.
+bool bcache_write(blockdev_t *dev, uint32_t block, uint32_t count, const void *buffer);
+
+// Write every dirty block of a device (all devices if NULL) and wait
+bool bcache_sync(blockdev_t *dev);
+
+// Write the dirty blocks of a device in [first, first + count) and wait
+bool bcache_sync_range(blockdev_t *dev, uint32_t first, uint32_t count);
+
+// Start reading blocks into the cache without waiting. Only free or clean
+// A1in buffers are used, so less (or nothing) is prefetched under memory
+// pressure. Returns the number of blocks scheduled.
+uint32_t bcache_prefetch(blockdev_t *dev, uint32_t block, uint32_t count);
+
+// Run the writeback flusher: reap finished writes and start new ones for
+// expired blocks, or for everything when over the dirty ratio. Never
+// waits; call it from idle loops.
+void bcache_writeback_poll(void);
+
+// Set the dirty ratio (percent of the cache) and expiry deadline
+void bcache_set_writeback(uint32_t dirty_ratio, uint32_t expire_ms);
+
+// Get the dirty ratio and expiry deadline
+void bcache_get_writeback(uint32_t *dirty_ratio, uint32_t *expire_ms);
+
+// Drop every cached block of a device, discarding unsynced changes
+void bcache_invalidate(blockdev_t *dev);
+
+// Get cache statistics
+void bcache_get_stats(bcache_stats_t *stats);
+
+#endif // BCACHE_H
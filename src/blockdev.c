@@ -0,0 +1,228 @@
+#include "blockdev.h"
+#include "string.h"     // For string operations
+#include "interrupts.h" // For waiting on request completion
+#include <stddef.h>
+
+// Registered block devices
+static blockdev_t *devices[BLOCKDEV_MAX_DEVICES];
+static int device_count = 0;
+
+// Register a block device
+bool blockdev_register(blockdev_t *dev)
+{
+    if (device_count >= BLOCKDEV_MAX_DEVICES || blockdev_find(dev->name) != NULL)
+    {
+        return false;
+    }
+
+    dev->queue = NULL;
+    dev->in_flight = 0;
+    dev->plugged = 0;
+    dev->last_lba = 0;
+    dev->reads = 0;
+    dev->writes = 0;
+    dev->errors = 0;
+    dev->sectors_read = 0;
+    dev->sectors_written = 0;
+    dev->kicks = 0;
+    devices[device_count++] = dev;
+    return true;
+}
+
+// Find a registered block device by name
+blockdev_t *blockdev_find(const char *name)
+{
+    for (int i = 0; i < device_count; i++)
+    {
+        if (strcmp(devices[i]->name, name) == 0)
+        {
+            return devices[i];
+        }
+    }
+    return NULL;
+}
+
+// Get a registered block device by index
+blockdev_t *blockdev_get(int index)
+{
+    if (index < 0 || index >= device_count)
+    {
+        return NULL;
+    }
+    return devices[index];
+}
+
+// Get the number of registered block devices
+int blockdev_count(void)
+{
+    return device_count;
+}
+
+// Record a finished request and wake its waiter
+static void blockdev_finish(blockdev_t *dev, blockdev_request_t *req, bool ok)
+{
+    if (req->write)
+    {
+        dev->writes++;
+        dev->sectors_written += req->count;
+    }
+    else
+    {
+        dev->reads++;
+        dev->sectors_read += req->count;
+    }
+    if (!ok)
+    {
+        dev->errors++;
+    }
+
+    req->ok = ok;
+    if (req->callback != NULL)
+    {
+        req->callback(req);
+    }
+    req->done = true;
+}
+
+// Hand queued requests to the driver until it is full. Requests are
+// served in ascending LBA order from the last position, wrapping to the
+// lowest LBA at the end of a sweep. Called with interrupts disabled.
+static void blockdev_dispatch(blockdev_t *dev)
+{
+    uint32_t depth = dev->queue_depth ? dev->queue_depth : 1;
+    bool started = false;
+
+    while (dev->queue != NULL && dev->in_flight < depth && !dev->plugged)
+    {
+        blockdev_request_t **link = &dev->queue;
+        while (*link != NULL && (*link)->lba < dev->last_lba)
+        {
+            link = &(*link)->next;
+        }
+        if (*link == NULL)
+        {
+            link = &dev->queue; // Sweep finished - start over from the lowest LBA
+        }
+
+        blockdev_request_t *req = *link;
+        *link = req->next;
+        req->next = NULL;
+
+        dev->in_flight++;
+        dev->last_lba = req->lba + req->count;
+        dev->start(dev, req);
+        started = true;
+    }
+
+    // One notification covers everything started above
+    if (started && dev->kick != NULL)
+    {
+        dev->kicks++;
+        dev->kick(dev);
+    }
+}
+
+// Queue a request
+bool blockdev_submit(blockdev_request_t *req)
+{
+    blockdev_t *dev = req->dev;
+
+    if (req->count == 0 || req->lba >= dev->sector_count || req->count > dev->sector_count - req->lba)
+    {
+        return false;
+    }
+
+    req->done = false;
+    req->ok = false;
+    req->next = NULL;
+
+    // Drivers without a queue complete the request right away
+    if (dev->start == NULL)
+    {
+        bool ok = req->write ? dev->write(dev, req->lba, req->count, req->buffer)
+                             : dev->read(dev, req->lba, req->count, req->buffer);
+        blockdev_finish(dev, req, ok);
+        return true;
+    }
+
+    uint32_t flags = irq_save();
+
+    // Insert in LBA order
+    blockdev_request_t **link = &dev->queue;
+    while (*link != NULL && (*link)->lba <= req->lba)
+    {
+        link = &(*link)->next;
+    }
+    req->next = *link;
+    *link = req;
+
+    blockdev_dispatch(dev);
+
+    irq_restore(flags);
+    return true;
+}
+
+// Wait for a submitted request
+bool blockdev_wait(blockdev_request_t *req)
+{
+    if (!req->done)
+    {
+        irq_wait_for(&req->done);
+    }
+    return req->ok;
+}
+
+// Complete a started request and start more
+void blockdev_complete(blockdev_t *dev, blockdev_request_t *req, bool ok)
+{
+    dev->in_flight--;
+    blockdev_finish(dev, req, ok);
+    blockdev_dispatch(dev);
+}
+
+// Hold back dispatch
+void blockdev_plug(blockdev_t *dev)
+{
+    uint32_t flags = irq_save();
+    dev->plugged++;
+    irq_restore(flags);
+}
+
+// Release a plug and dispatch the batch
+void blockdev_unplug(blockdev_t *dev)
+{
+    uint32_t flags = irq_save();
+    if (dev->plugged > 0 && --dev->plugged == 0)
+    {
+        blockdev_dispatch(dev);
+    }
+    irq_restore(flags);
+}
+
+// Read sectors from a device
+bool blockdev_read(blockdev_t *dev, uint32_t lba, uint32_t count, void *buffer)
+{
+    blockdev_request_t req;
+    memset(&req, 0, sizeof(req));
+    req.dev = dev;
+    req.lba = lba;
+    req.count = count;
+    req.buffer = buffer;
+    req.write = false;
+
+    return blockdev_submit(&req) && blockdev_wait(&req);
+}
+
+// Write sectors to a device
+bool blockdev_write(blockdev_t *dev, uint32_t lba, uint32_t count, const void *buffer)
+{
+    blockdev_request_t req;
+    memset(&req, 0, sizeof(req));
+    req.dev = dev;
+    req.lba = lba;
+    req.count = count;
+    req.buffer = (void *)buffer;
+    req.write = true;
+
+    return blockdev_submit(&req) && blockdev_wait(&req);
+}
@@ -0,0 +1,104 @@
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Block device limits
+#define BLOCKDEV_SECTOR_SIZE 512
+#define BLOCKDEV_MAX_DEVICES 4
+#define BLOCKDEV_MAX_NAME 16
+
+struct blockdev;
+
+// I/O request - queued on a device and completed by its driver
+typedef struct blockdev_request
+{
+    struct blockdev *dev;
+    uint32_t lba;
+    uint32_t count;
+    void *buffer;
+    bool write;
+
+    // Completion state, set by blockdev_complete()
+    volatile bool done;
+    bool ok;
+
+    // Optional completion callback, called from the driver's IRQ handler
+    void (*callback)(struct blockdev_request *req);
+    void *private_data;
+
+    struct blockdev_request *next;
+} blockdev_request_t;
+
+// Block device - drivers fill in the callbacks and register the device
+typedef struct blockdev
+{
+    char name[BLOCKDEV_MAX_NAME];
+    uint32_t sector_count;
+
+    // Synchronous transfer of `count` sectors starting at `lba`; return
+    // false on error. Used by drivers without a start callback.
+    bool (*read)(struct blockdev *dev, uint32_t lba, uint32_t count, void *buffer);
+    bool (*write)(struct blockdev *dev, uint32_t lba, uint32_t count, const void *buffer);
+
+    // Begin executing a request; the driver calls blockdev_complete() once
+    // it finishes. Called with interrupts disabled.
+    void (*start)(struct blockdev *dev, blockdev_request_t *req);
+
+    // Optional: notify the hardware once after a batch of start() calls
+    void (*kick)(struct blockdev *dev);
+
+    void *driver_data;
+
+    // Request queue, kept sorted by LBA and served in one sweep direction
+    blockdev_request_t *queue;
+    uint32_t queue_depth; // Requests the driver accepts at once (0 = 1)
+    uint32_t in_flight;
+    uint32_t plugged; // Dispatch is held back while non-zero
+    uint32_t last_lba;
+
+    // Statistics
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t errors;
+    uint32_t sectors_read;
+    uint32_t sectors_written;
+    uint32_t kicks;
+} blockdev_t;
+
+// Register a block device
+bool blockdev_register(blockdev_t *dev);
+
+// Find a registered block device by name
+blockdev_t *blockdev_find(const char *name);
+
+// Get a registered block device by index
+blockdev_t *blockdev_get(int index);
+
+// Get the number of registered block devices
+int blockdev_count(void);
+
+// Queue a request without waiting for it. Returns false if the request is
+// out of range; otherwise completion is reported through req->done.
+bool blockdev_submit(blockdev_request_t *req);
+
+// Wait for a submitted request; returns whether it succeeded
+bool blockdev_wait(blockdev_request_t *req);
+
+// Called by drivers when a started request finishes
+void blockdev_complete(blockdev_t *dev, blockdev_request_t *req, bool ok);
+
+// Hold back dispatch so a batch of submissions reaches the driver together
+void blockdev_plug(blockdev_t *dev);
+
+// Release a plug and dispatch everything queued meanwhile
+void blockdev_unplug(blockdev_t *dev);
+
+// Read sectors from a device
+bool blockdev_read(blockdev_t *dev, uint32_t lba, uint32_t count, void *buffer);
+
+// Write sectors to a device
+bool blockdev_write(blockdev_t *dev, uint32_t lba, uint32_t count, const void *buffer);
+
+#endif // BLOCKDEV_H
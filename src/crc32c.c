@@ -0,0 +1,196 @@
+#include "crc32c.h"
+
+// Reflected CRC32C polynomial
+#define CRC32C_POLY 0x82F63B78
+
+// Bytes each of the three interleaved hardware streams covers per round.
+// Three rounds' worth of input fit in one 512-byte block.
+#define CRC32C_STRIDE 128
+
+// CPUID leaf 1, ECX: SSE4.2 (includes the crc32 instruction)
+#define CPUID_ECX_SSE42 (1u << 20)
+
+static uint32_t crc_tables[8][256];   // Slicing-by-8
+static uint32_t shift_tables[4][256]; // Multiply a CRC by x^(8 * CRC32C_STRIDE)
+static bool crc_ready = false;
+static bool crc_hw = false;
+
+// Multiply two polynomials modulo the CRC polynomial (reflected, so x^0 is
+// the top bit)
+static uint32_t crc32c_multiply(uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+    for (uint32_t m = 1u << 31; m != 0; m >>= 1)
+    {
+        if (a & m)
+        {
+            product ^= b;
+        }
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+// Check whether the CPU supports SSE4.2
+static bool crc32c_cpu_has_sse42(void)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (ecx & CPUID_ECX_SSE42) != 0;
+}
+
+// Build the tables and pick an implementation
+static void crc32c_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+        {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        crc_tables[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        for (int t = 1; t < 8; t++)
+        {
+            uint32_t c = crc_tables[t - 1][i];
+            crc_tables[t][i] = (c >> 8) ^ crc_tables[0][c & 0xFF];
+        }
+    }
+
+    // x^(8 * stride), then its product with every byte in every position
+    uint32_t shift = 1u << 31;
+    for (int i = 0; i < CRC32C_STRIDE; i++)
+    {
+        shift = crc32c_multiply(1u << 23, shift);
+    }
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        for (int t = 0; t < 4; t++)
+        {
+            shift_tables[t][i] = crc32c_multiply(shift, i << (8 * t));
+        }
+    }
+
+    crc_hw = crc32c_cpu_has_sse42();
+    crc_ready = true;
+}
+
+// Advance a CRC over CRC32C_STRIDE zero bytes
+static uint32_t crc32c_shift(uint32_t crc)
+{
+    return shift_tables[0][crc & 0xFF] ^ shift_tables[1][(crc >> 8) & 0xFF] ^
+           shift_tables[2][(crc >> 16) & 0xFF] ^ shift_tables[3][crc >> 24];
+}
+
+// Table-driven CRC, eight bytes per step
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    while (len > 0 && ((uintptr_t)p & 3) != 0)
+    {
+        crc = crc_tables[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+
+    while (len >= 8)
+    {
+        uint32_t one = ((const uint32_t *)p)[0] ^ crc;
+        uint32_t two = ((const uint32_t *)p)[1];
+        crc = crc_tables[7][one & 0xFF] ^ crc_tables[6][(one >> 8) & 0xFF] ^
+              crc_tables[5][(one >> 16) & 0xFF] ^ crc_tables[4][one >> 24] ^
+              crc_tables[3][two & 0xFF] ^ crc_tables[2][(two >> 8) & 0xFF] ^
+              crc_tables[1][(two >> 16) & 0xFF] ^ crc_tables[0][two >> 24];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len-- > 0)
+    {
+        crc = crc_tables[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+// crc32 instruction on 4 bytes
+static inline uint32_t crc32c_hw_u32(uint32_t crc, uint32_t value)
+{
+    asm("crc32l %1, %0" : "+r"(crc) : "rm"(value));
+    return crc;
+}
+
+// crc32 instruction on 1 byte
+static inline uint32_t crc32c_hw_u8(uint32_t crc, uint8_t value)
+{
+    asm("crc32b %1, %0" : "+r"(crc) : "qm"(value));
+    return crc;
+}
+
+// Hardware CRC. The instruction has a latency of three cycles but issues
+// every cycle, so three independent streams keep it busy; their CRCs are
+// then merged by shifting over the bytes that follow each one.
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    while (len > 0 && ((uintptr_t)p & 3) != 0)
+    {
+        crc = crc32c_hw_u8(crc, *p++);
+        len--;
+    }
+
+    while (len >= 3 * CRC32C_STRIDE)
+    {
+        const uint32_t *a = (const uint32_t *)p;
+        const uint32_t *b = a + CRC32C_STRIDE / 4;
+        const uint32_t *c = b + CRC32C_STRIDE / 4;
+        uint32_t crc_b = 0;
+        uint32_t crc_c = 0;
+
+        for (int i = 0; i < CRC32C_STRIDE / 4; i++)
+        {
+            crc = crc32c_hw_u32(crc, a[i]);
+            crc_b = crc32c_hw_u32(crc_b, b[i]);
+            crc_c = crc32c_hw_u32(crc_c, c[i]);
+        }
+        crc = crc32c_shift(crc) ^ crc_b;
+        crc = crc32c_shift(crc) ^ crc_c;
+        p += 3 * CRC32C_STRIDE;
+        len -= 3 * CRC32C_STRIDE;
+    }
+
+    while (len >= 4)
+    {
+        crc = crc32c_hw_u32(crc, *(const uint32_t *)p);
+        p += 4;
+        len -= 4;
+    }
+    while (len-- > 0)
+    {
+        crc = crc32c_hw_u8(crc, *p++);
+    }
+    return crc;
+}
+
+// Continue a CRC32C over `len` more bytes
+uint32_t crc32c(uint32_t crc, const void *data, uint32_t len)
+{
+    if (!crc_ready)
+    {
+        crc32c_init();
+    }
+
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    crc = crc_hw ? crc32c_hw(crc, p, len) : crc32c_sw(crc, p, len);
+    return ~crc;
+}
+
+// Check whether the hardware instruction is in use
+bool crc32c_hardware(void)
+{
+    if (!crc_ready)
+    {
+        crc32c_init();
+    }
+    return crc_hw;
+}
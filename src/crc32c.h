@@ -0,0 +1,18 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// CRC32C (Castagnoli), the checksum used for file system blocks, journal
+// records and backups. Uses the SSE4.2 crc32 instruction when the CPU has
+// it, with a slicing-by-8 table fallback.
+
+// Continue a CRC32C over `len` more bytes. Start with crc = 0; passing the
+// result back in checksums data in pieces.
+uint32_t crc32c(uint32_t crc, const void *data, uint32_t len);
+
+// Check whether the hardware instruction is in use
+bool crc32c_hardware(void);
+
+#endif // CRC32C_H
@@ -1,262 +1,1550 @@
 #include "editor.h"
 #include "vga.h"
 #include "terminal.h"
+#include "fs.h"
+#include "string.h"
+#include "syntax.h"
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
 
+// Largest file a buffer can hold
+#define EDITOR_BUFFER_SIZE (512 * 1024)
+
+// Open buffers and windows
+#define EDITOR_MAX_BUFFERS 4
+#define EDITOR_MAX_WINDOWS 2
+
+// Text storage shared by all buffers. Each buffer owns one contiguous
+// region of the arena, packed in order of address; a buffer that runs out
+// of room grows in place by moving the regions after it up.
+#define EDITOR_ARENA_SIZE (1024 * 1024)
+#define EDITOR_GROW_MIN 4096 // Smallest amount a region grows by
+static char editor_arena[EDITOR_ARENA_SIZE];
+static int arena_used = 0;
+
+// Line index: a Fenwick tree counting the newlines in each block of
+// buffer positions. Characters only change buffer position when the gap
+// moves over them, so the counts are kept up to date as the text changes,
+// and finding a line's offset or an offset's line takes O(log n).
+#define EDITOR_LINE_BLOCK 64
+#define EDITOR_LINE_BLOCKS (EDITOR_BUFFER_SIZE / EDITOR_LINE_BLOCK)
+
+// Undo log: each record is a run of characters typed or deleted together,
+// with its text in undo_text. Records before undo_current can be undone,
+// the rest redone. When either array fills up the oldest half is dropped.
+#define EDITOR_UNDO_RECORDS 512
+#define EDITOR_UNDO_BYTES (32 * 1024)
+#define EDIT_INSERT 0
+#define EDIT_DELETE 1 // Text is stored last character first
+
+typedef struct
+{
+    uint8_t type;
+    int pos;    // Text position of the run
+    int length; // Characters in the run
+    int text;   // Offset of its characters in undo_text
+} editor_edit_t;
+
+// Syntax highlighting: the lexer state at the start of each line, cached
+// so a line is painted by lexing just that line. States for lines from
+// state_valid on may be stale. After an edit, the states for lines in
+// [state_stale_from, state_converge_end) are the ones from before it,
+// shifted with their lines: their text is unchanged, so once re-lexing
+// reaches one of them with the same state, the rest are right too. Lines
+// past EDITOR_STATE_LINES, and text past EDITOR_LEX_MAX in a line, are
+// shown without highlighting.
+#define EDITOR_STATE_LINES 65536
+#define EDITOR_LEX_MAX 1024
+
+// An open file. The text is kept in a gap buffer: everything before the
+// gap, then everything after it. Edits happen at the gap, which is moved
+// to the cursor only when the text is changed there, so typing costs O(1)
+// and cursor movement costs nothing.
+typedef struct
+{
+    bool used;
+    char *text;   // Region in editor_arena
+    int capacity; // Size of the region
+    int gap_start;
+    int gap_end;
+    int length;
+    char filename[64];
+    bool modified;
+    int saved_cursor; // Where the last window to leave it was
+    int saved_scroll;
+
+    // How much of the text still matches the file it was read from or last
+    // saved to, so a save writes back only what changed: the text before
+    // dirty_from, and its last clean_tail bytes if the length is the same
+    bool on_disk; // filename is that file
+    int disk_length;
+    uint32_t disk_version; // fs_get_file_version() of that file
+    int dirty_from;
+    int clean_tail;
+
+    int32_t line_tree[EDITOR_LINE_BLOCKS + 1]; // 1-based
+    int line_total;                            // Newlines in the text
+
+    editor_edit_t undo_log[EDITOR_UNDO_RECORDS];
+    char undo_text[EDITOR_UNDO_BYTES];
+    int undo_count;
+    int undo_current;
+    bool undo_sealed; // The next edit starts a new record
+
+    const syntax_t *syntax;
+    uint8_t line_state[EDITOR_STATE_LINES];
+    int state_valid;
+    int state_stale_from;
+    int state_converge_end;
+} editor_buffer_t;
+
+// A view of a buffer on part of the screen. Two windows may show the same
+// buffer; each has its own cursor and scroll position.
+typedef struct
+{
+    editor_buffer_t *buffer;
+    int cursor;
+    int scroll;       // First text line shown
+    int top;          // First screen row
+    int rows;         // Screen rows
+    int shown_scroll; // Scroll when last painted
+    int damage_first; // Damaged text lines, inclusive; none if
+    int damage_last;  // damage_last < damage_first
+} editor_window_t;
+
+static editor_buffer_t buffers[EDITOR_MAX_BUFFERS];
+static editor_window_t windows[EDITOR_MAX_WINDOWS];
+static int window_count = 1;
+static editor_window_t *window = &windows[0]; // Window with the cursor
+static editor_buffer_t *buffer = &buffers[0]; // Buffer being worked on
+
 // Variables to track editor state
-static char editor_content[2048];
-static int cursor_pos = 0;
-static int editor_length = 0;
-static char current_filename[64] = "";
-static bool editor_modified = false;
-static int editor_start_row = 2;
-static int editor_visible_rows = 20;
-static int editor_scroll_offset = 0;
-static int editor_mode = 0; // 0 = normal, 1 = insert
+static int editor_mode = 0; // 0 = normal, 1 = insert, 2 = search prompt, 3 = open prompt
+
+// Redraw state: editor_display repaints only the text lines damaged since
+// it last ran, the status line, and the header when what it shows changed
+#define EDITOR_DAMAGE_END 0x7FFFFFFF // Damage reaching the end of the text
+static bool editor_full_redraw = true;
+static bool editor_header_damaged = true;
+static int shown_mode = -1;
+static bool shown_modified = false;
+
+// Search: the pattern with Boyer-Moore-Horspool skip tables for both
+// directions, and the prompt typed after '/' (find, or find/replace)
+#define EDITOR_SEARCH_MAX 64
+static char search_pattern[EDITOR_SEARCH_MAX];
+static int search_length = 0;        // 0 when nothing is searched for
+static int search_skip[256];         // Forward shift by a window's last byte
+static int search_skip_back[256];    // Backward shift by a window's first byte
+static char search_query[2 * EDITOR_SEARCH_MAX + 2];
+static int search_query_length = 0;
+static int search_anchor = 0; // Cursor when the prompt was opened
+static int search_match = -1; // Match the prompt currently shows
+
+// File name typed after 'o'
+static char open_query[64];
+static int open_query_length = 0;
+
+static char lex_text[EDITOR_LEX_MAX];
+static uint8_t lex_colors[EDITOR_LEX_MAX];
+
+// Get the character at a text position
+static inline char editor_char_at(int pos)
+{
+    return pos < buffer->gap_start ? buffer->text[pos] : buffer->text[pos + buffer->gap_end - buffer->gap_start];
+}
+
+// Count a newline at a buffer position in the line index
+static void line_tree_add(int index, int delta)
+{
+    for (int i = index / EDITOR_LINE_BLOCK + 1; i <= EDITOR_LINE_BLOCKS; i += i & -i)
+    {
+        buffer->line_tree[i] += delta;
+    }
+}
+
+// Rebuild the line index from the buffer
+static void line_tree_build(void)
+{
+    memset(buffer->line_tree, 0, sizeof(buffer->line_tree));
+    buffer->line_total = 0;
+    for (int i = 0; i < buffer->capacity; i++)
+    {
+        if ((i < buffer->gap_start || i >= buffer->gap_end) && buffer->text[i] == '\n')
+        {
+            buffer->line_tree[i / EDITOR_LINE_BLOCK + 1]++;
+            buffer->line_total++;
+        }
+    }
+    for (int i = 1; i <= EDITOR_LINE_BLOCKS; i++)
+    {
+        int parent = i + (i & -i);
+        if (parent <= EDITOR_LINE_BLOCKS)
+        {
+            buffer->line_tree[parent] += buffer->line_tree[i];
+        }
+    }
+}
+
+// Update the line index for text about to move by `shift` positions
+static void line_tree_shift(int from, int count, int shift)
+{
+    const char *p = buffer->text + from;
+    const char *end = p + count;
+    while ((p = memchr(p, '\n', end - p)) != NULL)
+    {
+        int index = p - buffer->text;
+        if (index / EDITOR_LINE_BLOCK != (index + shift) / EDITOR_LINE_BLOCK)
+        {
+            line_tree_add(index, -1);
+            line_tree_add(index + shift, 1);
+        }
+        p++;
+    }
+}
+
+// Move the gap so that it starts at a text position
+static void editor_move_gap(int pos)
+{
+    int gap = buffer->gap_end - buffer->gap_start;
+    if (pos < buffer->gap_start)
+    {
+        int count = buffer->gap_start - pos;
+        line_tree_shift(pos, count, gap);
+        memmove(buffer->text + buffer->gap_end - count, buffer->text + pos, count);
+        buffer->gap_start -= count;
+        buffer->gap_end -= count;
+    }
+    else if (pos > buffer->gap_start)
+    {
+        int count = pos - buffer->gap_start;
+        line_tree_shift(buffer->gap_end, count, -gap);
+        memmove(buffer->text + buffer->gap_start, buffer->text + buffer->gap_end, count);
+        buffer->gap_start += count;
+        buffer->gap_end += count;
+    }
+}
+
+// Move everything in the arena from `from` to its end by `shift` bytes
+static void editor_arena_shift(char *from, int shift)
+{
+    memmove(from + shift, from, editor_arena + arena_used - from);
+    arena_used += shift;
+    for (int i = 0; i < EDITOR_MAX_BUFFERS; i++)
+    {
+        if (buffers[i].used && buffers[i].text >= from)
+        {
+            buffers[i].text += shift;
+        }
+    }
+}
+
+// Make room in the gap for `count` characters, growing the buffer's region
+// if needed; false if the buffer or the arena is full
+static bool editor_reserve(int count)
+{
+    int needed = count - (buffer->gap_end - buffer->gap_start);
+    if (needed <= 0)
+    {
+        return true;
+    }
+
+    // Grow by a quarter at least, so a growing file moves the regions
+    // after it a bounded number of times
+    int grow = buffer->capacity / 4 > EDITOR_GROW_MIN ? buffer->capacity / 4 : EDITOR_GROW_MIN;
+    if (grow < needed)
+    {
+        grow = needed;
+    }
+    if (grow > EDITOR_BUFFER_SIZE - buffer->capacity)
+    {
+        grow = EDITOR_BUFFER_SIZE - buffer->capacity;
+    }
+    if (grow > EDITOR_ARENA_SIZE - arena_used)
+    {
+        grow = EDITOR_ARENA_SIZE - arena_used;
+    }
+    if (grow < needed)
+    {
+        return false;
+    }
+
+    // Widen the gap by moving the text after it up with the later regions
+    editor_arena_shift(buffer->text + buffer->capacity, grow);
+    memmove(buffer->text + buffer->gap_end + grow, buffer->text + buffer->gap_end,
+            buffer->capacity - buffer->gap_end);
+    buffer->gap_end += grow;
+    buffer->capacity += grow;
+    line_tree_build();
+    editor_header_damaged = true; // It shows the size
+    return true;
+}
+
+// Count the newlines in the buffer range [from, to), skipping the gap
+static int editor_count_block(int from, int to)
+{
+    int count = 0;
+    for (int i = from; i < to; i++)
+    {
+        if (i >= buffer->gap_start && i < buffer->gap_end)
+        {
+            i = buffer->gap_end - 1;
+            continue;
+        }
+        count += buffer->text[i] == '\n';
+    }
+    return count;
+}
+
+// Count the newlines before a text position
+static int editor_line_of(int pos)
+{
+    int index = pos < buffer->gap_start ? pos : pos + buffer->gap_end - buffer->gap_start;
+    int block = index / EDITOR_LINE_BLOCK;
+    int count = 0;
+    for (int i = block; i > 0; i -= i & -i)
+    {
+        count += buffer->line_tree[i];
+    }
+    return count + editor_count_block(block * EDITOR_LINE_BLOCK, index);
+}
+
+// Find the text position of the n-th newline (from 1), or the text length
+static int editor_find_nth_newline(int n)
+{
+    if (n < 1 || n > buffer->line_total)
+    {
+        return buffer->length;
+    }
+
+    // Descend the tree to the block holding it
+    int block = 0;
+    for (int step = EDITOR_LINE_BLOCKS; step > 0; step >>= 1)
+    {
+        if (block + step <= EDITOR_LINE_BLOCKS && buffer->line_tree[block + step] < n)
+        {
+            block += step;
+            n -= buffer->line_tree[block];
+        }
+    }
+
+    // Then scan the block
+    int i = block * EDITOR_LINE_BLOCK;
+    for (;; i++)
+    {
+        if (i >= buffer->gap_start && i < buffer->gap_end)
+        {
+            i = buffer->gap_end - 1;
+            continue;
+        }
+        if (buffer->text[i] == '\n' && --n == 0)
+        {
+            break;
+        }
+    }
+    return i < buffer->gap_start ? i : i - (buffer->gap_end - buffer->gap_start);
+}
+
+// Get the text position where a line (counted from 0) starts
+static int editor_line_offset(int line)
+{
+    if (line <= 0)
+    {
+        return 0;
+    }
+    int pos = editor_find_nth_newline(line);
+    return pos < buffer->length ? pos + 1 : buffer->length;
+}
+
+// Mark text lines first to last of a window for repainting
+static void editor_window_damage(editor_window_t *w, int first, int last)
+{
+    if (w->damage_last < w->damage_first)
+    {
+        w->damage_first = first;
+        w->damage_last = last;
+        return;
+    }
+    if (first < w->damage_first)
+    {
+        w->damage_first = first;
+    }
+    if (last > w->damage_last)
+    {
+        w->damage_last = last;
+    }
+}
+
+// Mark text lines first to last of the current buffer for repainting in
+// every window showing it
+static void editor_damage(int first, int last)
+{
+    for (int i = 0; i < window_count; i++)
+    {
+        if (windows[i].buffer == buffer)
+        {
+            editor_window_damage(&windows[i], first, last);
+        }
+    }
+}
+
+// Note that text [from, to) changed; the text after it only moved
+static void editor_changed(int from, int to)
+{
+    if (from < buffer->dirty_from)
+    {
+        buffer->dirty_from = from;
+    }
+    if (buffer->length - to < buffer->clean_tail)
+    {
+        buffer->clean_tail = buffer->length - to;
+    }
+}
+
+// Note that the text matches the file named by the buffer
+static void editor_mark_clean(void)
+{
+    buffer->on_disk = true;
+    buffer->disk_length = buffer->length;
+    buffer->disk_version = fs_get_file_version(buffer->filename);
+    buffer->dirty_from = buffer->length;
+    buffer->clean_tail = buffer->length;
+}
+
+// Forget all cached lexer states
+static void editor_states_reset(void)
+{
+    buffer->line_state[0] = SYNTAX_STATE_START;
+    buffer->state_valid = 1;
+    buffer->state_stale_from = 0;
+    buffer->state_converge_end = 0;
+}
+
+// Move a cached line number past an edit on `line` that added `added`
+// lines (or removed -added)
+static int editor_states_shift(int n, int line, int added)
+{
+    if (n <= line)
+    {
+        return n;
+    }
+    n += added;
+    return n > line + 1 ? n : line + 1;
+}
+
+// Update the cached states for an edit on `line` that added `added` lines
+// (or removed -added)
+static void editor_states_edit(int line, int added)
+{
+    if (line >= EDITOR_STATE_LINES - 1)
+    {
+        return;
+    }
+
+    // Keep each cached state with its line
+    int from = line + 1;
+    if (added > 0 && from + added < EDITOR_STATE_LINES)
+    {
+        memmove(buffer->line_state + from + added, buffer->line_state + from, EDITOR_STATE_LINES - from - added);
+    }
+    else if (added < 0 && from - added < EDITOR_STATE_LINES)
+    {
+        memmove(buffer->line_state + from, buffer->line_state + from - added, EDITOR_STATE_LINES - from + added);
+    }
+
+    // Lines line to last have new text
+    int last = added > 0 ? line + added : line;
+    if (line < buffer->state_valid)
+    {
+        // The old states from after the edit up to state_valid can be
+        // reused once the new ones match them
+        buffer->state_converge_end = editor_states_shift(buffer->state_valid, line, added);
+        buffer->state_stale_from = last + 1;
+        buffer->state_valid = line + 1;
+    }
+    else if (line < buffer->state_stale_from)
+    {
+        buffer->state_stale_from = editor_states_shift(buffer->state_stale_from, line, added);
+        buffer->state_converge_end = editor_states_shift(buffer->state_converge_end, line, added);
+    }
+    else if (line < buffer->state_converge_end)
+    {
+        // States before the edit still hold; the ones after it no longer
+        // follow from them
+        buffer->state_converge_end = line + 1;
+    }
+}
+
+// Copy a line's text into lex_text; returns its length there
+static int editor_copy_line(int line)
+{
+    int start = editor_line_offset(line);
+    int end = editor_find_nth_newline(line + 1);
+    if (end - start > EDITOR_LEX_MAX)
+    {
+        end = start + EDITOR_LEX_MAX;
+    }
+    for (int i = start; i < end; i++)
+    {
+        lex_text[i - start] = editor_char_at(i);
+    }
+    return end - start;
+}
+
+// Bring the cached states up to date through a line. Re-lexing starts at
+// the first stale line and stops early when the states converge with the
+// ones from before the last edits, so an edit costs the lines it changes.
+static void editor_update_states(int last_line)
+{
+    if (!buffer->syntax)
+    {
+        return;
+    }
+    if (last_line > buffer->line_total)
+    {
+        last_line = buffer->line_total;
+    }
+    if (last_line > EDITOR_STATE_LINES - 1)
+    {
+        last_line = EDITOR_STATE_LINES - 1;
+    }
+
+    while (buffer->state_valid <= last_line)
+    {
+        int line = buffer->state_valid - 1;
+        uint8_t state = buffer->syntax->lex(lex_text, editor_copy_line(line), buffer->line_state[line], NULL);
+        int next = buffer->state_valid;
+        if (next >= buffer->state_stale_from && next < buffer->state_converge_end && buffer->line_state[next] == state)
+        {
+            buffer->state_valid = buffer->state_converge_end;
+            buffer->state_stale_from = buffer->state_converge_end;
+            continue;
+        }
+        if (buffer->line_state[next] != state)
+        {
+            buffer->line_state[next] = state;
+            editor_damage(next, next);
+        }
+        buffer->state_valid++;
+    }
+}
+
+// Get the end of the text used by the undo log
+static int undo_text_end(void)
+{
+    if (buffer->undo_count == 0)
+    {
+        return 0;
+    }
+    return buffer->undo_log[buffer->undo_count - 1].text + buffer->undo_log[buffer->undo_count - 1].length;
+}
+
+// Forget all undo history
+static void editor_undo_reset(void)
+{
+    buffer->undo_count = 0;
+    buffer->undo_current = 0;
+    buffer->undo_sealed = true;
+}
+
+// Insert text at a text position
+static bool editor_insert_text(int pos, const char *text, int count)
+{
+    if (!editor_reserve(count))
+    {
+        return false; // Buffer full
+    }
+
+    // A newline moves every line below it
+    int line = editor_line_of(pos);
+    editor_damage(line, memchr(text, '\n', count) != NULL ? EDITOR_DAMAGE_END : line);
+
+    editor_move_gap(pos);
+    int added = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (text[i] == '\n')
+        {
+            line_tree_add(buffer->gap_start, 1);
+            buffer->line_total++;
+            added++;
+        }
+        buffer->text[buffer->gap_start++] = text[i];
+    }
+    buffer->length += count;
+    editor_changed(pos, pos + count);
+    editor_states_edit(line, added);
+
+    // Keep the cursors of other windows on the same text
+    for (int i = 0; i < window_count; i++)
+    {
+        editor_window_t *w = &windows[i];
+        if (w != window && w->buffer == buffer && w->cursor > pos)
+        {
+            w->cursor += count;
+        }
+    }
+    return true;
+}
+
+// Delete count characters starting at a text position
+static void editor_delete_text(int pos, int count)
+{
+    int removed = 0;
+
+    // Widen the gap over the characters
+    editor_move_gap(pos + count);
+    for (int i = 0; i < count; i++)
+    {
+        buffer->gap_start--;
+        if (buffer->text[buffer->gap_start] == '\n')
+        {
+            line_tree_add(buffer->gap_start, -1);
+            buffer->line_total--;
+            removed++;
+        }
+    }
+    buffer->length -= count;
+    editor_changed(pos, pos);
+
+    int line = editor_line_of(pos);
+    editor_damage(line, removed > 0 ? EDITOR_DAMAGE_END : line);
+    editor_states_edit(line, -removed);
+
+    for (int i = 0; i < window_count; i++)
+    {
+        editor_window_t *w = &windows[i];
+        if (w != window && w->buffer == buffer && w->cursor > pos)
+        {
+            w->cursor = w->cursor - count > pos ? w->cursor - count : pos;
+        }
+    }
+}
+
+// Drop the oldest half of the undo log to make room
+static void editor_undo_trim(void)
+{
+    int drop = buffer->undo_count > 1 ? buffer->undo_count / 2 : 1;
+    int text_drop = drop < buffer->undo_count ? buffer->undo_log[drop].text : undo_text_end();
+
+    memmove(buffer->undo_log, buffer->undo_log + drop, (buffer->undo_count - drop) * sizeof(editor_edit_t));
+    memmove(buffer->undo_text, buffer->undo_text + text_drop, undo_text_end() - text_drop);
+    buffer->undo_count -= drop;
+    buffer->undo_current = buffer->undo_current > drop ? buffer->undo_current - drop : 0;
+    for (int i = 0; i < buffer->undo_count; i++)
+    {
+        buffer->undo_log[i].text -= text_drop;
+    }
+}
+
+// Record a typed or deleted character, extending the last record when it
+// continues the same run
+static void editor_record(uint8_t type, int pos, char c)
+{
+    // A new edit discards what could be redone
+    buffer->undo_count = buffer->undo_current;
+
+    editor_edit_t *last = buffer->undo_count > 0 ? &buffer->undo_log[buffer->undo_count - 1] : NULL;
+    bool continues = last != NULL && !buffer->undo_sealed && last->type == type &&
+                     (type == EDIT_INSERT ? last->pos + last->length == pos : pos + 1 == last->pos);
+    if (continues && undo_text_end() < EDITOR_UNDO_BYTES)
+    {
+        buffer->undo_text[last->text + last->length++] = c;
+        if (type == EDIT_DELETE)
+        {
+            last->pos = pos;
+        }
+    }
+    else
+    {
+        if (buffer->undo_count == EDITOR_UNDO_RECORDS || undo_text_end() == EDITOR_UNDO_BYTES)
+        {
+            editor_undo_trim();
+        }
+        int text = undo_text_end();
+        editor_edit_t *edit = &buffer->undo_log[buffer->undo_count++];
+        edit->type = type;
+        edit->pos = pos;
+        edit->length = 1;
+        edit->text = text;
+        buffer->undo_text[text] = c;
+    }
+
+    buffer->undo_current = buffer->undo_count;
+
+    // Lines are undone one at a time
+    buffer->undo_sealed = c == '\n';
+}
+
+// Screen rows for text, and the row the separator takes when split
+#define EDITOR_TEXT_TOP 2
+#define EDITOR_TEXT_ROWS 20
+
+// Place the windows on the screen
+static void editor_layout(void)
+{
+    windows[0].top = EDITOR_TEXT_TOP;
+    windows[0].rows = EDITOR_TEXT_ROWS;
+    if (window_count == 2)
+    {
+        // A separator row between the two
+        windows[0].rows = (EDITOR_TEXT_ROWS - 1) / 2;
+        windows[1].top = windows[0].top + windows[0].rows + 1;
+        windows[1].rows = EDITOR_TEXT_ROWS - windows[0].rows - 1;
+    }
+    editor_full_redraw = true;
+}
+
+// Give the current buffer a new, empty region with room for `size`
+// characters, to be read into the end of its gap; false if the arena is
+// full
+static bool editor_buffer_create(int size)
+{
+    int capacity = size + (size / 4 > EDITOR_GROW_MIN ? size / 4 : EDITOR_GROW_MIN);
+    if (capacity > EDITOR_BUFFER_SIZE)
+    {
+        capacity = EDITOR_BUFFER_SIZE;
+    }
+    if (capacity > EDITOR_ARENA_SIZE - arena_used)
+    {
+        capacity = EDITOR_ARENA_SIZE - arena_used;
+    }
+    if (capacity < size || capacity == 0)
+    {
+        return false;
+    }
+
+    buffer->used = true;
+    buffer->text = editor_arena + arena_used;
+    buffer->capacity = capacity;
+    arena_used += capacity;
+    buffer->gap_start = 0;
+    buffer->gap_end = capacity - size;
+    buffer->length = size;
+    buffer->filename[0] = '\0';
+    buffer->modified = false;
+    buffer->saved_cursor = 0;
+    buffer->saved_scroll = 0;
+    buffer->on_disk = false;
+    buffer->dirty_from = 0;
+    buffer->clean_tail = 0;
+    buffer->syntax = NULL;
+    editor_undo_reset();
+    editor_states_reset();
+    line_tree_build();
+    return true;
+}
+
+// Give the current buffer's region back to the arena
+static void editor_buffer_release(void)
+{
+    if (buffer->used)
+    {
+        buffer->used = false;
+        editor_arena_shift(buffer->text + buffer->capacity, -buffer->capacity);
+    }
+}
+
+// Show a buffer in the current window, where that window last left it
+static void editor_show_buffer(editor_buffer_t *b)
+{
+    if (window->buffer->used)
+    {
+        window->buffer->saved_cursor = window->cursor;
+        window->buffer->saved_scroll = window->scroll;
+    }
+    window->buffer = b;
+    buffer = b;
+    window->cursor = b->saved_cursor < b->length ? b->saved_cursor : b->length;
+    window->scroll = b->saved_scroll;
+    editor_window_damage(window, 0, EDITOR_DAMAGE_END);
+    editor_header_damaged = true;
+}
+
+// Name the current buffer; the new name may call for another highlighter
+static void editor_set_filename(const char *filename)
+{
+    if (strcmp(filename, buffer->filename) != 0)
+    {
+        buffer->on_disk = false;
+    }
+
+    int j = 0;
+    while (filename[j] != '\0' && j < 63)
+    {
+        buffer->filename[j] = filename[j];
+        j++;
+    }
+    buffer->filename[j] = '\0';
+    editor_header_damaged = true;
+
+    const syntax_t *syntax = syntax_for_file(buffer->filename);
+    if (syntax != buffer->syntax)
+    {
+        buffer->syntax = syntax;
+        editor_states_reset();
+        editor_damage(0, EDITOR_DAMAGE_END);
+    }
+}
+
+// Function to initialize the editor
+void editor_init(void)
+{
+    arena_used = 0;
+    for (int i = 0; i < EDITOR_MAX_BUFFERS; i++)
+    {
+        buffers[i].used = false;
+    }
+    buffer = &buffers[0];
+    editor_buffer_create(0);
+
+    window_count = 1;
+    window = &windows[0];
+    window->buffer = buffer;
+    window->cursor = 0;
+    window->scroll = 0;
+    window->shown_scroll = -1;
+    window->damage_first = 0;
+    window->damage_last = -1;
+    editor_layout();
+    editor_mode = 0;
+}
+
+// Function to load file content into the current buffer
+bool editor_load_file(const char *filename)
+{
+    // Check if file exists
+    if (!fs_file_exists(filename))
+    {
+        return false;
+    }
+
+    // The file has to fit in the arena once the buffer's old text is gone
+    int size = fs_get_file_size(filename);
+    int room = EDITOR_ARENA_SIZE - arena_used + (buffer->used ? buffer->capacity : 0);
+    if (size < 0 || size > EDITOR_BUFFER_SIZE || size > room)
+    {
+        return false;
+    }
+    int fd = fs_open(filename, FS_O_READ);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    // Read file content straight into the end of a new region, with the
+    // gap before it at the cursor
+    editor_buffer_release();
+    editor_buffer_create(size);
+    int i = fs_read(fd, buffer->text + buffer->gap_end, size);
+    fs_close(fd);
+
+    // Windows showing the buffer start again at the top
+    for (int w = 0; w < window_count; w++)
+    {
+        if (windows[w].buffer == buffer)
+        {
+            windows[w].cursor = 0;
+            windows[w].scroll = 0;
+        }
+    }
+    editor_damage(0, EDITOR_DAMAGE_END);
+    editor_header_damaged = true;
+
+    if (i != size)
+    {
+        // Start empty
+        buffer->gap_end = buffer->capacity;
+        buffer->length = 0;
+        line_tree_build();
+        return false;
+    }
+    line_tree_build();
+    editor_set_filename(filename);
+    editor_mark_clean();
+    return true;
+}
+
+// Show a file in the current window. A file already open is switched to
+// at once; otherwise it is loaded into a free buffer, or a new buffer is
+// started under its name if it does not exist yet.
+bool editor_open_buffer(const char *filename)
+{
+    if (filename[0] == '\0')
+    {
+        return false;
+    }
+    for (int i = 0; i < EDITOR_MAX_BUFFERS; i++)
+    {
+        if (buffers[i].used && strcmp(buffers[i].filename, filename) == 0)
+        {
+            editor_show_buffer(&buffers[i]);
+            return true;
+        }
+    }
+
+    int slot = 0;
+    while (slot < EDITOR_MAX_BUFFERS && buffers[slot].used)
+    {
+        slot++;
+    }
+    if (slot == EDITOR_MAX_BUFFERS)
+    {
+        return false;
+    }
+
+    editor_buffer_t *previous = buffer;
+    buffer = &buffers[slot];
+    if (fs_file_exists(filename) ? !editor_load_file(filename) : !editor_buffer_create(0))
+    {
+        editor_buffer_release();
+        buffer = previous;
+        return false;
+    }
+    editor_set_filename(filename);
+    editor_show_buffer(buffer);
+    return true;
+}
+
+// Show the next open buffer in the current window
+void editor_next_buffer(void)
+{
+    int current = buffer - buffers;
+    for (int i = 1; i < EDITOR_MAX_BUFFERS; i++)
+    {
+        editor_buffer_t *b = &buffers[(current + i) % EDITOR_MAX_BUFFERS];
+        if (b->used)
+        {
+            editor_show_buffer(b);
+            return;
+        }
+    }
+}
+
+// Close the current buffer. Windows showing it move to another open
+// buffer, or to a new empty one if it was the last.
+void editor_close_buffer(void)
+{
+    editor_buffer_t *closed = buffer;
+    editor_buffer_release();
+
+    editor_buffer_t *next = NULL;
+    for (int i = 0; i < EDITOR_MAX_BUFFERS && next == NULL; i++)
+    {
+        if (buffers[i].used)
+        {
+            next = &buffers[i];
+        }
+    }
+    if (next == NULL)
+    {
+        editor_buffer_create(0);
+        next = buffer;
+    }
+
+    editor_window_t *active = window;
+    for (int i = 0; i < window_count; i++)
+    {
+        if (windows[i].buffer == closed)
+        {
+            window = &windows[i];
+            editor_show_buffer(next);
+        }
+    }
+    window = active;
+    buffer = window->buffer;
+}
+
+// Split the screen into two windows on the current buffer, or go back to
+// one window showing the current one
+void editor_split(void)
+{
+    if (window_count == 1)
+    {
+        windows[1] = windows[0];
+        window_count = 2;
+    }
+    else
+    {
+        windows[0] = *window;
+        window = &windows[0];
+        window_count = 1;
+    }
+    editor_layout();
+}
+
+// Move the cursor to the other window
+void editor_other_window(void)
+{
+    if (window_count == 2)
+    {
+        window = window == &windows[0] ? &windows[1] : &windows[0];
+        buffer = window->buffer;
+        editor_header_damaged = true;
+    }
+}
+
+// Check whether any open buffer has unsaved changes
+static bool editor_any_modified(void)
+{
+    for (int i = 0; i < EDITOR_MAX_BUFFERS; i++)
+    {
+        if (buffers[i].used && buffers[i].modified)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Write text [from, to) to the same offsets in a file
+static bool editor_write_range(int fd, int from, int to)
+{
+    int gap = buffer->gap_end - buffer->gap_start;
+    int split = to < buffer->gap_start ? to : buffer->gap_start;
+    if (from < split && fs_pwrite(fd, buffer->text + from, split - from, from) != split - from)
+    {
+        return false;
+    }
+    if (from < buffer->gap_start)
+    {
+        from = buffer->gap_start;
+    }
+    return from >= to || fs_pwrite(fd, buffer->text + from + gap, to - from, from) == to - from;
+}
+
+// Function to save editor content to file. Saving back to the file the
+// text came from writes only from the first change to the last, or to
+// the end if the length changed.
+bool editor_save_file(void)
+{
+    if (buffer->filename[0] == '\0')
+    {
+        return false;
+    }
+
+    // Write everything if the file was changed behind the editor's back
+    file_t *file = buffer->on_disk ? fs_get_file_info(buffer->filename) : NULL;
+    bool partial = file != NULL && (int)file->size == buffer->disk_length &&
+                   fs_get_file_version(buffer->filename) == buffer->disk_version;
+    int fd = fs_open(buffer->filename, partial ? FS_O_WRITE : FS_O_WRITE | FS_O_CREATE | FS_O_TRUNC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    int from = partial ? buffer->dirty_from : 0;
+    int to = buffer->length;
+    if (partial && buffer->length == buffer->disk_length)
+    {
+        to -= buffer->clean_tail;
+    }
+    bool saved = editor_write_range(fd, from, to) &&
+                 (!partial || buffer->length >= buffer->disk_length || fs_ftruncate(fd, buffer->length) == 0);
+    fs_close(fd);
+    if (!saved)
+    {
+        // The file is partly written; the next save writes all of it
+        buffer->on_disk = false;
+        return false;
+    }
+
+    buffer->modified = false;
+    editor_mark_clean();
+    return true;
+}
+
+// Function to save editor content to a new file
+bool editor_save_as(const char *filename)
+{
+    editor_set_filename(filename);
+    return editor_save_file();
+}
+
+// Set the search pattern and build its skip tables. Highlighted matches
+// change, so every row of every window is repainted.
+static void editor_set_pattern(const char *pattern, int length)
+{
+    if (length > EDITOR_SEARCH_MAX)
+    {
+        length = EDITOR_SEARCH_MAX;
+    }
+    memcpy(search_pattern, pattern, length);
+    search_length = length;
+
+    for (int c = 0; c < 256; c++)
+    {
+        search_skip[c] = length;
+        search_skip_back[c] = length;
+    }
+    for (int i = 0; i < length - 1; i++)
+    {
+        search_skip[(uint8_t)pattern[i]] = length - 1 - i;
+    }
+    for (int i = length - 1; i > 0; i--)
+    {
+        search_skip_back[(uint8_t)pattern[i]] = i;
+    }
+    for (int i = 0; i < window_count; i++)
+    {
+        editor_window_damage(&windows[i], 0, EDITOR_DAMAGE_END);
+    }
+}
+
+// Find the pattern in a contiguous run of the buffer
+static const char *editor_bmh(const char *text, const char *end)
+{
+    int m = search_length;
+    if (end - text < m)
+    {
+        return NULL;
+    }
+    const char *last = end - m;
+    for (const char *p = text; p <= last; p += search_skip[(uint8_t)p[m - 1]])
+    {
+        if (p[m - 1] == search_pattern[m - 1] && memcmp(p, search_pattern, m - 1) == 0)
+        {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Check for the pattern at a text position
+static bool editor_match_at(int pos)
+{
+    for (int i = 0; i < search_length; i++)
+    {
+        if (editor_char_at(pos + i) != search_pattern[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Find the first match starting at or after `from` and ending by `to`,
+// or -1. Runs on each side of the gap are scanned directly; only matches
+// that straddle the gap are checked character by character.
+static int editor_find_forward(int from, int to)
+{
+    int m = search_length;
+    int gap = buffer->gap_end - buffer->gap_start;
+    const char *hit;
+    if (m == 0)
+    {
+        return -1;
+    }
 
-// Function to initialize the editor
-void editor_init(void)
+    if (from < buffer->gap_start)
+    {
+        hit = editor_bmh(buffer->text + from, buffer->text + (to < buffer->gap_start ? to : buffer->gap_start));
+        if (hit != NULL)
+        {
+            return hit - buffer->text;
+        }
+        for (int pos = from > buffer->gap_start - m ? from : buffer->gap_start - m + 1; pos < buffer->gap_start && pos + m <= to; pos++)
+        {
+            if (editor_match_at(pos))
+            {
+                return pos;
+            }
+        }
+        from = buffer->gap_start;
+    }
+
+    hit = editor_bmh(buffer->text + from + gap, buffer->text + to + gap);
+    return hit != NULL ? hit - buffer->text - gap : -1;
+}
+
+// Find the last match starting at or before `from`, or -1
+static int editor_find_backward(int from)
 {
-    editor_content[0] = '\0';
-    cursor_pos = 0;
-    editor_length = 0;
-    current_filename[0] = '\0';
-    editor_modified = false;
-    editor_scroll_offset = 0;
-    editor_mode = 0;
+    int m = search_length;
+    if (m == 0)
+    {
+        return -1;
+    }
+
+    int pos = from < buffer->length - m ? from : buffer->length - m;
+    while (pos >= 0)
+    {
+        if (editor_match_at(pos))
+        {
+            return pos;
+        }
+        pos -= search_skip_back[(uint8_t)editor_char_at(pos)];
+    }
+    return -1;
 }
 
-// Function to load file content into editor
-bool editor_load_file(const char *filename)
+// Move the cursor to the next match after it, wrapping at the end
+bool editor_find_next(void)
 {
-    // Check if file exists
-    if (!fs_file_exists(filename))
+    int pos = editor_find_forward(window->cursor + 1, buffer->length);
+    if (pos < 0)
+    {
+        pos = editor_find_forward(0, buffer->length);
+    }
+    if (pos < 0)
     {
         return false;
     }
+    window->cursor = pos;
+    return true;
+}
 
-    // Read file content
-    const char *content = fs_read_file(filename);
-    if (!content)
+// Move the cursor to the previous match before it, wrapping at the start
+bool editor_find_previous(void)
+{
+    int pos = window->cursor > 0 ? editor_find_backward(window->cursor - 1) : -1;
+    if (pos < 0)
+    {
+        pos = editor_find_backward(buffer->length);
+    }
+    if (pos < 0)
     {
         return false;
     }
+    window->cursor = pos;
+    return true;
+}
 
-    // Copy content to editor buffer
-    int i = 0;
-    while (content[i] != '\0' && i < 2047)
+// Replace every match of `find` with `replacement` in one pass over the
+// buffer. Returns the number replaced, or -1 if the result would not fit.
+// Replacing clears the undo history.
+int editor_replace_all(const char *find, const char *replacement)
+{
+    int find_length = strlen(find);
+    int replace_length = strlen(replacement);
+    if (find_length == 0 || find_length > EDITOR_SEARCH_MAX)
     {
-        editor_content[i] = content[i];
-        i++;
+        return -1;
     }
-    editor_content[i] = '\0';
-    editor_length = i;
-    cursor_pos = 0;
+    editor_set_pattern(find, find_length);
 
-    // Update filename
-    int j = 0;
-    while (filename[j] != '\0' && j < 63)
+    // Count first, so a result too big is refused before anything changes
+    int count = 0;
+    for (int pos = editor_find_forward(0, buffer->length); pos >= 0;
+         pos = editor_find_forward(pos + find_length, buffer->length))
     {
-        current_filename[j] = filename[j];
-        j++;
+        count++;
+    }
+    int growth = count * (replace_length - find_length);
+    if (count == 0 || !editor_reserve(growth > 0 ? growth : 0))
+    {
+        return count == 0 ? 0 : -1;
     }
-    current_filename[j] = '\0';
-
-    editor_modified = false;
-    editor_scroll_offset = 0;
 
-    return true;
+    // Put all the text after the gap, then copy it to the front of the
+    // buffer, replacing as it goes. The copy never catches up with the
+    // text still to be read because the result fits in the buffer.
+    editor_move_gap(0);
+    const char *read = buffer->text + buffer->gap_end;
+    const char *end = buffer->text + buffer->capacity;
+    char *write = buffer->text;
+    const char *hit;
+    int first = -1; // Span of the result that was replaced
+    int last = 0;
+    while ((hit = editor_bmh(read, end)) != NULL)
+    {
+        memmove(write, read, hit - read);
+        write += hit - read;
+        first = first < 0 ? write - buffer->text : first;
+        memmove(write, replacement, replace_length);
+        write += replace_length;
+        last = write - buffer->text;
+        read = hit + find_length;
+    }
+    memmove(write, read, end - read);
+    write += end - read;
+
+    buffer->gap_start = write - buffer->text;
+    buffer->gap_end = buffer->capacity;
+    buffer->length = buffer->gap_start;
+    editor_changed(first, last);
+    line_tree_build();
+    editor_undo_reset();
+    editor_states_reset();
+    for (int i = 0; i < window_count; i++)
+    {
+        if (windows[i].buffer == buffer && windows[i].cursor > buffer->length)
+        {
+            windows[i].cursor = buffer->length;
+        }
+    }
+    buffer->modified = true;
+    return count;
 }
 
-// Function to save editor content to file
-bool editor_save_file(void)
+// Handle a key typed at the search prompt. The cursor follows the first
+// match as the query is typed; a longer query resumes from the current
+// match, since any match of it is also a match of what was typed before.
+static void editor_search_input(char c)
 {
-    if (current_filename[0] == '\0')
+    if (c == 27)
     {
-        return false;
+        // Cancel: back to where the search started
+        window->cursor = search_anchor;
+        editor_set_pattern("", 0);
+        editor_mode = 0;
+        return;
     }
 
-    // Create file if it doesn't exist
-    if (!fs_file_exists(current_filename))
+    char *slash = memchr(search_query, '/', search_query_length);
+    if (c == '\n')
     {
-        if (!fs_create_file(current_filename, get_current_username()))
+        editor_mode = 0;
+        if (slash != NULL)
         {
-            return false;
+            search_query[search_query_length] = '\0';
+            *slash = '\0';
+            editor_replace_all(search_query, slash + 1);
+            editor_set_pattern("", 0);
         }
+        return;
     }
 
-    // Write content to file
-    if (!fs_write_file(current_filename, editor_content))
+    if (c == '\b')
     {
-        return false;
+        if (search_query_length == 0)
+        {
+            return;
+        }
+        search_query_length--;
+    }
+    else if (c >= ' ' && c <= '~' && search_query_length < (int)sizeof(search_query) - 1)
+    {
+        search_query[search_query_length++] = c;
+    }
+    else
+    {
+        return;
     }
 
-    editor_modified = false;
-    return true;
-}
-
-// Function to save editor content to a new file
-bool editor_save_as(const char *filename)
-{
-    // Update filename
-    int j = 0;
-    while (filename[j] != '\0' && j < 63)
+    // Only the part before a '/' is searched for
+    slash = memchr(search_query, '/', search_query_length);
+    int length = slash != NULL ? slash - search_query : search_query_length;
+    if (length > EDITOR_SEARCH_MAX)
     {
-        current_filename[j] = filename[j];
-        j++;
+        length = EDITOR_SEARCH_MAX;
+    }
+    if (length == search_length && memcmp(search_query, search_pattern, length) == 0)
+    {
+        return;
     }
-    current_filename[j] = '\0';
 
-    return editor_save_file();
+    bool extended = length > search_length && search_match >= 0;
+    int from = extended ? search_match : search_anchor;
+    editor_set_pattern(search_query, length);
+
+    search_match = editor_find_forward(from, buffer->length);
+    if (search_match < 0 && from > 0)
+    {
+        search_match = editor_find_forward(0, buffer->length);
+    }
+    window->cursor = search_match >= 0 ? search_match : search_anchor;
 }
 
 // Function to insert character at cursor position
 void editor_insert_char(char c)
 {
-    if (editor_length >= 2047)
+    if (!editor_reserve(1))
     {
         return; // Buffer full
     }
 
-    // Make room for the new character
-    for (int i = editor_length; i > cursor_pos; i--)
-    {
-        editor_content[i] = editor_content[i - 1];
-    }
-
-    // Insert character
-    editor_content[cursor_pos] = c;
-    cursor_pos++;
-    editor_length++;
-    editor_content[editor_length] = '\0';
-    editor_modified = true;
+    editor_record(EDIT_INSERT, window->cursor, c);
+    editor_insert_text(window->cursor, &c, 1);
+    window->cursor++;
+    buffer->modified = true;
 }
 
 // Function to delete character before cursor
 void editor_delete_char(void)
 {
-    if (cursor_pos <= 0)
+    if (window->cursor <= 0)
     {
         return; // At beginning of buffer
     }
 
-    // Shift characters
-    for (int i = cursor_pos - 1; i < editor_length - 1; i++)
+    editor_record(EDIT_DELETE, window->cursor - 1, editor_char_at(window->cursor - 1));
+    editor_delete_text(window->cursor - 1, 1);
+    window->cursor--;
+    buffer->modified = true;
+}
+
+// Reverse a run of characters in place
+static void editor_reverse(char *text, int length)
+{
+    for (int i = 0, j = length - 1; i < j; i++, j--)
+    {
+        char c = text[i];
+        text[i] = text[j];
+        text[j] = c;
+    }
+}
+
+// Undo the last edit run; false if there is none
+bool editor_undo(void)
+{
+    if (buffer->undo_current == 0)
+    {
+        return false;
+    }
+
+    editor_edit_t *edit = &buffer->undo_log[--buffer->undo_current];
+    char *text = &buffer->undo_text[edit->text];
+    if (edit->type == EDIT_INSERT)
+    {
+        editor_delete_text(edit->pos, edit->length);
+        window->cursor = edit->pos;
+    }
+    else
+    {
+        editor_reverse(text, edit->length);
+        editor_insert_text(edit->pos, text, edit->length);
+        editor_reverse(text, edit->length);
+        window->cursor = edit->pos + edit->length;
+    }
+    buffer->undo_sealed = true;
+    buffer->modified = true;
+    return true;
+}
+
+// Redo the last undone edit run; false if there is none
+bool editor_redo(void)
+{
+    if (buffer->undo_current == buffer->undo_count)
     {
-        editor_content[i] = editor_content[i + 1];
+        return false;
     }
 
-    cursor_pos--;
-    editor_length--;
-    editor_content[editor_length] = '\0';
-    editor_modified = true;
+    editor_edit_t *edit = &buffer->undo_log[buffer->undo_current++];
+    if (edit->type == EDIT_INSERT)
+    {
+        editor_insert_text(edit->pos, &buffer->undo_text[edit->text], edit->length);
+        window->cursor = edit->pos + edit->length;
+    }
+    else
+    {
+        editor_delete_text(edit->pos, edit->length);
+        window->cursor = edit->pos;
+    }
+    buffer->undo_sealed = true;
+    buffer->modified = true;
+    return true;
 }
 
 // Function to move cursor left
 void editor_move_left(void)
 {
-    if (cursor_pos > 0)
+    if (window->cursor > 0)
     {
-        cursor_pos--;
+        window->cursor--;
     }
 }
 
 // Function to move cursor right
 void editor_move_right(void)
 {
-    if (cursor_pos < editor_length)
+    if (window->cursor < buffer->length)
     {
-        cursor_pos++;
+        window->cursor++;
     }
 }
 
 // Function to move cursor up
 void editor_move_up(void)
 {
-    // Find current line start
-    int line_start = cursor_pos;
-    while (line_start > 0 && editor_content[line_start - 1] != '\n')
-    {
-        line_start--;
-    }
-
-    // Find column position within current line
-    int column = cursor_pos - line_start;
-
-    // Find previous line start
-    int prev_line_start = line_start - 1;
-    while (prev_line_start > 0 && editor_content[prev_line_start - 1] != '\n')
-    {
-        prev_line_start--;
-    }
+    // Find current line and column
+    int line = editor_line_of(window->cursor);
+    int line_start = editor_line_offset(line);
+    int column = window->cursor - line_start;
 
     // If we're already at the first line
-    if (prev_line_start < 0)
+    if (line == 0)
     {
-        cursor_pos = 0;
+        window->cursor = 0;
         return;
     }
 
-    // Find previous line length
+    // Find previous line start and length
+    int prev_line_start = editor_line_offset(line - 1);
     int prev_line_length = line_start - prev_line_start - 1;
 
     // Set new cursor position
-    cursor_pos = prev_line_start + (column < prev_line_length ? column : prev_line_length);
+    window->cursor = prev_line_start + (column < prev_line_length ? column : prev_line_length);
 }
 
 // Function to move cursor down
 void editor_move_down(void)
 {
-    // Find current line start
-    int line_start = cursor_pos;
-    while (line_start > 0 && editor_content[line_start - 1] != '\n')
+    // Find current line and column
+    int line = editor_line_of(window->cursor);
+    int column = window->cursor - editor_line_offset(line);
+
+    if (line == buffer->line_total)
     {
-        line_start--;
+        // We're at the last line already
+        window->cursor = buffer->length;
+        return;
     }
 
-    // Find column position within current line
-    int column = cursor_pos - line_start;
+    // Find next line start and end
+    int next_line_start = editor_line_offset(line + 1);
+    int next_line_end = editor_find_nth_newline(line + 2);
 
-    // Find next line start
-    int next_line_start = cursor_pos;
-    while (next_line_start < editor_length && editor_content[next_line_start] != '\n')
-    {
-        next_line_start++;
-    }
+    // Set new cursor position
+    int next_line_length = next_line_end - next_line_start;
+    window->cursor = next_line_start + (column < next_line_length ? column : next_line_length);
+}
 
-    // Skip the newline character
-    if (next_line_start < editor_length)
+// Handle a key typed at the open prompt
+static void editor_open_input(char c)
+{
+    if (c == 27 || c == '\n')
     {
-        next_line_start++;
+        editor_mode = 0;
+        if (c == '\n')
+        {
+            open_query[open_query_length] = '\0';
+            editor_open_buffer(open_query);
+        }
     }
-    else
+    else if (c == '\b')
     {
-        // We're at the last line already
-        cursor_pos = editor_length;
-        return;
+        if (open_query_length > 0)
+        {
+            open_query_length--;
+        }
     }
-
-    // Find next line end
-    int next_line_end = next_line_start;
-    while (next_line_end < editor_length && editor_content[next_line_end] != '\n')
+    else if (c > ' ' && c <= '~' && open_query_length < (int)sizeof(open_query) - 1)
     {
-        next_line_end++;
+        open_query[open_query_length++] = c;
     }
-
-    // Set new cursor position
-    int next_line_length = next_line_end - next_line_start;
-    cursor_pos = next_line_start + (column < next_line_length ? column : next_line_length);
 }
 
 // Function to handle editor input
 void editor_handle_input(char c)
 {
+    if (editor_mode == 2)
+    {
+        editor_search_input(c);
+        return;
+    }
+    if (editor_mode == 3)
+    {
+        editor_open_input(c);
+        return;
+    }
+
     switch (c)
     {
     case 27:             // ESC
         editor_mode = 0; // Switch to normal mode
+        buffer->undo_sealed = true;
         break;
     case 'i':
         if (editor_mode == 0)
@@ -290,126 +1578,253 @@ void editor_handle_input(char c)
             case 'l':
                 editor_move_right();
                 break;
+            case 'u':
+                editor_undo();
+                break;
+            case '/':
+                // Open the search prompt
+                editor_mode = 2;
+                search_anchor = window->cursor;
+                search_match = -1;
+                search_query_length = 0;
+                editor_set_pattern("", 0);
+                break;
+            case 'n':
+                editor_find_next();
+                break;
+            case 'N':
+                editor_find_previous();
+                break;
             case 'j':
                 editor_move_down();
                 break;
             case 'k':
                 editor_move_up();
                 break;
+            case 'o':
+                // Open the file prompt
+                editor_mode = 3;
+                open_query_length = 0;
+                break;
+            case 'b':
+                editor_next_buffer();
+                break;
+            case 'q':
+                if (!buffer->modified || confirm_action("Close without saving?"))
+                {
+                    editor_close_buffer();
+                }
+                editor_full_redraw = true; // The prompt drew over the text
+                break;
+            case 's':
+                editor_split();
+                break;
+            case 'w':
+                editor_other_window();
+                break;
             }
         }
         break;
     }
 }
 
-// Function to display editor content
-void editor_display(void)
+// Paint one row of the text area with the text line it shows
+static void editor_paint_row(int row, int line)
 {
-    clear_screen();
+    uint8_t number_color = vga_entry_color(VGA_COLOR_CYAN, VGA_COLOR_BLACK);
+    uint8_t content_color = vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK);
+    int y = window->top + row;
+    int x = 0;
 
-    // Calculate visible range
-    int start_line = 0;
-    int line_count = 0;
-    int i = 0;
-
-    // Count lines to find start position with scroll offset
-    while (i < editor_length)
+    int i = editor_line_offset(line);
+    if (i < buffer->length)
     {
-        if (editor_content[i] == '\n')
+        // Display line number
+        char num_buf[12];
+        itoa(line + 1, num_buf, 10);
+        int digits = strlen(num_buf);
+        for (; x < 4; x++)
+        {
+            terminal_putentryat(x < digits ? num_buf[x] : ' ', number_color, x, y);
+        }
+        terminal_putentryat('|', number_color, x++, y);
+
+        // Display line content, colored by the highlighter when its state
+        // at the start of the line is known
+        int line_start = i;
+        int line_end = editor_find_nth_newline(line + 1);
+        int colored = 0;
+        if (buffer->syntax && line < buffer->state_valid)
         {
-            line_count++;
-            if (line_count == editor_scroll_offset)
+            colored = editor_copy_line(line);
+            buffer->syntax->lex(lex_text, colored, buffer->line_state[line], lex_colors);
+        }
+        for (; i < line_end && x < VGA_WIDTH; i++, x++)
+        {
+            uint8_t color = i - line_start < colored ? lex_colors[i - line_start] : content_color;
+            terminal_putentryat(editor_char_at(i), color, x, y);
+        }
+
+        // Highlight search matches
+        uint8_t match_color = vga_entry_color(VGA_COLOR_BLACK, VGA_COLOR_LIGHT_BROWN);
+        for (int pos = editor_find_forward(line_start, line_end); pos >= 0 && 5 + pos - line_start < VGA_WIDTH;
+             pos = editor_find_forward(pos + search_length, line_end))
+        {
+            for (int k = 0; k < search_length && 5 + pos - line_start + k < VGA_WIDTH; k++)
             {
-                start_line = i + 1;
+                terminal_putentryat(editor_char_at(pos + k), match_color, 5 + pos - line_start + k, y);
             }
         }
-        i++;
     }
 
-    // Print header
+    // Blank the rest of the row
+    for (; x < VGA_WIDTH; x++)
+    {
+        terminal_putentryat(' ', content_color, x, y);
+    }
+}
+
+// Paint the header, or the separator below the top window when `row` is
+// not 0, with the name of a buffer
+static void editor_paint_title(int row, editor_buffer_t *b, const char *right)
+{
     terminal_setcolor(vga_entry_color(VGA_COLOR_BLACK, VGA_COLOR_LIGHT_GREY));
     for (int i = 0; i < VGA_WIDTH; i++)
     {
-        terminal_putentryat(' ', terminal_color, i, 0);
+        terminal_putentryat(row == 0 ? ' ' : '-', terminal_color, i, row);
     }
 
-    char header[VGA_WIDTH];
-    if (current_filename[0] != '\0')
+    char title[VGA_WIDTH + 32];
+    strcpy(title, " ");
+    if (b->filename[0] != '\0')
     {
-        strcpy(header, " File: ");
-        strcat(header, current_filename);
+        strcat(title, row == 0 ? "File: " : "");
+        strcat(title, b->filename);
     }
     else
     {
-        strcpy(header, " [New File]");
+        strcat(title, "[New File]");
     }
-
-    if (editor_modified)
+    if (b->modified)
     {
-        strcat(header, " [modified]");
+        strcat(title, " [modified]");
     }
 
-    terminal_row = 0;
+    // Which buffer this is, and the arena space its text takes
+    int number = 1;
+    int open = 0;
+    for (int i = 0; i < EDITOR_MAX_BUFFERS; i++)
+    {
+        if (buffers[i].used)
+        {
+            open++;
+            number += &buffers[i] < b;
+        }
+    }
+    char count[12];
+    strcat(title, " (");
+    strcat(title, itoa(number, count, 10));
+    strcat(title, "/");
+    strcat(title, itoa(open, count, 10));
+    strcat(title, ", ");
+    strcat(title, itoa((b->capacity + 1023) / 1024, count, 10));
+    strcat(title, " KB) ");
+
+    // Leave room for the text on the right
+    int limit = VGA_WIDTH - strlen(right) - 3;
+    if ((int)strlen(title) > limit)
+    {
+        title[limit] = '\0';
+    }
+    terminal_row = row;
     terminal_column = 0;
-    terminal_writestring(header);
-
-    char mode_str[20];
-    strcpy(mode_str, editor_mode == 0 ? "NORMAL" : "INSERT");
-
-    terminal_column = VGA_WIDTH - strlen(mode_str) - 2;
-    terminal_writestring(mode_str);
-
-    // Reset color for content
-    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    terminal_writestring(title);
+    terminal_column = VGA_WIDTH - strlen(right) - 2;
+    terminal_writestring(right);
+}
 
-    // Display content with line numbers
-    int display_row = editor_start_row;
-    int line_num = editor_scroll_offset + 1;
-    terminal_row = display_row;
+// Function to display editor content. Only what changed since the last
+// call is repainted, so typing costs one row of screen writes.
+void editor_display(void)
+{
+    // Scroll so the cursor stays visible
+    int line = editor_line_of(window->cursor);
+    if (line < window->scroll)
+    {
+        window->scroll = line;
+    }
+    else if (line >= window->scroll + window->rows)
+    {
+        window->scroll = line - window->rows + 1;
+    }
+    for (int i = 0; i < window_count; i++)
+    {
+        if (windows[i].scroll != windows[i].shown_scroll)
+        {
+            editor_window_damage(&windows[i], 0, EDITOR_DAMAGE_END);
+        }
+    }
 
-    // Display line numbers and line content
-    i = start_line;
-    while (i < editor_length && display_row < editor_start_row + editor_visible_rows)
+    if (editor_full_redraw)
     {
-        // Display line number
-        terminal_column = 0;
-        char num_buf[8];
-        itoa(line_num, num_buf, 10);
-        terminal_setcolor(vga_entry_color(VGA_COLOR_CYAN, VGA_COLOR_BLACK));
-        for (int j = 0; j < 4; j++)
+        clear_screen();
+        editor_header_damaged = true;
+        for (int i = 0; i < window_count; i++)
         {
-            if (j < strlen(num_buf))
-            {
-                terminal_putentryat(num_buf[j], terminal_color, j, display_row);
-            }
-            else
-            {
-                terminal_putentryat(' ', terminal_color, j, display_row);
-            }
+            editor_window_damage(&windows[i], 0, EDITOR_DAMAGE_END);
         }
-        terminal_putentryat('|', terminal_color, 4, display_row);
+    }
 
-        // Display line content
-        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
-        terminal_column = 5;
-        while (i < editor_length && editor_content[i] != '\n')
+    // Print header, and the separator between windows, which names the
+    // buffer of the top one
+    if (editor_header_damaged || editor_mode != shown_mode || buffer->modified != shown_modified)
+    {
+        editor_paint_title(0, buffer,
+                           editor_mode == 0   ? "NORMAL"
+                           : editor_mode == 1 ? "INSERT"
+                           : editor_mode == 2 ? "SEARCH"
+                                              : "OPEN");
+        if (window_count == 2)
         {
-            if (terminal_column < VGA_WIDTH)
-            {
-                terminal_putentryat(editor_content[i], terminal_color, terminal_column, display_row);
-                terminal_column++;
-            }
-            i++;
+            editor_paint_title(windows[0].top + windows[0].rows, windows[0].buffer, window == &windows[0] ? "^" : "");
         }
+    }
 
-        // Move to next line
-        if (i < editor_length && editor_content[i] == '\n')
+    // Bring the highlighters up to date with the visible lines; lines
+    // whose state changed are damaged in every window showing them, so
+    // this is done for all windows before any is painted
+    editor_window_t *active = window;
+    for (int i = 0; i < window_count; i++)
+    {
+        window = &windows[i];
+        buffer = window->buffer;
+        editor_update_states(window->scroll + window->rows - 1);
+    }
+
+    // Repaint the damaged rows
+    for (int i = 0; i < window_count; i++)
+    {
+        window = &windows[i];
+        buffer = window->buffer;
+        for (int row = 0; row < window->rows; row++)
         {
-            i++; // Skip the newline character
+            int text_line = window->scroll + row;
+            if (text_line >= window->damage_first && text_line <= window->damage_last)
+            {
+                editor_paint_row(row, text_line);
+            }
         }
-        display_row++;
-        line_num++;
+        window->damage_first = 0;
+        window->damage_last = -1;
+        window->shown_scroll = window->scroll;
     }
+    window = active;
+    buffer = window->buffer;
+
+    editor_full_redraw = false;
+    editor_header_damaged = false;
+    shown_mode = editor_mode;
+    shown_modified = buffer->modified;
 
     // Display status line
     terminal_row = VGA_HEIGHT - 1;
@@ -423,30 +1838,14 @@ void editor_display(void)
     char status[VGA_WIDTH];
     strcpy(status, " Ln ");
 
-    // Count current line
-    int cursor_line = 1;
-    for (i = 0; i < cursor_pos; i++)
-    {
-        if (editor_content[i] == '\n')
-        {
-            cursor_line++;
-        }
-    }
-
     char line_buf[10];
-    itoa(cursor_line, line_buf, 10);
+    itoa(line + 1, line_buf, 10);
     strcat(status, line_buf);
 
     strcat(status, ", Col ");
 
     // Count current column
-    int cursor_col = 0;
-    i = cursor_pos;
-    while (i > 0 && editor_content[i - 1] != '\n')
-    {
-        cursor_col++;
-        i--;
-    }
+    int cursor_col = window->cursor - editor_line_offset(line);
 
     char col_buf[10];
     itoa(cursor_col + 1, col_buf, 10);
@@ -455,44 +1854,39 @@ void editor_display(void)
     // Display help hint
     strcat(status, " | Press ESC for normal mode, i for insert mode");
 
-    terminal_column = 0;
-    terminal_writestring(status);
-
-    // Position the cursor
-    int cursor_display_row = editor_start_row;
-    int cursor_display_col = 5 + cursor_col;
-
-    // Find cursor position relative to view
-    i = 0;
-    int line = 0;
-    while (i < cursor_pos)
+    // A prompt replaces it while open
+    int prompt_length = search_query_length < VGA_WIDTH - 16 ? search_query_length : VGA_WIDTH - 16;
+    if (editor_mode == 2)
     {
-        if (editor_content[i] == '\n')
+        strcpy(status, " /");
+        memcpy(status + 2, search_query, prompt_length);
+        status[2 + prompt_length] = '\0';
+        if (search_match < 0 && search_length > 0)
         {
-            line++;
+            strcat(status, "  [not found]");
         }
-        i++;
-    }
-
-    // Adjust cursor display position based on scroll offset
-    cursor_display_row = editor_start_row + (line - editor_scroll_offset);
-
-    // Ensure cursor is visible by scrolling if needed
-    if (cursor_display_row < editor_start_row)
-    {
-        editor_scroll_offset = line;
     }
-    else if (cursor_display_row >= editor_start_row + editor_visible_rows)
+    else if (editor_mode == 3)
     {
-        editor_scroll_offset = line - editor_visible_rows + 1;
+        strcpy(status, " Open: ");
+        memcpy(status + 7, open_query, open_query_length);
+        status[7 + open_query_length] = '\0';
+        prompt_length = 5 + open_query_length;
     }
 
+    terminal_column = 0;
+    terminal_writestring(status);
+
+    // Reset color for content
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+
     // Set cursor position
-    if (cursor_display_row >= editor_start_row &&
-        cursor_display_row < editor_start_row + editor_visible_rows)
+    terminal_row = window->top + (line - window->scroll);
+    terminal_column = 5 + cursor_col;
+    if (editor_mode >= 2)
     {
-        terminal_row = cursor_display_row;
-        terminal_column = cursor_display_col;
+        terminal_row = VGA_HEIGHT - 1;
+        terminal_column = 2 + prompt_length;
     }
 }
 
@@ -528,13 +1922,29 @@ void run_editor(const char *filename)
             continue;
         }
 
+        // Check for Ctrl+Z (undo) and Ctrl+Y (redo)
+        if (c == 26 || c == 25)
+        {
+            if (c == 26)
+            {
+                editor_undo();
+            }
+            else
+            {
+                editor_redo();
+            }
+            editor_display();
+            continue;
+        }
+
         // Check for Ctrl+Q (quit)
         if (c == 17)
         { // Ctrl+Q
-            if (!editor_modified || confirm_action("Quit without saving?"))
+            if (!editor_any_modified() || confirm_action("Quit without saving?"))
             {
                 running = false;
             }
+            editor_full_redraw = true; // The prompt drew over the text
             editor_display();
             continue;
         }
@@ -560,23 +1970,24 @@ void editor_open_file(const char *filename)
 
 bool editor_is_modified(void)
 {
-    return editor_modified;
+    return buffer->modified;
 }
 
 const char *editor_get_filename(void)
 {
-    return current_filename;
+    return buffer->filename;
 }
 
 void editor_set_scroll(int offset)
 {
     if (offset >= 0)
     {
-        editor_scroll_offset = offset;
+        window->scroll = offset;
     }
 }
 
-// Function to search text in editor
+// Function to search text in editor: highlights every match, moves the
+// cursor to the first and returns how many there are
 int editor_search(const char *query)
 {
     if (!query || query[0] == '\0')
@@ -584,44 +1995,26 @@ int editor_search(const char *query)
         return -1;
     }
 
-    // Simple search implementation
     int query_len = strlen(query);
     int match_count = 0;
+    if (query_len > EDITOR_SEARCH_MAX)
+    {
+        return -1;
+    }
+    editor_set_pattern(query, query_len);
 
-    for (int i = 0; i <= editor_length - query_len; i++)
+    for (int pos = editor_find_forward(0, buffer->length); pos >= 0; pos = editor_find_forward(pos + 1, buffer->length))
     {
-        bool match = true;
-        for (int j = 0; j < query_len; j++)
-        {
-            if (editor_content[i + j] != query[j])
-            {
-                match = false;
-                break;
-            }
-        }
+        match_count++;
 
-        if (match)
+        // Set cursor to the first match
+        if (match_count == 1)
         {
-            match_count++;
-
-            // Set cursor to the first match
-            if (match_count == 1)
-            {
-                cursor_pos = i;
+            window->cursor = pos;
 
-                // Adjust scroll to make cursor visible
-                int line = 0;
-                for (int k = 0; k < cursor_pos; k++)
-                {
-                    if (editor_content[k] == '\n')
-                    {
-                        line++;
-                    }
-                }
-
-                // Set scroll position to show the match
-                editor_scroll_offset = line > 5 ? line - 5 : 0;
-            }
+            // Set scroll position to show the match
+            int line = editor_line_of(window->cursor);
+            window->scroll = line > 5 ? line - 5 : 0;
         }
     }
 
@@ -1,176 +1,2191 @@
 #include "fs.h"
 #include "string.h" // For string operations
+#include "user.h"   // For the owner of newly created files
+#include "virtio_blk.h"
+#include "ata.h"
+#include "ramdisk.h"
+#include "bcache.h"
+#include "journal.h"
+#include "crc32c.h" // For data block checksums
+#include "timer.h"  // For scrub timing
+#include "lz.h"     // For compressed files
+#include "utils.h"  // For strcasestr
 #include <stdbool.h>
 
-// Static file system storage
+// Inodes must stay one cache line each
+_Static_assert(sizeof(file_t) == 64, "file_t must be 64 bytes");
+
+// Blocks moved per device request when copying or loading tables
+#define FS_IO_BLOCKS 16
+
+// Readahead window limits, in blocks
+#define FS_RA_MIN_BLOCKS 4
+#define FS_RA_MAX_BLOCKS BCACHE_IO_MAX_BLOCKS
+
+// Decompressed units kept for reads of packed files
+#define FS_CZ_CACHE_UNITS 4
+
+// Compression units after which content that would not pack is taken to
+// be incompressible
+#define FS_CZ_TRIAL_UNITS 2
+
+// Search index: trigrams of file names and content, hashed into buckets
+// that each hold a list of the files containing them
+#define FS_SEARCH_BUCKET_BITS 12
+#define FS_SEARCH_BUCKETS (1 << FS_SEARCH_BUCKET_BITS)
+#define FS_SEARCH_POSTINGS 32768
+#define FS_SEARCH_NONE 0xFFFF
+#define FS_SEARCH_QUERY_TRIGRAMS 8 // Rarest query trigrams intersected
+
+// Name index: open addressing over inode numbers
+#define FS_INDEX_SIZE (FS_MAX_FILES * 2)
+#define FS_INDEX_EMPTY -1
+#define FS_INDEX_DELETED -2
+
+// In-memory inode table, loaded from the mounted volume
 static file_t file_system[FS_MAX_FILES];
+static int inode_count = 0;
 static int file_count = 0;
 static char current_directory[FS_MAX_PATH] = "/";
 
-// Initialize file system
-void fs_init(void)
-{
-    // Clear all file entries
-    for (int i = 0; i < FS_MAX_FILES; i++)
+// Content versions, kept in memory only. Every change takes the next value
+// of the counter, so a file deleted and created again never repeats one.
+static uint32_t file_versions[FS_MAX_FILES];
+static uint32_t version_counter = 0;
+
+// Owner names, referenced from inodes by index
+static char fs_owners[FS_MAX_OWNERS][32];
+static int owner_count = 0;
+
+// Mounted volume
+static blockdev_t *fs_dev = NULL;
+static osfs_superblock_t superblock;
+
+// Data block allocation bitmap (1 bit per block, set = used)
+static uint32_t block_bitmap[OSFS_MAX_DATA_BLOCKS / 32 + 1];
+static int data_blocks = 0;
+static int free_blocks = 0;
+
+// Blocks freed on a journaled volume are clear in the bitmap but held back
+// from the allocator until the transaction freeing them has committed.
+// Reused sooner, they could take new data that a crash would hand back to
+// their old owner when replay restores it. They wait in `pending` until
+// the bitmap change is logged, then in `committing` until the commit.
+static uint32_t pending_bitmap[OSFS_MAX_DATA_BLOCKS / 32 + 1];
+static uint32_t committing_bitmap[OSFS_MAX_DATA_BLOCKS / 32 + 1];
+static int pending_blocks = 0;
+static int committing_blocks = 0;
+
+// Metadata blocks changed since the last flush
+static bool inode_block_dirty[FS_MAX_FILES / OSFS_INODES_PER_BLOCK + 1];
+static bool dir_block_dirty[FS_MAX_FILES / OSFS_DIRENTS_PER_BLOCK + 1];
+static bool bitmap_block_dirty[OSFS_MAX_DATA_BLOCKS / OSFS_BITS_PER_BLOCK + 1];
+static bool owners_dirty = false;
+
+// Filename -> inode hash index
+static int16_t name_index[FS_INDEX_SIZE];
+static int index_deleted = 0;
+
+// Scratch buffers for device I/O
+static uint8_t block_buffer[FS_BLOCK_SIZE];
+static uint8_t io_buffer[FS_IO_BLOCKS * FS_BLOCK_SIZE];
+static char read_buffer[FS_READ_BUFFER_SIZE + 1];
+
+// Readahead state of a sequential reader. Blocks are file-relative.
+typedef struct
+{
+    uint32_t start;      // First block of the current window
+    uint32_t size;       // Blocks in the window, 0 if none
+    uint32_t marker;     // Reading this block starts the next window
+    uint32_t next;       // Block after the previous read
+} fs_readahead_t;
+
+// Open file descriptor
+typedef struct
+{
+    bool used;
+    int inode; // Index into file_system
+    int flags;
+    uint32_t offset;
+    fs_readahead_t ra;
+} fs_fd_t;
+
+static fs_fd_t fd_table[FS_MAX_OPEN_FILES];
+
+// Decompressed unit of a packed file
+typedef struct
+{
+    const file_t *file; // NULL if the slot is empty
+    uint32_t unit;
+    uint8_t data[OSFS_CZ_UNIT];
+} fs_cz_cache_t;
+
+static fs_cz_cache_t cz_cache[FS_CZ_CACHE_UNITS];
+
+// Scratch space for compressed files: a unit table, a unit's content and
+// its compressed form
+static uint16_t cz_table[OSFS_CZ_MAX_UNITS];
+static uint8_t cz_plain[OSFS_CZ_UNIT];
+static uint8_t cz_packed[OSFS_CZ_UNIT];
+static uint8_t cz_source[OSFS_CZ_UNIT];
+
+// Search index posting: a file in a trigram bucket's list, valid while
+// the generation matches the file's
+typedef struct
+{
+    uint16_t inode;
+    uint16_t generation;
+    uint16_t next; // Next posting in the bucket, or FS_SEARCH_NONE
+} fs_posting_t;
+
+static fs_posting_t search_postings[FS_SEARCH_POSTINGS];
+static uint16_t search_head[FS_SEARCH_BUCKETS];
+static uint16_t search_length[FS_SEARCH_BUCKETS]; // Including stale postings
+static uint16_t search_free = FS_SEARCH_NONE;
+static bool search_built = false; // Built on first search
+
+// Per-file index state
+static uint16_t search_generation[FS_MAX_FILES];
+static bool search_unindexed[FS_MAX_FILES]; // Did not fit; always checked
+static int search_unindexed_count = 0;
+static bool search_stale[FS_MAX_FILES];
+static int16_t search_stale_list[FS_MAX_FILES];
+static int search_stale_count = 0;
+
+// Query scratch
+static uint32_t search_seen[FS_SEARCH_BUCKETS / 32];
+static uint16_t search_mark[FS_MAX_FILES];
+static uint8_t search_hits[FS_MAX_FILES];
+static uint16_t search_query = 0;
+static int16_t search_candidates[FS_MAX_FILES];
+
+// Current date for timestamps (in real system, would use actual date)
+static uint16_t fs_today(void)
+{
+    return fs_pack_date(2025, 5, 15);
+}
+
+// Mark an inode's table block for writing
+static void fs_mark_inode_dirty(int inode)
+{
+    inode_block_dirty[inode / OSFS_INODES_PER_BLOCK] = true;
+}
+
+// Mark an inode's directory block for writing
+static void fs_mark_name_dirty(int inode)
+{
+    dir_block_dirty[inode / OSFS_DIRENTS_PER_BLOCK] = true;
+}
+
+// Note that a file's name or content changed: it gets a new version, and
+// is indexed again before the next search
+static void fs_search_stale(int inode)
+{
+    file_versions[inode] = ++version_counter;
+    if (search_built && !search_stale[inode])
+    {
+        search_stale[inode] = true;
+        search_stale_list[search_stale_count++] = inode;
+    }
+}
+
+// Look up (or add) an owner name and return its index
+static uint8_t fs_intern_owner(const char *owner)
+{
+    for (int i = 0; i < owner_count; i++)
+    {
+        if (strcmp(fs_owners[i], owner) == 0)
+        {
+            return i;
+        }
+    }
+
+    if (owner_count >= FS_MAX_OWNERS)
+    {
+        return 0; // Table full - fall back to "system"
+    }
+
+    int len = 0;
+    while (owner[len] != '\0' && len < 31)
+    {
+        fs_owners[owner_count][len] = owner[len];
+        len++;
+    }
+    fs_owners[owner_count][len] = '\0';
+    owners_dirty = true;
+    return owner_count++;
+}
+
+// Find the index slot holding a name, or -1
+static int fs_index_slot(const char *name)
+{
+    uint32_t slot = osfs_name_hash(name) & (FS_INDEX_SIZE - 1);
+
+    for (int probes = 0; probes < FS_INDEX_SIZE; probes++)
+    {
+        int inode = name_index[slot];
+        if (inode == FS_INDEX_EMPTY)
+        {
+            return -1;
+        }
+        if (inode >= 0 && strcmp(file_system[inode].filename, name) == 0)
+        {
+            return slot;
+        }
+        slot = (slot + 1) & (FS_INDEX_SIZE - 1);
+    }
+
+    return -1;
+}
+
+// Find a file's inode number by name, or -1
+static int fs_index_find(const char *name)
+{
+    int slot = fs_index_slot(name);
+    return slot < 0 ? -1 : name_index[slot];
+}
+
+// Add an inode to the name index
+static void fs_index_insert(int inode)
+{
+    uint32_t slot = osfs_name_hash(file_system[inode].filename) & (FS_INDEX_SIZE - 1);
+
+    while (name_index[slot] >= 0)
+    {
+        slot = (slot + 1) & (FS_INDEX_SIZE - 1);
+    }
+
+    if (name_index[slot] == FS_INDEX_DELETED)
+    {
+        index_deleted--;
+    }
+    name_index[slot] = inode;
+}
+
+// Rebuild the name index from the inode table
+static void fs_index_rebuild(void)
+{
+    for (int i = 0; i < FS_INDEX_SIZE; i++)
+    {
+        name_index[i] = FS_INDEX_EMPTY;
+    }
+    index_deleted = 0;
+
+    for (int i = 0; i < inode_count; i++)
+    {
+        if (file_system[i].exists)
+        {
+            fs_index_insert(i);
+        }
+    }
+}
+
+// Remove a name from the index
+static void fs_index_remove(const char *name)
+{
+    int slot = fs_index_slot(name);
+    if (slot < 0)
+    {
+        return;
+    }
+
+    name_index[slot] = FS_INDEX_DELETED;
+    index_deleted++;
+
+    // Too many tombstones make probes long - start over
+    if (index_deleted > FS_INDEX_SIZE / 4)
+    {
+        fs_index_rebuild();
+    }
+}
+
+// Get a word of the bitmap as the allocator sees it: held blocks are used
+static uint32_t fs_bitmap_word(int word)
+{
+    return block_bitmap[word] | pending_bitmap[word] | committing_bitmap[word];
+}
+
+// Check whether a data block is free to allocate
+static bool fs_block_is_free(int block)
+{
+    return (fs_bitmap_word(block >> 5) & (1u << (block & 31))) == 0;
+}
+
+// Mark a run of data blocks as used or free
+static void fs_mark_blocks(int start, int count, bool used)
+{
+    bool hold = !used && journal_active();
+
+    for (int b = start; b < start + count; b++)
+    {
+        if (used)
+        {
+            block_bitmap[b >> 5] |= 1u << (b & 31);
+        }
+        else
+        {
+            block_bitmap[b >> 5] &= ~(1u << (b & 31));
+            if (hold)
+            {
+                pending_bitmap[b >> 5] |= 1u << (b & 31);
+            }
+        }
+    }
+
+    for (int b = start / OSFS_BITS_PER_BLOCK; b <= (start + count - 1) / (int)OSFS_BITS_PER_BLOCK; b++)
+    {
+        bitmap_block_dirty[b] = true;
+    }
+    if (hold)
+    {
+        pending_blocks += count;
+    }
+    else
+    {
+        free_blocks += used ? -count : count;
+    }
+}
+
+// Move blocks whose release is now logged to wait for the commit, or
+// free them outright if `free` is set
+static void fs_release_pending(bool free)
+{
+    if (pending_blocks == 0)
+    {
+        return;
+    }
+
+    if (free)
+    {
+        free_blocks += pending_blocks;
+    }
+    else
+    {
+        for (int w = 0; w <= data_blocks / 32; w++)
+        {
+            committing_bitmap[w] |= pending_bitmap[w];
+        }
+        committing_blocks += pending_blocks;
+    }
+    memset(pending_bitmap, 0, sizeof(pending_bitmap));
+    pending_blocks = 0;
+}
+
+// Hand blocks freed by the committed transaction to the allocator
+static void fs_commit_done(void)
+{
+    if (committing_blocks > 0)
+    {
+        memset(committing_bitmap, 0, sizeof(committing_bitmap));
+        free_blocks += committing_blocks;
+        committing_blocks = 0;
+    }
+}
+
+// Check whether `count` more blocks can be allocated, committing first if
+// blocks waiting for the running transaction would make up the shortfall
+static bool fs_blocks_available(int count)
+{
+    if (count > free_blocks && count <= free_blocks + committing_blocks)
+    {
+        journal_commit();
+    }
+    return count <= free_blocks;
+}
+
+// Find the first free run of `count` blocks. Returns its start, or -1 if
+// there is none, in which case the longest free run is reported instead.
+static int fs_find_free_run(int count, int *longest_start, int *longest_len)
+{
+    int run_start = 0;
+    int run_len = 0;
+    int block = 0;
+
+    *longest_start = -1;
+    *longest_len = 0;
+
+    while (block < data_blocks)
+    {
+        // Skip fully allocated words without testing each bit
+        if ((block & 31) == 0 && fs_bitmap_word(block >> 5) == 0xFFFFFFFF)
+        {
+            run_len = 0;
+            block += 32;
+            continue;
+        }
+
+        if (fs_block_is_free(block))
+        {
+            if (run_len == 0)
+            {
+                run_start = block;
+            }
+            run_len++;
+
+            if (run_len > *longest_len)
+            {
+                *longest_start = run_start;
+                *longest_len = run_len;
+            }
+            if (run_len == count)
+            {
+                return run_start;
+            }
+        }
+        else
+        {
+            run_len = 0;
+        }
+        block++;
+    }
+
+    return -1;
+}
+
+// Number of blocks needed to hold `size` bytes
+static int fs_blocks_needed(uint32_t size)
+{
+    return (size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+}
+
+// Number of blocks currently allocated to a file
+static int fs_file_blocks(const file_t *file)
+{
+    int total = 0;
+    for (int i = 0; i < file->extent_count; i++)
+    {
+        total += file->extents[i].count;
+    }
+    return total;
+}
+
+// Release blocks from the end of a file until `keep` blocks remain
+static void fs_shrink_blocks(file_t *file, int keep)
+{
+    int total = fs_file_blocks(file);
+
+    while (total > keep && file->extent_count > 0)
+    {
+        fs_extent_t *ext = &file->extents[file->extent_count - 1];
+        int drop = total - keep;
+
+        if (drop >= ext->count)
+        {
+            fs_mark_blocks(ext->start, ext->count, false);
+            total -= ext->count;
+            file->extent_count--;
+        }
+        else
+        {
+            fs_mark_blocks(ext->start + ext->count - drop, drop, false);
+            ext->count -= drop;
+            total -= drop;
+        }
+    }
+}
+
+// Record the checksums of data blocks [block, block + count) from their
+// new contents
+static void fs_csum_store(uint32_t block, uint32_t count, const uint8_t *data)
+{
+    while (count > 0 && superblock.csum_blocks > 0)
+    {
+        bcache_buf_t *buf = bcache_get(fs_dev, superblock.csum_start + block / OSFS_CSUMS_PER_BLOCK);
+        if (buf == NULL)
+        {
+            return;
+        }
+
+        uint32_t *csums = (uint32_t *)buf->data;
+        do
+        {
+            csums[block % OSFS_CSUMS_PER_BLOCK] = crc32c(0, data, FS_BLOCK_SIZE);
+            block++;
+            data += FS_BLOCK_SIZE;
+            count--;
+        } while (count > 0 && block % OSFS_CSUMS_PER_BLOCK != 0);
+
+        bcache_mark_dirty(buf);
+        bcache_release(buf);
+    }
+}
+
+// Copy a run of data blocks on the device
+static bool fs_copy_blocks(int from, int to, int count)
+{
+    while (count > 0)
+    {
+        int chunk = count < FS_IO_BLOCKS ? count : FS_IO_BLOCKS;
+        if (!bcache_read(fs_dev, superblock.data_start + from, chunk, io_buffer) ||
+            !bcache_write(fs_dev, superblock.data_start + to, chunk, io_buffer))
+        {
+            return false;
+        }
+        fs_csum_store(to, chunk, io_buffer);
+        from += chunk;
+        to += chunk;
+        count -= chunk;
+    }
+    return true;
+}
+
+// Move a file into a single contiguous run of `want` blocks
+static bool fs_relocate(file_t *file, int want)
+{
+    int longest_start, longest_len;
+    int start = fs_find_free_run(want, &longest_start, &longest_len);
+    if (start < 0)
+    {
+        return false;
+    }
+
+    // Copy existing blocks in file order
+    int dest = start;
+    for (int i = 0; i < file->extent_count; i++)
+    {
+        if (!fs_copy_blocks(file->extents[i].start, dest, file->extents[i].count))
+        {
+            return false;
+        }
+        dest += file->extents[i].count;
+    }
+
+    for (int i = 0; i < file->extent_count; i++)
+    {
+        fs_mark_blocks(file->extents[i].start, file->extents[i].count, false);
+    }
+    fs_mark_blocks(start, want, true);
+    file->extents[0].start = start;
+    file->extents[0].count = want;
+    file->extent_count = 1;
+    return true;
+}
+
+// Grow a file to `want` blocks, preferring to extend its last extent
+static bool fs_grow_blocks(file_t *file, int want)
+{
+    int had = fs_file_blocks(file);
+    int need = want - had;
+
+    if (!fs_blocks_available(need))
+    {
+        return false;
+    }
+
+    // Extend the last extent in place while the following blocks are free
+    if (file->extent_count > 0)
+    {
+        fs_extent_t *ext = &file->extents[file->extent_count - 1];
+        while (need > 0 && ext->start + ext->count < data_blocks &&
+               fs_block_is_free(ext->start + ext->count))
+        {
+            fs_mark_blocks(ext->start + ext->count, 1, true);
+            ext->count++;
+            need--;
+        }
+    }
+
+    // Allocate new extents for the rest
+    while (need > 0)
+    {
+        if (file->extent_count == FS_MAX_EXTENTS)
+        {
+            // Out of extent slots - fall back to one contiguous run
+            if (fs_relocate(file, want))
+            {
+                return true;
+            }
+            fs_shrink_blocks(file, had);
+            return false;
+        }
+
+        int longest_start, longest_len;
+        int start = fs_find_free_run(need, &longest_start, &longest_len);
+        int count = need;
+        if (start < 0)
+        {
+            start = longest_start;
+            count = longest_len;
+        }
+
+        fs_mark_blocks(start, count, true);
+        file->extents[file->extent_count].start = start;
+        file->extents[file->extent_count].count = count;
+        file->extent_count++;
+        need -= count;
+    }
+
+    return true;
+}
+
+// Move bytes between a buffer and a file's data blocks through the buffer
+// cache. Partial blocks are patched in their cached copy.
+static bool fs_transfer(file_t *file, uint32_t offset, uint8_t *buffer, uint32_t len, bool write)
+{
+    uint32_t ext_offset = 0;
+
+    for (int i = 0; i < file->extent_count && len > 0; i++)
+    {
+        uint32_t ext_bytes = file->extents[i].count * FS_BLOCK_SIZE;
+        if (offset < ext_offset + ext_bytes)
+        {
+            uint32_t rel = offset - ext_offset;
+            uint32_t lba = superblock.data_start + file->extents[i].start + rel / FS_BLOCK_SIZE;
+            uint32_t skip = rel % FS_BLOCK_SIZE;
+            uint32_t chunk = ext_bytes - rel;
+            if (chunk > len)
+            {
+                chunk = len;
+            }
+            offset += chunk;
+            len -= chunk;
+
+            while (chunk > 0)
+            {
+                if (skip == 0 && chunk >= FS_BLOCK_SIZE)
+                {
+                    uint32_t count = chunk / FS_BLOCK_SIZE;
+                    bool ok = write ? bcache_write(fs_dev, lba, count, buffer)
+                                    : bcache_read(fs_dev, lba, count, buffer);
+                    if (!ok)
+                    {
+                        return false;
+                    }
+                    if (write)
+                    {
+                        fs_csum_store(lba - superblock.data_start, count, buffer);
+                    }
+                    lba += count;
+                    buffer += count * FS_BLOCK_SIZE;
+                    chunk -= count * FS_BLOCK_SIZE;
+                }
+                else
+                {
+                    uint32_t part = FS_BLOCK_SIZE - skip;
+                    if (part > chunk)
+                    {
+                        part = chunk;
+                    }
+                    bcache_buf_t *buf = bcache_get(fs_dev, lba);
+                    if (buf == NULL)
+                    {
+                        return false;
+                    }
+                    if (write)
+                    {
+                        memcpy(buf->data + skip, buffer, part);
+                        bcache_mark_dirty(buf);
+                        fs_csum_store(lba - superblock.data_start, 1, buf->data);
+                    }
+                    else
+                    {
+                        memcpy(buffer, buf->data + skip, part);
+                    }
+                    bcache_release(buf);
+                    skip = 0;
+                    lba++;
+                    buffer += part;
+                    chunk -= part;
+                }
+            }
+        }
+        ext_offset += ext_bytes;
+    }
+
+    return true;
+}
+
+// Zero a byte range of a file's blocks
+static bool fs_zero_blocks(file_t *file, uint32_t offset, uint32_t len)
+{
+    memset(io_buffer, 0, sizeof(io_buffer));
+
+    while (len > 0)
+    {
+        uint32_t chunk = len < sizeof(io_buffer) ? len : sizeof(io_buffer);
+        if (!fs_transfer(file, offset, io_buffer, chunk, true))
+        {
+            return false;
+        }
+        offset += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+// Resize a file's block allocation to hold `size` bytes
+static bool fs_resize_blocks(file_t *file, uint32_t size)
+{
+    int had = fs_file_blocks(file);
+    int want = fs_blocks_needed(size);
+
+    if (want > had)
+    {
+        return fs_grow_blocks(file, want);
+    }
+    if (want < had)
+    {
+        fs_shrink_blocks(file, want);
+    }
+    return true;
+}
+
+// Number of compression units holding `size` bytes
+static uint32_t fs_cz_units(uint32_t size)
+{
+    return (size + OSFS_CZ_UNIT - 1) / OSFS_CZ_UNIT;
+}
+
+// Content bytes in unit `unit` of a file of `size` bytes
+static uint32_t fs_cz_unit_size(uint32_t size, uint32_t unit)
+{
+    uint32_t start = unit * OSFS_CZ_UNIT;
+    return size - start < OSFS_CZ_UNIT ? size - start : OSFS_CZ_UNIT;
+}
+
+// Drop a file's decompressed units from the cache
+static void fs_cz_forget(const file_t *file)
+{
+    for (int i = 0; i < FS_CZ_CACHE_UNITS; i++)
+    {
+        if (cz_cache[i].file == file)
+        {
+            cz_cache[i].file = NULL;
+        }
+    }
+}
+
+// Get a unit of a packed file, decompressed, through the unit cache
+static const uint8_t *fs_cz_get(file_t *file, uint32_t unit)
+{
+    fs_cz_cache_t *slot = &cz_cache[((file - file_system) * 7 + unit) % FS_CZ_CACHE_UNITS];
+    if (slot->file == file && slot->unit == unit)
+    {
+        return slot->data;
+    }
+
+    if (!fs_transfer(file, 0, (uint8_t *)cz_table, FS_BLOCK_SIZE, false))
+    {
+        return NULL;
+    }
+    uint32_t block = 1;
+    for (uint32_t i = 0; i < unit; i++)
+    {
+        block += fs_blocks_needed(cz_table[i]);
+    }
+
+    uint32_t stored = cz_table[unit];
+    uint32_t size = fs_cz_unit_size(file->size, unit);
+    slot->file = NULL;
+    if (stored == size)
+    {
+        if (!fs_transfer(file, block * FS_BLOCK_SIZE, slot->data, size, false))
+        {
+            return NULL;
+        }
+    }
+    else if (stored > size ||
+             !fs_transfer(file, block * FS_BLOCK_SIZE, cz_packed, stored, false) ||
+             lz_decompress(cz_packed, stored, slot->data, size) != (int)size)
+    {
+        return NULL;
+    }
+
+    slot->file = file;
+    slot->unit = unit;
+    return slot->data;
+}
+
+// Read from a packed file
+static int fs_cz_read(file_t *file, uint32_t offset, uint8_t *buffer, uint32_t count)
+{
+    uint32_t done = 0;
+    while (done < count)
+    {
+        const uint8_t *data = fs_cz_get(file, offset / OSFS_CZ_UNIT);
+        if (data == NULL)
+        {
+            return -1;
+        }
+        uint32_t skip = offset % OSFS_CZ_UNIT;
+        uint32_t part = OSFS_CZ_UNIT - skip < count - done ? OSFS_CZ_UNIT - skip : count - done;
+        memcpy(buffer + done, data + skip, part);
+        offset += part;
+        done += part;
+    }
+    return done;
+}
+
+// Check whether a write of [offset, end) to a packed file can stay packed:
+// it must leave every unit before the last one alone, since only the tail
+// of the unit sequence can change size
+static bool fs_cz_fits(const file_t *file, uint32_t offset, uint32_t end)
+{
+    uint32_t units = fs_cz_units(file->size);
+    uint32_t last = units > 0 ? units - 1 : 0;
+    return offset >= last * OSFS_CZ_UNIT && fs_cz_units(end) <= OSFS_CZ_MAX_UNITS;
+}
+
+// Write to a packed file. The units from the one holding `offset` (or the
+// last one, if the write starts past the end) onward are rebuilt:
+// compressed if that saves a block, raw otherwise.
+static int fs_cz_write(file_t *file, uint32_t offset, const uint8_t *buffer, uint32_t count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    uint32_t end = offset + count;
+    uint32_t size = file->size;
+    uint32_t new_size = end > size ? end : size;
+    uint32_t units = fs_cz_units(size);
+    uint32_t first = units > 0 && size % OSFS_CZ_UNIT != 0 ? units - 1 : units;
+    if (offset / OSFS_CZ_UNIT < first)
+    {
+        first = offset / OSFS_CZ_UNIT;
+    }
+
+    // The part of the old content that the rewrite keeps
+    uint32_t kept = 0;
+    if (first < units)
+    {
+        const uint8_t *data = fs_cz_get(file, first);
+        if (data == NULL)
+        {
+            return -1;
+        }
+        kept = fs_cz_unit_size(size, first);
+        memcpy(cz_plain, data, kept);
+    }
+    fs_cz_forget(file);
+
+    if (fs_file_blocks(file) == 0)
+    {
+        memset(cz_table, 0, FS_BLOCK_SIZE);
+        if (!fs_grow_blocks(file, 1))
+        {
+            return -1;
+        }
+    }
+    else if (!fs_transfer(file, 0, (uint8_t *)cz_table, FS_BLOCK_SIZE, false))
+    {
+        return -1;
+    }
+    uint32_t block = 1;
+    for (uint32_t i = 0; i < first; i++)
+    {
+        block += fs_blocks_needed(cz_table[i]);
+    }
+
+    // Fail up front unless even raw units would fit
+    int worst = block + fs_blocks_needed(new_size - first * OSFS_CZ_UNIT);
+    int had = fs_file_blocks(file);
+    if (worst > had && !fs_blocks_available(worst - had))
+    {
+        return -1;
+    }
+
+    uint32_t unit = first;
+    bool ok = true;
+    for (; unit * OSFS_CZ_UNIT < new_size; unit++)
+    {
+        // Assemble the unit's new content: kept bytes, zero fill, new data
+        uint32_t start = unit * OSFS_CZ_UNIT;
+        uint32_t length = fs_cz_unit_size(new_size, unit);
+        uint32_t old = unit == first ? kept : 0;
+        memset(cz_plain + old, 0, OSFS_CZ_UNIT - old);
+        uint32_t from = offset > start ? offset : start;
+        uint32_t to = end < start + length ? end : start + length;
+        if (from < to)
+        {
+            memcpy(cz_plain + (from - start), buffer + (from - offset), to - from);
+        }
+
+        // Compressed only if it takes fewer blocks than the raw unit
+        uint32_t raw_blocks = fs_blocks_needed(length);
+        uint32_t stored = 0;
+        if (raw_blocks > 1)
+        {
+            stored = lz_compress(cz_plain, length, cz_packed, (raw_blocks - 1) * FS_BLOCK_SIZE);
+        }
+        const uint8_t *data = cz_packed;
+        if (stored == 0)
+        {
+            stored = length;
+            data = cz_plain;
+        }
+        else
+        {
+            memset(cz_packed + stored, 0, fs_blocks_needed(stored) * FS_BLOCK_SIZE - stored);
+        }
+
+        uint32_t blocks = fs_blocks_needed(stored);
+        if ((fs_file_blocks(file) < (int)(block + blocks) && !fs_grow_blocks(file, block + blocks)) ||
+            !fs_transfer(file, block * FS_BLOCK_SIZE, (uint8_t *)data, blocks * FS_BLOCK_SIZE, true))
+        {
+            ok = false;
+            break;
+        }
+        cz_table[unit] = stored;
+        block += blocks;
+    }
+
+    // On failure keep the units that were written; the first one is still
+    // the old unit if nothing was
+    if (!ok && unit == first)
+    {
+        return -1;
+    }
+    if (!ok)
+    {
+        new_size = unit * OSFS_CZ_UNIT;
+    }
+    for (uint32_t i = unit; i < OSFS_CZ_MAX_UNITS; i++)
+    {
+        cz_table[i] = 0;
+    }
+    if (!fs_transfer(file, 0, (uint8_t *)cz_table, FS_BLOCK_SIZE, true))
+    {
+        return -1;
+    }
+    fs_shrink_blocks(file, block);
+    file->size = new_size;
+    return ok ? (int)count : -1;
+}
+
+// Swap a converted copy's blocks into a file, releasing the old ones
+static void fs_cz_adopt(file_t *file, const file_t *copy)
+{
+    fs_cz_forget(file);
+    fs_shrink_blocks(file, 0);
+    file->extent_count = copy->extent_count;
+    memcpy(file->extents, copy->extents, sizeof(file->extents));
+    file->flags = (file->flags & ~FS_FLAG_PACKED) | copy->flags;
+    fs_mark_inode_dirty(file - file_system);
+}
+
+// Pack a plain file if that saves blocks. The packed copy is built in
+// fresh blocks, so the file stays intact if space runs out. Data that
+// does not compress, in a file big enough to have been a fair test, loses
+// its compress flag so it is not tried again on every close.
+static bool fs_cz_pack(file_t *file)
+{
+    file_t copy;
+    memset(&copy, 0, sizeof(copy));
+    copy.flags = FS_FLAG_PACKED;
+
+    uint32_t units = fs_cz_units(file->size);
+    for (uint32_t unit = 0; unit < units && units <= OSFS_CZ_MAX_UNITS; unit++)
+    {
+        uint32_t length = fs_cz_unit_size(file->size, unit);
+        if (!fs_transfer(file, unit * OSFS_CZ_UNIT, cz_source, length, false) ||
+            fs_cz_write(&copy, unit * OSFS_CZ_UNIT, cz_source, length) != (int)length)
+        {
+            fs_shrink_blocks(&copy, 0);
+            return false;
+        }
+    }
+
+    if (units > OSFS_CZ_MAX_UNITS || fs_file_blocks(&copy) >= fs_blocks_needed(file->size))
+    {
+        fs_shrink_blocks(&copy, 0);
+        if (units >= FS_CZ_TRIAL_UNITS)
+        {
+            file->flags &= ~FS_FLAG_COMPRESS;
+            fs_mark_inode_dirty(file - file_system);
+        }
+        return true;
+    }
+
+    fs_cz_adopt(file, &copy);
+    return true;
+}
+
+// Unpack a packed file into plain blocks
+static bool fs_cz_unpack(file_t *file)
+{
+    file_t copy;
+    memset(&copy, 0, sizeof(copy));
+    if (!fs_grow_blocks(&copy, fs_blocks_needed(file->size)))
+    {
+        return false;
+    }
+
+    for (uint32_t unit = 0; unit < fs_cz_units(file->size); unit++)
+    {
+        const uint8_t *data = fs_cz_get(file, unit);
+        if (data == NULL ||
+            !fs_transfer(&copy, unit * OSFS_CZ_UNIT, (uint8_t *)data, fs_cz_unit_size(file->size, unit), true))
+        {
+            fs_shrink_blocks(&copy, 0);
+            return false;
+        }
+    }
+
+    fs_cz_adopt(file, &copy);
+    return true;
+}
+
+// Check whether a new file should be compressed by default: text the
+// system writes a lot of
+static bool fs_cz_default(const char *filename)
+{
+    uint32_t len = strlen(filename);
+    return superblock.version >= 4 && len > 4 &&
+           (strcmp(filename + len - 4, ".txt") == 0 || strcmp(filename + len - 4, ".log") == 0);
+}
+
+// Start reading file blocks [start, start + count) into the buffer cache
+static void fs_prefetch(file_t *file, uint32_t start, uint32_t count)
+{
+    uint32_t pos = 0;
+
+    for (int i = 0; i < file->extent_count && count > 0; i++)
+    {
+        uint32_t ext_count = file->extents[i].count;
+        if (start < pos + ext_count)
+        {
+            uint32_t rel = start - pos;
+            uint32_t n = ext_count - rel < count ? ext_count - rel : count;
+            bcache_prefetch(fs_dev, superblock.data_start + file->extents[i].start + rel, n);
+            start += n;
+            count -= n;
+        }
+        pos += ext_count;
+    }
+}
+
+// Track a read of [offset, offset + count) and prefetch ahead of it. A
+// sequential reader gets a window of blocks past the read; when it reaches
+// the window's marker block the next window, twice as large, is fetched
+// while it still has data to consume. Random access drops the window.
+static void fs_readahead(fs_readahead_t *ra, file_t *file, uint32_t offset, uint32_t count)
+{
+    uint32_t first = offset / FS_BLOCK_SIZE;
+    uint32_t last = (offset + count - 1) / FS_BLOCK_SIZE;
+    uint32_t request = last - first + 1;
+    uint32_t file_blocks = (file->size + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE;
+    bool sequential = first == ra->next || first + 1 == ra->next; // Re-reading the last block counts
+
+    if (ra->size > 0 && first <= ra->marker && ra->marker <= last)
+    {
+        // Reached the marker: fetch the following window now
+        ra->start += ra->size;
+        ra->size = ra->size * 2 < FS_RA_MAX_BLOCKS ? ra->size * 2 : FS_RA_MAX_BLOCKS;
+        ra->marker = ra->start;
+    }
+    else if (ra->size > 0 && sequential && last < ra->start + ra->size)
+    {
+        ra->next = last + 1; // Still inside data already fetched
+        return;
+    }
+    else if (sequential || first == 0)
+    {
+        // New window: this read plus as much again beyond it
+        ra->start = first;
+        ra->size = request * 2 > FS_RA_MIN_BLOCKS ? request * 2 : FS_RA_MIN_BLOCKS;
+        if (ra->size > FS_RA_MAX_BLOCKS)
+        {
+            ra->size = request > FS_RA_MAX_BLOCKS ? request : FS_RA_MAX_BLOCKS;
+        }
+        ra->marker = first + request;
+    }
+    else
+    {
+        ra->size = 0;
+        ra->next = last + 1;
+        return;
+    }
+
+    ra->next = last + 1;
+    if (ra->start < file_blocks)
+    {
+        uint32_t n = file_blocks - ra->start < ra->size ? file_blocks - ra->start : ra->size;
+        fs_prefetch(file, ra->start, n);
+    }
+}
+
+// Read from a file at a byte offset, with readahead if `ra` is given;
+// returns bytes read
+static int fs_read_at(file_t *file, uint32_t offset, void *buffer, uint32_t count, fs_readahead_t *ra)
+{
+    if (offset >= file->size)
+    {
+        return 0;
+    }
+    if (count > file->size - offset)
+    {
+        count = file->size - offset;
+    }
+    if (file->flags & FS_FLAG_PACKED)
+    {
+        return fs_cz_read(file, offset, (uint8_t *)buffer, count);
+    }
+    if (ra != NULL && count > 0)
+    {
+        fs_readahead(ra, file, offset, count);
+    }
+
+    if (!fs_transfer(file, offset, (uint8_t *)buffer, count, false))
+    {
+        return -1;
+    }
+    return count;
+}
+
+// Write to a file at a byte offset, growing it as needed; returns bytes written
+static int fs_write_at(file_t *file, uint32_t offset, const void *buffer, uint32_t count)
+{
+    uint32_t end = offset + count;
+    if (end > FS_MAX_FILE_SIZE || end < offset)
+    {
+        return -1;
+    }
+
+    // Packed files take writes at their tail in place; anything else
+    // unpacks them until they are closed
+    if (file->flags & FS_FLAG_PACKED)
+    {
+        if (fs_cz_fits(file, offset, end))
+        {
+            int done = fs_cz_write(file, offset, (const uint8_t *)buffer, count);
+            file->modified_date = fs_today();
+            fs_mark_inode_dirty(file - file_system);
+            fs_search_stale(file - file_system);
+            return done;
+        }
+        if (!fs_cz_unpack(file))
+        {
+            return -1;
+        }
+    }
+
+    if (end > file->size)
+    {
+        if (!fs_resize_blocks(file, end))
+        {
+            return -1;
+        }
+
+        // Writing past the end leaves a zero-filled gap
+        if (offset > file->size && !fs_zero_blocks(file, file->size, offset - file->size))
+        {
+            return -1;
+        }
+    }
+
+    if (!fs_transfer(file, offset, (uint8_t *)buffer, count, true))
+    {
+        return -1;
+    }
+
+    if (end > file->size)
+    {
+        file->size = end;
+    }
+    file->modified_date = fs_today();
+    fs_mark_inode_dirty(file - file_system);
+    fs_search_stale(file - file_system);
+    return count;
+}
+
+// Check whether a file's content contains `query`, streaming it in chunks
+static bool fs_content_contains(file_t *file, const char *query, bool ignore_case)
+{
+    uint32_t query_len = strlen(query);
+    uint32_t chunk_size = sizeof(io_buffer) - 1;
+    uint32_t offset = 0;
+    fs_readahead_t ra;
+    memset(&ra, 0, sizeof(ra));
+
+    if (query_len == 0 || query_len > chunk_size)
+    {
+        return query_len == 0;
+    }
+
+    while (offset < file->size)
+    {
+        int got = fs_read_at(file, offset, io_buffer, chunk_size, &ra);
+        if (got <= 0)
+        {
+            return false;
+        }
+        io_buffer[got] = '\0';
+
+        const char *text = (const char *)io_buffer;
+        if ((ignore_case ? strcasestr(text, query) : strstr(text, query)) != NULL)
+        {
+            return true;
+        }
+        if (offset + got >= file->size)
+        {
+            break;
+        }
+
+        // Overlap chunks so matches spanning a boundary are found
+        offset += got - (query_len - 1);
+    }
+
+    return false;
+}
+
+// Case-folded byte, so one index serves both search modes
+static inline uint8_t fs_fold(uint8_t c)
+{
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// Bucket of the trigram ending in byte c, given the two bytes before it
+static inline uint32_t fs_trigram_bucket(uint32_t a, uint32_t b, uint32_t c)
+{
+    return ((a << 16 | b << 8 | c) * 2654435761u) >> (32 - FS_SEARCH_BUCKET_BITS);
+}
+
+// Drop postings of replaced content and deleted files
+static void fs_search_compact(void)
+{
+    for (uint32_t b = 0; b < FS_SEARCH_BUCKETS; b++)
+    {
+        uint16_t *link = &search_head[b];
+        while (*link != FS_SEARCH_NONE)
+        {
+            fs_posting_t *p = &search_postings[*link];
+            if (file_system[p->inode].exists && p->generation == search_generation[p->inode])
+            {
+                link = &p->next;
+                continue;
+            }
+            uint16_t dead = *link;
+            *link = p->next;
+            p->next = search_free;
+            search_free = dead;
+            search_length[b]--;
+        }
+    }
+}
+
+// Add a posting for a file to a bucket; false if the pool is exhausted
+static bool fs_search_post(uint32_t bucket, int inode)
+{
+    if (search_free == FS_SEARCH_NONE)
+    {
+        fs_search_compact();
+        if (search_free == FS_SEARCH_NONE)
+        {
+            return false;
+        }
+    }
+
+    uint16_t n = search_free;
+    search_free = search_postings[n].next;
+    search_postings[n].inode = inode;
+    search_postings[n].generation = search_generation[inode];
+    search_postings[n].next = search_head[bucket];
+    search_head[bucket] = n;
+    search_length[bucket]++;
+    return true;
+}
+
+// Add the trigrams of a byte string to the file's bucket set
+static void fs_search_scan(const uint8_t *data, uint32_t len, uint32_t *a, uint32_t *b)
+{
+    for (uint32_t i = 0; i < len; i++)
+    {
+        uint32_t c = fs_fold(data[i]);
+        if (*a != FS_SEARCH_NONE)
+        {
+            uint32_t bucket = fs_trigram_bucket(*a, *b, c);
+            search_seen[bucket / 32] |= 1u << (bucket % 32);
+        }
+        *a = *b;
+        *b = c;
+    }
+}
+
+// (Re)index a file's name and content. Older postings of the file become
+// stale by bumping its generation. A file that does not fit in the pool
+// is left unindexed, and every search checks it directly.
+static void fs_search_index(int inode)
+{
+    file_t *file = &file_system[inode];
+    search_generation[inode]++;
+    if (search_unindexed[inode])
+    {
+        search_unindexed[inode] = false;
+        search_unindexed_count--;
+    }
+    if (!file->exists)
+    {
+        return;
+    }
+
+    // Name and content are indexed as separate strings
+    memset(search_seen, 0, sizeof(search_seen));
+    uint32_t a = FS_SEARCH_NONE, b = FS_SEARCH_NONE;
+    fs_search_scan((const uint8_t *)file->filename, strlen(file->filename), &a, &b);
+    a = b = FS_SEARCH_NONE;
+    for (uint32_t offset = 0; offset < file->size;)
+    {
+        int got = fs_read_at(file, offset, io_buffer, sizeof(io_buffer), NULL);
+        if (got <= 0)
+        {
+            search_unindexed[inode] = true;
+            search_unindexed_count++;
+            return;
+        }
+        fs_search_scan(io_buffer, got, &a, &b);
+        offset += got;
+    }
+
+    for (uint32_t w = 0; w < FS_SEARCH_BUCKETS / 32; w++)
+    {
+        for (uint32_t bits = search_seen[w]; bits != 0; bits &= bits - 1)
+        {
+            if (!fs_search_post(w * 32 + __builtin_ctz(bits), inode))
+            {
+                search_generation[inode]++; // Drop what was posted
+                search_unindexed[inode] = true;
+                search_unindexed_count++;
+                return;
+            }
+        }
+    }
+}
+
+// Bring the index up to date: build it on first use, afterwards reindex
+// only the files changed since the last search
+static void fs_search_refresh(void)
+{
+    if (!search_built)
+    {
+        for (uint32_t b = 0; b < FS_SEARCH_BUCKETS; b++)
+        {
+            search_head[b] = FS_SEARCH_NONE;
+            search_length[b] = 0;
+        }
+        for (uint32_t n = 0; n < FS_SEARCH_POSTINGS; n++)
+        {
+            search_postings[n].next = n + 1 < FS_SEARCH_POSTINGS ? n + 1 : FS_SEARCH_NONE;
+        }
+        search_free = 0;
+        search_stale_count = 0;
+        search_unindexed_count = 0;
+        memset(search_unindexed, 0, sizeof(search_unindexed));
+        memset(search_stale, 0, sizeof(search_stale));
+        for (int i = 0; i < inode_count; i++)
+        {
+            fs_search_index(i);
+        }
+        search_built = true;
+        return;
+    }
+
+    for (int i = 0; i < search_stale_count; i++)
+    {
+        search_stale[search_stale_list[i]] = false;
+        fs_search_index(search_stale_list[i]);
+    }
+    search_stale_count = 0;
+}
+
+// Collect the files that may contain `query`, in inode order: those
+// holding its rarest trigrams, plus unindexed files. Returns the count.
+static int fs_search_candidates(const char *query, int16_t *candidates)
+{
+    uint32_t len = strlen(query);
+    uint32_t buckets[FS_SEARCH_QUERY_TRIGRAMS];
+    int used = 0;
+    int count = 0;
+
+    // The query's distinct trigrams, rarest first
+    for (uint32_t i = 2; i < len; i++)
+    {
+        uint32_t bucket = fs_trigram_bucket(fs_fold(query[i - 2]), fs_fold(query[i - 1]), fs_fold(query[i]));
+        int at = used;
+        for (int j = 0; j < used; j++)
+        {
+            if (buckets[j] == bucket)
+            {
+                at = -1;
+                break;
+            }
+        }
+        if (at < 0)
+        {
+            continue;
+        }
+        while (at > 0 && search_length[buckets[at - 1]] > search_length[bucket])
+        {
+            if (at < FS_SEARCH_QUERY_TRIGRAMS)
+            {
+                buckets[at] = buckets[at - 1];
+            }
+            at--;
+        }
+        if (at < FS_SEARCH_QUERY_TRIGRAMS)
+        {
+            buckets[at] = bucket;
+            if (used < FS_SEARCH_QUERY_TRIGRAMS)
+            {
+                used++;
+            }
+        }
+    }
+
+    // Files in the rarest list, then how many of the other lists each is in
+    if (++search_query == 0)
+    {
+        memset(search_mark, 0, sizeof(search_mark));
+        search_query = 1;
+    }
+    for (uint16_t n = search_head[buckets[0]]; n != FS_SEARCH_NONE; n = search_postings[n].next)
+    {
+        fs_posting_t *p = &search_postings[n];
+        if (file_system[p->inode].exists && p->generation == search_generation[p->inode] &&
+            search_mark[p->inode] != search_query)
+        {
+            search_mark[p->inode] = search_query;
+            search_hits[p->inode] = 1;
+            candidates[count++] = p->inode;
+        }
+    }
+    for (int j = 1; j < used && count > 0; j++)
+    {
+        for (uint16_t n = search_head[buckets[j]]; n != FS_SEARCH_NONE; n = search_postings[n].next)
+        {
+            fs_posting_t *p = &search_postings[n];
+            if (search_mark[p->inode] == search_query && p->generation == search_generation[p->inode] &&
+                search_hits[p->inode] == j)
+            {
+                search_hits[p->inode]++;
+            }
+        }
+    }
+
+    int kept = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (search_hits[candidates[i]] == used)
+        {
+            candidates[kept++] = candidates[i];
+        }
+    }
+    count = kept;
+    for (int i = 0; i < inode_count && search_unindexed_count > 0; i++)
+    {
+        if (search_unindexed[i] && file_system[i].exists)
+        {
+            candidates[count++] = i;
+        }
+    }
+
+    // Insertion sort: candidate sets are small
+    for (int i = 1; i < count; i++)
+    {
+        int16_t c = candidates[i];
+        int j = i;
+        while (j > 0 && candidates[j - 1] > c)
+        {
+            candidates[j] = candidates[j - 1];
+            j--;
+        }
+        candidates[j] = c;
+    }
+    return count;
+}
+
+// Look up an open descriptor, or NULL if it is not valid
+static fs_fd_t *fs_get_fd(int fd)
+{
+    if (fd < 0 || fd >= FS_MAX_OPEN_FILES || !fd_table[fd].used)
+    {
+        return NULL;
+    }
+    return &fd_table[fd];
+}
+
+// Claim a free inode for a new entry; returns its number or -1
+static int fs_alloc_inode(const char *name, const char *owner, int type, int permissions)
+{
+    // Check if we've reached the maximum number of files
+    if (file_count >= inode_count || strlen(name) >= FS_MAX_FILENAME)
+    {
+        return -1;
+    }
+
+    // Check if the name is already taken
+    if (fs_index_find(name) >= 0)
+    {
+        return -1;
+    }
+
+    // Find an empty slot
+    for (int i = 0; i < inode_count; i++)
+    {
+        if (!file_system[i].exists)
+        {
+            strcpy(file_system[i].filename, name);
+            file_system[i].exists = true;
+            file_system[i].size = 0;
+            file_system[i].extent_count = 0;
+            file_system[i].flags = 0;
+            file_system[i].owner = fs_intern_owner(owner);
+
+            // Set current date
+            file_system[i].created_date = fs_today();
+            file_system[i].modified_date = fs_today();
+
+            file_system[i].type = type;
+            file_system[i].permissions = permissions;
+
+            fs_index_insert(i);
+            fs_search_stale(i);
+            fs_mark_inode_dirty(i);
+            fs_mark_name_dirty(i);
+            file_count++;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Write a metadata block through the journal if `logged`, or straight
+// into the buffer cache on a volume without one
+static void fs_write_meta(uint32_t block, const void *data, bool logged)
+{
+    if (!logged || !journal_log(block, data))
+    {
+        bcache_write(fs_dev, block, 1, data);
+    }
+}
+
+// Write every dirty metadata block into the journal or buffer cache
+static void fs_flush_metadata(void)
+{
+    if (fs_dev == NULL)
+    {
+        return;
+    }
+
+    // Keep one update's blocks in one transaction; one that cannot fit in
+    // any is written without the journal
+    uint32_t dirty = owners_dirty ? 1 : 0;
+    for (uint32_t b = 0; b < superblock.bitmap_blocks; b++)
+    {
+        dirty += bitmap_block_dirty[b];
+    }
+    for (uint32_t b = 0; b < superblock.inode_blocks; b++)
+    {
+        dirty += inode_block_dirty[b];
+    }
+    for (uint32_t b = 0; b < superblock.dir_blocks; b++)
+    {
+        dirty += dir_block_dirty[b];
+    }
+    bool logged = journal_reserve(dirty);
+
+    // Blocks freed by this update wait for the transaction it joins. One
+    // written without the journal has no crash guarantee to keep.
+    fs_release_pending(!logged);
+
+    // Bitmap first, so without a journal a crash never leaves blocks
+    // referenced but free
+    for (uint32_t b = 0; b < superblock.bitmap_blocks; b++)
+    {
+        if (bitmap_block_dirty[b])
+        {
+            fs_write_meta(superblock.bitmap_start + b, (uint8_t *)block_bitmap + b * FS_BLOCK_SIZE, logged);
+            bitmap_block_dirty[b] = false;
+        }
+    }
+
+    for (uint32_t b = 0; b < superblock.inode_blocks; b++)
+    {
+        if (!inode_block_dirty[b])
+        {
+            continue;
+        }
+
+        osfs_inode_t *disk = (osfs_inode_t *)block_buffer;
+        memset(block_buffer, 0, FS_BLOCK_SIZE);
+        for (uint32_t j = 0; j < OSFS_INODES_PER_BLOCK; j++)
+        {
+            uint32_t i = b * OSFS_INODES_PER_BLOCK + j;
+            if (i >= (uint32_t)inode_count || !file_system[i].exists)
+            {
+                continue;
+            }
+            disk[j].size = file_system[i].size;
+            disk[j].created_date = file_system[i].created_date;
+            disk[j].modified_date = file_system[i].modified_date;
+            disk[j].type = file_system[i].type;
+            disk[j].permissions = file_system[i].permissions;
+            disk[j].owner = file_system[i].owner;
+            disk[j].flags = OSFS_INODE_USED | file_system[i].flags;
+            disk[j].extent_count = file_system[i].extent_count;
+            memcpy(disk[j].extents, file_system[i].extents, sizeof(disk[j].extents));
+        }
+        fs_write_meta(superblock.inode_start + b, block_buffer, logged);
+        inode_block_dirty[b] = false;
+    }
+
+    for (uint32_t b = 0; b < superblock.dir_blocks; b++)
     {
-        file_system[i].exists = false;
-        file_system[i].size = 0;
-        file_system[i].filename[0] = '\0';
-        file_system[i].content[0] = '\0';
-        file_system[i].owner[0] = '\0';
-        file_system[i].created_date[0] = '\0';
-        file_system[i].modified_date[0] = '\0';
-        file_system[i].type = FS_TYPE_REGULAR;
-        file_system[i].permissions = FS_PERM_READ | FS_PERM_WRITE;
+        if (!dir_block_dirty[b])
+        {
+            continue;
+        }
+
+        osfs_dirent_t *dirent = (osfs_dirent_t *)block_buffer;
+        memset(block_buffer, 0, FS_BLOCK_SIZE);
+        for (uint32_t j = 0; j < OSFS_DIRENTS_PER_BLOCK; j++)
+        {
+            uint32_t i = b * OSFS_DIRENTS_PER_BLOCK + j;
+            if (i >= (uint32_t)inode_count || !file_system[i].exists)
+            {
+                continue;
+            }
+            dirent[j].hash = osfs_name_hash(file_system[i].filename);
+            strcpy(dirent[j].name, file_system[i].filename);
+        }
+        fs_write_meta(superblock.dir_start + b, block_buffer, logged);
+        dir_block_dirty[b] = false;
     }
 
-    file_count = 0;
-    strcpy(current_directory, "/");
+    if (owners_dirty)
+    {
+        memset(block_buffer, 0, FS_BLOCK_SIZE);
+        memcpy(block_buffer, fs_owners, owner_count * sizeof(fs_owners[0]));
+        fs_write_meta(superblock.owner_block, block_buffer, logged);
+        owners_dirty = false;
+    }
 }
 
-// Create a file
-bool fs_create_file(const char *filename, const char *owner)
+// Write the superblock with current counters
+static bool fs_write_superblock(void)
 {
-    // Check if we've reached the maximum number of files
-    if (file_count >= FS_MAX_FILES)
+    superblock.free_blocks = free_blocks + pending_blocks + committing_blocks;
+    superblock.file_count = file_count;
+
+    memset(block_buffer, 0, FS_BLOCK_SIZE);
+    memcpy(block_buffer, &superblock, sizeof(superblock));
+    return journal_log(0, block_buffer) || bcache_write(fs_dev, 0, 1, block_buffer);
+}
+
+// Read the superblock of a device and check it before trusting any of
+// its fields
+static bool fs_read_superblock(blockdev_t *dev, osfs_superblock_t *sb)
+{
+    if (!blockdev_read(dev, 0, 1, block_buffer))
     {
         return false;
     }
+    memcpy(sb, block_buffer, sizeof(*sb));
 
-    // Check if file already exists
-    if (fs_file_exists(filename))
+    // Fields added by later versions read as zero on older volumes
+    if (sb->magic != OSFS_MAGIC || sb->version == 0 || sb->version > OSFS_VERSION ||
+        sb->block_size != FS_BLOCK_SIZE || sb->total_blocks > dev->sector_count ||
+        sb->inode_count > FS_MAX_FILES || sb->data_blocks > OSFS_MAX_DATA_BLOCKS ||
+        sb->data_start + sb->data_blocks > sb->total_blocks)
     {
         return false;
     }
+    if (sb->version < 2)
+    {
+        sb->journal_start = 0;
+        sb->journal_blocks = 0;
+    }
+    if (sb->version < 3)
+    {
+        sb->csum_start = 0;
+        sb->csum_blocks = 0;
+    }
+    if (sb->csum_blocks > 0 && (sb->csum_start + sb->csum_blocks > sb->data_start ||
+                                sb->csum_blocks * OSFS_CSUMS_PER_BLOCK < sb->data_blocks))
+    {
+        return false;
+    }
+    return sb->journal_blocks == 0 ||
+           (sb->journal_start > 0 && sb->journal_blocks >= 3 &&
+            sb->journal_start + sb->journal_blocks <= sb->data_start);
+}
 
-    // Find an empty slot
-    for (int i = 0; i < FS_MAX_FILES; i++)
+// Read a metadata region into memory, FS_IO_BLOCKS at a time
+static bool fs_load_region(blockdev_t *dev, uint32_t start, uint32_t blocks, void *dest)
+{
+    uint8_t *out = (uint8_t *)dest;
+
+    while (blocks > 0)
     {
-        if (!file_system[i].exists)
+        uint32_t chunk = blocks < FS_IO_BLOCKS ? blocks : FS_IO_BLOCKS;
+        if (!blockdev_read(dev, start, chunk, out))
         {
-            strcpy(file_system[i].filename, filename);
-            file_system[i].exists = true;
-            file_system[i].size = 0;
-            file_system[i].content[0] = '\0';
-            strcpy(file_system[i].owner, owner);
+            return false;
+        }
+        start += chunk;
+        out += chunk * FS_BLOCK_SIZE;
+        blocks -= chunk;
+    }
+    return true;
+}
+
+// Initialize file system
+void fs_init(void)
+{
+    // Prefer a persistent disk that already holds a file system, trying
+    // the paravirtual disk before the emulated IDE one
+    blockdev_t *disk = virtio_blk_init();
+    if (disk != NULL && fs_mount(disk))
+    {
+        return;
+    }
 
-            // Set current date (in real system, would use actual date)
-            strcpy(file_system[i].created_date, "2025-05-15");
-            strcpy(file_system[i].modified_date, "2025-05-15");
+    disk = ata_init();
+    if (disk != NULL && fs_mount(disk))
+    {
+        return;
+    }
 
-            file_system[i].type = FS_TYPE_REGULAR;
-            file_system[i].permissions = FS_PERM_READ | FS_PERM_WRITE;
+    // Otherwise run from a freshly formatted RAM disk
+    blockdev_t *ram = ramdisk_init();
+    fs_mkfs(ram, "ramdisk");
+    fs_mount(ram);
+}
 
-            file_count++;
-            return true;
+// Write an empty file system to a block device
+bool fs_mkfs(blockdev_t *dev, const char *label)
+{
+    osfs_superblock_t sb;
+    uint32_t inodes = dev->sector_count / 8;
+    if (inodes > FS_MAX_FILES)
+    {
+        inodes = FS_MAX_FILES;
+    }
+
+    memset(&sb, 0, sizeof(sb));
+    if (osfs_compute_layout(&sb, dev->sector_count, inodes) < 0)
+    {
+        return false;
+    }
+
+    int len = 0;
+    while (label[len] != '\0' && len < (int)sizeof(sb.label) - 1)
+    {
+        sb.label[len] = label[len];
+        len++;
+    }
+
+    // Cached blocks of the old volume are meaningless now
+    bcache_invalidate(dev);
+
+    // Zero every metadata block, then lay down the owner table and superblock
+    memset(io_buffer, 0, sizeof(io_buffer));
+    for (uint32_t b = 1; b < sb.data_start; b += FS_IO_BLOCKS)
+    {
+        uint32_t chunk = sb.data_start - b < FS_IO_BLOCKS ? sb.data_start - b : FS_IO_BLOCKS;
+        if (!blockdev_write(dev, b, chunk, io_buffer))
+        {
+            return false;
         }
     }
 
-    return false;
+    strcpy((char *)io_buffer, "system");
+    if (!blockdev_write(dev, sb.owner_block, 1, io_buffer) || !journal_format(dev, &sb))
+    {
+        return false;
+    }
+
+    memset(io_buffer, 0, FS_BLOCK_SIZE);
+    memcpy(io_buffer, &sb, sizeof(sb));
+    return blockdev_write(dev, 0, 1, io_buffer);
 }
 
-// Delete a file
-bool fs_delete_file(const char *filename)
+// Mount the file system on a block device
+bool fs_mount(blockdev_t *dev)
 {
-    for (int i = 0; i < FS_MAX_FILES; i++)
+    osfs_superblock_t sb;
+
+    // Metadata is loaded straight from the device into the in-memory tables
+    bcache_sync(dev);
+    if (!fs_read_superblock(dev, &sb))
+    {
+        return false;
+    }
+
+    fs_unmount();
+
+    // Bring the metadata up to date with every committed transaction; the
+    // superblock itself may have been among them
+    if (sb.journal_blocks > 0)
+    {
+        journal_set_commit_hook(fs_commit_done);
+        int replayed = journal_open(dev, &sb);
+        if (replayed < 0 || (replayed > 0 && !fs_read_superblock(dev, &sb)))
+        {
+            journal_close();
+            return false;
+        }
+    }
+
+    superblock = sb;
+    inode_count = sb.inode_count;
+    data_blocks = sb.data_blocks;
+
+    // Close every descriptor and forget pending metadata
+    for (int i = 0; i < FS_MAX_OPEN_FILES; i++)
+    {
+        fd_table[i].used = false;
+    }
+    memset(inode_block_dirty, 0, sizeof(inode_block_dirty));
+    memset(dir_block_dirty, 0, sizeof(dir_block_dirty));
+    memset(bitmap_block_dirty, 0, sizeof(bitmap_block_dirty));
+    memset(pending_bitmap, 0, sizeof(pending_bitmap));
+    memset(committing_bitmap, 0, sizeof(committing_bitmap));
+    pending_blocks = 0;
+    committing_blocks = 0;
+
+    // Owner table
+    if (!blockdev_read(dev, sb.owner_block, 1, block_buffer))
+    {
+        return false;
+    }
+    memcpy(fs_owners, block_buffer, sizeof(fs_owners));
+    owners_dirty = false;
+    owner_count = 0;
+    while (owner_count < FS_MAX_OWNERS && fs_owners[owner_count][0] != '\0')
+    {
+        fs_owners[owner_count][31] = '\0';
+        owner_count++;
+    }
+    if (owner_count == 0)
+    {
+        fs_intern_owner("system");
+    }
+
+    // Block bitmap, then count what is free
+    memset(block_bitmap, 0, sizeof(block_bitmap));
+    if (!fs_load_region(dev, sb.bitmap_start, sb.bitmap_blocks, block_bitmap))
+    {
+        return false;
+    }
+    free_blocks = 0;
+    for (int b = 0; b < data_blocks; b++)
+    {
+        if (fs_block_is_free(b))
+        {
+            free_blocks++;
+        }
+    }
+
+    // Inode table and directory, streamed through the I/O buffer
+    file_count = 0;
+    for (uint32_t b = 0; b < sb.inode_blocks; b++)
     {
-        if (file_system[i].exists && strcmp(file_system[i].filename, filename) == 0)
+        if (b % FS_IO_BLOCKS == 0)
         {
-            // Check if it's a system file
-            if (file_system[i].type == FS_TYPE_SYSTEM)
+            uint32_t chunk = sb.inode_blocks - b < FS_IO_BLOCKS ? sb.inode_blocks - b : FS_IO_BLOCKS;
+            if (!blockdev_read(dev, sb.inode_start + b, chunk, io_buffer))
             {
-                // Can't delete system files
                 return false;
             }
+        }
 
-            file_system[i].exists = false;
-            file_count--;
-            return true;
+        osfs_inode_t *disk = (osfs_inode_t *)(io_buffer + (b % FS_IO_BLOCKS) * FS_BLOCK_SIZE);
+        for (uint32_t j = 0; j < OSFS_INODES_PER_BLOCK; j++)
+        {
+            uint32_t i = b * OSFS_INODES_PER_BLOCK + j;
+            if (i >= sb.inode_count)
+            {
+                break;
+            }
+
+            file_t *file = &file_system[i];
+            file->exists = (disk[j].flags & OSFS_INODE_USED) != 0;
+            file->size = disk[j].size;
+            file->created_date = disk[j].created_date;
+            file->modified_date = disk[j].modified_date;
+            file->type = disk[j].type;
+            file->permissions = disk[j].permissions;
+            file->owner = disk[j].owner;
+            file->extent_count = disk[j].extent_count <= FS_MAX_EXTENTS ? disk[j].extent_count : 0;
+            file->flags = disk[j].flags & (FS_FLAG_COMPRESS | FS_FLAG_PACKED);
+            memcpy(file->extents, disk[j].extents, sizeof(file->extents));
+            file->filename[0] = '\0';
+            if (file->exists)
+            {
+                file_count++;
+            }
         }
     }
 
-    return false;
-}
-
-// Write to a file
-bool fs_write_file(const char *filename, const char *content)
-{
-    for (int i = 0; i < FS_MAX_FILES; i++)
+    for (uint32_t b = 0; b < sb.dir_blocks; b++)
     {
-        if (file_system[i].exists && strcmp(file_system[i].filename, filename) == 0)
+        if (b % FS_IO_BLOCKS == 0)
         {
-            // Check write permission
-            if (!(file_system[i].permissions & FS_PERM_WRITE))
+            uint32_t chunk = sb.dir_blocks - b < FS_IO_BLOCKS ? sb.dir_blocks - b : FS_IO_BLOCKS;
+            if (!blockdev_read(dev, sb.dir_start + b, chunk, io_buffer))
             {
                 return false;
             }
+        }
 
-            // Check content length
-            int content_len = strlen(content);
-            if (content_len >= FS_MAX_CONTENT)
+        osfs_dirent_t *dirent = (osfs_dirent_t *)(io_buffer + (b % FS_IO_BLOCKS) * FS_BLOCK_SIZE);
+        for (uint32_t j = 0; j < OSFS_DIRENTS_PER_BLOCK; j++)
+        {
+            uint32_t i = b * OSFS_DIRENTS_PER_BLOCK + j;
+            if (i < sb.inode_count && file_system[i].exists)
             {
-                return false;
+                memcpy(file_system[i].filename, dirent[j].name, FS_MAX_FILENAME);
+                file_system[i].filename[FS_MAX_FILENAME - 1] = '\0';
             }
+        }
+    }
 
-            strcpy(file_system[i].content, content);
-            file_system[i].size = content_len;
+    fs_index_rebuild();
+    strcpy(current_directory, "/");
+    fs_dev = dev;
 
-            // Update modification date (in real system, would use actual date)
-            strcpy(file_system[i].modified_date, "2025-05-15");
+    // Mark the volume in use until it is unmounted cleanly
+    superblock.state = OSFS_STATE_DIRTY;
+    superblock.mount_count++;
+    fs_write_superblock();
+    journal_commit();
 
-            return true;
-        }
+    // A fresh volume gets the standard system files
+    if (file_count == 0)
+    {
+        fs_create_system_files();
     }
 
-    return false;
+    return true;
 }
 
-// Read from a file
-const char *fs_read_file(const char *filename)
+// Write all pending metadata and cached data to the device
+void fs_sync(void)
 {
-    for (int i = 0; i < FS_MAX_FILES; i++)
+    if (fs_dev == NULL)
     {
-        if (file_system[i].exists && strcmp(file_system[i].filename, filename) == 0)
-        {
-            // Check read permission
-            if (!(file_system[i].permissions & FS_PERM_READ))
-            {
-                return "Permission denied";
-            }
+        return;
+    }
 
-            return file_system[i].content;
-        }
+    fs_flush_metadata();
+    fs_write_superblock();
+    journal_commit();
+    bcache_sync(fs_dev);
+}
+
+// Sync and mark the volume cleanly unmounted
+void fs_unmount(void)
+{
+    if (fs_dev == NULL)
+    {
+        return;
     }
 
-    return NULL;
+    // Everything else must be on the device before the clean flag is, and
+    // the journal empty
+    fs_flush_metadata();
+    journal_close();
+    bcache_sync(fs_dev);
+    superblock.state = OSFS_STATE_CLEAN;
+    fs_write_superblock();
+    bcache_sync(fs_dev);
+    bcache_invalidate(fs_dev);
+    fs_dev = NULL;
+
+    for (int i = 0; i < FS_CZ_CACHE_UNITS; i++)
+    {
+        cz_cache[i].file = NULL;
+    }
+    search_built = false;
 }
 
-// Check if a file exists
-bool fs_file_exists(const char *filename)
+// Get the mounted block device
+blockdev_t *fs_get_device(void)
+{
+    return fs_dev;
+}
+
+// Create a file
+bool fs_create_file(const char *filename, const char *owner)
+{
+    int i = fs_alloc_inode(filename, owner, FS_TYPE_REGULAR, FS_PERM_READ | FS_PERM_WRITE);
+    if (i < 0)
+    {
+        return false;
+    }
+    if (fs_cz_default(filename))
+    {
+        file_system[i].flags = FS_FLAG_COMPRESS;
+    }
+
+    fs_flush_metadata();
+    return true;
+}
+
+// Delete a file
+bool fs_delete_file(const char *filename)
 {
-    for (int i = 0; i < FS_MAX_FILES; i++)
+    int i = fs_index_find(filename);
+    if (i < 0)
+    {
+        return false;
+    }
+
+    // Check if it's a system file
+    if (file_system[i].type == FS_TYPE_SYSTEM)
+    {
+        // Can't delete system files
+        return false;
+    }
+
+    // Return the file's data blocks to the pool
+    fs_cz_forget(&file_system[i]);
+    fs_shrink_blocks(&file_system[i], 0);
+
+    // Invalidate descriptors still referring to the file
+    for (int fd = 0; fd < FS_MAX_OPEN_FILES; fd++)
     {
-        if (file_system[i].exists && strcmp(file_system[i].filename, filename) == 0)
+        if (fd_table[fd].used && fd_table[fd].inode == i)
         {
-            return true;
+            fd_table[fd].used = false;
         }
     }
 
-    return false;
+    // Clear the inode before unindexing it: removing a name can rebuild
+    // the index from every inode that still exists
+    fs_search_stale(i);
+    file_system[i].exists = false;
+    fs_index_remove(filename);
+    fs_mark_inode_dirty(i);
+    fs_mark_name_dirty(i);
+    file_count--;
+
+    fs_flush_metadata();
+    return true;
 }
 
-// Get file information
-file_t *fs_get_file_info(const char *filename)
+// Write to a file
+bool fs_write_file(const char *filename, const char *content)
 {
-    for (int i = 0; i < FS_MAX_FILES; i++)
+    file_t *file = fs_get_file_info(filename);
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    // Check write permission
+    if (!(file->permissions & FS_PERM_WRITE))
+    {
+        return false;
+    }
+
+    // Check content length
+    uint32_t content_len = strlen(content);
+    if (content_len > FS_MAX_FILE_SIZE)
     {
-        if (file_system[i].exists && strcmp(file_system[i].filename, filename) == 0)
+        return false;
+    }
+
+    bool ok;
+    if (file->flags & FS_FLAG_PACKED)
+    {
+        // Packed content is replaced as a whole, then packed again below.
+        // The new content goes to fresh blocks, so the file keeps the old
+        // one if space runs out.
+        file_t copy;
+        memset(&copy, 0, sizeof(copy));
+        if (!fs_grow_blocks(&copy, fs_blocks_needed(content_len)) ||
+            !fs_transfer(&copy, 0, (uint8_t *)content, content_len, true))
+        {
+            fs_shrink_blocks(&copy, 0);
+            return false;
+        }
+        fs_cz_adopt(file, &copy);
+        file->size = content_len;
+        ok = true;
+    }
+    else
+    {
+        // Resize the file's block allocation to fit the new content
+        if (!fs_resize_blocks(file, content_len))
         {
-            return &file_system[i];
+            return false;
         }
+
+        file->size = content_len;
+        ok = fs_transfer(file, 0, (uint8_t *)content, content_len, true);
+    }
+    if (ok && (file->flags & FS_FLAG_COMPRESS))
+    {
+        ok = fs_cz_pack(file);
+    }
+
+    // Update modification date
+    file->modified_date = fs_today();
+    fs_mark_inode_dirty(file - file_system);
+    fs_search_stale(file - file_system);
+    fs_flush_metadata();
+
+    return ok;
+}
+
+// Read a whole file into the shared read buffer
+const char *fs_read_file(const char *filename)
+{
+    file_t *file = fs_get_file_info(filename);
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    // Check read permission
+    if (!(file->permissions & FS_PERM_READ))
+    {
+        return "Permission denied";
     }
 
-    return NULL;
+    if (file->size > FS_READ_BUFFER_SIZE)
+    {
+        return NULL; // Too large - use fs_open/fs_read
+    }
+
+    // Readahead queues every extent at once, so fragments load in parallel
+    fs_readahead_t ra;
+    memset(&ra, 0, sizeof(ra));
+    int got = fs_read_at(file, 0, read_buffer, file->size, &ra);
+    if (got < 0)
+    {
+        return NULL;
+    }
+
+    read_buffer[got] = '\0';
+    return read_buffer;
+}
+
+// Check if a file exists
+bool fs_file_exists(const char *filename)
+{
+    return fs_index_find(filename) >= 0;
+}
+
+// Get file information
+file_t *fs_get_file_info(const char *filename)
+{
+    int i = fs_index_find(filename);
+    return i < 0 ? NULL : &file_system[i];
+}
+
+// Get the file in an inode slot
+file_t *fs_get_file_by_index(int index)
+{
+    if (index < 0 || index >= inode_count || !file_system[index].exists)
+    {
+        return NULL;
+    }
+    return &file_system[index];
 }
 
 // List all files
@@ -178,7 +2193,7 @@ void fs_list_files(void)
 {
     int count = 0;
 
-    for (int i = 0; i < FS_MAX_FILES; i++)
+    for (int i = 0; i < inode_count; i++)
     {
         if (file_system[i].exists)
         {
@@ -204,7 +2219,7 @@ void fs_list_files(void)
     printf("%-20s %-6s %-12s %-12s %-5s\n", "Filename", "Size", "Created", "Modified", "Type");
     printf("-------------------------------------------------------------------\n");
 
-    for (int i = 0; i < FS_MAX_FILES; i++)
+    for (int i = 0; i < inode_count; i++)
     {
         if (file_system[i].exists)
         {
@@ -222,11 +2237,15 @@ void fs_list_files(void)
             else if (file_system[i].type == FS_TYPE_SYSTEM)
                 type_char = 'S';
 
+            char created[11], modified[11];
+            fs_format_date(file_system[i].created_date, created);
+            fs_format_date(file_system[i].modified_date, modified);
+
             printf("%-20s %-6d %-12s %-12s %c\n",
                    file_system[i].filename,
                    file_system[i].size,
-                   file_system[i].created_date,
-                   file_system[i].modified_date,
+                   created,
+                   modified,
                    type_char);
         }
     }
@@ -236,36 +2255,19 @@ void fs_list_files(void)
 void fs_create_system_files(void)
 {
     // Create root directory
-    for (int i = 0; i < FS_MAX_FILES; i++)
-    {
-        if (!file_system[i].exists)
-        {
-            strcpy(file_system[i].filename, "/");
-            file_system[i].exists = true;
-            file_system[i].size = 0;
-            strcpy(file_system[i].owner, "system");
-            strcpy(file_system[i].created_date, "2025-05-15");
-            strcpy(file_system[i].modified_date, "2025-05-15");
-            file_system[i].type = FS_TYPE_DIRECTORY;
-            file_system[i].permissions = FS_PERM_READ;
-            file_count++;
-            break;
-        }
-    }
+    fs_alloc_inode("/", "system", FS_TYPE_DIRECTORY, FS_PERM_READ);
 
     // Create system info file
     fs_create_file("system.cfg", "system");
     fs_write_file("system.cfg", "OS: OSIRIS\nVersion: 2.0\nBuild: 2025-05-15\n");
 
     // Set it as a system file
-    for (int i = 0; i < FS_MAX_FILES; i++)
+    file_t *file = fs_get_file_info("system.cfg");
+    if (file != NULL)
     {
-        if (file_system[i].exists && strcmp(file_system[i].filename, "system.cfg") == 0)
-        {
-            file_system[i].type = FS_TYPE_SYSTEM;
-            file_system[i].permissions = FS_PERM_READ | FS_PERM_ADMIN;
-            break;
-        }
+        file->type = FS_TYPE_SYSTEM;
+        file->permissions = FS_PERM_READ | FS_PERM_ADMIN;
+        fs_mark_inode_dirty(file - file_system);
     }
 
     // Create a welcome file
@@ -277,25 +2279,31 @@ void fs_create_system_files(void)
     fs_write_file(".secret", "The key to enlightenment is found in the year the temple was built: osiris1371");
 
     // Set it as a hidden file
-    for (int i = 0; i < FS_MAX_FILES; i++)
+    file = fs_get_file_info(".secret");
+    if (file != NULL)
     {
-        if (file_system[i].exists && strcmp(file_system[i].filename, ".secret") == 0)
-        {
-            file_system[i].type = FS_TYPE_HIDDEN;
-            file_system[i].permissions = FS_PERM_READ | FS_PERM_ADMIN;
-            break;
-        }
+        file->type = FS_TYPE_HIDDEN;
+        file->permissions = FS_PERM_READ | FS_PERM_ADMIN;
+        fs_mark_inode_dirty(file - file_system);
     }
+
+    fs_sync();
 }
 
 // Format file system
 void fs_format(void)
 {
-    // Clear all file entries
-    fs_init();
+    if (fs_dev == NULL)
+    {
+        fs_init();
+        return;
+    }
 
-    // Then create system files
-    fs_create_system_files();
+    // Lay down an empty volume; mounting it recreates the system files
+    blockdev_t *dev = fs_dev;
+    fs_unmount();
+    fs_mkfs(dev, superblock.label);
+    fs_mount(dev);
 }
 
 // Get file count
@@ -307,56 +2315,22 @@ int fs_get_file_count(void)
 // Create directory
 bool fs_create_directory(const char *dirname)
 {
-    // Check if we've reached the maximum number of files
-    if (file_count >= FS_MAX_FILES)
-    {
-        return false;
-    }
-
-    // Check if directory already exists
-    if (fs_file_exists(dirname))
+    // Would use current user
+    if (fs_alloc_inode(dirname, "system", FS_TYPE_DIRECTORY, FS_PERM_READ | FS_PERM_WRITE) < 0)
     {
         return false;
     }
 
-    // Find an empty slot
-    for (int i = 0; i < FS_MAX_FILES; i++)
-    {
-        if (!file_system[i].exists)
-        {
-            strcpy(file_system[i].filename, dirname);
-            file_system[i].exists = true;
-            file_system[i].size = 0;
-            strcpy(file_system[i].owner, "system"); // Would use current user
-            strcpy(file_system[i].created_date, "2025-05-15");
-            strcpy(file_system[i].modified_date, "2025-05-15");
-            file_system[i].type = FS_TYPE_DIRECTORY;
-            file_system[i].permissions = FS_PERM_READ | FS_PERM_WRITE;
-            file_count++;
-            return true;
-        }
-    }
-
-    return false;
+    fs_flush_metadata();
+    return true;
 }
 
 // Set current directory
 bool fs_set_directory(const char *dirname)
 {
     // Check if directory exists
-    bool found = false;
-    for (int i = 0; i < FS_MAX_FILES; i++)
-    {
-        if (file_system[i].exists &&
-            strcmp(file_system[i].filename, dirname) == 0 &&
-            file_system[i].type == FS_TYPE_DIRECTORY)
-        {
-            found = true;
-            break;
-        }
-    }
-
-    if (!found)
+    file_t *dir = fs_get_file_info(dirname);
+    if (dir == NULL || dir->type != FS_TYPE_DIRECTORY)
     {
         return false;
     }
@@ -386,16 +2360,31 @@ bool fs_check_permission(const char *filename, int permission)
 // Set file permissions
 bool fs_set_permission(const char *filename, int permission)
 {
-    for (int i = 0; i < FS_MAX_FILES; i++)
+    file_t *file = fs_get_file_info(filename);
+    if (file == NULL)
     {
-        if (file_system[i].exists && strcmp(file_system[i].filename, filename) == 0)
-        {
-            file_system[i].permissions = permission;
-            return true;
-        }
+        return false;
     }
 
-    return false;
+    file->permissions = permission;
+    fs_mark_inode_dirty(file - file_system);
+    fs_flush_metadata();
+    return true;
+}
+
+// Set file type
+bool fs_set_type(const char *filename, int type)
+{
+    file_t *file = fs_get_file_info(filename);
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    file->type = type;
+    fs_mark_inode_dirty(file - file_system);
+    fs_flush_metadata();
+    return true;
 }
 
 // Get file size
@@ -410,6 +2399,60 @@ int fs_get_file_size(const char *filename)
     return file->size;
 }
 
+// Get a file's content version
+uint32_t fs_get_file_version(const char *filename)
+{
+    file_t *file = fs_get_file_info(filename);
+    if (file == NULL)
+    {
+        return 0;
+    }
+
+    return file_versions[file - file_system];
+}
+
+// Turn compression of a file on or off
+bool fs_set_compression(const char *filename, bool enable)
+{
+    file_t *file = fs_get_file_info(filename);
+    if (file == NULL || file->type == FS_TYPE_DIRECTORY || (enable && superblock.version < 4))
+    {
+        return false;
+    }
+
+    bool ok;
+    if (enable)
+    {
+        file->flags |= FS_FLAG_COMPRESS;
+        ok = (file->flags & FS_FLAG_PACKED) || fs_cz_pack(file);
+    }
+    else
+    {
+        ok = !(file->flags & FS_FLAG_PACKED) || fs_cz_unpack(file);
+        if (ok)
+        {
+            file->flags = 0;
+        }
+    }
+    fs_mark_inode_dirty(file - file_system);
+    fs_flush_metadata();
+
+    // Content that turned out incompressible is left uncompressed
+    return ok && (file->flags & FS_FLAG_COMPRESS) == (enable ? FS_FLAG_COMPRESS : 0);
+}
+
+// Get the number of data blocks a file occupies
+int fs_get_file_blocks(const char *filename)
+{
+    file_t *file = fs_get_file_info(filename);
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    return fs_file_blocks(file);
+}
+
 // Display file browser
 void display_file_browser(void)
 {
@@ -428,16 +2471,33 @@ void display_file_browser(void)
 }
 
 // Search for files
-void fs_search(const char *query)
+void fs_search(const char *query, bool ignore_case)
 {
     bool found = false;
+    int count = 0;
 
     printf("Search results for \"%s\":\n", query);
     printf("%-20s %-6s %-12s %-5s\n", "Filename", "Size", "Modified", "Type");
     printf("---------------------------------------------\n");
 
-    for (int i = 0; i < FS_MAX_FILES; i++)
+    // Only files holding every trigram of the query are checked; queries
+    // too short to have one check every file
+    if (strlen(query) >= 3)
+    {
+        fs_search_refresh();
+        count = fs_search_candidates(query, search_candidates);
+    }
+    else
+    {
+        for (int i = 0; i < inode_count; i++)
+        {
+            search_candidates[count++] = i;
+        }
+    }
+
+    for (int c = 0; c < count; c++)
     {
+        int i = search_candidates[c];
         if (file_system[i].exists)
         {
             // Skip hidden files unless in admin mode
@@ -448,7 +2508,8 @@ void fs_search(const char *query)
             }
 
             // Search in filename
-            if (strstr(file_system[i].filename, query) != NULL)
+            const char *name = file_system[i].filename;
+            if ((ignore_case ? strcasestr(name, query) : strstr(name, query)) != NULL)
             {
                 char type_char = 'F';
                 if (file_system[i].type == FS_TYPE_DIRECTORY)
@@ -456,22 +2517,29 @@ void fs_search(const char *query)
                 else if (file_system[i].type == FS_TYPE_SYSTEM)
                     type_char = 'S';
 
+                char modified[11];
+                fs_format_date(file_system[i].modified_date, modified);
+
                 printf("%-20s %-6d %-12s %c\n",
                        file_system[i].filename,
                        file_system[i].size,
-                       file_system[i].modified_date,
+                       modified,
                        type_char);
 
                 found = true;
             }
 
             // Also search in file content (only for text files)
-            else if (file_system[i].type == FS_TYPE_REGULAR && strstr(file_system[i].content, query) != NULL)
+            else if (file_system[i].type == FS_TYPE_REGULAR &&
+                     fs_content_contains(&file_system[i], query, ignore_case))
             {
+                char modified[11];
+                fs_format_date(file_system[i].modified_date, modified);
+
                 printf("%-20s %-6d %-12s F (content match)\n",
                        file_system[i].filename,
                        file_system[i].size,
-                       file_system[i].modified_date);
+                       modified);
 
                 found = true;
             }
@@ -482,4 +2550,387 @@ void fs_search(const char *query)
     {
         printf("No files found matching \"%s\"\n", query);
     }
-}
\ No newline at end of file
+}
+
+// Get the owner name of a file
+const char *fs_get_file_owner(const file_t *file)
+{
+    if (file->owner >= owner_count)
+    {
+        return fs_owners[0];
+    }
+    return fs_owners[file->owner];
+}
+
+// Pack a date as (year - 1980) << 9 | month << 5 | day
+uint16_t fs_pack_date(int year, int month, int day)
+{
+    return (uint16_t)(((year - 1980) << 9) | (month << 5) | day);
+}
+
+// Format a packed date as yyyy-mm-dd
+void fs_format_date(uint16_t date, char *buffer)
+{
+    int year = (date >> 9) + 1980;
+    int month = (date >> 5) & 0x0F;
+    int day = date & 0x1F;
+
+    buffer[0] = '0' + (year / 1000) % 10;
+    buffer[1] = '0' + (year / 100) % 10;
+    buffer[2] = '0' + (year / 10) % 10;
+    buffer[3] = '0' + year % 10;
+    buffer[4] = '-';
+    buffer[5] = '0' + month / 10;
+    buffer[6] = '0' + month % 10;
+    buffer[7] = '-';
+    buffer[8] = '0' + day / 10;
+    buffer[9] = '0' + day % 10;
+    buffer[10] = '\0';
+}
+
+// Get the number of free data blocks
+int fs_get_free_blocks(void)
+{
+    return free_blocks;
+}
+
+// Get the recorded checksum of a data block, or 0
+static uint32_t fs_csum_load(uint32_t block)
+{
+    bcache_buf_t *buf = bcache_get(fs_dev, superblock.csum_start + block / OSFS_CSUMS_PER_BLOCK);
+    if (buf == NULL)
+    {
+        return 0;
+    }
+    uint32_t csum = ((uint32_t *)buf->data)[block % OSFS_CSUMS_PER_BLOCK];
+    bcache_release(buf);
+    return csum;
+}
+
+// Verify every file's blocks against their checksums
+bool fs_scrub(fs_scrub_result_t *result, void (*report)(const char *filename, uint32_t bad_blocks))
+{
+    memset(result, 0, sizeof(*result));
+    if (fs_dev == NULL || superblock.csum_blocks == 0)
+    {
+        return false;
+    }
+
+    // Check what is on the device rather than in the cache
+    fs_sync();
+    uint32_t started = timer_ms();
+
+    for (int i = 0; i < inode_count; i++)
+    {
+        file_t *file = &file_system[i];
+        if (!file->exists)
+        {
+            continue;
+        }
+
+        uint32_t bad = 0;
+        uint32_t left = fs_blocks_needed(file->size);
+        for (int e = 0; e < file->extent_count && left > 0; e++)
+        {
+            uint32_t block = file->extents[e].start;
+            uint32_t count = file->extents[e].count < left ? file->extents[e].count : left;
+            left -= count;
+
+            while (count > 0)
+            {
+                uint32_t chunk = count < FS_IO_BLOCKS ? count : FS_IO_BLOCKS;
+                result->blocks += chunk;
+                if (!blockdev_read(fs_dev, superblock.data_start + block, chunk, io_buffer))
+                {
+                    bad += chunk;
+                }
+                else
+                {
+                    for (uint32_t k = 0; k < chunk; k++)
+                    {
+                        uint32_t expected = fs_csum_load(block + k);
+                        if (expected == 0)
+                        {
+                            result->unchecked++;
+                        }
+                        else if (crc32c(0, io_buffer + k * FS_BLOCK_SIZE, FS_BLOCK_SIZE) != expected)
+                        {
+                            bad++;
+                        }
+                    }
+                }
+                block += chunk;
+                count -= chunk;
+            }
+        }
+
+        result->files++;
+        if (bad > 0)
+        {
+            result->bad_blocks += bad;
+            result->bad_files++;
+            if (report != NULL)
+            {
+                report(file->filename, bad);
+            }
+        }
+    }
+
+    result->elapsed_ms = timer_ms() - started;
+    return true;
+}
+
+// Open a file and return a descriptor
+int fs_open(const char *filename, int flags)
+{
+    file_t *file = fs_get_file_info(filename);
+
+    if (file == NULL)
+    {
+        if (!(flags & FS_O_CREATE) || !fs_create_file(filename, get_current_username()))
+        {
+            return -1;
+        }
+        file = fs_get_file_info(filename);
+    }
+
+    if (file->type == FS_TYPE_DIRECTORY)
+    {
+        return -1;
+    }
+
+    // Check access against the file's permissions
+    if (((flags & FS_O_READ) && !(file->permissions & FS_PERM_READ)) ||
+        ((flags & (FS_O_WRITE | FS_O_APPEND | FS_O_TRUNC)) && !(file->permissions & FS_PERM_WRITE)))
+    {
+        return -1;
+    }
+
+    for (int fd = 0; fd < FS_MAX_OPEN_FILES; fd++)
+    {
+        if (!fd_table[fd].used)
+        {
+            if (flags & FS_O_TRUNC)
+            {
+                fs_cz_forget(file);
+                fs_shrink_blocks(file, 0);
+                file->size = 0;
+                file->flags &= ~FS_FLAG_PACKED;
+                file->modified_date = fs_today();
+                fs_mark_inode_dirty(file - file_system);
+                fs_search_stale(file - file_system);
+                fs_flush_metadata();
+            }
+
+            fd_table[fd].used = true;
+            fd_table[fd].inode = file - file_system;
+            fd_table[fd].flags = flags;
+            fd_table[fd].offset = 0;
+            memset(&fd_table[fd].ra, 0, sizeof(fd_table[fd].ra));
+            return fd;
+        }
+    }
+
+    return -1; // Descriptor table full
+}
+
+// Close a file descriptor
+int fs_close(int fd)
+{
+    fs_fd_t *desc = fs_get_fd(fd);
+    if (desc == NULL)
+    {
+        return -1;
+    }
+
+    desc->used = false;
+
+    // Compressed files are written plain until they have enough content
+    // to pack, and unpacked by updates in their middle; pack them now
+    file_t *file = &file_system[desc->inode];
+    if ((desc->flags & (FS_O_WRITE | FS_O_APPEND)) &&
+        (file->flags & (FS_FLAG_COMPRESS | FS_FLAG_PACKED)) == FS_FLAG_COMPRESS)
+    {
+        fs_cz_pack(file);
+        fs_flush_metadata();
+    }
+    return 0;
+}
+
+// Write a file's data and all metadata to the device
+int fs_fsync(int fd)
+{
+    fs_fd_t *desc = fs_get_fd(fd);
+    if (desc == NULL || fs_dev == NULL)
+    {
+        return -1;
+    }
+
+    file_t *file = &file_system[desc->inode];
+    bool ok = true;
+    for (int i = 0; i < file->extent_count; i++)
+    {
+        ok = bcache_sync_range(fs_dev, superblock.data_start + file->extents[i].start,
+                               file->extents[i].count) && ok;
+    }
+
+    // Metadata is durable once committed to the journal; without one it
+    // must reach its home blocks below the data area
+    fs_flush_metadata();
+    fs_write_superblock();
+    if (journal_active())
+    {
+        ok = journal_commit() && ok;
+    }
+    else
+    {
+        ok = bcache_sync_range(fs_dev, 0, superblock.data_start) && ok;
+    }
+    return ok ? 0 : -1;
+}
+
+// Read at the descriptor's offset
+int fs_read(int fd, void *buffer, uint32_t count)
+{
+    fs_fd_t *desc = fs_get_fd(fd);
+    if (desc == NULL || !(desc->flags & FS_O_READ))
+    {
+        return -1;
+    }
+
+    int done = fs_read_at(&file_system[desc->inode], desc->offset, buffer, count, &desc->ra);
+    if (done > 0)
+    {
+        desc->offset += done;
+    }
+    return done;
+}
+
+// Write at the descriptor's offset
+int fs_write(int fd, const void *buffer, uint32_t count)
+{
+    fs_fd_t *desc = fs_get_fd(fd);
+    if (desc == NULL || !(desc->flags & (FS_O_WRITE | FS_O_APPEND)))
+    {
+        return -1;
+    }
+
+    file_t *file = &file_system[desc->inode];
+    if (desc->flags & FS_O_APPEND)
+    {
+        desc->offset = file->size;
+    }
+
+    int done = fs_write_at(file, desc->offset, buffer, count);
+    if (done > 0)
+    {
+        desc->offset += done;
+    }
+    fs_flush_metadata();
+    return done;
+}
+
+// Read at an explicit offset
+int fs_pread(int fd, void *buffer, uint32_t count, uint32_t offset)
+{
+    fs_fd_t *desc = fs_get_fd(fd);
+    if (desc == NULL || !(desc->flags & FS_O_READ))
+    {
+        return -1;
+    }
+
+    return fs_read_at(&file_system[desc->inode], offset, buffer, count, &desc->ra);
+}
+
+// Write at an explicit offset
+int fs_pwrite(int fd, const void *buffer, uint32_t count, uint32_t offset)
+{
+    fs_fd_t *desc = fs_get_fd(fd);
+    if (desc == NULL || !(desc->flags & FS_O_WRITE))
+    {
+        return -1;
+    }
+
+    int done = fs_write_at(&file_system[desc->inode], offset, buffer, count);
+    fs_flush_metadata();
+    return done;
+}
+
+// Cut a file to `size` bytes, or extend it with zeros
+int fs_ftruncate(int fd, uint32_t size)
+{
+    fs_fd_t *desc = fs_get_fd(fd);
+    if (desc == NULL || !(desc->flags & FS_O_WRITE) || size > FS_MAX_FILE_SIZE)
+    {
+        return -1;
+    }
+
+    file_t *file = &file_system[desc->inode];
+    if (size == file->size)
+    {
+        return 0;
+    }
+    if ((file->flags & FS_FLAG_PACKED) && !fs_cz_unpack(file))
+    {
+        return -1;
+    }
+
+    if (!fs_resize_blocks(file, size) || (size > file->size && !fs_zero_blocks(file, file->size, size - file->size)))
+    {
+        return -1;
+    }
+    file->size = size;
+    file->modified_date = fs_today();
+    fs_mark_inode_dirty(file - file_system);
+    fs_search_stale(file - file_system);
+    fs_flush_metadata();
+    return 0;
+}
+
+// Move the descriptor's offset
+int fs_lseek(int fd, int offset, int whence)
+{
+    fs_fd_t *desc = fs_get_fd(fd);
+    if (desc == NULL)
+    {
+        return -1;
+    }
+
+    int base;
+    switch (whence)
+    {
+    case FS_SEEK_SET:
+        base = 0;
+        break;
+    case FS_SEEK_CUR:
+        base = desc->offset;
+        break;
+    case FS_SEEK_END:
+        base = file_system[desc->inode].size;
+        break;
+    default:
+        return -1;
+    }
+
+    if (base + offset < 0)
+    {
+        return -1;
+    }
+
+    desc->offset = base + offset;
+    return desc->offset;
+}
+
+// Append bytes to the end of a file
+int fs_append(const char *filename, const void *data, uint32_t count)
+{
+    int fd = fs_open(filename, FS_O_APPEND | FS_O_CREATE);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    int done = fs_write(fd, data, count);
+    fs_close(fd);
+    return done;
+}
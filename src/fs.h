@@ -2,12 +2,41 @@
 #define FS_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "blockdev.h"
+#include "fs_layout.h"
 
 // File system limits
-#define FS_MAX_FILES 32
-#define FS_MAX_FILENAME 32
-#define FS_MAX_CONTENT 2048
+#define FS_MAX_FILES 2048
+#define FS_MAX_FILENAME OSFS_MAX_NAME
 #define FS_MAX_PATH 64
+#define FS_MAX_OWNERS OSFS_MAX_OWNERS
+
+// Data blocks - file content is stored on the mounted block device
+#define FS_BLOCK_SIZE OSFS_BLOCK_SIZE
+#define FS_MAX_BLOCKS OSFS_MAX_DATA_BLOCKS
+#define FS_MAX_EXTENTS OSFS_INODE_EXTENTS // Extents held directly in each inode
+#define FS_MAX_FILE_SIZE (FS_MAX_BLOCKS * FS_BLOCK_SIZE)
+
+// Largest file fs_read_file can return in one buffer; use fs_open/fs_read
+// for anything bigger
+#define FS_READ_BUFFER_SIZE (32 * 1024)
+
+// Open file descriptors
+#define FS_MAX_OPEN_FILES 16
+
+// Open flags
+#define FS_O_READ 0x01
+#define FS_O_WRITE 0x02
+#define FS_O_RDWR (FS_O_READ | FS_O_WRITE)
+#define FS_O_CREATE 0x04 // Create the file if it does not exist
+#define FS_O_TRUNC 0x08  // Discard existing content on open
+#define FS_O_APPEND 0x10 // Every write goes to the end of the file
+
+// Seek origins
+#define FS_SEEK_SET 0
+#define FS_SEEK_CUR 1
+#define FS_SEEK_END 2
 
 // File permissions
 #define FS_PERM_READ 0x01
@@ -21,23 +50,54 @@
 #define FS_TYPE_SYSTEM 2
 #define FS_TYPE_HIDDEN 3
 
-// File structure
+// File flags
+#define FS_FLAG_COMPRESS OSFS_INODE_COMPRESS // Keep content compressed
+#define FS_FLAG_PACKED OSFS_INODE_PACKED     // Content is stored compressed now
+
+// Extent - a run of contiguous data blocks
+typedef struct
+{
+    uint16_t start; // First block of the run, relative to the data area
+    uint16_t count; // Number of blocks in the run
+} fs_extent_t;
+
+// In-memory inode, sized to a single 64-byte cache line so that metadata
+// walks never touch file content. The name is cached from the directory.
 typedef struct
 {
     char filename[FS_MAX_FILENAME];
-    char content[FS_MAX_CONTENT];
-    int size;
+    uint32_t size;
+    uint16_t created_date;  // Packed date, see fs_pack_date()
+    uint16_t modified_date; // Packed date, see fs_pack_date()
+    uint8_t type;
+    uint8_t permissions;
+    uint8_t owner; // Index into the owner name table
     bool exists;
-    char owner[32];
-    char created_date[16];
-    char modified_date[16];
-    int type;
-    int permissions;
+    uint8_t extent_count;
+    uint8_t flags; // FS_FLAG_*
+    uint8_t reserved[2];
+    fs_extent_t extents[FS_MAX_EXTENTS];
 } file_t;
 
-// Initialize file system
+// Initialize file system: mount an OSFS volume from a virtio or ATA disk,
+// otherwise format and mount a RAM disk
 void fs_init(void);
 
+// Write an empty file system to a block device
+bool fs_mkfs(blockdev_t *dev, const char *label);
+
+// Mount the file system on a block device
+bool fs_mount(blockdev_t *dev);
+
+// Write all pending metadata and cached data to the device
+void fs_sync(void);
+
+// Sync and mark the volume cleanly unmounted
+void fs_unmount(void);
+
+// Get the mounted block device (NULL if none)
+blockdev_t *fs_get_device(void);
+
 // Create a file
 bool fs_create_file(const char *filename, const char *owner);
 
@@ -47,7 +107,7 @@ bool fs_delete_file(const char *filename);
 // Write to a file
 bool fs_write_file(const char *filename, const char *content);
 
-// Read from a file
+// Read a whole file into a shared buffer, valid until the next call
 const char *fs_read_file(const char *filename);
 
 // Check if a file exists
@@ -56,6 +116,10 @@ bool fs_file_exists(const char *filename);
 // Get file information
 file_t *fs_get_file_info(const char *filename);
 
+// Get the file in inode slot `index` (0 to FS_MAX_FILES - 1), or NULL if
+// the slot is unused
+file_t *fs_get_file_by_index(int index);
+
 // List all files
 void fs_list_files(void);
 
@@ -83,13 +147,86 @@ bool fs_check_permission(const char *filename, int permission);
 // Set file permissions
 bool fs_set_permission(const char *filename, int permission);
 
+// Set file type
+bool fs_set_type(const char *filename, int type);
+
 // Get file size
 int fs_get_file_size(const char *filename);
 
+// Get a number that changes whenever a file's name or content does, for
+// noticing changes made by another writer. 0 if the file does not exist.
+uint32_t fs_get_file_version(const char *filename);
+
+// Turn transparent compression of a file's content on or off, converting
+// what it holds now
+bool fs_set_compression(const char *filename, bool enable);
+
+// Get the number of data blocks a file occupies on the device
+int fs_get_file_blocks(const char *filename);
+
 // Display file browser
 void display_file_browser(void);
 
-// Search for files
-void fs_search(const char *query);
+// Search file names and content, optionally ignoring case
+void fs_search(const char *query, bool ignore_case);
+
+// Open a file and return a descriptor, or -1 on failure
+int fs_open(const char *filename, int flags);
+
+// Close a file descriptor
+int fs_close(int fd);
+
+// Write a file's cached data and all metadata to the device; returns 0 on
+// success or -1
+int fs_fsync(int fd);
+
+// Read up to count bytes at the descriptor's offset; returns bytes read
+int fs_read(int fd, void *buffer, uint32_t count);
+
+// Write count bytes at the descriptor's offset; returns bytes written
+int fs_write(int fd, const void *buffer, uint32_t count);
+
+// Read at an explicit offset without moving the descriptor's offset
+int fs_pread(int fd, void *buffer, uint32_t count, uint32_t offset);
+
+// Write at an explicit offset without moving the descriptor's offset
+int fs_pwrite(int fd, const void *buffer, uint32_t count, uint32_t offset);
+
+// Cut a file to `size` bytes, or extend it with zeros; 0 on success or -1
+int fs_ftruncate(int fd, uint32_t size);
+
+// Move the descriptor's offset; returns the new offset or -1
+int fs_lseek(int fd, int offset, int whence);
+
+// Append bytes to the end of a file, creating it if needed
+int fs_append(const char *filename, const void *data, uint32_t count);
+
+// Get the owner name of a file
+const char *fs_get_file_owner(const file_t *file);
+
+// Pack a date as (year - 1980) << 9 | month << 5 | day
+uint16_t fs_pack_date(int year, int month, int day);
+
+// Format a packed date as yyyy-mm-dd (buffer of at least 11 bytes)
+void fs_format_date(uint16_t date, char *buffer);
+
+// Get the number of free data blocks
+int fs_get_free_blocks(void);
+
+// Result of a scrub
+typedef struct
+{
+    uint32_t files;      // Files checked
+    uint32_t blocks;     // Data blocks read
+    uint32_t unchecked;  // Blocks without a recorded checksum
+    uint32_t bad_blocks; // Blocks that failed to read or match
+    uint32_t bad_files;
+    uint32_t elapsed_ms;
+} fs_scrub_result_t;
+
+// Read every file's blocks from the device and verify them against their
+// checksums. `report` (may be NULL) is called for each corrupt file.
+// Returns false if the volume has no checksums.
+bool fs_scrub(fs_scrub_result_t *result, void (*report)(const char *filename, uint32_t bad_blocks));
 
 #endif // FS_H
\ No newline at end of file
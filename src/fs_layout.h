@@ -0,0 +1,218 @@
+#ifndef FS_LAYOUT_H
+#define FS_LAYOUT_H
+
+// On-disk layout of the OSIRIS file system (OSFS). This header is shared
+// by the kernel and the host-side tools/osfs image tool, so it must only
+// depend on fixed-width types.
+//
+//   block 0                superblock
+//   block 1                owner name table
+//   inode_start ...        inode table (OSFS_INODES_PER_BLOCK per block)
+//   dir_start ...          directory blocks (entry i names inode i)
+//   journal_start ...      metadata journal (version 2)
+//   bitmap_start ...       data block allocation bitmap
+//   csum_start ...         CRC32C of each data block (version 3)
+//   data_start ...         file data, addressed by extents
+
+#include <stdint.h>
+
+#define OSFS_MAGIC 0x5346534F // "OSFS"
+#define OSFS_VERSION 4 // Version 2 adds the journal, 3 block checksums, 4 compression
+#define OSFS_BLOCK_SIZE 512
+
+#define OSFS_MAX_NAME 32
+#define OSFS_MAX_OWNERS 16
+#define OSFS_INODE_EXTENTS 4
+#define OSFS_MAX_DATA_BLOCKS 65535 // Extents address data with 16 bits
+
+// Journal size: 1/32 of the volume, within these bounds
+#define OSFS_JOURNAL_MIN_BLOCKS 16
+#define OSFS_JOURNAL_MAX_BLOCKS 256
+
+#define OSFS_INODES_PER_BLOCK (OSFS_BLOCK_SIZE / sizeof(osfs_inode_t))
+#define OSFS_DIRENTS_PER_BLOCK (OSFS_BLOCK_SIZE / sizeof(osfs_dirent_t))
+#define OSFS_BITS_PER_BLOCK (OSFS_BLOCK_SIZE * 8)
+#define OSFS_CSUMS_PER_BLOCK (OSFS_BLOCK_SIZE / 4)
+
+// Superblock state
+#define OSFS_STATE_CLEAN 0 // Unmounted cleanly
+#define OSFS_STATE_DIRTY 1 // Mounted, or not shut down cleanly
+
+// Inode flags
+#define OSFS_INODE_USED 0x01
+#define OSFS_INODE_COMPRESS 0x02 // Store content compressed (version 4)
+#define OSFS_INODE_PACKED 0x04   // Content is stored compressed, see below
+
+// Superblock (block 0)
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t total_blocks;
+    uint32_t inode_count;
+    uint32_t owner_block;
+    uint32_t inode_start;
+    uint32_t inode_blocks;
+    uint32_t dir_start;
+    uint32_t dir_blocks;
+    uint32_t bitmap_start;
+    uint32_t bitmap_blocks;
+    uint32_t data_start;
+    uint32_t data_blocks;
+    uint32_t free_blocks;
+    uint32_t file_count;
+    uint32_t state;
+    uint32_t mount_count;
+    char label[16];
+    uint32_t journal_start; // Version 2
+    uint32_t journal_blocks;
+    uint32_t csum_start; // Version 3
+    uint32_t csum_blocks;
+} osfs_superblock_t;
+
+// Data block checksums: entry i of the checksum region is the CRC32C of
+// data block i, or 0 if none has been recorded. They are written like
+// data, not journaled.
+
+// Journal records. The first journal block is the header; the rest is a
+// log of transactions, each a descriptor, the block images it lists and a
+// commit block, written contiguously. Replay starts at the header's
+// position and sequence and stops at the first transaction whose
+// sequence or checksum does not match.
+#define OSFS_JOURNAL_MAGIC 0x4C4E524A // "JRNL"
+#define OSFS_JOURNAL_DESCRIPTOR 1
+#define OSFS_JOURNAL_COMMIT 2
+#define OSFS_JOURNAL_MAX_TARGETS ((OSFS_BLOCK_SIZE - 16) / 4)
+
+// Journal header (first journal block)
+typedef struct
+{
+    uint32_t magic;
+    uint32_t blocks;   // Journal size, including the header
+    uint32_t sequence; // First transaction to replay
+    uint32_t start;    // Its log position, relative to journal_start
+} osfs_journal_header_t;
+
+// Transaction descriptor
+typedef struct
+{
+    uint32_t magic;
+    uint32_t type; // OSFS_JOURNAL_DESCRIPTOR
+    uint32_t sequence;
+    uint32_t count;                             // Block images that follow
+    uint32_t targets[OSFS_JOURNAL_MAX_TARGETS]; // Home block of each image
+} osfs_journal_descriptor_t;
+
+// Commit block, after the block images
+typedef struct
+{
+    uint32_t magic;
+    uint32_t type; // OSFS_JOURNAL_COMMIT
+    uint32_t sequence;
+    uint32_t count;
+    uint32_t checksum; // CRC32C of the descriptor and the block images
+} osfs_journal_commit_t;
+
+// Compressed content. A packed file's blocks start with a table of
+// uint16_t stored lengths, one per OSFS_CZ_UNIT bytes of content, followed
+// by each unit in turn, block aligned. A unit whose stored length equals
+// its content length is raw; otherwise it is an LZ block (see src/lz.h).
+#define OSFS_CZ_UNIT 4096
+#define OSFS_CZ_MAX_UNITS (OSFS_BLOCK_SIZE / 2)
+
+// Extent - a run of data blocks, relative to data_start
+typedef struct
+{
+    uint16_t start;
+    uint16_t count;
+} osfs_extent_t;
+
+// Inode (32 bytes, 16 per block)
+typedef struct
+{
+    uint32_t size;
+    uint16_t created_date;
+    uint16_t modified_date;
+    uint8_t type;
+    uint8_t permissions;
+    uint8_t owner;
+    uint8_t flags;
+    uint8_t extent_count;
+    uint8_t reserved[3];
+    osfs_extent_t extents[OSFS_INODE_EXTENTS];
+} osfs_inode_t;
+
+// Directory entry (40 bytes, 12 per block); entry i names inode i
+typedef struct
+{
+    uint32_t hash; // osfs_name_hash(name), 0 when unused
+    uint32_t reserved;
+    char name[OSFS_MAX_NAME];
+} osfs_dirent_t;
+
+// FNV-1a hash of a file name; never returns 0 so 0 can mark free entries
+static inline uint32_t osfs_name_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    while (*name)
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+// Compute the region layout for a volume of total_blocks blocks
+static inline int osfs_compute_layout(osfs_superblock_t *sb, uint32_t total_blocks, uint32_t inode_count)
+{
+    sb->magic = OSFS_MAGIC;
+    sb->version = OSFS_VERSION;
+    sb->block_size = OSFS_BLOCK_SIZE;
+    sb->total_blocks = total_blocks;
+    sb->inode_count = inode_count;
+    sb->owner_block = 1;
+    sb->inode_start = 2;
+    sb->inode_blocks = (inode_count + OSFS_INODES_PER_BLOCK - 1) / OSFS_INODES_PER_BLOCK;
+    sb->dir_start = sb->inode_start + sb->inode_blocks;
+    sb->dir_blocks = (inode_count + OSFS_DIRENTS_PER_BLOCK - 1) / OSFS_DIRENTS_PER_BLOCK;
+    sb->journal_start = sb->dir_start + sb->dir_blocks;
+    sb->journal_blocks = total_blocks / 32;
+    if (sb->journal_blocks < OSFS_JOURNAL_MIN_BLOCKS)
+    {
+        sb->journal_blocks = OSFS_JOURNAL_MIN_BLOCKS;
+    }
+    if (sb->journal_blocks > OSFS_JOURNAL_MAX_BLOCKS)
+    {
+        sb->journal_blocks = OSFS_JOURNAL_MAX_BLOCKS;
+    }
+    sb->bitmap_start = sb->journal_start + sb->journal_blocks;
+
+    // Every data block needs a bitmap bit and a checksum; give data as
+    // much of the rest as fits (large disks: as much as extents address)
+    uint32_t rest = total_blocks > sb->bitmap_start ? total_blocks - sb->bitmap_start : 0;
+    uint32_t data = rest < OSFS_MAX_DATA_BLOCKS ? rest : OSFS_MAX_DATA_BLOCKS;
+    while (data > 0 && data + (data + OSFS_BITS_PER_BLOCK - 1) / OSFS_BITS_PER_BLOCK +
+                               (data + OSFS_CSUMS_PER_BLOCK - 1) / OSFS_CSUMS_PER_BLOCK > rest)
+    {
+        data--;
+    }
+    if (data == 0)
+    {
+        return -1; // Volume too small
+    }
+
+    sb->bitmap_blocks = (data + OSFS_BITS_PER_BLOCK - 1) / OSFS_BITS_PER_BLOCK;
+    sb->csum_start = sb->bitmap_start + sb->bitmap_blocks;
+    sb->csum_blocks = (data + OSFS_CSUMS_PER_BLOCK - 1) / OSFS_CSUMS_PER_BLOCK;
+    sb->data_start = sb->csum_start + sb->csum_blocks;
+    sb->data_blocks = data;
+    sb->total_blocks = sb->data_start + sb->data_blocks;
+    sb->free_blocks = sb->data_blocks;
+    sb->file_count = 0;
+    sb->state = OSFS_STATE_CLEAN;
+    sb->mount_count = 0;
+    return 0;
+}
+
+#endif // FS_LAYOUT_H
@@ -0,0 +1,191 @@
+#include "interrupts.h"
+#include "utils.h" // For port I/O
+#include <stddef.h>
+
+// IDT gate descriptor
+typedef struct
+{
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t zero;
+    uint8_t type_attr;
+    uint16_t offset_high;
+} __attribute__((packed)) idt_entry_t;
+
+// Operand of the lidt instruction
+typedef struct
+{
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) idt_pointer_t;
+
+// 32-bit interrupt gate, present, ring 0
+#define IDT_INTERRUPT_GATE 0x8E
+
+// Entry stubs for IRQ 0-15, defined in boot/interrupts.asm
+extern uint32_t irq_stub_table[IRQ_COUNT];
+
+static idt_entry_t idt[256];
+static irq_handler_t irq_handlers[IRQ_COUNT][IRQ_MAX_HANDLERS];
+static bool interrupts_ready = false;
+
+// Point an IDT vector at a handler
+static void idt_set_gate(int vector, uint32_t handler, uint16_t selector)
+{
+    idt[vector].offset_low = handler & 0xFFFF;
+    idt[vector].selector = selector;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = IDT_INTERRUPT_GATE;
+    idt[vector].offset_high = (handler >> 16) & 0xFFFF;
+}
+
+// Remap the PICs to IRQ_BASE_VECTOR and mask every line
+static void pic_remap(void)
+{
+    outb(PIC1_COMMAND, 0x11); // ICW1: initialize, expect ICW4
+    outb(PIC2_COMMAND, 0x11);
+    outb(PIC1_DATA, IRQ_BASE_VECTOR);     // ICW2: vector offsets
+    outb(PIC2_DATA, IRQ_BASE_VECTOR + 8);
+    outb(PIC1_DATA, 0x04); // ICW3: slave on IRQ2
+    outb(PIC2_DATA, 0x02);
+    outb(PIC1_DATA, 0x01); // ICW4: 8086 mode
+    outb(PIC2_DATA, 0x01);
+
+    // Mask everything except the cascade line
+    outb(PIC1_DATA, 0xFF & ~(1 << IRQ_CASCADE));
+    outb(PIC2_DATA, 0xFF);
+}
+
+// Read the in-service register of the PIC serving an IRQ
+static uint8_t pic_read_isr(int irq)
+{
+    uint16_t port = irq < 8 ? PIC1_COMMAND : PIC2_COMMAND;
+    outb(port, PIC_READ_ISR);
+    return inb(port);
+}
+
+// Initialize interrupt handling
+void interrupts_init(void)
+{
+    if (interrupts_ready)
+    {
+        return;
+    }
+
+    // Reuse whatever code segment the boot loader left us in
+    uint16_t code_selector;
+    asm volatile("mov %%cs, %0" : "=r"(code_selector));
+
+    for (int i = 0; i < IRQ_COUNT; i++)
+    {
+        idt_set_gate(IRQ_BASE_VECTOR + i, irq_stub_table[i], code_selector);
+    }
+
+    idt_pointer_t pointer;
+    pointer.limit = sizeof(idt) - 1;
+    pointer.base = (uint32_t)(uintptr_t)idt;
+    asm volatile("lidt %0" : : "m"(pointer));
+
+    pic_remap();
+    interrupts_ready = true;
+    asm volatile("sti");
+}
+
+// Register an IRQ handler
+bool irq_register(int irq, irq_handler_t handler)
+{
+    if (irq < 0 || irq >= IRQ_COUNT)
+    {
+        return false;
+    }
+
+    interrupts_init();
+
+    uint32_t flags = irq_save();
+    for (int i = 0; i < IRQ_MAX_HANDLERS; i++)
+    {
+        if (irq_handlers[irq][i] == NULL)
+        {
+            irq_handlers[irq][i] = handler;
+            irq_restore(flags);
+            irq_unmask(irq);
+            return true;
+        }
+    }
+    irq_restore(flags);
+    return false;
+}
+
+// Mask an IRQ line
+void irq_mask(int irq)
+{
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) | (1 << (irq & 7)));
+}
+
+// Unmask an IRQ line
+void irq_unmask(int irq)
+{
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) & ~(1 << (irq & 7)));
+}
+
+// Disable interrupts and return the previous EFLAGS
+uint32_t irq_save(void)
+{
+    uint32_t flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+// Restore the interrupt flag
+void irq_restore(uint32_t flags)
+{
+    if (flags & 0x200)
+    {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+// Sleep until `*flag` is set
+void irq_wait_for(volatile bool *flag)
+{
+    while (true)
+    {
+        asm volatile("cli" : : : "memory");
+        if (*flag)
+        {
+            asm volatile("sti" : : : "memory");
+            return;
+        }
+
+        // sti only takes effect after the next instruction, so no
+        // interrupt can slip in between the check and the hlt
+        asm volatile("sti; hlt" : : : "memory");
+    }
+}
+
+// Dispatch an IRQ to its handlers and acknowledge it
+void irq_dispatch(uint32_t irq)
+{
+    // Lines 7 and 15 fire spuriously when an IRQ is withdrawn
+    if ((irq == 7 || irq == 15) && !(pic_read_isr(irq) & 0x80))
+    {
+        if (irq == 15)
+        {
+            outb(PIC1_COMMAND, PIC_EOI); // The master still saw the cascade
+        }
+        return;
+    }
+
+    for (int i = 0; i < IRQ_MAX_HANDLERS && irq_handlers[irq][i] != NULL; i++)
+    {
+        irq_handlers[irq][i](irq);
+    }
+
+    if (irq >= 8)
+    {
+        outb(PIC2_COMMAND, PIC_EOI);
+    }
+    outb(PIC1_COMMAND, PIC_EOI);
+}
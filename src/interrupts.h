@@ -0,0 +1,56 @@
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The PICs are remapped so IRQ 0-15 arrive on vectors 32-47
+#define IRQ_BASE_VECTOR 32
+#define IRQ_COUNT 16
+#define IRQ_MAX_HANDLERS 4 // Handlers sharing one line
+
+// Hardware IRQ lines
+#define IRQ_TIMER 0
+#define IRQ_KEYBOARD 1
+#define IRQ_CASCADE 2
+#define IRQ_PRIMARY_ATA 14
+#define IRQ_SECONDARY_ATA 15
+
+// PIC ports and commands
+#define PIC1_COMMAND 0x20
+#define PIC1_DATA 0x21
+#define PIC2_COMMAND 0xA0
+#define PIC2_DATA 0xA1
+#define PIC_EOI 0x20
+#define PIC_READ_ISR 0x0B
+
+// IRQ handler, called with the line that fired
+typedef void (*irq_handler_t)(int irq);
+
+// Load the IDT, remap the PICs with every line masked and enable
+// interrupts. Safe to call more than once.
+void interrupts_init(void);
+
+// Install a handler for an IRQ line and unmask it
+bool irq_register(int irq, irq_handler_t handler);
+
+// Mask an IRQ line
+void irq_mask(int irq);
+
+// Unmask an IRQ line
+void irq_unmask(int irq);
+
+// Disable interrupts and return the previous EFLAGS
+uint32_t irq_save(void);
+
+// Restore the interrupt flag saved by irq_save()
+void irq_restore(uint32_t flags);
+
+// Sleep until an interrupt arrives unless `*flag` is already set.
+// Checks and halts atomically so a wakeup cannot be missed.
+void irq_wait_for(volatile bool *flag);
+
+// Entry point from the assembly stubs in boot/interrupts.asm
+void irq_dispatch(uint32_t irq);
+
+#endif // INTERRUPTS_H
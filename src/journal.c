@@ -0,0 +1,351 @@
+#include "journal.h"
+#include "bcache.h" // Home copies are written back through the cache
+#include "crc32c.h" // For commit block checksums
+#include "string.h" // For memcpy
+#include "timer.h"  // For transaction ages
+#include <stddef.h>
+
+// Open journal
+static blockdev_t *jnl_dev = NULL;
+static uint32_t jnl_start;         // First journal block (the header)
+static uint32_t jnl_blocks;        // Journal size, including the header
+static uint32_t jnl_ordered_start; // Checksums and data, flushed before each commit
+static uint32_t jnl_ordered_blocks;
+static uint32_t jnl_sequence;      // Sequence of the running transaction
+static uint32_t jnl_head;          // Log position it will be written at
+
+// Running transaction, laid out as it goes to the log: descriptor, block
+// images, commit block
+static uint32_t jnl_count = 0;
+static uint32_t jnl_opened_ms; // timer_ms() when the first block was logged
+static uint8_t jnl_buffer[(JOURNAL_TXN_BLOCKS + 2) * OSFS_BLOCK_SIZE] __attribute__((aligned(16)));
+
+static journal_stats_t stats;
+
+// Called after each commit block is written
+static void (*jnl_commit_hook)(void) = NULL;
+
+// Write the journal header: replay starts at `start` with `sequence`
+static bool journal_write_header(blockdev_t *dev, uint32_t start, uint32_t blocks,
+                                 uint32_t sequence, uint32_t log_start)
+{
+    uint8_t block[OSFS_BLOCK_SIZE];
+    osfs_journal_header_t *header = (osfs_journal_header_t *)block;
+
+    memset(block, 0, sizeof(block));
+    header->magic = OSFS_JOURNAL_MAGIC;
+    header->blocks = blocks;
+    header->sequence = sequence;
+    header->start = log_start;
+    return blockdev_write(dev, start, 1, block);
+}
+
+// Get the descriptor of the running transaction
+static osfs_journal_descriptor_t *journal_descriptor(void)
+{
+    return (osfs_journal_descriptor_t *)jnl_buffer;
+}
+
+// Get the image slot of the running transaction's i-th block
+static uint8_t *journal_image(uint32_t i)
+{
+    return jnl_buffer + (i + 1) * OSFS_BLOCK_SIZE;
+}
+
+// Write every committed block home and empty the log
+static bool journal_checkpoint(void)
+{
+    bool ok = bcache_sync(jnl_dev);
+    if (ok)
+    {
+        ok = journal_write_header(jnl_dev, jnl_start, jnl_blocks, jnl_sequence, 1);
+    }
+    if (!ok)
+    {
+        stats.errors++;
+        return false;
+    }
+
+    jnl_head = 1;
+    stats.checkpoints++;
+    return true;
+}
+
+// Write an empty journal for a freshly laid out volume
+bool journal_format(blockdev_t *dev, const osfs_superblock_t *sb)
+{
+    if (sb->journal_blocks == 0)
+    {
+        return true;
+    }
+    return journal_write_header(dev, sb->journal_start, sb->journal_blocks, 1, 1);
+}
+
+// Read and check the transaction at a log position. Leaves it in the
+// transaction buffer and returns its block count, or -1 if the log ends.
+// Targets must be metadata blocks outside the journal.
+static int journal_read_transaction(uint32_t pos, uint32_t sequence)
+{
+    if (pos + 2 > jnl_blocks || !blockdev_read(jnl_dev, jnl_start + pos, 1, jnl_buffer))
+    {
+        return -1;
+    }
+
+    osfs_journal_descriptor_t *desc = journal_descriptor();
+    uint32_t count = desc->count;
+    if (desc->magic != OSFS_JOURNAL_MAGIC || desc->type != OSFS_JOURNAL_DESCRIPTOR ||
+        desc->sequence != sequence || count == 0 || count > JOURNAL_TXN_BLOCKS ||
+        pos + count + 2 > jnl_blocks)
+    {
+        return -1;
+    }
+
+    if (!blockdev_read(jnl_dev, jnl_start + pos + 1, count + 1, journal_image(0)))
+    {
+        return -1;
+    }
+
+    // A torn write leaves a commit block that does not match
+    osfs_journal_commit_t *commit = (osfs_journal_commit_t *)journal_image(count);
+    if (commit->magic != OSFS_JOURNAL_MAGIC || commit->type != OSFS_JOURNAL_COMMIT ||
+        commit->sequence != sequence || commit->count != count ||
+        commit->checksum != crc32c(0, jnl_buffer, (count + 1) * OSFS_BLOCK_SIZE))
+    {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t target = desc->targets[i];
+        if (target >= jnl_ordered_start || (target >= jnl_start && target < jnl_start + jnl_blocks))
+        {
+            return -1;
+        }
+    }
+    return (int)count;
+}
+
+// Replay committed transactions onto their home blocks and start logging
+int journal_open(blockdev_t *dev, const osfs_superblock_t *sb)
+{
+    uint8_t block[OSFS_BLOCK_SIZE];
+    osfs_journal_header_t *header = (osfs_journal_header_t *)block;
+
+    if (!blockdev_read(dev, sb->journal_start, 1, block) ||
+        header->magic != OSFS_JOURNAL_MAGIC || header->blocks != sb->journal_blocks ||
+        header->start == 0 || header->start >= header->blocks)
+    {
+        return -1;
+    }
+
+    timer_init();
+    jnl_dev = dev;
+    jnl_start = sb->journal_start;
+    jnl_blocks = sb->journal_blocks;
+    jnl_ordered_start = sb->csum_blocks > 0 ? sb->csum_start : sb->data_start;
+    jnl_ordered_blocks = sb->data_start + sb->data_blocks - jnl_ordered_start;
+    jnl_count = 0;
+
+    // Only the log since the last checkpoint is read, so recovery time
+    // depends on the journal size, not the volume size
+    uint32_t pos = header->start;
+    uint32_t sequence = header->sequence;
+    int replayed = 0;
+    int count;
+    while ((count = journal_read_transaction(pos, sequence)) > 0)
+    {
+        osfs_journal_descriptor_t *desc = journal_descriptor();
+        for (int i = 0; i < count; i++)
+        {
+            if (!blockdev_write(dev, desc->targets[i], 1, journal_image(i)))
+            {
+                jnl_dev = NULL;
+                return -1;
+            }
+        }
+        pos += count + 2;
+        sequence++;
+        replayed++;
+    }
+
+    // Cached copies of replayed blocks are stale
+    if (replayed > 0)
+    {
+        bcache_invalidate(dev);
+    }
+
+    jnl_sequence = sequence;
+    jnl_head = 1;
+    if (!journal_write_header(dev, jnl_start, jnl_blocks, jnl_sequence, jnl_head))
+    {
+        jnl_dev = NULL;
+        return -1;
+    }
+
+    stats.replayed = replayed;
+    return replayed;
+}
+
+// Commit, checkpoint and stop logging
+bool journal_close(void)
+{
+    if (jnl_dev == NULL)
+    {
+        return true;
+    }
+
+    bool ok = journal_commit();
+    ok = journal_checkpoint() && ok;
+    jnl_dev = NULL;
+    return ok;
+}
+
+// Check whether a journal is open
+bool journal_active(void)
+{
+    return jnl_dev != NULL;
+}
+
+// Commit first if an update of `count` blocks would not fit
+bool journal_reserve(uint32_t count)
+{
+    if (jnl_dev == NULL)
+    {
+        return true;
+    }
+
+    count += JOURNAL_TXN_OVERHEAD;
+    if (count > JOURNAL_TXN_BLOCKS)
+    {
+        // Never split an update. With the log empty, replay cannot put an
+        // older image over the blocks the caller writes directly.
+        journal_commit();
+        journal_checkpoint();
+        return false;
+    }
+    if (jnl_count + count > JOURNAL_TXN_BLOCKS)
+    {
+        journal_commit();
+    }
+    return true;
+}
+
+// Add a metadata block to the running transaction
+bool journal_log(uint32_t block, const void *data)
+{
+    if (jnl_dev == NULL)
+    {
+        return false;
+    }
+
+    // A block logged again in the same transaction is updated in place
+    osfs_journal_descriptor_t *desc = journal_descriptor();
+    uint32_t i = 0;
+    while (i < jnl_count && desc->targets[i] != block)
+    {
+        i++;
+    }
+
+    if (i == jnl_count)
+    {
+        if (jnl_count == JOURNAL_TXN_BLOCKS)
+        {
+            journal_commit();
+            i = 0;
+        }
+        if (jnl_count == 0)
+        {
+            jnl_opened_ms = timer_ms();
+        }
+        desc->targets[i] = block;
+        jnl_count++;
+    }
+
+    memcpy(journal_image(i), data, OSFS_BLOCK_SIZE);
+    return true;
+}
+
+// Write the running transaction to the log and wait for it
+bool journal_commit(void)
+{
+    if (jnl_dev == NULL || jnl_count == 0)
+    {
+        return true;
+    }
+
+    uint32_t count = jnl_count;
+    bool ok = true;
+
+    // Out of log space: everything committed so far must reach its home
+    // location before the log can be reused
+    if (jnl_head + count + 2 > jnl_blocks)
+    {
+        ok = journal_checkpoint();
+    }
+
+    // Ordered mode: data the new metadata points at goes first
+    ok = ok && bcache_sync_range(jnl_dev, jnl_ordered_start, jnl_ordered_blocks);
+
+    osfs_journal_descriptor_t *desc = journal_descriptor();
+    desc->magic = OSFS_JOURNAL_MAGIC;
+    desc->type = OSFS_JOURNAL_DESCRIPTOR;
+    desc->sequence = jnl_sequence;
+    desc->count = count;
+
+    osfs_journal_commit_t *commit = (osfs_journal_commit_t *)journal_image(count);
+    memset(commit, 0, OSFS_BLOCK_SIZE);
+    commit->magic = OSFS_JOURNAL_MAGIC;
+    commit->type = OSFS_JOURNAL_COMMIT;
+    commit->sequence = jnl_sequence;
+    commit->count = count;
+    commit->checksum = crc32c(0, jnl_buffer, (count + 1) * OSFS_BLOCK_SIZE);
+
+    // One request for the whole transaction; the checksum catches a torn one
+    ok = ok && blockdev_write(jnl_dev, jnl_start + jnl_head, count + 2, jnl_buffer);
+    if (ok)
+    {
+        jnl_head += count + 2;
+        jnl_sequence++;
+        stats.commits++;
+        stats.blocks += count;
+    }
+    else
+    {
+        stats.errors++;
+    }
+
+    // Home copies are written back lazily by the cache. Without a durable
+    // commit they still go home, just without the atomicity guarantee.
+    for (uint32_t i = 0; i < count; i++)
+    {
+        bcache_write(jnl_dev, desc->targets[i], 1, journal_image(i));
+    }
+    jnl_count = 0;
+
+    if (ok && jnl_commit_hook != NULL)
+    {
+        jnl_commit_hook();
+    }
+    return ok;
+}
+
+// Call `done` each time a commit block reaches the log
+void journal_set_commit_hook(void (*done)(void))
+{
+    jnl_commit_hook = done;
+}
+
+// Commit the running transaction once it is old enough
+void journal_poll(void)
+{
+    if (jnl_dev != NULL && jnl_count > 0 && timer_ms() - jnl_opened_ms >= JOURNAL_COMMIT_MS)
+    {
+        journal_commit();
+    }
+}
+
+// Get journal statistics
+void journal_get_stats(journal_stats_t *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,67 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "blockdev.h"
+#include "fs_layout.h"
+
+// Blocks one transaction may log. A transaction is written to the log as
+// a single request: descriptor, block images, commit block.
+#define JOURNAL_TXN_BLOCKS 32
+
+// Blocks every update logs besides the ones it reserves: the superblock
+// with the volume counters
+#define JOURNAL_TXN_OVERHEAD 1
+
+// A running transaction is committed once it is this old, so many small
+// metadata updates share one log write and one barrier
+#define JOURNAL_COMMIT_MS 500
+
+// Journal statistics
+typedef struct
+{
+    uint32_t commits;     // Transactions written to the log
+    uint32_t blocks;      // Block images written to the log
+    uint32_t checkpoints; // Times the log was emptied
+    uint32_t replayed;    // Transactions replayed by the last journal_open()
+    uint32_t errors;
+} journal_stats_t;
+
+// Write an empty journal for a freshly laid out volume
+bool journal_format(blockdev_t *dev, const osfs_superblock_t *sb);
+
+// Replay committed transactions onto their home blocks and start logging.
+// Returns the number of transactions replayed, or -1 if the journal is
+// unreadable.
+int journal_open(blockdev_t *dev, const osfs_superblock_t *sb);
+
+// Commit, checkpoint and stop logging
+bool journal_close(void);
+
+// Check whether a journal is open
+bool journal_active(void);
+
+// Commit first if an update of `count` blocks would not fit in the
+// running transaction, so it stays atomic. Returns false, after emptying
+// the log, for an update too large for any transaction; the caller then
+// writes its blocks home without the journal.
+bool journal_reserve(uint32_t count);
+
+// Add a metadata block to the running transaction. Returns false when no
+// journal is open, in which case the caller writes the block itself.
+bool journal_log(uint32_t block, const void *data);
+
+// Write the running transaction to the log and wait for it
+bool journal_commit(void);
+
+// Call `done` each time a commit block reaches the log, so the caller can
+// reuse what the committed transaction released. NULL for none.
+void journal_set_commit_hook(void (*done)(void));
+
+// Commit the running transaction once it is old enough. Never waits
+// unless it commits; call it from idle loops.
+void journal_poll(void);
+
+// Get journal statistics
+void journal_get_stats(journal_stats_t *stats);
+
+#endif // JOURNAL_H
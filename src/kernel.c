@@ -236,6 +236,46 @@ void outb(uint16_t port, uint8_t val)
     asm volatile("outb %0, %1" : : "a"(val), "dN"(port));
 }
 
+// Read a 16-bit word from an I/O port
+uint16_t inw(uint16_t port)
+{
+    uint16_t ret;
+    asm volatile("inw %1, %0" : "=a"(ret) : "dN"(port));
+    return ret;
+}
+
+// Write a 16-bit word to an I/O port
+void outw(uint16_t port, uint16_t val)
+{
+    asm volatile("outw %0, %1" : : "a"(val), "dN"(port));
+}
+
+// Read a 32-bit value from an I/O port
+uint32_t inl(uint16_t port)
+{
+    uint32_t ret;
+    asm volatile("inl %1, %0" : "=a"(ret) : "dN"(port));
+    return ret;
+}
+
+// Write a 32-bit value to an I/O port
+void outl(uint16_t port, uint32_t val)
+{
+    asm volatile("outl %0, %1" : : "a"(val), "dN"(port));
+}
+
+// Read `count` 16-bit words from an I/O port into a buffer
+void insw(uint16_t port, void *buffer, uint32_t count)
+{
+    asm volatile("rep insw" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+// Write `count` 16-bit words from a buffer to an I/O port
+void outsw(uint16_t port, const void *buffer, uint32_t count)
+{
+    asm volatile("rep outsw" : "+S"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
 // The kernel main function, called from boot.asm
 void kernel_main(void)
 {
@@ -0,0 +1,299 @@
+#include "lz.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5 // Bytes at the end that are always literals
+#define LZ_MATCH_LIMIT 12  // No match starts in the last 12 bytes
+#define LZ_MAX_OFFSET 65535
+
+// Match finder: a hash of the next 4 bytes selects a chain of earlier
+// positions with that hash, searched newest first
+#define LZ_HASH_BITS 12
+#define LZ_CHAIN_DEPTH 16
+
+// Every 2^LZ_SKIP_SHIFT positions without a match the search steps one
+// byte further, so incompressible data is skimmed rather than searched
+#define LZ_SKIP_SHIFT 5
+
+static uint16_t hash_head[1 << LZ_HASH_BITS]; // Position + 1, 0 if none
+static uint16_t hash_chain[LZ_MAX_INPUT];     // Previous position + 1
+
+// Load 4 bytes, unaligned
+static inline uint32_t lz_read32(const uint8_t *p)
+{
+    uint32_t value;
+    __builtin_memcpy(&value, p, 4);
+    return value;
+}
+
+// Copy 8 bytes, unaligned
+static inline void lz_copy8(uint8_t *dst, const uint8_t *src)
+{
+    uint64_t value;
+    __builtin_memcpy(&value, src, 8);
+    __builtin_memcpy(dst, &value, 8);
+}
+
+// Hash the 4 bytes at p
+static inline uint32_t lz_hash(const uint8_t *p)
+{
+    return (lz_read32(p) * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Count the bytes two positions have in common, up to max (at least
+// LZ_MIN_MATCH are known to match), four at a time
+static inline uint32_t lz_match_length(const uint8_t *a, const uint8_t *b, uint32_t max)
+{
+    uint32_t n = LZ_MIN_MATCH;
+    while (n + 4 <= max)
+    {
+        uint32_t diff = lz_read32(a + n) ^ lz_read32(b + n);
+        if (diff != 0)
+        {
+            return n + (__builtin_ctz(diff) >> 3);
+        }
+        n += 4;
+    }
+    while (n < max && a[n] == b[n])
+    {
+        n++;
+    }
+    return n;
+}
+
+// Add position pos to its hash chain
+static inline void lz_insert(const uint8_t *src, uint32_t pos)
+{
+    uint32_t h = lz_hash(src + pos);
+    hash_chain[pos] = hash_head[h];
+    hash_head[h] = pos + 1;
+}
+
+// Write a length's extension bytes after a nibble of 15
+static uint8_t *lz_put_length(uint8_t *op, uint32_t n)
+{
+    while (n >= 255)
+    {
+        *op++ = 255;
+        n -= 255;
+    }
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+// Compress a block
+uint32_t lz_compress(const void *src, uint32_t len, void *dst, uint32_t capacity)
+{
+    const uint8_t *in = (const uint8_t *)src;
+    uint8_t *out = (uint8_t *)dst;
+    uint8_t *op = out;
+    uint8_t *oend = out + capacity;
+    uint32_t anchor = 0;
+    uint32_t pos = 0;
+    uint32_t misses = 0;
+
+    if (len > LZ_MAX_INPUT)
+    {
+        return 0;
+    }
+    for (uint32_t i = 0; i < (1u << LZ_HASH_BITS); i++)
+    {
+        hash_head[i] = 0;
+    }
+
+    while (len >= LZ_MATCH_LIMIT + 1 && pos + LZ_MATCH_LIMIT <= len)
+    {
+        // Longest match among the chain's candidates
+        uint32_t best_len = 0;
+        uint32_t best_pos = 0;
+        uint32_t max_len = len - LZ_LAST_LITERALS - pos;
+        uint32_t word = lz_read32(in + pos);
+        uint32_t candidate = hash_head[lz_hash(in + pos)];
+        for (int depth = 0; depth < LZ_CHAIN_DEPTH && candidate != 0; depth++)
+        {
+            uint32_t cand = candidate - 1;
+            if (pos - cand > LZ_MAX_OFFSET)
+            {
+                break;
+            }
+            if (lz_read32(in + cand) == word && in[cand + best_len] == in[pos + best_len])
+            {
+                uint32_t n = lz_match_length(in + cand, in + pos, max_len);
+                if (n > best_len)
+                {
+                    best_len = n;
+                    best_pos = cand;
+                    if (n == max_len)
+                    {
+                        break;
+                    }
+                }
+            }
+            candidate = hash_chain[cand];
+        }
+        lz_insert(in, pos);
+
+        if (best_len < LZ_MIN_MATCH)
+        {
+            misses++;
+            pos += 1 + (misses >> LZ_SKIP_SHIFT);
+            continue;
+        }
+        misses = 0;
+
+        // Token, literals, offset, match length
+        uint32_t literals = pos - anchor;
+        uint32_t match = best_len - LZ_MIN_MATCH;
+        if ((uint32_t)(oend - op) < 1 + literals + literals / 255 + 1 + 2 + match / 255 + 1)
+        {
+            return 0;
+        }
+        uint8_t *token = op++;
+        *token = (uint8_t)((literals < 15 ? literals : 15) << 4 | (match < 15 ? match : 15));
+        if (literals >= 15)
+        {
+            op = lz_put_length(op, literals - 15);
+        }
+        for (uint32_t i = 0; i < literals; i++)
+        {
+            *op++ = in[anchor + i];
+        }
+        uint32_t offset = pos - best_pos;
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        if (match >= 15)
+        {
+            op = lz_put_length(op, match - 15);
+        }
+
+        // Index the matched bytes so later matches can refer into them
+        uint32_t end = pos + best_len;
+        for (pos++; pos < end && pos + LZ_MIN_MATCH <= len; pos++)
+        {
+            lz_insert(in, pos);
+        }
+        pos = end;
+        anchor = pos;
+    }
+
+    // Trailing literals
+    uint32_t literals = len - anchor;
+    if ((uint32_t)(oend - op) < 1 + literals + literals / 255 + 1)
+    {
+        return 0;
+    }
+    *op++ = (uint8_t)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15)
+    {
+        op = lz_put_length(op, literals - 15);
+    }
+    for (uint32_t i = 0; i < literals; i++)
+    {
+        *op++ = in[anchor + i];
+    }
+    return op - out;
+}
+
+// Decompress a block. Copies run 8 bytes at a time wherever the output
+// has room for the overshoot, falling back to single bytes near the end.
+int lz_decompress(const void *src, uint32_t len, void *dst, uint32_t capacity)
+{
+    const uint8_t *ip = (const uint8_t *)src;
+    const uint8_t *iend = ip + len;
+    uint8_t *out = (uint8_t *)dst;
+    uint8_t *op = out;
+    uint8_t *oend = out + capacity;
+
+    while (ip < iend)
+    {
+        uint32_t token = *ip++;
+
+        // Literals
+        uint32_t literals = token >> 4;
+        if (literals == 15)
+        {
+            uint32_t b;
+            do
+            {
+                if (ip >= iend)
+                {
+                    return -1;
+                }
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > (uint32_t)(iend - ip) || literals > (uint32_t)(oend - op))
+        {
+            return -1;
+        }
+        if (literals + 8 <= (uint32_t)(iend - ip) && literals + 8 <= (uint32_t)(oend - op))
+        {
+            for (uint32_t i = 0; i < literals; i += 8)
+            {
+                lz_copy8(op + i, ip + i);
+            }
+        }
+        else
+        {
+            for (uint32_t i = 0; i < literals; i++)
+            {
+                op[i] = ip[i];
+            }
+        }
+        ip += literals;
+        op += literals;
+        if (ip == iend)
+        {
+            break; // The last sequence has no match
+        }
+
+        // Match
+        if (iend - ip < 2)
+        {
+            return -1;
+        }
+        uint32_t offset = ip[0] | (uint32_t)ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - out))
+        {
+            return -1;
+        }
+        uint32_t match = token & 15;
+        if (match == 15)
+        {
+            uint32_t b;
+            do
+            {
+                if (ip >= iend)
+                {
+                    return -1;
+                }
+                b = *ip++;
+                match += b;
+            } while (b == 255);
+        }
+        match += LZ_MIN_MATCH;
+        if (match > (uint32_t)(oend - op))
+        {
+            return -1;
+        }
+
+        const uint8_t *from = op - offset;
+        if (offset >= 8 && match + 8 <= (uint32_t)(oend - op))
+        {
+            for (uint32_t i = 0; i < match; i += 8)
+            {
+                lz_copy8(op + i, from + i);
+            }
+        }
+        else
+        {
+            for (uint32_t i = 0; i < match; i++)
+            {
+                op[i] = from[i];
+            }
+        }
+        op += match;
+    }
+    return op - out;
+}
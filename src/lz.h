@@ -0,0 +1,24 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+
+// LZ4-style block codec used for compressed file content. A block is a
+// sequence of (literals, match) pairs, each led by a token byte whose high
+// nibble is the literal count and low nibble the match length - 4, with
+// 255-run extension bytes when a nibble is 15, and a 16-bit little-endian
+// match offset. The last 5 bytes are always literals.
+
+// Largest input lz_compress accepts
+#define LZ_MAX_INPUT 8192
+
+// Compress `len` bytes into at most `capacity` bytes. Returns the
+// compressed size, or 0 if the input is too large or does not fit, so a
+// capacity below `len` turns the call into a compressibility test.
+uint32_t lz_compress(const void *src, uint32_t len, void *dst, uint32_t capacity);
+
+// Decompress a block into at most `capacity` bytes. Returns the
+// decompressed size, or -1 if the block is malformed.
+int lz_decompress(const void *src, uint32_t len, void *dst, uint32_t capacity);
+
+#endif // LZ_H
@@ -0,0 +1,481 @@
+#include "pci.h"
+#include "utils.h"  // For port I/O
+#include "string.h" // For memset
+#include <stddef.h>
+
+void printf(const char *format, ...);
+
+// Enumerated functions
+static pci_device_t devices[PCI_MAX_DEVICES];
+static int device_count = 0;
+static bool pci_ready = false;
+
+// Registered drivers
+static const pci_driver_t *drivers[PCI_MAX_DRIVERS];
+static int driver_count = 0;
+
+// Lookup tables: heads of the per-ID and per-class chains, -1 when empty
+static int16_t id_heads[PCI_ID_HASH_SIZE];
+static int16_t class_heads[256];
+
+// Class names for lspci
+static const struct
+{
+    uint8_t class_code;
+    uint8_t subclass;
+    const char *name;
+} class_names[] = {
+    {0x01, 0x00, "SCSI controller"},
+    {0x01, 0x01, "IDE controller"},
+    {0x01, 0x05, "ATA controller"},
+    {0x01, 0x06, "SATA controller"},
+    {0x01, 0x08, "NVMe controller"},
+    {0x01, 0x80, "Storage controller"},
+    {0x02, 0x00, "Ethernet controller"},
+    {0x03, 0x00, "VGA controller"},
+    {0x04, 0x01, "Audio device"},
+    {0x04, 0x03, "Audio device"},
+    {0x06, 0x00, "Host bridge"},
+    {0x06, 0x01, "ISA bridge"},
+    {0x06, 0x04, "PCI bridge"},
+    {0x06, 0x80, "Bridge"},
+    {0x0C, 0x03, "USB controller"},
+    {0x0C, 0x05, "SMBus"},
+    {0x00, 0xFF, "Device"},
+};
+
+// Build the CONFIG_ADDRESS value for a register
+static uint32_t pci_config_address(pci_address_t addr, uint8_t offset)
+{
+    return 0x80000000u | ((uint32_t)addr.bus << 16) | ((uint32_t)addr.slot << 11) |
+           ((uint32_t)addr.func << 8) | (offset & 0xFC);
+}
+
+// Read a 32-bit configuration register
+uint32_t pci_config_read32(pci_address_t addr, uint8_t offset)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_config_address(addr, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+// Write a 32-bit configuration register
+void pci_config_write32(pci_address_t addr, uint8_t offset, uint32_t value)
+{
+    outl(PCI_CONFIG_ADDRESS, pci_config_address(addr, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+// Read a 16-bit configuration register
+uint16_t pci_config_read16(pci_address_t addr, uint8_t offset)
+{
+    return (pci_config_read32(addr, offset) >> ((offset & 2) * 8)) & 0xFFFF;
+}
+
+// Write a 16-bit configuration register
+void pci_config_write16(pci_address_t addr, uint8_t offset, uint16_t value)
+{
+    uint32_t shift = (offset & 2) * 8;
+    uint32_t reg = pci_config_read32(addr, offset);
+    reg = (reg & ~(0xFFFFu << shift)) | ((uint32_t)value << shift);
+    pci_config_write32(addr, offset, reg);
+}
+
+// Read an 8-bit configuration register
+uint8_t pci_config_read8(pci_address_t addr, uint8_t offset)
+{
+    return (pci_config_read32(addr, offset) >> ((offset & 3) * 8)) & 0xFF;
+}
+
+// Hash bucket for a vendor/device pair
+static int pci_id_bucket(uint16_t vendor, uint16_t device)
+{
+    return (vendor * 31 + device) & (PCI_ID_HASH_SIZE - 1);
+}
+
+// Size every BAR by writing all ones and reading back the decoded mask
+static void pci_size_bars(pci_device_t *dev)
+{
+    int count = dev->header_type == PCI_HEADER_BRIDGE ? 2 : PCI_MAX_BARS;
+
+    // Stop decoding while the BARs hold probe values
+    uint16_t command = pci_config_read16(dev->addr, PCI_COMMAND);
+    pci_config_write16(dev->addr, PCI_COMMAND, command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t offset = PCI_BAR0 + i * 4;
+        uint32_t original = pci_config_read32(dev->addr, offset);
+
+        pci_config_write32(dev->addr, offset, 0xFFFFFFFF);
+        uint32_t mask = pci_config_read32(dev->addr, offset);
+        pci_config_write32(dev->addr, offset, original);
+
+        pci_bar_t *bar = &dev->bars[i];
+        if (mask == 0 || mask == 0xFFFFFFFF)
+        {
+            continue; // Unimplemented
+        }
+
+        if (original & PCI_BAR_IO)
+        {
+            bar->io = true;
+            bar->base = original & ~0x3u;
+            bar->size = ~(mask & ~0x3u) + 1;
+            bar->size &= 0xFFFF; // I/O space is 64 KiB
+            continue;
+        }
+
+        bar->base = original & ~0xFu;
+        bar->size = ~(mask & ~0xFu) + 1;
+        bar->prefetchable = (original & PCI_BAR_PREFETCH) != 0;
+
+        if ((original & 0x6) == PCI_BAR_TYPE_64 && i + 1 < count)
+        {
+            // The upper half lives in the next BAR; only 32-bit addresses are usable here
+            bar->is_64bit = true;
+            i++;
+        }
+    }
+
+    pci_config_write16(dev->addr, PCI_COMMAND, command);
+}
+
+// Walk the capability list looking for MSI and MSI-X
+static void pci_parse_capabilities(pci_device_t *dev)
+{
+    if (!(pci_config_read16(dev->addr, PCI_STATUS) & PCI_STATUS_CAP_LIST))
+    {
+        return;
+    }
+
+    uint8_t offset = pci_config_read8(dev->addr, PCI_CAPABILITIES) & 0xFC;
+    for (int guard = 0; offset != 0 && guard < 48; guard++)
+    {
+        uint8_t id = pci_config_read8(dev->addr, offset);
+        uint16_t control = pci_config_read16(dev->addr, offset + 2);
+
+        if (id == PCI_CAP_ID_MSI)
+        {
+            dev->msi_offset = offset;
+            dev->msi_vectors = 1 << ((control >> 1) & 0x7);
+            dev->msi_64bit = (control & PCI_MSI_64BIT) != 0;
+            dev->msi_maskable = (control & PCI_MSI_PER_VECTOR_MASK) != 0;
+        }
+        else if (id == PCI_CAP_ID_MSIX)
+        {
+            dev->msix_offset = offset;
+            dev->msix_vectors = (control & 0x7FF) + 1;
+        }
+
+        offset = pci_config_read8(dev->addr, offset + 1) & 0xFC;
+    }
+}
+
+static void pci_scan_bus(uint8_t bus);
+
+// Record one function in the device table
+static void pci_add_function(pci_address_t addr)
+{
+    if (device_count >= PCI_MAX_DEVICES)
+    {
+        return;
+    }
+
+    int index = device_count++;
+    pci_device_t *dev = &devices[index];
+    memset(dev, 0, sizeof(*dev));
+
+    uint32_t id = pci_config_read32(addr, PCI_VENDOR_ID);
+    uint32_t class_reg = pci_config_read32(addr, PCI_REVISION);
+
+    dev->addr = addr;
+    dev->vendor_id = id & 0xFFFF;
+    dev->device_id = id >> 16;
+    dev->revision = class_reg & 0xFF;
+    dev->prog_if = (class_reg >> 8) & 0xFF;
+    dev->subclass = (class_reg >> 16) & 0xFF;
+    dev->class_code = class_reg >> 24;
+    dev->header_type = pci_config_read8(addr, PCI_HEADER_TYPE) & 0x7F;
+    dev->irq_line = pci_config_read8(addr, PCI_INTERRUPT_LINE);
+    dev->irq_pin = pci_config_read8(addr, PCI_INTERRUPT_PIN);
+
+    if (dev->header_type != PCI_HEADER_NORMAL && dev->header_type != PCI_HEADER_BRIDGE)
+    {
+        device_count--; // CardBus and unknown layouts are not supported
+        return;
+    }
+
+    pci_size_bars(dev);
+    pci_parse_capabilities(dev);
+
+    // Chain into the lookup tables (appended so scan order is kept)
+    dev->next_same_id = -1;
+    dev->next_same_class = -1;
+
+    int16_t *link = &id_heads[pci_id_bucket(dev->vendor_id, dev->device_id)];
+    while (*link >= 0)
+    {
+        link = &devices[*link].next_same_id;
+    }
+    *link = index;
+
+    link = &class_heads[dev->class_code];
+    while (*link >= 0)
+    {
+        link = &devices[*link].next_same_class;
+    }
+    *link = index;
+
+    // Follow bridges to the buses behind them
+    if (dev->class_code == PCI_CLASS_BRIDGE && dev->subclass == PCI_SUBCLASS_PCI_BRIDGE)
+    {
+        uint8_t secondary = pci_config_read8(addr, PCI_SECONDARY_BUS);
+        if (secondary > addr.bus)
+        {
+            pci_scan_bus(secondary);
+        }
+    }
+}
+
+// Scan every slot on a bus
+static void pci_scan_bus(uint8_t bus)
+{
+    for (int slot = 0; slot < 32; slot++)
+    {
+        pci_address_t addr = {bus, slot, 0};
+        if (pci_config_read16(addr, PCI_VENDOR_ID) == 0xFFFF)
+        {
+            continue;
+        }
+
+        int functions = (pci_config_read8(addr, PCI_HEADER_TYPE) & PCI_HEADER_MULTIFUNCTION) ? 8 : 1;
+        for (int func = 0; func < functions; func++)
+        {
+            addr.func = func;
+            if (pci_config_read16(addr, PCI_VENDOR_ID) != 0xFFFF)
+            {
+                pci_add_function(addr);
+            }
+        }
+    }
+}
+
+// Check whether a driver matches a function
+static bool pci_driver_matches(const pci_driver_t *driver, const pci_device_t *dev)
+{
+    return (driver->vendor_id == PCI_ANY_ID || driver->vendor_id == dev->vendor_id) &&
+           (driver->device_id == PCI_ANY_ID || driver->device_id == dev->device_id) &&
+           (driver->class_code == PCI_ANY_ID || driver->class_code == dev->class_code) &&
+           (driver->subclass == PCI_ANY_ID || driver->subclass == dev->subclass);
+}
+
+// Offer every unclaimed function to a driver
+static int pci_probe_driver(const pci_driver_t *driver)
+{
+    int claimed = 0;
+    for (int i = 0; i < device_count; i++)
+    {
+        if (devices[i].driver == NULL && pci_driver_matches(driver, &devices[i]) &&
+            driver->probe(&devices[i]))
+        {
+            devices[i].driver = driver;
+            claimed++;
+        }
+    }
+    return claimed;
+}
+
+// Enumerate every bus once
+void pci_init(void)
+{
+    if (pci_ready)
+    {
+        return;
+    }
+    pci_ready = true;
+
+    for (int i = 0; i < PCI_ID_HASH_SIZE; i++)
+    {
+        id_heads[i] = -1;
+    }
+    for (int i = 0; i < 256; i++)
+    {
+        class_heads[i] = -1;
+    }
+
+    // A multi-function host bridge means one root bus per function
+    pci_address_t host = {0, 0, 0};
+    if (pci_config_read8(host, PCI_HEADER_TYPE) & PCI_HEADER_MULTIFUNCTION)
+    {
+        for (int func = 0; func < 8; func++)
+        {
+            host.func = func;
+            if (pci_config_read16(host, PCI_VENDOR_ID) != 0xFFFF)
+            {
+                pci_scan_bus(func);
+            }
+        }
+    }
+    else
+    {
+        pci_scan_bus(0);
+    }
+
+    // Drivers registered before enumeration get their probe now
+    for (int i = 0; i < driver_count; i++)
+    {
+        pci_probe_driver(drivers[i]);
+    }
+}
+
+// Get the number of enumerated functions
+int pci_device_count(void)
+{
+    pci_init();
+    return device_count;
+}
+
+// Get an enumerated function by index
+pci_device_t *pci_get_device(int index)
+{
+    pci_init();
+    if (index < 0 || index >= device_count)
+    {
+        return NULL;
+    }
+    return &devices[index];
+}
+
+// Find the first function with the given vendor and device ID
+pci_device_t *pci_find_device(uint16_t vendor, uint16_t device)
+{
+    pci_init();
+    for (int i = id_heads[pci_id_bucket(vendor, device)]; i >= 0; i = devices[i].next_same_id)
+    {
+        if (devices[i].vendor_id == vendor && devices[i].device_id == device)
+        {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+// Find the first function with the given class and subclass
+pci_device_t *pci_find_class(uint8_t class_code, uint8_t subclass)
+{
+    pci_init();
+    for (int i = class_heads[class_code]; i >= 0; i = devices[i].next_same_class)
+    {
+        if (devices[i].subclass == subclass)
+        {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+// Register a driver and probe matching functions
+int pci_register_driver(const pci_driver_t *driver)
+{
+    if (driver_count >= PCI_MAX_DRIVERS)
+    {
+        return 0;
+    }
+
+    // Enumerate first so the new driver is probed once, here, and its
+    // count reaches the caller
+    pci_init();
+    drivers[driver_count++] = driver;
+    return pci_probe_driver(driver);
+}
+
+// Turn on decoding and bus mastering
+void pci_enable_device(pci_device_t *dev)
+{
+    uint16_t command = pci_config_read16(dev->addr, PCI_COMMAND);
+    pci_config_write16(dev->addr, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+}
+
+// Get a human readable class name
+const char *pci_class_name(uint8_t class_code, uint8_t subclass)
+{
+    int count = sizeof(class_names) / sizeof(class_names[0]);
+    for (int i = 0; i < count - 1; i++)
+    {
+        if (class_names[i].class_code == class_code && class_names[i].subclass == subclass)
+        {
+            return class_names[i].name;
+        }
+    }
+    return class_names[count - 1].name;
+}
+
+// Format a value as `digits` lowercase hex digits
+static void pci_format_hex(uint32_t value, int digits, char *buffer)
+{
+    for (int i = digits - 1; i >= 0; i--)
+    {
+        buffer[i] = "0123456789abcdef"[value & 0xF];
+        value >>= 4;
+    }
+    buffer[digits] = '\0';
+}
+
+// Print the device table
+void pci_list_devices(void)
+{
+    pci_init();
+
+    if (device_count == 0)
+    {
+        printf("No PCI devices found\n");
+        return;
+    }
+
+    for (int i = 0; i < device_count; i++)
+    {
+        pci_device_t *dev = &devices[i];
+        char bus[3], slot[3], vendor[5], device[5], base[9];
+
+        pci_format_hex(dev->addr.bus, 2, bus);
+        pci_format_hex(dev->addr.slot, 2, slot);
+        pci_format_hex(dev->vendor_id, 4, vendor);
+        pci_format_hex(dev->device_id, 4, device);
+
+        printf("%s:%s.%d %s [%s:%s]", bus, slot, dev->addr.func,
+               pci_class_name(dev->class_code, dev->subclass), vendor, device);
+        if (dev->irq_pin != 0)
+        {
+            printf(" irq %d", dev->irq_line);
+        }
+        if (dev->driver != NULL)
+        {
+            printf(" (%s)", dev->driver->name);
+        }
+        printf("\n");
+
+        for (int b = 0; b < PCI_MAX_BARS; b++)
+        {
+            if (dev->bars[b].size == 0)
+            {
+                continue;
+            }
+            // I/O ranges and small windows are sized in bytes
+            bool kib = !dev->bars[b].io && dev->bars[b].size >= 1024;
+            pci_format_hex(dev->bars[b].base, dev->bars[b].io ? 4 : 8, base);
+            printf("    BAR%d: %s %s, %d %s%s\n", b, dev->bars[b].io ? "I/O" : "mem", base,
+                   kib ? dev->bars[b].size / 1024 : dev->bars[b].size, kib ? "KiB" : "bytes",
+                   dev->bars[b].prefetchable ? " prefetchable" : "");
+        }
+
+        if (dev->msi_offset != 0)
+        {
+            printf("    MSI: %d vectors%s%s\n", dev->msi_vectors,
+                   dev->msi_64bit ? ", 64-bit" : "", dev->msi_maskable ? ", maskable" : "");
+        }
+        if (dev->msix_offset != 0)
+        {
+            printf("    MSI-X: %d vectors\n", dev->msix_vectors);
+        }
+    }
+}
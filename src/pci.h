@@ -0,0 +1,175 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Configuration mechanism #1 ports
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+
+// Configuration space offsets
+#define PCI_VENDOR_ID 0x00
+#define PCI_DEVICE_ID 0x02
+#define PCI_COMMAND 0x04
+#define PCI_STATUS 0x06
+#define PCI_REVISION 0x08
+#define PCI_PROG_IF 0x09
+#define PCI_SUBCLASS 0x0A
+#define PCI_CLASS 0x0B
+#define PCI_HEADER_TYPE 0x0E
+#define PCI_BAR0 0x10
+#define PCI_SECONDARY_BUS 0x19 // PCI-to-PCI bridges
+#define PCI_CAPABILITIES 0x34
+#define PCI_INTERRUPT_LINE 0x3C
+#define PCI_INTERRUPT_PIN 0x3D
+
+// Command register bits
+#define PCI_COMMAND_IO 0x0001
+#define PCI_COMMAND_MEMORY 0x0002
+#define PCI_COMMAND_MASTER 0x0004
+
+// Status register bits
+#define PCI_STATUS_CAP_LIST 0x0010
+
+// Header types
+#define PCI_HEADER_NORMAL 0x00
+#define PCI_HEADER_BRIDGE 0x01
+#define PCI_HEADER_MULTIFUNCTION 0x80
+
+// BAR bits
+#define PCI_BAR_IO 0x01
+#define PCI_BAR_TYPE_64 0x04
+#define PCI_BAR_PREFETCH 0x08
+
+// Capability IDs
+#define PCI_CAP_ID_MSI 0x05
+#define PCI_CAP_ID_MSIX 0x11
+
+// MSI message control bits
+#define PCI_MSI_64BIT 0x0080
+#define PCI_MSI_PER_VECTOR_MASK 0x0100
+
+// Class codes
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_CLASS_BRIDGE 0x06
+#define PCI_SUBCLASS_IDE 0x01
+#define PCI_SUBCLASS_PCI_BRIDGE 0x04
+
+// Wildcard for driver ID and class matches
+#define PCI_ANY_ID 0xFFFF
+
+// Table sizes
+#define PCI_MAX_DEVICES 64
+#define PCI_MAX_DRIVERS 8
+#define PCI_MAX_BARS 6
+#define PCI_ID_HASH_SIZE 128
+
+// Location of a function on the bus
+typedef struct
+{
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+} pci_address_t;
+
+// Base address register, sized at enumeration
+typedef struct
+{
+    uint32_t base;
+    uint32_t size; // 0 if the BAR is unimplemented
+    bool io;
+    bool prefetchable;
+    bool is_64bit;
+} pci_bar_t;
+
+struct pci_driver;
+
+// Enumerated function
+typedef struct
+{
+    pci_address_t addr;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t revision;
+    uint8_t header_type;
+    uint8_t irq_line;
+    uint8_t irq_pin;
+    pci_bar_t bars[PCI_MAX_BARS];
+
+    // MSI capability, msi_offset is 0 if absent
+    uint8_t msi_offset;
+    uint8_t msi_vectors; // Vectors the function can request
+    bool msi_64bit;
+    bool msi_maskable;
+    uint8_t msix_offset;   // 0 if absent
+    uint16_t msix_vectors; // MSI-X table size
+
+    const struct pci_driver *driver; // Driver that claimed the function
+
+    // Chains through the lookup tables
+    int16_t next_same_id;
+    int16_t next_same_class;
+} pci_device_t;
+
+// Driver - matched by vendor/device ID and/or class; PCI_ANY_ID fields
+// match anything
+typedef struct pci_driver
+{
+    const char *name;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint16_t class_code;
+    uint16_t subclass;
+
+    // Set up a matching function; return true to claim it
+    bool (*probe)(pci_device_t *dev);
+} pci_driver_t;
+
+// Read a 32-bit configuration register
+uint32_t pci_config_read32(pci_address_t addr, uint8_t offset);
+
+// Write a 32-bit configuration register
+void pci_config_write32(pci_address_t addr, uint8_t offset, uint32_t value);
+
+// Read a 16-bit configuration register
+uint16_t pci_config_read16(pci_address_t addr, uint8_t offset);
+
+// Write a 16-bit configuration register
+void pci_config_write16(pci_address_t addr, uint8_t offset, uint16_t value);
+
+// Read an 8-bit configuration register
+uint8_t pci_config_read8(pci_address_t addr, uint8_t offset);
+
+// Enumerate every bus once and build the device table
+void pci_init(void);
+
+// Get the number of enumerated functions
+int pci_device_count(void);
+
+// Get an enumerated function by index
+pci_device_t *pci_get_device(int index);
+
+// Find the first function with the given vendor and device ID
+pci_device_t *pci_find_device(uint16_t vendor, uint16_t device);
+
+// Find the first function with the given class and subclass
+pci_device_t *pci_find_class(uint8_t class_code, uint8_t subclass);
+
+// Register a driver and probe every unclaimed matching function.
+// Returns the number of functions the driver claimed.
+int pci_register_driver(const pci_driver_t *driver);
+
+// Turn on I/O, memory and bus master decoding for a function
+void pci_enable_device(pci_device_t *dev);
+
+// Get a human readable class name
+const char *pci_class_name(uint8_t class_code, uint8_t subclass);
+
+// Print the device table (lspci)
+void pci_list_devices(void);
+
+#endif // PCI_H
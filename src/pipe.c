@@ -0,0 +1,71 @@
+#include "pipe.h"
+#include "string.h"
+#include <stddef.h>
+
+// Set up an empty pipe read by `drain`
+void pipe_init(pipe_t *pipe, pipe_drain_t drain, void *context)
+{
+    pipe->length = 0;
+    pipe->closed = false;
+    pipe->drain = drain;
+    pipe->context = context;
+}
+
+// Append bytes, draining the pipe whenever it fills
+uint32_t pipe_write(pipe_t *pipe, const void *data, uint32_t length)
+{
+    const char *bytes = data;
+    uint32_t written = 0;
+    while (written < length)
+    {
+        uint32_t space;
+        char *room = pipe_reserve(pipe, &space);
+        if (space == 0)
+        {
+            break; // The reader took nothing
+        }
+
+        uint32_t chunk = length - written < space ? length - written : space;
+        memcpy(room, bytes + written, chunk);
+        pipe_commit(pipe, chunk);
+        written += chunk;
+    }
+    return written;
+}
+
+// Get the free space at the end of the pipe, draining it first if it is
+// full, to be filled in place and then committed
+char *pipe_reserve(pipe_t *pipe, uint32_t *space)
+{
+    if (pipe_full(pipe))
+    {
+        pipe->drain(pipe, pipe->context);
+    }
+    *space = PIPE_SIZE - pipe->length;
+    return pipe->data + pipe->length;
+}
+
+// Append `length` bytes written into the space from pipe_reserve
+void pipe_commit(pipe_t *pipe, uint32_t length)
+{
+    pipe->length += length;
+}
+
+// Drop the first `length` unread bytes
+void pipe_consume(pipe_t *pipe, uint32_t length)
+{
+    if (length >= pipe->length)
+    {
+        pipe->length = 0;
+        return;
+    }
+    memmove(pipe->data, pipe->data + length, pipe->length - length);
+    pipe->length -= length;
+}
+
+// Mark the end of the data and let the reader take the rest
+void pipe_close(pipe_t *pipe)
+{
+    pipe->closed = true;
+    pipe->drain(pipe, pipe->context);
+}
@@ -0,0 +1,56 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Bounded in-kernel pipe between two shell commands. The writer appends;
+// when the buffer is full, the reader's drain function runs on what is
+// buffered and must make room before the write goes on. Unread bytes
+// stay at the start of the buffer so the reader can scan them in place,
+// and consuming moves what is left over (usually part of a line) down.
+
+#define PIPE_SIZE 4096
+
+typedef struct pipe pipe_t;
+
+// Runs the reader when the pipe is full, and once more after it closes.
+// A drain of a full pipe must consume something, or the write ends short.
+typedef void (*pipe_drain_t)(pipe_t *pipe, void *context);
+
+struct pipe
+{
+    char data[PIPE_SIZE];
+    uint32_t length; // Unread bytes at the start of data
+    bool closed;     // The writer is done
+    pipe_drain_t drain;
+    void *context;
+};
+
+// Set up an empty pipe read by `drain`
+void pipe_init(pipe_t *pipe, pipe_drain_t drain, void *context);
+
+// Append bytes, draining the pipe whenever it fills. Returns the number
+// appended, which is short if a drain left the pipe full.
+uint32_t pipe_write(pipe_t *pipe, const void *data, uint32_t length);
+
+// Get the free space at the end of the pipe, draining it first if it is
+// full, to be filled in place and then committed
+char *pipe_reserve(pipe_t *pipe, uint32_t *space);
+
+// Append `length` bytes written into the space from pipe_reserve
+void pipe_commit(pipe_t *pipe, uint32_t length);
+
+// Drop the first `length` unread bytes
+void pipe_consume(pipe_t *pipe, uint32_t length);
+
+// Mark the end of the data and let the reader take the rest
+void pipe_close(pipe_t *pipe);
+
+// Check whether the pipe has no free space
+static inline bool pipe_full(const pipe_t *pipe)
+{
+    return pipe->length == PIPE_SIZE;
+}
+
+#endif // PIPE_H
@@ -0,0 +1,39 @@
+#include "ramdisk.h"
+#include "string.h" // For memory operations
+
+// Backing storage for the RAM disk
+static uint8_t ramdisk_data[RAMDISK_SECTORS][BLOCKDEV_SECTOR_SIZE];
+static blockdev_t ramdisk_dev;
+static bool ramdisk_ready = false;
+
+// Read sectors from the RAM disk
+static bool ramdisk_read(blockdev_t *dev, uint32_t lba, uint32_t count, void *buffer)
+{
+    (void)dev;
+    memcpy(buffer, ramdisk_data[lba], count * BLOCKDEV_SECTOR_SIZE);
+    return true;
+}
+
+// Write sectors to the RAM disk
+static bool ramdisk_write(blockdev_t *dev, uint32_t lba, uint32_t count, const void *buffer)
+{
+    (void)dev;
+    memcpy(ramdisk_data[lba], buffer, count * BLOCKDEV_SECTOR_SIZE);
+    return true;
+}
+
+// Initialize the RAM disk and register it as "ram0"
+blockdev_t *ramdisk_init(void)
+{
+    if (!ramdisk_ready)
+    {
+        strcpy(ramdisk_dev.name, "ram0");
+        ramdisk_dev.sector_count = RAMDISK_SECTORS;
+        ramdisk_dev.read = ramdisk_read;
+        ramdisk_dev.write = ramdisk_write;
+        ramdisk_dev.driver_data = NULL;
+        blockdev_register(&ramdisk_dev);
+        ramdisk_ready = true;
+    }
+    return &ramdisk_dev;
+}
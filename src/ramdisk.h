@@ -0,0 +1,12 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include "blockdev.h"
+
+// RAM disk size in sectors (4 MiB)
+#define RAMDISK_SECTORS 8192
+
+// Initialize the RAM disk and register it as "ram0"
+blockdev_t *ramdisk_init(void);
+
+#endif // RAMDISK_H
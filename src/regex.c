@@ -0,0 +1,954 @@
+#include "regex.h"
+#include "string.h"
+
+// NFA state types
+#define RX_CHAR 0  // Consume a byte in the state's set
+#define RX_SPLIT 1 // Continue at out and out1
+#define RX_EMPTY 2 // Continue at out
+#define RX_BOL 3   // Continue at out at the start of a line
+#define RX_EOL 4   // Continue at out at the end of a line
+#define RX_MATCH 5
+
+#define RX_NONE -1
+
+// DFA transitions below 0 are not states
+#define DFA_UNKNOWN -1  // Not computed yet
+#define DFA_MATCH -2    // The line matches
+#define DFA_LINE_END -3 // Newline: the line matches if the state accepts there
+
+// Member slots shared by the cached DFA states
+#define DFA_MEMBERS (REGEX_DFA_STATES * 32)
+
+// Times the DFA cache may fill during one scan before the NFA takes over
+#define DFA_MAX_FLUSHES 8
+
+#define RX_SET_WORDS (REGEX_MAX_STATES / 32)
+
+// NFA state. `out` and `out1` double as links of a fragment's list of
+// unconnected exits while the pattern is parsed.
+typedef struct
+{
+    uint8_t type;
+    int16_t out;
+    int16_t out1;
+    uint32_t bytes[8]; // RX_CHAR: bytes it accepts
+} rx_state_t;
+
+// Part of the NFA being built: its entry and its unconnected exits
+typedef struct
+{
+    int start;
+    int exits; // Slot list: state * 2 + (0 for out, 1 for out1)
+} rx_frag_t;
+
+// Compiled pattern
+static rx_state_t rx_states[REGEX_MAX_STATES];
+static int rx_count = 0;
+static int rx_start = RX_NONE;
+static int rx_match = RX_NONE;
+static bool rx_compiled = false;
+static int rx_flags = 0;
+static uint8_t rx_prefix[REGEX_MAX_PREFIX]; // Every match starts with it
+static uint32_t rx_prefix_len = 0;
+
+// Parser state
+static const char *rx_pos;
+static const char *rx_err = NULL;
+
+// Closure scratch
+static uint32_t rx_visited[RX_SET_WORDS];
+static int16_t rx_stack[2 * REGEX_MAX_STATES + 2];
+static uint32_t rx_step_set[RX_SET_WORDS];
+
+// Lazily built DFA: each state is a sorted set of NFA states
+static int16_t dfa_next[REGEX_DFA_STATES][256];
+static uint16_t dfa_first[REGEX_DFA_STATES]; // Into dfa_members
+static uint16_t dfa_size[REGEX_DFA_STATES];
+static uint32_t dfa_hash[REGEX_DFA_STATES];
+static bool dfa_eol[REGEX_DFA_STATES]; // Accepts at the end of a line
+static int16_t dfa_members[DFA_MEMBERS];
+static int dfa_count = 0;
+static int dfa_used = 0;
+static int dfa_flushes = 0;
+static bool dfa_start_matches = false; // Every line matches
+static bool dfa_empty_matches = false; // An empty line matches
+static int16_t dfa_list[REGEX_MAX_STATES];
+
+// Add a byte to a byte set
+static inline void rx_set_add(uint32_t *set, uint32_t c)
+{
+    set[c >> 5] |= 1u << (c & 31);
+}
+
+// Check a byte set
+static inline bool rx_set_has(const uint32_t *set, uint32_t c)
+{
+    return (set[c >> 5] >> (c & 31)) & 1;
+}
+
+// Record a parse error (the first one wins)
+static void rx_fail(const char *message)
+{
+    if (rx_err == NULL)
+    {
+        rx_err = message;
+    }
+}
+
+// Create an NFA state
+static int rx_new(uint8_t type, int out, int out1)
+{
+    if (rx_count == REGEX_MAX_STATES)
+    {
+        rx_fail("pattern too complex");
+        return RX_NONE;
+    }
+    rx_state_t *s = &rx_states[rx_count];
+    s->type = type;
+    s->out = out;
+    s->out1 = out1;
+    memset(s->bytes, 0, sizeof(s->bytes));
+    return rx_count++;
+}
+
+// Field an exit slot refers to
+static int16_t *rx_slot(int slot)
+{
+    return (slot & 1) ? &rx_states[slot >> 1].out1 : &rx_states[slot >> 1].out;
+}
+
+// Single-slot exit list
+static int rx_exit(int state, int which)
+{
+    int slot = state * 2 + which;
+    *rx_slot(slot) = RX_NONE;
+    return slot;
+}
+
+// Connect every exit in a list to a state
+static void rx_patch(int exits, int target)
+{
+    while (exits != RX_NONE)
+    {
+        int16_t *field = rx_slot(exits);
+        exits = *field;
+        *field = target;
+    }
+}
+
+// Join two exit lists
+static int rx_join(int a, int b)
+{
+    if (a == RX_NONE)
+    {
+        return b;
+    }
+    int last = a;
+    while (*rx_slot(last) != RX_NONE)
+    {
+        last = *rx_slot(last);
+    }
+    *rx_slot(last) = b;
+    return a;
+}
+
+// Fragment of a single state with one exit
+static rx_frag_t rx_single(int state)
+{
+    rx_frag_t frag = {state, RX_NONE};
+    if (state != RX_NONE)
+    {
+        frag.exits = rx_exit(state, 0);
+    }
+    return frag;
+}
+
+// Add the bytes of a class escape (\d \w \s, uppercase negated); false if
+// `c` is not one
+static bool rx_class_escape(uint32_t *set, char c)
+{
+    uint32_t bytes[8];
+    memset(bytes, 0, sizeof(bytes));
+    switch (c | 0x20)
+    {
+    case 'd':
+        for (uint32_t b = '0'; b <= '9'; b++)
+        {
+            rx_set_add(bytes, b);
+        }
+        break;
+    case 'w':
+        for (uint32_t b = 0; b < 256; b++)
+        {
+            if ((b >= '0' && b <= '9') || (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || b == '_')
+            {
+                rx_set_add(bytes, b);
+            }
+        }
+        break;
+    case 's':
+        rx_set_add(bytes, ' ');
+        rx_set_add(bytes, '\t');
+        rx_set_add(bytes, '\r');
+        rx_set_add(bytes, '\f');
+        rx_set_add(bytes, '\v');
+        break;
+    default:
+        return false;
+    }
+
+    bool negate = c >= 'A' && c <= 'Z';
+    for (int i = 0; i < 8; i++)
+    {
+        set[i] |= negate ? ~bytes[i] : bytes[i];
+    }
+    set['\n' >> 5] &= ~(1u << ('\n' & 31));
+    return true;
+}
+
+// Give every letter in a set its other case
+static void rx_fold_set(uint32_t *set)
+{
+    for (uint32_t c = 'a'; c <= 'z'; c++)
+    {
+        if (rx_set_has(set, c) || rx_set_has(set, c - 'a' + 'A'))
+        {
+            rx_set_add(set, c);
+            rx_set_add(set, c - 'a' + 'A');
+        }
+    }
+}
+
+// Parse a bracket class after its '['
+static void rx_parse_class(uint32_t *set)
+{
+    bool negate = *rx_pos == '^';
+    if (negate)
+    {
+        rx_pos++;
+    }
+
+    bool first = true;
+    while (*rx_pos != '\0' && (*rx_pos != ']' || first))
+    {
+        first = false;
+        uint8_t lo = (uint8_t)*rx_pos++;
+        if (lo == '\\' && *rx_pos != '\0')
+        {
+            if (rx_class_escape(set, *rx_pos))
+            {
+                rx_pos++;
+                continue;
+            }
+            lo = (uint8_t)*rx_pos++;
+        }
+
+        uint8_t hi = lo;
+        if (rx_pos[0] == '-' && rx_pos[1] != '\0' && rx_pos[1] != ']')
+        {
+            rx_pos++;
+            hi = (uint8_t)*rx_pos++;
+            if (hi == '\\' && *rx_pos != '\0')
+            {
+                hi = (uint8_t)*rx_pos++;
+            }
+            if (hi < lo)
+            {
+                rx_fail("bad range in [...]");
+                return;
+            }
+        }
+        for (uint32_t c = lo; c <= hi; c++)
+        {
+            rx_set_add(set, c);
+        }
+    }
+
+    if (*rx_pos != ']')
+    {
+        rx_fail("missing ]");
+        return;
+    }
+    rx_pos++;
+
+    if (rx_flags & REGEX_ICASE)
+    {
+        rx_fold_set(set);
+    }
+    if (negate)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            set[i] = ~set[i];
+        }
+    }
+    set['\n' >> 5] &= ~(1u << ('\n' & 31));
+}
+
+static rx_frag_t rx_parse_alt(void);
+
+// atom := literal | '.' | [class] | \escape | ^ | $ | ( alt )
+static rx_frag_t rx_parse_atom(void)
+{
+    char c = *rx_pos++;
+    int state;
+
+    switch (c)
+    {
+    case '(':
+    {
+        rx_frag_t frag = rx_parse_alt();
+        if (*rx_pos != ')')
+        {
+            rx_fail("missing )");
+        }
+        else
+        {
+            rx_pos++;
+        }
+        return frag;
+    }
+    case '*':
+    case '+':
+    case '?':
+        rx_fail("nothing to repeat");
+        return rx_single(RX_NONE);
+    case '^':
+        return rx_single(rx_new(RX_BOL, RX_NONE, RX_NONE));
+    case '$':
+        return rx_single(rx_new(RX_EOL, RX_NONE, RX_NONE));
+    }
+
+    state = rx_new(RX_CHAR, RX_NONE, RX_NONE);
+    if (state == RX_NONE)
+    {
+        return rx_single(RX_NONE);
+    }
+    uint32_t *set = rx_states[state].bytes;
+    if (c == '.')
+    {
+        memset(set, 0xFF, sizeof(rx_states[state].bytes));
+        set['\n' >> 5] &= ~(1u << ('\n' & 31));
+    }
+    else if (c == '[')
+    {
+        rx_parse_class(set);
+    }
+    else
+    {
+        if (c == '\\')
+        {
+            c = *rx_pos++;
+            if (c == '\0')
+            {
+                rx_fail("trailing \\");
+                rx_pos--;
+            }
+            else if (rx_class_escape(set, c))
+            {
+                return rx_single(state);
+            }
+            else if (c == 't')
+            {
+                c = '\t';
+            }
+        }
+        rx_set_add(set, (uint8_t)c);
+        if (rx_flags & REGEX_ICASE)
+        {
+            rx_fold_set(set);
+        }
+    }
+    return rx_single(state);
+}
+
+// repeat := atom ('*' | '+' | '?')*
+static rx_frag_t rx_parse_repeat(void)
+{
+    rx_frag_t frag = rx_parse_atom();
+
+    while (rx_err == NULL && (*rx_pos == '*' || *rx_pos == '+' || *rx_pos == '?'))
+    {
+        char op = *rx_pos++;
+        int split = rx_new(RX_SPLIT, frag.start, RX_NONE);
+        if (split == RX_NONE)
+        {
+            break;
+        }
+        if (op == '*')
+        {
+            rx_patch(frag.exits, split);
+            frag.start = split;
+            frag.exits = rx_exit(split, 1);
+        }
+        else if (op == '+')
+        {
+            rx_patch(frag.exits, split);
+            frag.exits = rx_exit(split, 1);
+        }
+        else
+        {
+            frag.start = split;
+            frag.exits = rx_join(frag.exits, rx_exit(split, 1));
+        }
+    }
+    return frag;
+}
+
+// concat := repeat*
+static rx_frag_t rx_parse_concat(void)
+{
+    rx_frag_t frag = {RX_NONE, RX_NONE};
+
+    while (rx_err == NULL && *rx_pos != '\0' && *rx_pos != '|' && *rx_pos != ')')
+    {
+        rx_frag_t next = rx_parse_repeat();
+        if (frag.start == RX_NONE)
+        {
+            frag = next;
+        }
+        else
+        {
+            rx_patch(frag.exits, next.start);
+            frag.exits = next.exits;
+        }
+    }
+
+    if (frag.start == RX_NONE)
+    {
+        frag = rx_single(rx_new(RX_EMPTY, RX_NONE, RX_NONE));
+    }
+    return frag;
+}
+
+// alt := concat ('|' concat)*
+static rx_frag_t rx_parse_alt(void)
+{
+    rx_frag_t frag = rx_parse_concat();
+
+    while (rx_err == NULL && *rx_pos == '|')
+    {
+        rx_pos++;
+        rx_frag_t other = rx_parse_concat();
+        int split = rx_new(RX_SPLIT, frag.start, other.start);
+        frag.start = split;
+        frag.exits = rx_join(frag.exits, other.exits);
+    }
+    return frag;
+}
+
+// Find the literal text every match must start with, so the scan can
+// jump between its occurrences. Only simple patterns have one.
+static void rx_find_prefix(const char *pattern)
+{
+    rx_prefix_len = 0;
+    if (strstr(pattern, "|") != NULL)
+    {
+        return;
+    }
+
+    const char *p = pattern;
+    if (*p == '^')
+    {
+        p++;
+    }
+    while (*p != '\0' && rx_prefix_len < REGEX_MAX_PREFIX)
+    {
+        uint8_t c = (uint8_t)*p;
+        if (c == '.' || c == '[' || c == '(' || c == ')' || c == '^' || c == '$' ||
+            c == '*' || c == '+' || c == '?')
+        {
+            break;
+        }
+        if (c == '\\')
+        {
+            c = (uint8_t)p[1];
+            if (c == '\0' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+            {
+                break;
+            }
+            p++;
+        }
+        p++;
+
+        // Case-insensitive prefixes are only usable without letters
+        bool letter = (c | 0x20) >= 'a' && (c | 0x20) <= 'z';
+        if ((rx_flags & REGEX_ICASE) && letter)
+        {
+            break;
+        }
+
+        // An optional last literal is not required
+        if (*p == '*' || *p == '?')
+        {
+            break;
+        }
+        rx_prefix[rx_prefix_len++] = c;
+        if (*p == '+')
+        {
+            break;
+        }
+    }
+}
+
+// Add the states reachable from `state` without consuming a byte to a set
+// of NFA states. Only byte-consuming, end-of-line and match states are
+// kept; `bol` says whether start-of-line assertions hold.
+static void rx_add(int state, bool bol, uint32_t *set)
+{
+    int top = 0;
+    rx_stack[top++] = state;
+
+    while (top > 0)
+    {
+        int s = rx_stack[--top];
+        if (s == RX_NONE || rx_set_has(rx_visited, s))
+        {
+            continue;
+        }
+        rx_set_add(rx_visited, s);
+
+        rx_state_t *st = &rx_states[s];
+        switch (st->type)
+        {
+        case RX_CHAR:
+        case RX_EOL:
+        case RX_MATCH:
+            rx_set_add(set, s);
+            break;
+        case RX_SPLIT:
+            rx_stack[top++] = st->out1;
+            rx_stack[top++] = st->out;
+            break;
+        case RX_EMPTY:
+            rx_stack[top++] = st->out;
+            break;
+        case RX_BOL:
+            if (bol)
+            {
+                rx_stack[top++] = st->out;
+            }
+            break;
+        }
+    }
+}
+
+// Check whether a set of NFA states matches when the line ends here;
+// `bol` is set for an empty line
+static bool rx_accepts_at_eol(const uint32_t *set, bool bol)
+{
+    uint32_t after[RX_SET_WORDS];
+    memset(after, 0, sizeof(after));
+    memset(rx_visited, 0, sizeof(rx_visited));
+
+    // Follow end-of-line assertions until nothing new is reached
+    bool grew = true;
+    for (int s = 0; s < rx_count; s++)
+    {
+        if (rx_set_has(set, s) && rx_states[s].type == RX_EOL)
+        {
+            rx_add(rx_states[s].out, bol, after);
+        }
+    }
+    while (grew)
+    {
+        grew = false;
+        for (int s = 0; s < rx_count; s++)
+        {
+            if (rx_set_has(after, s) && rx_states[s].type == RX_EOL && !rx_set_has(rx_visited, rx_states[s].out))
+            {
+                rx_add(rx_states[s].out, bol, after);
+                grew = true;
+            }
+        }
+    }
+    return rx_set_has(set, rx_match) || rx_set_has(after, rx_match);
+}
+
+// Step a set of NFA states over one byte, restarting the pattern at the
+// next position too (matches may start anywhere in a line)
+static void rx_step(const int16_t *members, int count, uint8_t c, uint32_t *next)
+{
+    memset(next, 0, RX_SET_WORDS * 4);
+    memset(rx_visited, 0, sizeof(rx_visited));
+    for (int i = 0; i < count; i++)
+    {
+        rx_state_t *st = &rx_states[members[i]];
+        if (st->type == RX_CHAR && rx_set_has(st->bytes, c))
+        {
+            rx_add(st->out, false, next);
+        }
+    }
+    rx_add(rx_start, false, next);
+}
+
+// List the members of a set in order; returns the count
+static int rx_members(const uint32_t *set, int16_t *list)
+{
+    int count = 0;
+    for (int w = 0; w < RX_SET_WORDS; w++)
+    {
+        for (uint32_t bits = set[w]; bits != 0; bits &= bits - 1)
+        {
+            list[count++] = w * 32 + __builtin_ctz(bits);
+        }
+    }
+    return count;
+}
+
+// Look up the DFA state for a set of NFA states, adding it if it is new.
+// Returns -1 if the cache is full.
+static int dfa_lookup(const uint32_t *set)
+{
+    int count = rx_members(set, dfa_list);
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < count; i++)
+    {
+        hash = (hash ^ (uint32_t)dfa_list[i]) * 16777619u;
+    }
+
+    for (int d = 0; d < dfa_count; d++)
+    {
+        if (dfa_hash[d] == hash && dfa_size[d] == count &&
+            memcmp(&dfa_members[dfa_first[d]], dfa_list, count * sizeof(int16_t)) == 0)
+        {
+            return d;
+        }
+    }
+
+    if (dfa_count == REGEX_DFA_STATES || dfa_used + count > DFA_MEMBERS)
+    {
+        return -1;
+    }
+    int d = dfa_count++;
+    dfa_first[d] = dfa_used;
+    dfa_size[d] = count;
+    dfa_hash[d] = hash;
+    memcpy(&dfa_members[dfa_used], dfa_list, count * sizeof(int16_t));
+    dfa_used += count;
+    dfa_eol[d] = rx_accepts_at_eol(set, false);
+    for (int c = 0; c < 256; c++)
+    {
+        dfa_next[d][c] = DFA_UNKNOWN;
+    }
+    dfa_next[d]['\n'] = DFA_LINE_END;
+    return d;
+}
+
+// Empty the DFA cache, leaving only the line start state (state 0)
+static void dfa_reset(void)
+{
+    uint32_t start[RX_SET_WORDS];
+    memset(start, 0, sizeof(start));
+    memset(rx_visited, 0, sizeof(rx_visited));
+    rx_add(rx_start, true, start);
+
+    dfa_count = 0;
+    dfa_used = 0;
+    dfa_start_matches = rx_set_has(start, rx_match);
+    dfa_empty_matches = rx_accepts_at_eol(start, true);
+    dfa_lookup(start);
+}
+
+// Compute and cache the transition of DFA state d on byte c
+static int dfa_step(int d, uint8_t c)
+{
+    rx_step(&dfa_members[dfa_first[d]], dfa_size[d], c, rx_step_set);
+    if (rx_set_has(rx_step_set, rx_match))
+    {
+        dfa_next[d][c] = DFA_MATCH;
+        return DFA_MATCH;
+    }
+
+    int next = dfa_lookup(rx_step_set);
+    if (next < 0)
+    {
+        dfa_flushes++;
+        dfa_reset();
+        return dfa_lookup(rx_step_set);
+    }
+    dfa_next[d][c] = next;
+    return next;
+}
+
+// Run the DFA over one line starting at p. Returns 1 if it matches, 0 if
+// not, or -1 if the cache thrashed and the NFA should take over.
+static int dfa_match_line(const uint8_t *p, const uint8_t *end)
+{
+    int s = 0;
+    if (p == end || *p == '\n')
+    {
+        return dfa_empty_matches;
+    }
+    while (p < end)
+    {
+        int next = dfa_next[s][*p];
+        if (next >= 0)
+        {
+            s = next;
+            p++;
+            continue;
+        }
+        if (next == DFA_LINE_END)
+        {
+            return dfa_eol[s];
+        }
+        if (next == DFA_MATCH)
+        {
+            return 1;
+        }
+
+        next = dfa_step(s, *p);
+        if (next == DFA_MATCH)
+        {
+            return 1;
+        }
+        if (dfa_flushes > DFA_MAX_FLUSHES)
+        {
+            return -1;
+        }
+        s = next;
+        p++;
+    }
+    return dfa_eol[s];
+}
+
+// Simulate the NFA over one line starting at p
+static bool nfa_match_line(const uint8_t *p, const uint8_t *end)
+{
+    uint32_t set[RX_SET_WORDS];
+    memset(set, 0, sizeof(set));
+    memset(rx_visited, 0, sizeof(rx_visited));
+    rx_add(rx_start, true, set);
+    if (p == end || *p == '\n')
+    {
+        return rx_accepts_at_eol(set, true);
+    }
+
+    for (; p < end && *p != '\n'; p++)
+    {
+        if (rx_set_has(set, rx_match))
+        {
+            return true;
+        }
+        int count = rx_members(set, dfa_list);
+        rx_step(dfa_list, count, *p, set);
+    }
+    return rx_accepts_at_eol(set, false);
+}
+
+// Compile a pattern
+bool regex_compile(const char *pattern, int flags)
+{
+    rx_count = 0;
+    rx_err = NULL;
+    rx_flags = flags;
+    rx_compiled = false;
+    rx_pos = pattern;
+
+    rx_frag_t frag = rx_parse_alt();
+    if (rx_err == NULL && *rx_pos == ')')
+    {
+        rx_fail("unmatched )");
+    }
+    rx_match = rx_new(RX_MATCH, RX_NONE, RX_NONE);
+    if (rx_err != NULL)
+    {
+        return false;
+    }
+    rx_patch(frag.exits, rx_match);
+    rx_start = frag.start;
+
+    rx_find_prefix(pattern);
+    dfa_reset();
+    rx_compiled = true;
+    return true;
+}
+
+// Describe the last compile error
+const char *regex_error(void)
+{
+    return rx_err != NULL ? rx_err : "no error";
+}
+
+// Count newlines in [p, end)
+static uint32_t rx_count_lines(const uint8_t *p, const uint8_t *end)
+{
+    uint32_t lines = 0;
+    while ((p = memchr(p, '\n', end - p)) != NULL)
+    {
+        lines++;
+        p++;
+    }
+    return lines;
+}
+
+// Find the next occurrence of the literal prefix at or after p
+static const uint8_t *rx_next_prefix(const uint8_t *p, const uint8_t *end)
+{
+    while (end - p >= (int)rx_prefix_len)
+    {
+        const uint8_t *hit = memchr(p, rx_prefix[0], end - p - rx_prefix_len + 1);
+        if (hit == NULL || memcmp(hit, rx_prefix, rx_prefix_len) == 0)
+        {
+            return hit;
+        }
+        p = hit + 1;
+    }
+    return NULL;
+}
+
+// Report the lines of a buffer that match
+uint32_t regex_scan(const char *text, uint32_t length, uint32_t *line_number, regex_report_t report,
+                    void *context)
+{
+    const uint8_t *p = (const uint8_t *)text;
+    const uint8_t *end = p + length;
+    uint32_t line = line_number != NULL ? *line_number : 0;
+    uint32_t matches = 0;
+    bool use_nfa = false;
+
+    if (!rx_compiled)
+    {
+        return 0;
+    }
+    dfa_flushes = 0;
+
+    while (p < end)
+    {
+        // Skip to the line holding the next occurrence of the prefix
+        if (rx_prefix_len > 0)
+        {
+            const uint8_t *hit = rx_next_prefix(p, end);
+            const uint8_t *start = hit != NULL ? hit : end;
+            while (start > p && start[-1] != '\n')
+            {
+                start--;
+            }
+            if (line_number != NULL)
+            {
+                line += rx_count_lines(p, start);
+            }
+            p = start;
+            if (hit == NULL)
+            {
+                break;
+            }
+        }
+
+        int matched = 1;
+        if (!dfa_start_matches)
+        {
+            matched = use_nfa ? -1 : dfa_match_line(p, end);
+            if (matched < 0)
+            {
+                use_nfa = true;
+                matched = nfa_match_line(p, end);
+            }
+        }
+
+        const uint8_t *eol = memchr(p, '\n', end - p);
+        if (eol == NULL)
+        {
+            eol = end;
+        }
+        if (matched)
+        {
+            report((const char *)p, eol - p, line, context);
+            matches++;
+        }
+        if (eol < end)
+        {
+            line++;
+        }
+        p = eol + 1;
+    }
+
+    if (line_number != NULL)
+    {
+        *line_number = line;
+    }
+    return matches;
+}
+
+// Check whether a byte matches a glob bracket class starting after '[';
+// sets *next past the class
+static bool glob_class(const char *p, uint8_t c, const char **next)
+{
+    bool negate = *p == '!' || *p == '^';
+    bool found = false;
+    if (negate)
+    {
+        p++;
+    }
+
+    bool first = true;
+    while (*p != '\0' && (*p != ']' || first))
+    {
+        first = false;
+        uint8_t lo = (uint8_t)*p++;
+        uint8_t hi = lo;
+        if (p[0] == '-' && p[1] != '\0' && p[1] != ']')
+        {
+            hi = (uint8_t)p[1];
+            p += 2;
+        }
+        if (c >= lo && c <= hi)
+        {
+            found = true;
+        }
+    }
+    *next = *p == ']' ? p + 1 : p;
+    return found != negate;
+}
+
+// Match a shell glob; '*' backtracks to the most recent star only
+bool glob_match(const char *pattern, const char *name)
+{
+    const char *star = NULL;
+    const char *resume = NULL;
+
+    while (*name != '\0')
+    {
+        const char *next = pattern + 1;
+        if (*pattern == '*')
+        {
+            star = pattern++;
+            resume = name;
+            continue;
+        }
+        if ((*pattern == '?') ||
+            (*pattern == '[' && glob_class(pattern + 1, (uint8_t)*name, &next)) ||
+            (*pattern != '\0' && *pattern != '[' && *pattern == *name))
+        {
+            pattern = next;
+            name++;
+            continue;
+        }
+        if (star == NULL)
+        {
+            return false;
+        }
+        pattern = star + 1;
+        name = ++resume;
+    }
+
+    while (*pattern == '*')
+    {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+// Check for glob metacharacters
+bool glob_is_pattern(const char *pattern)
+{
+    for (; *pattern != '\0'; pattern++)
+    {
+        if (*pattern == '*' || *pattern == '?' || *pattern == '[')
+        {
+            return true;
+        }
+    }
+    return false;
+}
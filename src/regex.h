@@ -0,0 +1,44 @@
+#ifndef REGEX_H
+#define REGEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Line-oriented regular expressions for grep. Supported syntax:
+//   c  .  [abc]  [^a-z]  \d \w \s (and \D \W \S)  \. (any escaped byte)
+//   x*  x+  x?  xy  x|y  (x)  ^  $
+// One pattern is compiled at a time. It is matched by a DFA built lazily
+// from the pattern's NFA, one state per distinct set of NFA states met in
+// the text; when the DFA outgrows its cache too often, scanning falls
+// back to simulating the NFA.
+
+// Compile flags
+#define REGEX_ICASE 0x01
+
+// Limits
+#define REGEX_MAX_STATES 512    // NFA states
+#define REGEX_DFA_STATES 128    // DFA states cached at once
+#define REGEX_MAX_PREFIX 32     // Literal prefix used to skip ahead
+
+// Called for each matching line (without its newline)
+typedef void (*regex_report_t)(const char *line, uint32_t length, uint32_t line_number, void *context);
+
+// Compile a pattern; false if it is invalid (see regex_error)
+bool regex_compile(const char *pattern, int flags);
+
+// Describe why the last regex_compile failed
+const char *regex_error(void);
+
+// Report every line of `text` the compiled pattern matches. If
+// `line_number` is given it is the number of the first line on entry and
+// advanced past the text on return. Returns the number of matching lines.
+uint32_t regex_scan(const char *text, uint32_t length, uint32_t *line_number, regex_report_t report,
+                    void *context);
+
+// Check whether a name matches a shell glob (* ? [...])
+bool glob_match(const char *pattern, const char *name);
+
+// Check whether a string contains glob metacharacters
+bool glob_is_pattern(const char *pattern);
+
+#endif // REGEX_H
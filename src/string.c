@@ -178,4 +178,123 @@ int atoi(const char *str)
     }
 
     return sign * result;
-}
\ No newline at end of file
+}
+
+// Copy n bytes (regions must not overlap)
+void *memcpy(void *dest, const void *src, size_t n)
+{
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    // Move whole words while both pointers share alignment
+    if ((((uintptr_t)d ^ (uintptr_t)s) & 3) == 0)
+    {
+        while (n && ((uintptr_t)d & 3))
+        {
+            *d++ = *s++;
+            n--;
+        }
+        while (n >= 4)
+        {
+            *(uint32_t *)d = *(const uint32_t *)s;
+            d += 4;
+            s += 4;
+            n -= 4;
+        }
+    }
+
+    while (n--)
+    {
+        *d++ = *s++;
+    }
+    return dest;
+}
+
+// Copy n bytes (regions may overlap)
+void *memmove(void *dest, const void *src, size_t n)
+{
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+
+    if (d <= s || d >= s + n)
+    {
+        return memcpy(dest, src, n);
+    }
+
+    // Overlapping with dest above src: copy backwards
+    d += n;
+    s += n;
+    while (n--)
+    {
+        *--d = *--s;
+    }
+    return dest;
+}
+
+// Fill n bytes with a value
+void *memset(void *dest, int value, size_t n)
+{
+    uint8_t *d = (uint8_t *)dest;
+    while (n--)
+    {
+        *d++ = (uint8_t)value;
+    }
+    return dest;
+}
+
+// Compare n bytes
+int memcmp(const void *s1, const void *s2, size_t n)
+{
+    const uint8_t *a = (const uint8_t *)s1;
+    const uint8_t *b = (const uint8_t *)s2;
+    while (n--)
+    {
+        if (*a != *b)
+        {
+            return *a - *b;
+        }
+        a++;
+        b++;
+    }
+    return 0;
+}
+
+// Find a byte, testing a word at a time once aligned
+void *memchr(const void *s, int c, size_t n)
+{
+    const uint8_t *p = (const uint8_t *)s;
+    uint8_t byte = (uint8_t)c;
+
+    while (n && ((uintptr_t)p & 3))
+    {
+        if (*p == byte)
+        {
+            return (void *)p;
+        }
+        p++;
+        n--;
+    }
+
+    // A word holds the byte if XORing it in leaves a zero byte
+    uint32_t pattern = byte * 0x01010101u;
+    while (n >= 4)
+    {
+        uint32_t word = *(const uint32_t *)p ^ pattern;
+        if ((word - 0x01010101u) & ~word & 0x80808080u)
+        {
+            break;
+        }
+        p += 4;
+        n -= 4;
+    }
+
+    while (n--)
+    {
+        if (*p == byte)
+        {
+            return (void *)p;
+        }
+        p++;
+    }
+    return NULL;
+}
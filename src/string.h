@@ -35,4 +35,19 @@ char *itoa(int num, char *str, int base);
 // String to integer conversion
 int atoi(const char *str);
 
+// Copy n bytes (regions must not overlap)
+void *memcpy(void *dest, const void *src, size_t n);
+
+// Copy n bytes (regions may overlap)
+void *memmove(void *dest, const void *src, size_t n);
+
+// Fill n bytes with a value
+void *memset(void *dest, int value, size_t n);
+
+// Compare n bytes
+int memcmp(const void *s1, const void *s2, size_t n);
+
+// Find the first occurrence of a byte in n bytes
+void *memchr(const void *s, int c, size_t n);
+
 #endif // STRING_H
\ No newline at end of file
@@ -0,0 +1,446 @@
+#include "syntax.h"
+#include "string.h"
+#include "vga.h"
+
+// Attribute bytes (foreground on black)
+#define SYNTAX_ATTR(fg) ((uint8_t)((fg) | (VGA_COLOR_BLACK << 4)))
+#define COLOR_PLAIN SYNTAX_ATTR(VGA_COLOR_LIGHT_GREY)
+#define COLOR_COMMENT SYNTAX_ATTR(VGA_COLOR_GREEN)
+#define COLOR_KEYWORD SYNTAX_ATTR(VGA_COLOR_LIGHT_CYAN)
+#define COLOR_TYPE SYNTAX_ATTR(VGA_COLOR_LIGHT_BLUE)
+#define COLOR_STRING SYNTAX_ATTR(VGA_COLOR_LIGHT_BROWN)
+#define COLOR_NUMBER SYNTAX_ATTR(VGA_COLOR_LIGHT_MAGENTA)
+#define COLOR_DIRECTIVE SYNTAX_ATTR(VGA_COLOR_LIGHT_RED)
+
+// C lexer states
+#define C_NORMAL 0
+#define C_COMMENT 1 // Inside /* */
+
+// Shell lexer states
+#define SH_NORMAL 0
+#define SH_DOUBLE 1 // Inside "..."
+#define SH_SINGLE 2 // Inside '...'
+
+static const char *c_keywords[] = {
+    "break", "case", "continue", "default", "do", "else", "enum", "extern", "for", "goto", "if",
+    "inline", "register", "return", "sizeof", "static", "struct", "switch", "typedef", "union",
+    "volatile", "while", "const", "true", "false", "NULL", NULL};
+
+static const char *c_types[] = {
+    "void", "char", "short", "int", "long", "float", "double", "signed", "unsigned", "bool",
+    "size_t", "int8_t", "int16_t", "int32_t", "int64_t", "uint8_t", "uint16_t", "uint32_t",
+    "uint64_t", "uintptr_t", NULL};
+
+static const char *sh_keywords[] = {
+    "if", "then", "else", "elif", "fi", "for", "while", "until", "do", "done", "case", "esac",
+    "in", "function", "return", "break", "continue", "export", "local", "exit", NULL};
+
+// Fill colors[from..to) if colors are wanted
+static void syntax_paint(uint8_t *colors, int from, int to, uint8_t color)
+{
+    if (colors && to > from)
+    {
+        memset(colors + from, color, to - from);
+    }
+}
+
+// Check whether a character can appear in an identifier
+static bool syntax_is_word(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Check whether a character is a decimal digit
+static bool syntax_is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Check whether line[start..start+length) is one of the words in a list
+static bool syntax_in_list(const char **list, const char *word, int length)
+{
+    for (int i = 0; list[i]; i++)
+    {
+        if ((int)strlen(list[i]) == length && strncmp(list[i], word, length) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Find the end of a quoted string starting after its opening quote at
+// `i`; backslash escapes the next character. Returns the index past the
+// closing quote, or the line length if it is unterminated.
+static int syntax_skip_quoted(const char *line, int length, int i, char quote, bool escapes)
+{
+    while (i < length)
+    {
+        if (escapes && line[i] == '\\' && i + 1 < length)
+        {
+            i += 2;
+            continue;
+        }
+        if (line[i++] == quote)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+// Lex a line of C
+static uint8_t syntax_lex_c(const char *line, int length, uint8_t state, uint8_t *colors)
+{
+    int i = 0;
+    syntax_paint(colors, 0, length, COLOR_PLAIN);
+
+    // A directive is '#' as the first non-blank on a line outside a comment
+    if (state == C_NORMAL)
+    {
+        int start = 0;
+        while (start < length && (line[start] == ' ' || line[start] == '\t'))
+        {
+            start++;
+        }
+        if (start < length && line[start] == '#')
+        {
+            i = start + 1;
+            while (i < length && (line[i] == ' ' || line[i] == '\t'))
+            {
+                i++;
+            }
+            while (i < length && syntax_is_word(line[i]))
+            {
+                i++;
+            }
+            syntax_paint(colors, start, i, COLOR_DIRECTIVE);
+
+            // #include <file>
+            int open = i;
+            while (open < length && line[open] == ' ')
+            {
+                open++;
+            }
+            if (open < length && line[open] == '<')
+            {
+                int close = syntax_skip_quoted(line, length, open + 1, '>', false);
+                syntax_paint(colors, open, close, COLOR_STRING);
+                i = close;
+            }
+        }
+    }
+
+    while (i < length)
+    {
+        int start = i;
+        char c = line[i];
+
+        if (state == C_COMMENT)
+        {
+            while (i < length && !(line[i] == '*' && i + 1 < length && line[i + 1] == '/'))
+            {
+                i++;
+            }
+            if (i < length)
+            {
+                i += 2;
+                state = C_NORMAL;
+            }
+            syntax_paint(colors, start, i, COLOR_COMMENT);
+        }
+        else if (c == '/' && i + 1 < length && line[i + 1] == '/')
+        {
+            syntax_paint(colors, start, length, COLOR_COMMENT);
+            i = length;
+        }
+        else if (c == '/' && i + 1 < length && line[i + 1] == '*')
+        {
+            state = C_COMMENT;
+            i += 2;
+            syntax_paint(colors, start, i, COLOR_COMMENT);
+        }
+        else if (c == '"' || c == '\'')
+        {
+            i = syntax_skip_quoted(line, length, i + 1, c, true);
+            syntax_paint(colors, start, i, COLOR_STRING);
+        }
+        else if (syntax_is_digit(c) || (c == '.' && i + 1 < length && syntax_is_digit(line[i + 1])))
+        {
+            while (i < length && (syntax_is_word(line[i]) || line[i] == '.'))
+            {
+                i++;
+            }
+            syntax_paint(colors, start, i, COLOR_NUMBER);
+        }
+        else if (syntax_is_word(c))
+        {
+            while (i < length && syntax_is_word(line[i]))
+            {
+                i++;
+            }
+            if (syntax_in_list(c_keywords, line + start, i - start))
+            {
+                syntax_paint(colors, start, i, COLOR_KEYWORD);
+            }
+            else if (syntax_in_list(c_types, line + start, i - start))
+            {
+                syntax_paint(colors, start, i, COLOR_TYPE);
+            }
+        }
+        else
+        {
+            i++;
+        }
+    }
+    return state;
+}
+
+// Lex a line of shell script
+static uint8_t syntax_lex_shell(const char *line, int length, uint8_t state, uint8_t *colors)
+{
+    int i = 0;
+    syntax_paint(colors, 0, length, COLOR_PLAIN);
+
+    while (i < length)
+    {
+        int start = i;
+        char c = line[i];
+
+        if (state == SH_SINGLE)
+        {
+            // No escapes inside single quotes
+            while (i < length && line[i] != '\'')
+            {
+                i++;
+            }
+            if (i < length)
+            {
+                i++;
+                state = SH_NORMAL;
+            }
+            syntax_paint(colors, start, i, COLOR_STRING);
+        }
+        else if (state == SH_DOUBLE)
+        {
+            while (i < length && line[i] != '"' && line[i] != '$')
+            {
+                i += (line[i] == '\\' && i + 1 < length) ? 2 : 1;
+            }
+            if (i < length && line[i] == '"')
+            {
+                i++;
+                state = SH_NORMAL;
+            }
+            syntax_paint(colors, start, i, COLOR_STRING);
+            if (i < length && line[i] == '$')
+            {
+                // Expansion inside the string; stay in the string after it
+                int end = i + 1;
+                if (end < length && line[end] == '{')
+                {
+                    while (end < length && line[end] != '}' && line[end] != '"')
+                    {
+                        end++;
+                    }
+                    if (end < length && line[end] == '}')
+                    {
+                        end++;
+                    }
+                }
+                else
+                {
+                    while (end < length && syntax_is_word(line[end]))
+                    {
+                        end++;
+                    }
+                }
+                syntax_paint(colors, i, end, COLOR_TYPE);
+                i = end;
+            }
+        }
+        else if (c == '#' && (i == 0 || line[i - 1] == ' ' || line[i - 1] == '\t' || line[i - 1] == ';'))
+        {
+            syntax_paint(colors, start, length, COLOR_COMMENT);
+            i = length;
+        }
+        else if (c == '"')
+        {
+            state = SH_DOUBLE;
+            i++;
+            syntax_paint(colors, start, i, COLOR_STRING);
+        }
+        else if (c == '\'')
+        {
+            state = SH_SINGLE;
+            i++;
+            syntax_paint(colors, start, i, COLOR_STRING);
+        }
+        else if (c == '\\')
+        {
+            i = (i + 2 < length) ? i + 2 : length;
+        }
+        else if (c == '$')
+        {
+            i++;
+            if (i < length && line[i] == '{')
+            {
+                while (i < length && line[i] != '}')
+                {
+                    i++;
+                }
+                if (i < length)
+                {
+                    i++;
+                }
+            }
+            else if (i < length && !syntax_is_word(line[i]))
+            {
+                i++; // $?, $#, $@ ...
+            }
+            else
+            {
+                while (i < length && syntax_is_word(line[i]))
+                {
+                    i++;
+                }
+            }
+            syntax_paint(colors, start, i, COLOR_TYPE);
+        }
+        else if (syntax_is_digit(c) && (i == 0 || !syntax_is_word(line[i - 1])))
+        {
+            while (i < length && syntax_is_word(line[i]))
+            {
+                i++;
+            }
+            syntax_paint(colors, start, i, COLOR_NUMBER);
+        }
+        else if (syntax_is_word(c))
+        {
+            while (i < length && syntax_is_word(line[i]))
+            {
+                i++;
+            }
+            if (syntax_in_list(sh_keywords, line + start, i - start))
+            {
+                syntax_paint(colors, start, i, COLOR_KEYWORD);
+            }
+        }
+        else
+        {
+            i++;
+        }
+    }
+    return state;
+}
+
+// Lex a line of a "key: value" / "key = value" / "[section]" config file
+static uint8_t syntax_lex_config(const char *line, int length, uint8_t state, uint8_t *colors)
+{
+    syntax_paint(colors, 0, length, COLOR_PLAIN);
+
+    int i = 0;
+    while (i < length && (line[i] == ' ' || line[i] == '\t'))
+    {
+        i++;
+    }
+    if (i == length)
+    {
+        return state;
+    }
+
+    if (line[i] == '#' || line[i] == ';')
+    {
+        syntax_paint(colors, i, length, COLOR_COMMENT);
+    }
+    else if (line[i] == '[')
+    {
+        syntax_paint(colors, i, syntax_skip_quoted(line, length, i + 1, ']', false), COLOR_DIRECTIVE);
+    }
+    else
+    {
+        int separator = i;
+        while (separator < length && line[separator] != ':' && line[separator] != '=')
+        {
+            separator++;
+        }
+        if (separator < length)
+        {
+            syntax_paint(colors, i, separator, COLOR_KEYWORD);
+            int value = separator + 1;
+            while (value < length && line[value] == ' ')
+            {
+                value++;
+            }
+            bool numeric = value < length;
+            for (int j = value; j < length; j++)
+            {
+                if (!syntax_is_digit(line[j]) && line[j] != '.')
+                {
+                    numeric = false;
+                    break;
+                }
+            }
+            syntax_paint(colors, value, length, numeric ? COLOR_NUMBER : COLOR_STRING);
+        }
+    }
+    return state;
+}
+
+static const syntax_t syntaxes[] = {
+    {"C", ".c .h", syntax_lex_c},
+    {"Shell", ".sh", syntax_lex_shell},
+    {"Config", ".cfg .conf .ini", syntax_lex_config},
+};
+
+// Find the highlighter for a file name, or NULL for plain text
+const syntax_t *syntax_for_file(const char *filename)
+{
+    if (!filename)
+    {
+        return NULL;
+    }
+
+    const char *extension = NULL;
+    for (const char *p = filename; *p; p++)
+    {
+        if (*p == '.')
+        {
+            extension = p;
+        }
+    }
+    if (!extension)
+    {
+        return NULL;
+    }
+    int length = strlen(extension);
+
+    for (uint32_t s = 0; s < sizeof(syntaxes) / sizeof(syntaxes[0]); s++)
+    {
+        const char *list = syntaxes[s].extensions;
+        while (*list)
+        {
+            int word = 0;
+            while (list[word] && list[word] != ' ')
+            {
+                word++;
+            }
+            if (word == length && strncmp(list, extension, length) == 0)
+            {
+                return &syntaxes[s];
+            }
+            list += word;
+            while (*list == ' ')
+            {
+                list++;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Attribute for text a highlighter leaves plain
+uint8_t syntax_plain_color(void)
+{
+    return COLOR_PLAIN;
+}
@@ -0,0 +1,34 @@
+#ifndef SYNTAX_H
+#define SYNTAX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Syntax highlighters for the editor. A highlighter lexes one line at a
+// time: it takes the lexer state at the start of the line (0 for the
+// first line) and returns the state at its end, which is the start state
+// of the next line. States carry constructs that span lines, such as C
+// block comments, so the editor can cache them per line and re-lex only
+// from an edited line until they converge again.
+
+// Lexer state at the start of a file
+#define SYNTAX_STATE_START 0
+
+// Lex a line: fill colors[0..length) with VGA attribute bytes (colors may
+// be NULL when only the end state is wanted) and return the end state
+typedef uint8_t (*syntax_lex_t)(const char *line, int length, uint8_t state, uint8_t *colors);
+
+typedef struct
+{
+    const char *name;
+    const char *extensions; // Space separated, with the dot
+    syntax_lex_t lex;
+} syntax_t;
+
+// Find the highlighter for a file name, or NULL for plain text
+const syntax_t *syntax_for_file(const char *filename);
+
+// Attribute for text a highlighter leaves plain
+uint8_t syntax_plain_color(void);
+
+#endif // SYNTAX_H
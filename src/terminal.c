@@ -2,6 +2,13 @@
 #include "vga.h"
 #include "string.h"
 #include "system.h"
+#include "fs.h"
+#include "pci.h"
+#include "bcache.h"
+#include "journal.h"
+#include "backup.h"
+#include "regex.h"
+#include "pipe.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -21,9 +28,6 @@ extern bool caps_lock;
 extern bool ctrl_pressed;
 extern int system_state;
 
-static const int VGA_WIDTH = 80;
-static const int VGA_HEIGHT = 25;
-
 // I/O functions
 extern uint8_t inb(uint16_t port);
 extern void outb(uint16_t port, uint8_t val);
@@ -66,96 +70,1282 @@ extern void draw_logo(void);
 extern const char keyboard_map[128];
 extern const char keyboard_map_shifted[128];
 
-// Command processing
-void execute_command(const char *command)
+// Print an error: `message` in red, then `detail` if given. Errors stay
+// on the screen when a command's output is piped or written to a file.
+static void command_error(const char *message, const char *detail)
 {
-    // Basic command parser
-    if (strcmp(command, "") == 0)
+    terminal_screen_begin();
+    terminal_writestring_colored(message, vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+    if (detail != NULL)
     {
-        return; // Empty command
+        terminal_writestring(detail);
     }
-    else if (strcmp(command, "help") == 0)
+    terminal_putchar('\n');
+    terminal_screen_end();
+}
+
+// Print how a command is used, on the screen like an error
+static void command_usage(const char *usage)
+{
+    terminal_screen_begin();
+    terminal_writestring("Usage: ");
+    terminal_writestring(usage);
+    terminal_putchar('\n');
+    terminal_screen_end();
+}
+
+// Print a file that failed the scrub
+static void report_corrupt_file(const char *filename, uint32_t bad_blocks)
+{
+    char number[16];
+    terminal_writestring_colored("  corrupt: ", vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+    terminal_writestring(filename);
+    terminal_writestring(" (");
+    itoa(bad_blocks, number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" bad blocks)\n");
+}
+
+// grep limits
+#define GREP_BUFFER_SIZE (16 * 1024) // File content scanned per read
+#define GREP_MAX_SHOWN 240           // Longest part of a matching line printed
+#define GREP_USAGE "grep [-i] [-n] <pattern> [file]..."
+
+// How grep prints matching lines
+typedef struct
+{
+    const char *filename; // NULL when a single file is searched
+    bool numbers;
+} grep_output_t;
+
+static char grep_buffer[GREP_BUFFER_SIZE];
+
+// Split a command's arguments at spaces, keeping "quoted" or 'quoted'
+// text together. Returns the number of arguments.
+static int split_arguments(const char *text, char *buffer, size_t size, char **args, int max)
+{
+    int count = 0;
+    size_t used = 0;
+
+    while (*text != '\0' && count < max)
     {
-        display_help();
+        while (*text == ' ')
+        {
+            text++;
+        }
+        if (*text == '\0')
+        {
+            break;
+        }
+
+        char quote = (*text == '"' || *text == '\'') ? *text++ : '\0';
+        args[count++] = &buffer[used];
+        while (*text != '\0' && (quote ? *text != quote : *text != ' ') && used + 1 < size)
+        {
+            buffer[used++] = *text++;
+        }
+        if (quote && *text == quote)
+        {
+            text++;
+        }
+        buffer[used++] = '\0';
+        if (used >= size)
+        {
+            break;
+        }
     }
-    else if (strcmp(command, "clear") == 0 || strcmp(command, "cls") == 0)
+    return count;
+}
+
+// Print a line grep matched
+static void grep_print_line(const char *line, uint32_t length, uint32_t line_number, void *context)
+{
+    grep_output_t *output = context;
+    char number[16];
+
+    if (output->filename != NULL)
     {
-        clear_screen();
+        terminal_writestring_colored(output->filename, vga_entry_color(VGA_COLOR_LIGHT_MAGENTA, VGA_COLOR_BLACK));
+        terminal_putchar(':');
     }
-    else if (strcmp(command, "about") == 0)
+    if (output->numbers)
     {
-        display_about();
+        itoa(line_number, number, 10);
+        terminal_writestring_colored(number, vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK));
+        terminal_putchar(':');
     }
-    else if (strcmp(command, "info") == 0 || strcmp(command, "sysinfo") == 0)
+    for (uint32_t i = 0; i < length && i < GREP_MAX_SHOWN; i++)
     {
-        display_system_info();
+        terminal_putchar(line[i] == '\r' ? ' ' : line[i]);
     }
-    else if (strcmp(command, "reboot") == 0)
+    terminal_putchar('\n');
+}
+
+// Print the lines of a file the compiled pattern matches. The file is
+// read in large chunks; a line cut off at the end of one is carried over
+// to the next. Returns the number of matches, or -1 if it cannot be read.
+static int grep_file(const char *filename, grep_output_t *output)
+{
+    int fd = fs_open(filename, FS_O_READ);
+    if (fd < 0)
     {
-        if (confirm_action("Are you sure you want to reboot the system? (y/n): "))
+        return -1;
+    }
+
+    uint32_t held = 0;
+    uint32_t line = 1;
+    uint32_t *line_number = output->numbers ? &line : NULL;
+    int matches = 0;
+    int got;
+
+    while ((got = fs_read(fd, grep_buffer + held, GREP_BUFFER_SIZE - held)) > 0)
+    {
+        held += got;
+        uint32_t end = held;
+        while (end > 0 && grep_buffer[end - 1] != '\n')
+        {
+            end--;
+        }
+        if (end == 0)
         {
-            simulate_reboot();
+            if (held < GREP_BUFFER_SIZE)
+            {
+                continue;
+            }
+            end = held; // A line longer than the buffer is scanned in pieces
         }
+
+        matches += regex_scan(grep_buffer, end, line_number, grep_print_line, output);
+        memmove(grep_buffer, grep_buffer + end, held - end);
+        held -= end;
     }
-    else if (strcmp(command, "shutdown") == 0 || strcmp(command, "halt") == 0)
+    if (held > 0)
     {
-        if (confirm_action("Are you sure you want to shut down the system? (y/n): "))
+        matches += regex_scan(grep_buffer, held, line_number, grep_print_line, output);
+    }
+
+    fs_close(fd);
+    return matches;
+}
+
+// Read grep's options. Returns the index of the pattern, or -1 if an
+// option is unknown or the pattern is missing.
+static int grep_options(int count, char **args, int *flags, grep_output_t *output)
+{
+    int i = 0;
+    for (; i < count && args[i][0] == '-' && args[i][1] != '\0'; i++)
+    {
+        for (const char *option = args[i] + 1; *option != '\0'; option++)
         {
-            perform_shutdown();
+            if (*option == 'i')
+            {
+                *flags |= REGEX_ICASE;
+            }
+            else if (*option == 'n')
+            {
+                output->numbers = true;
+            }
+            else
+            {
+                return -1;
+            }
         }
     }
-    else if (strcmp(command, "calendar") == 0)
+    return i < count ? i : -1;
+}
+
+// Compile grep's pattern, reporting a bad one
+static bool grep_compile(const char *pattern, int flags)
+{
+    if (!regex_compile(pattern, flags))
+    {
+        command_error("grep: ", regex_error());
+        return false;
+    }
+    return true;
+}
+
+// grep [-i] [-n] <pattern> <file|glob>..., given the arguments after "grep"
+static void grep_command(int count, char **args)
+{
+    int flags = 0;
+    grep_output_t output = {NULL, false};
+    int i = grep_options(count, args, &flags, &output);
+    if (i < 0 || count - i < 2)
+    {
+        command_usage(GREP_USAGE);
+        return;
+    }
+
+    if (!grep_compile(args[i], flags))
+    {
+        return;
+    }
+
+    bool single = count - i == 2 && !glob_is_pattern(args[i + 1]);
+    for (i++; i < count; i++)
     {
-        show_calendar();
+        if (!glob_is_pattern(args[i]))
+        {
+            output.filename = single ? NULL : args[i];
+            if (grep_file(args[i], &output) < 0)
+            {
+                command_error("grep: cannot read ", args[i]);
+            }
+            continue;
+        }
+
+        // Expand the glob over the visible files
+        bool any = false;
+        for (int index = 0; index < FS_MAX_FILES; index++)
+        {
+            file_t *file = fs_get_file_by_index(index);
+            if (file == NULL || file->type == FS_TYPE_DIRECTORY || file->type == FS_TYPE_HIDDEN ||
+                !glob_match(args[i], file->filename))
+            {
+                continue;
+            }
+            any = true;
+            output.filename = file->filename;
+            grep_file(file->filename, &output);
+        }
+        if (!any)
+        {
+            command_error("grep: no files match ", args[i]);
+        }
     }
-    else if (strcmp(command, "time") == 0 || strcmp(command, "clock") == 0)
+}
+
+// Command table limits
+#define COMMAND_MAX_ARGS 16      // Arguments after the command name
+#define COMMAND_MAX_ALIASES 2
+#define COMMAND_SLOT_BITS 6
+#define COMMAND_SLOTS (1 << COMMAND_SLOT_BITS)
+#define COMMAND_HELP_WIDTH 12 // Left column of the help list
+
+// Seed under which every command name and alias below hashes to its own
+// slot, found by searching offline; tests/test_shell.c checks that it still
+// does. If a new name collides, the table is built with the next seed that
+// works instead, and the seed here should be updated.
+#define COMMAND_HASH_SEED 0x811d12dau
+
+// Arguments a command is run with
+typedef struct
+{
+    int argc;
+    char **argv;      // Split at spaces; "quoted" text stays together
+    const char *text; // Everything after the command name, as typed
+} command_args_t;
+
+// Phases in which a command reading piped input is called
+#define SHELL_INPUT_START 0 // Before any input arrives
+#define SHELL_INPUT_DATA 1  // The input pipe is full
+#define SHELL_INPUT_END 2   // The input has ended; take the rest
+
+// Manual page, shared by commands documented together
+typedef struct
+{
+    const char *topic; // Shown as "MANUAL: <topic>"
+    int rule;          // Width of the line under the title, or 0 to match it
+    const char *text;
+} manual_page_t;
+
+// Shell command. Commands without arguments set action, the others run.
+// Commands that can read the output of the command before them in a
+// pipeline, or a file given with <, also set filter.
+typedef struct
+{
+    const char *name;
+    const char *aliases[COMMAND_MAX_ALIASES]; // Other names, or NULL
+    void (*action)(void);
+    void (*run)(const command_args_t *args);
+    void (*filter)(const command_args_t *args, pipe_t *input, int phase);
+    int min_args;
+    const char *usage;   // Printed when fewer than min_args are given; commands
+                         // without arguments print their name if given any
+    const char *help;    // Left column of help, or NULL to leave it out
+    const char *summary; // Right column of help
+    const manual_page_t *manual;
+} command_t;
+
+static const manual_page_t manual_help = {
+    "help", 13,
+    "Displays a list of available commands with brief descriptions.\n"
+    "Commands can be joined into pipelines: cmd1 | cmd2 passes the\n"
+    "output of the first to the second through a 4 KiB buffer, which\n"
+    "the second works through each time it fills. > file writes the\n"
+    "output of the last command to a file, >> file appends to it, and\n"
+    "< file feeds a file to the first. For example: ls | grep txt > out\n"
+    "Usage: help\n"};
+
+static const manual_page_t manual_clear = {
+    "clear/cls", 0,
+    "Clears the terminal screen and resets cursor position.\n"
+    "Usage: clear\n"
+    "   or: cls\n"};
+
+static const manual_page_t manual_about = {
+    "about", 0,
+    "Displays information about the operating system.\n"
+    "Usage: about\n"};
+
+static const manual_page_t manual_info = {
+    "info/sysinfo", 19,
+    "Displays detailed system information including memory usage,\n"
+    "uptime, and other system statistics.\n"
+    "Usage: info\n"
+    "   or: sysinfo\n"};
+
+static const manual_page_t manual_lspci = {
+    "lspci", 0,
+    "Lists every PCI function found at boot with its class, vendor\n"
+    "and device ID, IRQ, sized BARs, MSI/MSI-X capabilities and the\n"
+    "driver that claimed it.\n"
+    "Usage: lspci\n"};
+
+static const manual_page_t manual_sync = {
+    "sync/fsync", 0,
+    "Writes are buffered in memory and flushed in the background once\n"
+    "blocks have been dirty for 3 seconds or 20% of the cache is dirty.\n"
+    "sync flushes everything now; fsync flushes one file's data and\n"
+    "the file system metadata.\n"
+    "Usage: sync\n"
+    "   or: fsync <file>\n"};
+
+static const manual_page_t manual_scrub = {
+    "scrub", 0,
+    "Flushes pending writes, then reads every file's blocks from the\n"
+    "disk and checks them against their CRC32C checksums, listing any\n"
+    "file with corrupt blocks.\n"
+    "Usage: scrub\n"};
+
+static const manual_page_t manual_search = {
+    "search", 0,
+    "Lists files whose name or content contains the text. An index of\n"
+    "three-character sequences narrows the files that are read, so\n"
+    "searches for three characters or more stay fast on full disks.\n"
+    "-i ignores case.\n"
+    "Usage: search [-i] <text>\n"};
+
+static const manual_page_t manual_grep = {
+    "grep", 0,
+    "Prints the lines of the files that match a regular expression:\n"
+    ". [a-z] [^0-9] \\d \\w \\s * + ? | ( ) ^ $. Files may be globs such\n"
+    "as *.txt. Quote patterns that contain spaces. Without files it\n"
+    "reads its input, as in: ls | grep txt. A pipeline can hold only\n"
+    "one grep, since one pattern is compiled at a time.\n"
+    "-i ignores case, -n numbers the lines.\n"
+    "Usage: grep [-i] [-n] <pattern> [file]...\n"};
+
+static const manual_page_t manual_ls = {
+    "ls", 0,
+    "Lists the visible files, one per line, or those matching a glob\n"
+    "such as *.txt.\n"
+    "Usage: ls [glob]\n"};
+
+static const manual_page_t manual_cat = {
+    "cat", 0,
+    "Prints the content of files. Without files it copies its input.\n"
+    "Usage: cat [file]...\n"};
+
+static const manual_page_t manual_compress = {
+    "compress/uncompress", 0,
+    "Stores a file's content compressed in 4 KiB units, or back as\n"
+    "plain blocks. Reads and writes are unchanged. New .txt and .log\n"
+    "files are compressed by default; content that does not shrink\n"
+    "is kept plain.\n"
+    "Usage: compress <file>\n"
+    "   or: uncompress <file>\n"};
+
+static const manual_page_t manual_backup = {
+    "backup/restore", 0,
+    "backup splits every file into content-defined chunks and stores\n"
+    "each distinct chunk once, so a snapshot after small edits only\n"
+    "writes the chunks that changed. restore brings back every file\n"
+    "of the latest snapshot, or just the one named. The store holds\n"
+    "at most 4096 distinct chunks and never drops any; once it is\n"
+    "full, backups that need new chunks fail.\n"
+    "Usage: backup\n"
+    "   or: restore [file]\n"};
+
+static const manual_page_t manual_manual = {
+    "manual/man", 0,
+    "Displays the manual page of a command.\n"
+    "Usage: manual <command>\n"
+    "   or: man <command>\n"};
+
+// sync
+static void command_sync(void)
+{
+    fs_sync();
+    terminal_writestring("All cached writes flushed to disk.\n");
+}
+
+// fsync <file>
+static void command_fsync(const command_args_t *args)
+{
+    int fd = fs_open(args->argv[1], FS_O_READ);
+    if (fd < 0)
     {
-        show_clock();
+        command_error("No such file: ", args->argv[1]);
+        return;
     }
-    else if (strcmp(command, "ascii") == 0)
+    if (fs_fsync(fd) != 0)
     {
-        show_ascii_table();
+        command_error("fsync: write error", NULL);
     }
-    else if (strcmp(command, "calc") == 0)
+    fs_close(fd);
+}
+
+// search [-i] <text>
+static void command_search(const command_args_t *args)
+{
+    const char *query = args->text;
+    bool ignore_case = strncmp(query, "-i ", 3) == 0;
+    fs_search(ignore_case ? query + 3 : query, ignore_case);
+}
+
+// grep [-i] [-n] <pattern> <file|glob>...
+static void command_grep(const command_args_t *args)
+{
+    grep_command(args->argc - 1, args->argv + 1);
+}
+
+// compress <file> / uncompress <file>
+static void command_compress(const command_args_t *args)
+{
+    bool enable = args->argv[0][0] == 'c';
+    const char *name = args->argv[1];
+    char number[16];
+    if (!fs_file_exists(name))
     {
-        run_calculator();
+        command_error("No such file: ", name);
+        return;
     }
-    else if (strncmp(command, "echo ", 5) == 0)
+
+    if (!fs_set_compression(name, enable))
     {
-        terminal_writestring(command + 5);
-        terminal_putchar('\n');
+        if (enable)
+        {
+            terminal_writestring("Content does not compress; left as is.\n");
+        }
+        else
+        {
+            command_error("uncompress: not enough free space", NULL);
+        }
+    }
+    terminal_writestring(name);
+    terminal_writestring(": ");
+    itoa(fs_get_file_size(name), number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" bytes in ");
+    itoa(fs_get_file_blocks(name), number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" blocks\n");
+}
+
+// scrub
+static void command_scrub(void)
+{
+    fs_scrub_result_t scrub;
+    char number[16];
+    if (!fs_scrub(&scrub, report_corrupt_file))
+    {
+        terminal_writestring("This volume has no block checksums.\n");
+        return;
     }
-    else if (strncmp(command, "manual ", 7) == 0 || strncmp(command, "man ", 4) == 0)
+
+    itoa(scrub.files, number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" files, ");
+    itoa(scrub.blocks, number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" blocks checked in ");
+    itoa(scrub.elapsed_ms, number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" ms: ");
+    itoa(scrub.bad_blocks, number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" corrupt, ");
+    itoa(scrub.unchecked, number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" without checksum\n");
+}
+
+// backup
+static void command_backup(void)
+{
+    backup_result_t result;
+    char number[16];
+    if (backup_create(&result) < 0)
     {
-        const char *cmd = strncmp(command, "manual ", 7) == 0 ? command + 7 : command + 4;
-        display_manual(cmd);
+        command_error(result.store_full ? "backup: chunk store is full" : "backup: failed", NULL);
+        return;
     }
-    else if (strcmp(command, "disk") == 0)
+
+    terminal_writestring("Snapshot ");
+    itoa(result.snapshot, number, 10);
+    terminal_writestring(number);
+    terminal_writestring(": ");
+    itoa(result.files, number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" files, ");
+    itoa(result.bytes / 1024, number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" KB in ");
+    itoa(result.chunks, number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" chunks, ");
+    itoa(result.new_chunks, number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" new (");
+    itoa(result.new_bytes / 1024, number, 10);
+    terminal_writestring(number);
+    terminal_writestring(" KB written)\n");
+}
+
+// restore [file]
+static void command_restore(const command_args_t *args)
+{
+    if (args->argc < 2)
     {
-        display_disk_usage();
+        if (confirm_action("Overwrite files with the latest snapshot? (y/n): "))
+        {
+            if (restore_from_backup())
+            {
+                terminal_writestring("Files restored from the latest snapshot.\n");
+            }
+            else
+            {
+                command_error("restore: failed", NULL);
+            }
+        }
+        return;
     }
-    else if (strcmp(command, "screensaver") == 0)
+
+    const char *name = args->argv[1];
+    int snapshot = backup_latest();
+    if (snapshot == 0 || !backup_restore_file(snapshot, name, name))
     {
-        run_screensaver();
+        command_error("Not in the latest snapshot: ", name);
     }
-    else if (strncmp(command, "title ", 6) == 0)
+}
+
+// reboot
+static void command_reboot(void)
+{
+    if (confirm_action("Are you sure you want to reboot the system? (y/n): "))
     {
-        set_terminal_title(command + 6);
+        simulate_reboot();
     }
-    else if (strcmp(command, "secret") == 0)
+}
+
+// shutdown
+static void command_shutdown(void)
+{
+    if (confirm_action("Are you sure you want to shut down the system? (y/n): "))
     {
-        extern const char *SECRET_MESSAGE;
-        terminal_writestring_colored("Secret message: ", vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK));
-        terminal_writestring(SECRET_MESSAGE);
+        perform_shutdown();
+    }
+}
+
+// Print every matching line in grep's input
+static struct
+{
+    bool scanning; // Reading input, with the pattern compiled
+    bool files;    // Files were named; the input is ignored
+    grep_output_t output;
+    uint32_t line;
+} grep_input;
+
+// grep [-i] [-n] <pattern> reading its input
+static void grep_filter(const command_args_t *args, pipe_t *input, int phase)
+{
+    int count = args->argc - 1;
+    char **argv = args->argv + 1;
+
+    if (phase == SHELL_INPUT_START)
+    {
+        int flags = 0;
+        grep_input.output.filename = NULL;
+        grep_input.output.numbers = false;
+        grep_input.line = 1;
+        int i = grep_options(count, argv, &flags, &grep_input.output);
+        grep_input.files = i >= 0 && count - i >= 2;
+        grep_input.scanning = false;
+        if (i < 0)
+        {
+            command_usage(GREP_USAGE);
+        }
+        else if (!grep_input.files)
+        {
+            grep_input.scanning = grep_compile(argv[i], flags);
+        }
+        return;
+    }
+
+    if (!grep_input.scanning)
+    {
+        pipe_consume(input, input->length);
+        if (phase == SHELL_INPUT_END && grep_input.files)
+        {
+            grep_command(count, argv);
+        }
+        return;
+    }
+
+    // Scan whole lines; a line longer than the pipe is scanned in pieces
+    uint32_t end = input->length;
+    if (phase != SHELL_INPUT_END)
+    {
+        while (end > 0 && input->data[end - 1] != '\n')
+        {
+            end--;
+        }
+        if (end == 0)
+        {
+            end = input->length;
+        }
+    }
+    uint32_t *line_number = grep_input.output.numbers ? &grep_input.line : NULL;
+    regex_scan(input->data, end, line_number, grep_print_line, &grep_input.output);
+    pipe_consume(input, end);
+}
+
+// ls [glob]
+static void command_ls(const command_args_t *args)
+{
+    for (int index = 0; index < FS_MAX_FILES; index++)
+    {
+        file_t *file = fs_get_file_by_index(index);
+        if (file == NULL || file->type == FS_TYPE_DIRECTORY || file->type == FS_TYPE_HIDDEN ||
+            (args->argc > 1 && !glob_match(args->argv[1], file->filename)))
+        {
+            continue;
+        }
+        terminal_writestring(file->filename);
         terminal_putchar('\n');
     }
+}
+
+// cat <file>...
+static void command_cat(const command_args_t *args)
+{
+    for (int i = 1; i < args->argc; i++)
+    {
+        int fd = fs_open(args->argv[i], FS_O_READ);
+        if (fd < 0)
+        {
+            command_error("cat: cannot read ", args->argv[i]);
+            continue;
+        }
+
+        int got;
+        while ((got = fs_read(fd, grep_buffer, GREP_BUFFER_SIZE)) > 0)
+        {
+            terminal_write(grep_buffer, got);
+        }
+        fs_close(fd);
+    }
+}
+
+// cat reading its input
+static void cat_filter(const command_args_t *args, pipe_t *input, int phase)
+{
+    if (args->argc > 1)
+    {
+        // Files were named; the input is ignored
+        pipe_consume(input, input->length);
+        if (phase == SHELL_INPUT_END)
+        {
+            command_cat(args);
+        }
+        return;
+    }
+    terminal_write(input->data, input->length);
+    pipe_consume(input, input->length);
+}
+
+// echo [text]
+static void command_echo(const command_args_t *args)
+{
+    terminal_writestring(args->text);
+    terminal_putchar('\n');
+}
+
+// manual <command>
+static void command_manual(const command_args_t *args)
+{
+    display_manual(args->argv[1]);
+}
+
+// title <text>
+static void command_title(const command_args_t *args)
+{
+    set_terminal_title(args->text);
+}
+
+// secret
+static void command_secret(void)
+{
+    extern const char *SECRET_MESSAGE;
+    terminal_writestring_colored("Secret message: ", vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK));
+    terminal_writestring(SECRET_MESSAGE);
+    terminal_putchar('\n');
+}
+
+// Every shell command, in the order help lists them
+static const command_t commands[] = {
+    {"help", {NULL}, display_help, NULL, NULL, 0, NULL, "help", "Display this help information", &manual_help},
+    {"clear", {"cls"}, clear_screen, NULL, NULL, 0, NULL, "clear, cls", "Clear the screen", &manual_clear},
+    {"about", {NULL}, display_about, NULL, NULL, 0, NULL, "about", "Display information about OSIRIS OS",
+     &manual_about},
+    {"info", {"sysinfo"}, display_system_info, NULL, NULL, 0, NULL, "info", "Display system information",
+     &manual_info},
+    {"lspci", {NULL}, pci_list_devices, NULL, NULL, 0, NULL, "lspci", "List PCI devices", &manual_lspci},
+    {"ls", {NULL}, NULL, command_ls, NULL, 0, NULL, "ls [glob]", "List files", &manual_ls},
+    {"cat", {NULL}, NULL, command_cat, cat_filter, 0, NULL, "cat [file]", "Print files", &manual_cat},
+    {"sync", {NULL}, command_sync, NULL, NULL, 0, NULL, "sync", "Flush all cached writes to disk", &manual_sync},
+    {"fsync", {NULL}, NULL, command_fsync, NULL, 1, "fsync <file>", "fsync <file>", "Flush one file to disk",
+     &manual_sync},
+    {"scrub", {NULL}, command_scrub, NULL, NULL, 0, NULL, "scrub", "Verify file checksums", &manual_scrub},
+    {"search", {NULL}, NULL, command_search, NULL, 1, "search [-i] <text>", "search [-i]",
+     "Find files by name or content", &manual_search},
+    {"grep", {NULL}, NULL, command_grep, grep_filter, 0, NULL, "grep p files", "Print lines matching a pattern",
+     &manual_grep},
+    {"compress", {NULL}, NULL, command_compress, NULL, 1, "compress <file>", "compress f",
+     "Store a file compressed (uncompress f)", &manual_compress},
+    {"uncompress", {NULL}, NULL, command_compress, NULL, 1, "uncompress <file>", NULL, NULL, &manual_compress},
+    {"backup", {NULL}, command_backup, NULL, NULL, 0, NULL, "backup", "Take an incremental snapshot",
+     &manual_backup},
+    {"restore", {NULL}, NULL, command_restore, NULL, 0, NULL, "restore [f]", "Restore all files, or one, from it",
+     &manual_backup},
+    {"reboot", {NULL}, command_reboot, NULL, NULL, 0, NULL, "reboot", "Reboot the system", NULL},
+    {"shutdown", {"halt"}, command_shutdown, NULL, NULL, 0, NULL, "shutdown", "Shut down the system", NULL},
+    {"calendar", {NULL}, show_calendar, NULL, NULL, 0, NULL, "calendar", "Display a calendar", NULL},
+    {"time", {"clock"}, show_clock, NULL, NULL, 0, NULL, "time, clock", "Display the current time", NULL},
+    {"ascii", {NULL}, show_ascii_table, NULL, NULL, 0, NULL, "ascii", "Display ASCII table", NULL},
+    {"calc", {NULL}, run_calculator, NULL, NULL, 0, NULL, "calc", "Run a simple calculator", NULL},
+    {"echo", {NULL}, NULL, command_echo, NULL, 0, NULL, "echo [text]", "Display text", NULL},
+    {"manual", {"man"}, NULL, command_manual, NULL, 1, "manual <command>", "manual [cmd]",
+     "Display manual for a command", &manual_manual},
+    {"disk", {NULL}, display_disk_usage, NULL, NULL, 0, NULL, "disk", "Display disk usage", NULL},
+    {"screensaver", {NULL}, run_screensaver, NULL, NULL, 0, NULL, "screensaver", "Run a simple screensaver", NULL},
+    {"title", {NULL}, NULL, command_title, NULL, 1, "title <text>", "title [text]", "Set terminal title", NULL},
+    {"secret", {NULL}, command_secret, NULL, NULL, 0, NULL, NULL, NULL, NULL},
+};
+
+#define COMMAND_COUNT ((int)(sizeof(commands) / sizeof(commands[0])))
+
+// Perfect hash table of command names: each name owns a slot, so finding
+// a command costs one hash and one string comparison
+static int8_t command_slots[COMMAND_SLOTS]; // Index into commands, or -1
+static const char *slot_names[COMMAND_SLOTS];
+static uint32_t command_seed;
+static bool commands_ready = false;
+
+// FNV-1a hash of a command name, starting from a seed
+static uint32_t command_hash(const char *name, uint32_t seed)
+{
+    uint32_t hash = seed;
+    while (*name)
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Slot of a command name under the current seed
+static uint32_t command_slot(const char *name, uint32_t seed)
+{
+    return command_hash(name, seed) >> (32 - COMMAND_SLOT_BITS);
+}
+
+// Try to give every name its own slot under a seed
+static bool commands_place(uint32_t seed)
+{
+    for (int i = 0; i < COMMAND_SLOTS; i++)
+    {
+        command_slots[i] = -1;
+        slot_names[i] = NULL;
+    }
+
+    for (int i = 0; i < COMMAND_COUNT; i++)
+    {
+        for (int n = -1; n < COMMAND_MAX_ALIASES; n++)
+        {
+            const char *name = n < 0 ? commands[i].name : commands[i].aliases[n];
+            if (name == NULL)
+            {
+                break;
+            }
+            uint32_t slot = command_slot(name, seed);
+            if (command_slots[slot] >= 0)
+            {
+                return false;
+            }
+            command_slots[slot] = i;
+            slot_names[slot] = name;
+        }
+    }
+    return true;
+}
+
+// Build the command hash table on first use
+static void commands_init(void)
+{
+    command_seed = COMMAND_HASH_SEED;
+    while (!commands_place(command_seed))
+    {
+        command_seed++;
+    }
+    commands_ready = true;
+}
+
+// Find a command by name or alias, or NULL
+static const command_t *command_find(const char *name)
+{
+    if (!commands_ready)
+    {
+        commands_init();
+    }
+
+    uint32_t slot = command_slot(name, command_seed);
+    if (command_slots[slot] < 0 || strcmp(slot_names[slot], name) != 0)
+    {
+        return NULL;
+    }
+    return &commands[command_slots[slot]];
+}
+
+// Pipeline limits
+#define SHELL_MAX_STAGES 4
+#define SHELL_FILE_PIPE SHELL_MAX_STAGES // Pipe in front of the > file
+
+// One command of a pipeline
+typedef struct
+{
+    char *text; // Its part of the line, redirections blanked out
+    const command_t *command;
+    command_args_t args;
+    char *argv[COMMAND_MAX_ARGS + 1];
+    char words[256]; // The arguments split apart
+    pipe_t *input;   // What it reads, or NULL
+    pipe_t *output;  // Where its output goes, or NULL for the screen
+} shell_stage_t;
+
+// Redirection taken out of a command line
+typedef struct
+{
+    char input[FS_MAX_FILENAME];  // < file, or empty
+    char output[FS_MAX_FILENAME]; // > or >> file, or empty
+    bool append;                  // >> rather than >
+} shell_redirect_t;
+
+static char shell_line[256];
+static shell_stage_t shell_stages[SHELL_MAX_STAGES];
+static pipe_t shell_pipes[SHELL_MAX_STAGES + 1]; // Indexed by reading stage
+static shell_stage_t *shell_current = NULL;      // Stage the terminal writes for
+static int shell_output_fd = -1;
+static bool shell_write_failed = false;
+static bool shell_truncated = false; // A stage did not take all of its input
+
+// Take the file name after a redirection out of the line, blanking it.
+// Returns false if there is none or it does not fit.
+static bool shell_take_name(char **cursor, char *name)
+{
+    char *p = *cursor;
+    while (*p == ' ')
+    {
+        p++;
+    }
+
+    char quote = (*p == '"' || *p == '\'') ? *p : '\0';
+    if (quote)
+    {
+        *p++ = ' ';
+    }
+    int length = 0;
+    while (*p != '\0' && (quote ? *p != quote : (*p != ' ' && *p != '|' && *p != '<' && *p != '>')))
+    {
+        if (length == FS_MAX_FILENAME - 1)
+        {
+            return false;
+        }
+        name[length++] = *p;
+        *p++ = ' ';
+    }
+    if (quote && *p == quote)
+    {
+        *p++ = ' ';
+    }
+    name[length] = '\0';
+    *cursor = p - 1;
+    return length > 0;
+}
+
+// Split a command line into the stages of a pipeline at |, taking out
+// the < and > redirections. Returns the number of stages, 0 for an empty
+// line, or -1 after printing why the line cannot run.
+static int shell_parse(const char *command, shell_redirect_t *redirect)
+{
+    int count = 0;
+    int output_stage = -1;
+    char quote = '\0';
+
+    size_t length = strlen(command);
+    if (length >= sizeof(shell_line))
+    {
+        length = sizeof(shell_line) - 1;
+    }
+    memcpy(shell_line, command, length);
+    shell_line[length] = '\0';
+    redirect->input[0] = '\0';
+    redirect->output[0] = '\0';
+    redirect->append = false;
+    shell_stages[0].text = shell_line;
+
+    for (char *p = shell_line; *p != '\0'; p++)
+    {
+        if (quote)
+        {
+            quote = *p == quote ? '\0' : quote;
+        }
+        else if (*p == '"' || *p == '\'')
+        {
+            quote = *p;
+        }
+        else if (*p == '|')
+        {
+            if (count + 1 == SHELL_MAX_STAGES)
+            {
+                command_error("Too many commands in the pipeline", NULL);
+                return -1;
+            }
+            *p = '\0';
+            shell_stages[++count].text = p + 1;
+        }
+        else if (*p == '<')
+        {
+            *p = ' ';
+            if (count > 0 || redirect->input[0] != '\0')
+            {
+                command_error("Only the first command can read a file", NULL);
+                return -1;
+            }
+            if (!shell_take_name(&p, redirect->input))
+            {
+                command_error("Missing file name after <", NULL);
+                return -1;
+            }
+        }
+        else if (*p == '>')
+        {
+            *p = ' ';
+            if (p[1] == '>')
+            {
+                *++p = ' ';
+                redirect->append = true;
+            }
+            if (redirect->output[0] != '\0')
+            {
+                command_error("Output can go to one file only", NULL);
+                return -1;
+            }
+            if (!shell_take_name(&p, redirect->output))
+            {
+                command_error("Missing file name after >", NULL);
+                return -1;
+            }
+            output_stage = count;
+        }
+    }
+    if (output_stage >= 0 && output_stage != count)
+    {
+        command_error("Only the last command can write a file", NULL);
+        return -1;
+    }
+
+    for (int i = 0; i <= count; i++)
+    {
+        shell_stage_t *stage = &shell_stages[i];
+
+        // Drop the blanks around the command, including those left by
+        // redirections
+        while (*stage->text == ' ')
+        {
+            stage->text++;
+        }
+        for (char *end = stage->text + strlen(stage->text); end > stage->text && end[-1] == ' ';)
+        {
+            *--end = '\0';
+        }
+
+        stage->args.argc = split_arguments(stage->text, stage->words, sizeof(stage->words), stage->argv,
+                                           COMMAND_MAX_ARGS + 1);
+        if (stage->args.argc == 0)
+        {
+            if (count == 0 && redirect->input[0] == '\0' && redirect->output[0] == '\0')
+            {
+                return 0; // Empty command
+            }
+            command_error("Missing command in the pipeline", NULL);
+            return -1;
+        }
+        stage->args.argv = stage->argv;
+
+        // The argument text starts after the name and the spaces following it
+        const char *text = stage->text;
+        while (*text != '\0' && *text != ' ')
+        {
+            text++;
+        }
+        while (*text == ' ')
+        {
+            text++;
+        }
+        stage->args.text = text;
+    }
+
+    int greps = 0;
+    for (int i = 0; i <= count; i++)
+    {
+        shell_stage_t *stage = &shell_stages[i];
+        stage->command = command_find(stage->argv[0]);
+        if (stage->command == NULL)
+        {
+            terminal_writestring_colored("Unknown command: ", vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+            terminal_writestring(stage->text);
+            terminal_putchar('\n');
+            terminal_writestring("Type 'help' for a list of commands.\n");
+            return -1;
+        }
+
+        // The regular expression engine holds one pattern at a time
+        if (stage->command->run == command_grep && ++greps > 1)
+        {
+            command_error("Only one grep can run in a pipeline", NULL);
+            return -1;
+        }
+    }
+    return count + 1;
+}
+
+// Run a stage's command on its arguments
+static void shell_run(shell_stage_t *stage)
+{
+    const command_t *command = stage->command;
+    int given = stage->args.argc - 1;
+    if (command->action != NULL ? given > 0 : given < command->min_args)
+    {
+        command_usage(command->action != NULL ? command->name : command->usage);
+    }
+    else if (command->action != NULL)
+    {
+        command->action();
+    }
     else
     {
-        terminal_writestring_colored("Unknown command: ", vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
-        terminal_writestring(command);
-        terminal_putchar('\n');
-        terminal_writestring("Type 'help' for a list of commands.\n");
+        command->run(&stage->args);
+    }
+}
+
+// Carry terminal output into a pipe
+static void shell_output(void *context, const char *data, uint32_t length)
+{
+    if (pipe_write(context, data, length) < length)
+    {
+        shell_truncated = true;
+    }
+}
+
+// Point terminal output at a stage's output
+static void shell_select(shell_stage_t *stage)
+{
+    shell_current = stage;
+    if (stage != NULL && stage->output != NULL)
+    {
+        terminal_redirect(shell_output, stage->output);
+    }
+    else
+    {
+        terminal_redirect(NULL, NULL);
+    }
+}
+
+// Let a stage handle a phase of its input. A command that cannot read
+// input has it thrown away and runs once it ends; one without input runs
+// straight away.
+static void shell_call(shell_stage_t *stage, int phase)
+{
+    shell_stage_t *previous = shell_current;
+    shell_select(stage);
+
+    if (stage->input == NULL)
+    {
+        shell_run(stage);
+    }
+    else if (stage->command->filter != NULL)
+    {
+        stage->command->filter(&stage->args, stage->input, phase);
+    }
+    else
+    {
+        pipe_consume(stage->input, stage->input->length);
+        if (phase == SHELL_INPUT_END)
+        {
+            shell_run(stage);
+        }
+    }
+
+    shell_select(previous);
+}
+
+// Run the stage reading a pipe that filled up or closed
+static void shell_drain(pipe_t *pipe, void *context)
+{
+    shell_call(context, pipe->closed ? SHELL_INPUT_END : SHELL_INPUT_DATA);
+}
+
+// Write out the pipe in front of the > file
+static void shell_file_drain(pipe_t *pipe, void *context)
+{
+    (void)context;
+    if (fs_write(shell_output_fd, pipe->data, pipe->length) != (int)pipe->length)
+    {
+        shell_write_failed = true;
     }
+    pipe_consume(pipe, pipe->length);
+}
+
+// Run the stages of a pipeline together. Each stage writes into a
+// bounded pipe, and whenever one fills the stage reading it runs on what
+// is there, so output streams through without being held whole.
+static void shell_run_pipeline(int count, const shell_redirect_t *redirect)
+{
+    int input_fd = -1;
+    if (redirect->input[0] != '\0')
+    {
+        input_fd = fs_open(redirect->input, FS_O_READ);
+        if (input_fd < 0)
+        {
+            command_error("No such file: ", redirect->input);
+            return;
+        }
+    }
+    shell_output_fd = -1;
+    if (redirect->output[0] != '\0')
+    {
+        int flags = FS_O_WRITE | FS_O_CREATE | (redirect->append ? FS_O_APPEND : FS_O_TRUNC);
+        shell_output_fd = fs_open(redirect->output, flags);
+        if (shell_output_fd < 0)
+        {
+            command_error("Cannot write ", redirect->output);
+            if (input_fd >= 0)
+            {
+                fs_close(input_fd);
+            }
+            return;
+        }
+    }
+
+    // Connect the stages
+    for (int i = 0; i < count; i++)
+    {
+        shell_stages[i].input = NULL;
+        shell_stages[i].output = NULL;
+        if (i > 0 || input_fd >= 0)
+        {
+            pipe_init(&shell_pipes[i], shell_drain, &shell_stages[i]);
+            shell_stages[i].input = &shell_pipes[i];
+        }
+        if (i > 0)
+        {
+            shell_stages[i - 1].output = &shell_pipes[i];
+        }
+    }
+    shell_write_failed = false;
+    shell_truncated = false;
+    if (shell_output_fd >= 0)
+    {
+        pipe_init(&shell_pipes[SHELL_FILE_PIPE], shell_file_drain, NULL);
+        shell_stages[count - 1].output = &shell_pipes[SHELL_FILE_PIPE];
+    }
+
+    // Readers set up first, then the first stage produces, and each pipe
+    // is closed once the stage writing it is done
+    for (int i = count - 1; i >= 0; i--)
+    {
+        if (shell_stages[i].input != NULL)
+        {
+            shell_call(&shell_stages[i], SHELL_INPUT_START);
+        }
+    }
+    if (input_fd >= 0)
+    {
+        int got;
+        do
+        {
+            uint32_t space;
+            char *room = pipe_reserve(&shell_pipes[0], &space);
+            if (space == 0)
+            {
+                shell_truncated = true;
+                break;
+            }
+            got = fs_read(input_fd, room, space);
+            if (got > 0)
+            {
+                pipe_commit(&shell_pipes[0], got);
+            }
+        } while (got > 0);
+        fs_close(input_fd);
+        pipe_close(&shell_pipes[0]);
+    }
+    else
+    {
+        shell_call(&shell_stages[0], SHELL_INPUT_END);
+    }
+    for (int i = 1; i < count; i++)
+    {
+        pipe_close(&shell_pipes[i]);
+    }
+
+    if (shell_output_fd >= 0)
+    {
+        pipe_close(&shell_pipes[SHELL_FILE_PIPE]);
+        fs_close(shell_output_fd);
+        shell_output_fd = -1;
+        if (shell_write_failed)
+        {
+            command_error("Write error on ", redirect->output);
+        }
+    }
+    if (shell_truncated)
+    {
+        command_error("Output lost: a command did not take all of its input", NULL);
+    }
+}
+
+// Command processing
+void execute_command(const char *command)
+{
+    static shell_redirect_t redirect;
+    int count = shell_parse(command, &redirect);
+    if (count <= 0)
+    {
+        return;
+    }
+
+    if (count == 1 && redirect.input[0] == '\0' && redirect.output[0] == '\0')
+    {
+        shell_stages[0].input = NULL;
+        shell_stages[0].output = NULL;
+        shell_run(&shell_stages[0]);
+        return;
+    }
+    shell_run_pipeline(count, &redirect);
 }
 
 void add_command_history(const char *command)
@@ -319,6 +1509,11 @@ void run_terminal(void)
         // Process keyboard input
         handle_keyboard();
 
+        // Commit metadata updates that have waited long enough, then let
+        // the buffer cache write back expired dirty blocks
+        journal_poll();
+        bcache_writeback_poll();
+
         // Small delay to avoid consuming too much CPU
         delay(10);
     }
@@ -338,50 +1533,26 @@ void display_help(void)
 
     terminal_writestring_colored("Available commands:\n", header_color);
 
-    terminal_writestring_colored("  help        ", cmd_color);
-    terminal_writestring_colored("- Display this help information\n", desc_color);
-
-    terminal_writestring_colored("  clear, cls  ", cmd_color);
-    terminal_writestring_colored("- Clear the screen\n", desc_color);
-
-    terminal_writestring_colored("  about       ", cmd_color);
-    terminal_writestring_colored("- Display information about OSIRIS OS\n", desc_color);
-
-    terminal_writestring_colored("  info        ", cmd_color);
-    terminal_writestring_colored("- Display system information\n", desc_color);
-
-    terminal_writestring_colored("  reboot      ", cmd_color);
-    terminal_writestring_colored("- Reboot the system\n", desc_color);
-
-    terminal_writestring_colored("  shutdown    ", cmd_color);
-    terminal_writestring_colored("- Shut down the system\n", desc_color);
-
-    terminal_writestring_colored("  calendar    ", cmd_color);
-    terminal_writestring_colored("- Display a calendar\n", desc_color);
-
-    terminal_writestring_colored("  time, clock ", cmd_color);
-    terminal_writestring_colored("- Display the current time\n", desc_color);
-
-    terminal_writestring_colored("  ascii       ", cmd_color);
-    terminal_writestring_colored("- Display ASCII table\n", desc_color);
-
-    terminal_writestring_colored("  calc        ", cmd_color);
-    terminal_writestring_colored("- Run a simple calculator\n", desc_color);
-
-    terminal_writestring_colored("  echo [text] ", cmd_color);
-    terminal_writestring_colored("- Display text\n", desc_color);
-
-    terminal_writestring_colored("  manual [cmd]", cmd_color);
-    terminal_writestring_colored("- Display manual for a command\n", desc_color);
-
-    terminal_writestring_colored("  disk        ", cmd_color);
-    terminal_writestring_colored("- Display disk usage\n", desc_color);
+    for (int i = 0; i < COMMAND_COUNT; i++)
+    {
+        if (commands[i].help == NULL)
+        {
+            continue;
+        }
 
-    terminal_writestring_colored("  screensaver ", cmd_color);
-    terminal_writestring_colored("- Run a simple screensaver\n", desc_color);
+        terminal_writestring_colored("  ", cmd_color);
+        terminal_writestring_colored(commands[i].help, cmd_color);
+        for (int pad = strlen(commands[i].help); pad < COMMAND_HELP_WIDTH; pad++)
+        {
+            terminal_putchar(' ');
+        }
+        terminal_writestring_colored("- ", desc_color);
+        terminal_writestring_colored(commands[i].summary, desc_color);
+        terminal_putchar('\n');
+    }
 
-    terminal_writestring_colored("  title [text]", cmd_color);
-    terminal_writestring_colored("- Set terminal title\n", desc_color);
+    terminal_writestring_colored("  a | b > f  ", cmd_color);
+    terminal_writestring_colored("- Pipe output into a command or file (>> f, < f)\n", desc_color);
 }
 
 void display_welcome_message(void)
@@ -417,6 +1588,8 @@ int read_line(char *buffer, int max_length, int input_type)
     int length = 0;
     char c;
 
+    // Typing is echoed on the screen even inside a pipeline
+    terminal_screen_begin();
     while (1)
     {
         c = get_keyboard_input();
@@ -431,6 +1604,7 @@ int read_line(char *buffer, int max_length, int input_type)
         if (c == '\n' || c == '\r')
         {
             terminal_putchar('\n');
+            terminal_screen_end();
             buffer[length] = '\0';
             return length;
         }
@@ -476,7 +1650,10 @@ char *get_input(const char *prompt, int input_type)
 {
     static char buffer[256];
 
+    // Prompts are for the user, not the command's output
+    terminal_screen_begin();
     terminal_writestring(prompt);
+    terminal_screen_end();
     read_line(buffer, sizeof(buffer), input_type);
 
     return buffer;
@@ -492,7 +1669,9 @@ void press_any_key(const char *message)
 {
     if (message)
     {
+        terminal_screen_begin();
         terminal_writestring(message);
+        terminal_screen_end();
     }
 
     // Wait for any key press
@@ -571,6 +1750,86 @@ void display_system_info(void)
     itoa(info.num_files, file_count, 10);
     terminal_writestring_colored(file_count, value_color);
     terminal_putchar('\n');
+
+    bcache_stats_t cache;
+    bcache_get_stats(&cache);
+    uint32_t lookups = cache.hits + cache.misses;
+    char number[16];
+
+    terminal_writestring_colored("Buffer Cache: ", label_color);
+    itoa(cache.hits, number, 10);
+    terminal_writestring_colored(number, value_color);
+    terminal_writestring_colored(" hits, ", value_color);
+    itoa(cache.misses, number, 10);
+    terminal_writestring_colored(number, value_color);
+    terminal_writestring_colored(" misses (", value_color);
+    uint32_t hit_rate = 0;
+    if (lookups > 0)
+    {
+        // Avoid overflowing hits * 100 (and 64-bit division)
+        hit_rate = lookups > 0x1000000 ? cache.hits / (lookups / 100) : cache.hits * 100 / lookups;
+    }
+    itoa(hit_rate, number, 10);
+    terminal_writestring_colored(number, value_color);
+    terminal_writestring_colored("% hit)", value_color);
+    terminal_putchar('\n');
+
+    terminal_writestring_colored("Cache Blocks: ", label_color);
+    itoa(cache.cached, number, 10);
+    terminal_writestring_colored(number, value_color);
+    terminal_writestring_colored("/", value_color);
+    itoa(BCACHE_BUFFERS, number, 10);
+    terminal_writestring_colored(number, value_color);
+    terminal_writestring_colored(" used, ", value_color);
+    itoa(cache.dirty, number, 10);
+    terminal_writestring_colored(number, value_color);
+    terminal_writestring_colored(" dirty, ", value_color);
+    itoa(cache.evictions, number, 10);
+    terminal_writestring_colored(number, value_color);
+    terminal_writestring_colored(" evicted", value_color);
+    terminal_putchar('\n');
+
+    terminal_writestring_colored("Writeback: ", label_color);
+    itoa(cache.writebacks, number, 10);
+    terminal_writestring_colored(number, value_color);
+    terminal_writestring_colored(" blocks in ", value_color);
+    itoa(cache.flushes, number, 10);
+    terminal_writestring_colored(number, value_color);
+    terminal_writestring_colored(" requests", value_color);
+    terminal_putchar('\n');
+
+    terminal_writestring_colored("Readahead: ", label_color);
+    itoa(cache.ra_blocks, number, 10);
+    terminal_writestring_colored(number, value_color);
+    terminal_writestring_colored(" blocks, ", value_color);
+    itoa(cache.ra_hits, number, 10);
+    terminal_writestring_colored(number, value_color);
+    terminal_writestring_colored(" used, ", value_color);
+    itoa(cache.ra_wasted, number, 10);
+    terminal_writestring_colored(number, value_color);
+    terminal_writestring_colored(" wasted", value_color);
+    terminal_putchar('\n');
+
+    journal_stats_t journal;
+    journal_get_stats(&journal);
+    terminal_writestring_colored("Journal: ", label_color);
+    if (!journal_active())
+    {
+        terminal_writestring_colored("none", value_color);
+    }
+    else
+    {
+        itoa(journal.commits, number, 10);
+        terminal_writestring_colored(number, value_color);
+        terminal_writestring_colored(" commits, ", value_color);
+        itoa(journal.blocks, number, 10);
+        terminal_writestring_colored(number, value_color);
+        terminal_writestring_colored(" blocks logged, ", value_color);
+        itoa(journal.replayed, number, 10);
+        terminal_writestring_colored(number, value_color);
+        terminal_writestring_colored(" replayed at mount", value_color);
+    }
+    terminal_putchar('\n');
 }
 
 void simulate_reboot(void)
@@ -614,6 +1873,7 @@ void perform_shutdown(void)
     delay(300);
 
     terminal_writestring("Unmounting filesystems...\n");
+    fs_unmount();
     delay(200);
 
     terminal_writestring("Syncing disks...\n");
@@ -776,44 +2036,27 @@ void display_manual(const char *command)
 {
     uint8_t title_color = vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
     uint8_t text_color = vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    const command_t *found = command_find(command);
 
-    if (strcmp(command, "help") == 0)
-    {
-        terminal_writestring_colored("MANUAL: help\n", title_color);
-        terminal_writestring_colored("-------------\n", title_color);
-        terminal_writestring_colored("Displays a list of available commands with brief descriptions.\n", text_color);
-        terminal_writestring_colored("Usage: help\n", text_color);
-    }
-    else if (strcmp(command, "clear") == 0 || strcmp(command, "cls") == 0)
-    {
-        terminal_writestring_colored("MANUAL: clear/cls\n", title_color);
-        terminal_writestring_colored("-----------------\n", title_color);
-        terminal_writestring_colored("Clears the terminal screen and resets cursor position.\n", text_color);
-        terminal_writestring_colored("Usage: clear\n", text_color);
-        terminal_writestring_colored("   or: cls\n", text_color);
-    }
-    else if (strcmp(command, "about") == 0)
-    {
-        terminal_writestring_colored("MANUAL: about\n", title_color);
-        terminal_writestring_colored("-------------\n", title_color);
-        terminal_writestring_colored("Displays information about the operating system.\n", text_color);
-        terminal_writestring_colored("Usage: about\n", text_color);
-    }
-    else if (strcmp(command, "info") == 0 || strcmp(command, "sysinfo") == 0)
-    {
-        terminal_writestring_colored("MANUAL: info/sysinfo\n", title_color);
-        terminal_writestring_colored("-------------------\n", title_color);
-        terminal_writestring_colored("Displays detailed system information including memory usage,\n", text_color);
-        terminal_writestring_colored("uptime, and other system statistics.\n", text_color);
-        terminal_writestring_colored("Usage: info\n", text_color);
-        terminal_writestring_colored("   or: sysinfo\n", text_color);
-    }
-    else
+    if (found == NULL || found->manual == NULL)
     {
         terminal_writestring_colored("No manual entry for '", text_color);
         terminal_writestring(command);
         terminal_writestring_colored("'\n", text_color);
+        return;
     }
+
+    const manual_page_t *page = found->manual;
+    int rule = page->rule ? page->rule : (int)(strlen("MANUAL: ") + strlen(page->topic));
+    terminal_writestring_colored("MANUAL: ", title_color);
+    terminal_writestring_colored(page->topic, title_color);
+    terminal_putchar('\n');
+    for (int i = 0; i < rule; i++)
+    {
+        terminal_writestring_colored("-", title_color);
+    }
+    terminal_putchar('\n');
+    terminal_writestring_colored(page->text, text_color);
 }
 
 void display_disk_usage(void)
@@ -0,0 +1,43 @@
+#include "timer.h"
+#include "interrupts.h" // For IRQ 0
+#include "utils.h"      // For port I/O
+#include <stdbool.h>
+
+static volatile uint32_t ticks = 0;
+static bool timer_ready = false;
+
+// Timer interrupt handler
+static void timer_irq(int irq)
+{
+    (void)irq;
+    ticks++;
+}
+
+// Program the PIT and start counting ticks
+void timer_init(void)
+{
+    if (timer_ready)
+    {
+        return;
+    }
+    timer_ready = true;
+
+    uint32_t divisor = PIT_FREQUENCY / TIMER_HZ;
+    outb(PIT_COMMAND, PIT_MODE_SQUARE);
+    outb(PIT_CHANNEL0, divisor & 0xFF);
+    outb(PIT_CHANNEL0, (divisor >> 8) & 0xFF);
+
+    irq_register(IRQ_TIMER, timer_irq);
+}
+
+// Get the number of ticks
+uint32_t timer_ticks(void)
+{
+    return ticks;
+}
+
+// Get the milliseconds since timer_init()
+uint32_t timer_ms(void)
+{
+    return ticks * (1000 / TIMER_HZ);
+}
@@ -0,0 +1,27 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+// Programmable interval timer (8253/8254) ports
+#define PIT_CHANNEL0 0x40
+#define PIT_COMMAND 0x43
+#define PIT_FREQUENCY 1193182
+
+// Channel 0, lobyte/hibyte access, mode 3 (square wave)
+#define PIT_MODE_SQUARE 0x36
+
+// System tick rate
+#define TIMER_HZ 100
+
+// Program the PIT and start counting ticks on IRQ 0. Safe to call more
+// than once.
+void timer_init(void);
+
+// Get the number of ticks since timer_init()
+uint32_t timer_ticks(void);
+
+// Get the milliseconds since timer_init()
+uint32_t timer_ms(void);
+
+#endif // TIMER_H
@@ -13,6 +13,24 @@ uint8_t inb(uint16_t port);
 // Write to an I/O port
 void outb(uint16_t port, uint8_t val);
 
+// Read a 16-bit word from an I/O port
+uint16_t inw(uint16_t port);
+
+// Write a 16-bit word to an I/O port
+void outw(uint16_t port, uint16_t val);
+
+// Read a 32-bit value from an I/O port
+uint32_t inl(uint16_t port);
+
+// Write a 32-bit value to an I/O port
+void outl(uint16_t port, uint32_t val);
+
+// Read `count` 16-bit words from an I/O port into a buffer
+void insw(uint16_t port, void *buffer, uint32_t count);
+
+// Write `count` 16-bit words from a buffer to an I/O port
+void outsw(uint16_t port, const void *buffer, uint32_t count);
+
 // Get random number
 int rand(void);
 
@@ -4,8 +4,6 @@
 
 // VGA text buffer address
 static uint16_t *const VGA_MEMORY = (uint16_t *)0xB8000;
-static const int VGA_WIDTH = 80;
-static const int VGA_HEIGHT = 25;
 
 // Terminal state variables exposed for use in kernel.c
 int terminal_row;
@@ -13,6 +11,11 @@ int terminal_column;
 uint8_t terminal_color;
 uint16_t *terminal_buffer;
 
+// Where terminal output goes instead of the screen, if anywhere
+static terminal_output_t terminal_output = NULL;
+static void *terminal_output_context = NULL;
+static int terminal_screen_depth = 0; // Open terminal_screen_begin() calls
+
 // Create a VGA entry color
 uint8_t vga_entry_color(enum vga_color fg, enum vga_color bg)
 {
@@ -78,9 +81,35 @@ void terminal_scroll()
     }
 }
 
+// Send terminal output to a function instead of the screen, or back to
+// the screen if `output` is NULL
+void terminal_redirect(terminal_output_t output, void *context)
+{
+    terminal_output = output;
+    terminal_output_context = context;
+}
+
+// Send output to the screen even while it is redirected
+void terminal_screen_begin(void)
+{
+    terminal_screen_depth++;
+}
+
+// End a terminal_screen_begin()
+void terminal_screen_end(void)
+{
+    terminal_screen_depth--;
+}
+
 // Put a character at the current position and advance cursor
 void terminal_putchar(char c)
 {
+    if (terminal_output && terminal_screen_depth == 0)
+    {
+        terminal_output(terminal_output_context, &c, 1);
+        return;
+    }
+
     if (c == '\n')
     {
         terminal_column = 0;
@@ -124,9 +153,28 @@ void terminal_putchar(char c)
     }
 }
 
+// Write `length` bytes to the terminal
+void terminal_write(const char *data, uint32_t length)
+{
+    if (terminal_output && terminal_screen_depth == 0)
+    {
+        terminal_output(terminal_output_context, data, length);
+        return;
+    }
+
+    for (uint32_t i = 0; i < length; i++)
+        terminal_putchar(data[i]);
+}
+
 // Write a string to the terminal
 void terminal_writestring(const char *data)
 {
+    if (terminal_output && terminal_screen_depth == 0)
+    {
+        terminal_output(terminal_output_context, data, strlen(data));
+        return;
+    }
+
     for (int i = 0; data[i] != '\0'; i++)
         terminal_putchar(data[i]);
 }
@@ -3,6 +3,10 @@
 
 #include <stdint.h>
 
+// Text mode screen size
+#define VGA_WIDTH 80
+#define VGA_HEIGHT 25
+
 // Constants for VGA text mode
 enum vga_color
 {
@@ -31,6 +35,9 @@ extern int terminal_column;
 extern uint8_t terminal_color;
 extern uint16_t *terminal_buffer;
 
+// Receives terminal output while it is redirected
+typedef void (*terminal_output_t)(void *context, const char *data, uint32_t length);
+
 // Create a VGA entry color
 uint8_t vga_entry_color(enum vga_color fg, enum vga_color bg);
 
@@ -49,9 +56,21 @@ void terminal_putentryat(char c, uint8_t color, int x, int y);
 // Scroll the terminal up one line
 void terminal_scroll(void);
 
+// Send terminal output to a function instead of the screen, or back to
+// the screen if `output` is NULL
+void terminal_redirect(terminal_output_t output, void *context);
+
+// Send output to the screen even while it is redirected, until the
+// matching terminal_screen_end(). Calls nest.
+void terminal_screen_begin(void);
+void terminal_screen_end(void);
+
 // Put a character at the current position and advance cursor
 void terminal_putchar(char c);
 
+// Write `length` bytes to the terminal
+void terminal_write(const char *data, uint32_t length);
+
 // Write a string to the terminal
 void terminal_writestring(const char *data);
 
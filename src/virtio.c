@@ -0,0 +1,147 @@
+#include "virtio.h"
+#include "utils.h"  // For port I/O
+#include "string.h" // For memset
+
+// Full memory barrier; the device reads the rings concurrently
+static inline void virtio_mb(void)
+{
+    __sync_synchronize();
+}
+
+// Round up to the ring alignment
+static uint32_t virtq_align(uint32_t value)
+{
+    return (value + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1);
+}
+
+// True if moving the index from old_idx to new_idx passes event_idx
+static bool virtq_need_event(uint16_t event_idx, uint16_t new_idx, uint16_t old_idx)
+{
+    return (uint16_t)(new_idx - event_idx - 1) < (uint16_t)(new_idx - old_idx);
+}
+
+// Reset the device and acknowledge it
+uint32_t virtio_begin_init(uint16_t io_base)
+{
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS, 0);
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    return inl(io_base + VIRTIO_REG_DEVICE_FEATURES);
+}
+
+// Accept a feature subset
+void virtio_set_features(uint16_t io_base, uint32_t features)
+{
+    outl(io_base + VIRTIO_REG_GUEST_FEATURES, features);
+}
+
+// Tell the device the driver is ready
+void virtio_finish_init(uint16_t io_base)
+{
+    uint8_t status = inb(io_base + VIRTIO_REG_DEVICE_STATUS);
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS, status | VIRTIO_STATUS_DRIVER_OK);
+}
+
+// Set up a queue
+bool virtq_init(virtqueue_t *vq, uint16_t io_base, uint16_t index, void *memory, bool event_idx)
+{
+    outw(io_base + VIRTIO_REG_QUEUE_SELECT, index);
+    uint16_t size = inw(io_base + VIRTIO_REG_QUEUE_SIZE);
+    if (size == 0 || size > VIRTQ_MAX_SIZE)
+    {
+        return false;
+    }
+
+    // Descriptors, then the available ring, then the used ring on the next
+    // page boundary
+    uint8_t *base = (uint8_t *)memory;
+    uint32_t used_offset = virtq_align(size * sizeof(virtq_desc_t) + 6 + 2 * size);
+    memset(base, 0, used_offset + 6 + sizeof(virtq_used_elem_t) * size);
+
+    vq->io_base = io_base;
+    vq->index = index;
+    vq->size = size;
+    vq->event_idx = event_idx;
+    vq->desc = (virtq_desc_t *)base;
+    vq->avail = (virtq_avail_t *)(base + size * sizeof(virtq_desc_t));
+    vq->used = (virtq_used_t *)(base + used_offset);
+    vq->last_used = 0;
+    vq->kicked_idx = 0;
+
+    outl(io_base + VIRTIO_REG_QUEUE_ADDRESS, (uint32_t)(uintptr_t)base / VIRTQ_ALIGN);
+    return true;
+}
+
+// Make a chain available
+void virtq_publish(virtqueue_t *vq, uint16_t head)
+{
+    vq->avail->ring[vq->avail->idx % vq->size] = head;
+
+    // The entry must be visible before the index that exposes it
+    virtio_mb();
+    vq->avail->idx++;
+}
+
+// Notify the device
+bool virtq_kick(virtqueue_t *vq)
+{
+    uint16_t new_idx = vq->avail->idx;
+    uint16_t old_idx = vq->kicked_idx;
+
+    // Order the index update before reading the device's suppression hints
+    virtio_mb();
+    vq->kicked_idx = new_idx;
+
+    bool notify;
+    if (vq->event_idx)
+    {
+        volatile uint16_t *avail_event = (volatile uint16_t *)&vq->used->ring[vq->size];
+        notify = virtq_need_event(*avail_event, new_idx, old_idx);
+    }
+    else
+    {
+        notify = !(((volatile virtq_used_t *)vq->used)->flags & VIRTQ_USED_F_NO_NOTIFY);
+    }
+
+    if (notify)
+    {
+        outw(vq->io_base + VIRTIO_REG_QUEUE_NOTIFY, vq->index);
+    }
+    return notify;
+}
+
+// Take the next finished chain
+bool virtq_next_used(virtqueue_t *vq, uint16_t *head, uint32_t *length)
+{
+    volatile uint16_t *used_idx = &vq->used->idx;
+    if (vq->last_used == *used_idx)
+    {
+        return false;
+    }
+
+    // Read the entry only after seeing the index that covers it
+    virtio_mb();
+    virtq_used_elem_t *elem = &vq->used->ring[vq->last_used % vq->size];
+    *head = elem->id;
+    *length = elem->length;
+    vq->last_used++;
+    return true;
+}
+
+// Ask for the next interrupt after `pending` more completions
+bool virtq_arm_interrupt(virtqueue_t *vq, uint16_t pending)
+{
+    if (!vq->event_idx)
+    {
+        return false; // The device interrupts on every completion
+    }
+
+    // used_event lives just past the available ring. With several requests
+    // outstanding, wait for the whole batch rather than waking per request.
+    volatile uint16_t *used_event = &vq->avail->ring[vq->size];
+    *used_event = vq->last_used + (pending > 0 ? pending - 1 : 0);
+
+    // A completion may have raced with the update
+    virtio_mb();
+    return vq->last_used != *(volatile uint16_t *)&vq->used->idx;
+}
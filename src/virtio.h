@@ -0,0 +1,121 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Legacy virtio PCI devices
+#define VIRTIO_VENDOR_ID 0x1AF4
+
+// Legacy PCI I/O registers, offsets from BAR0
+#define VIRTIO_REG_DEVICE_FEATURES 0x00
+#define VIRTIO_REG_GUEST_FEATURES 0x04
+#define VIRTIO_REG_QUEUE_ADDRESS 0x08
+#define VIRTIO_REG_QUEUE_SIZE 0x0C
+#define VIRTIO_REG_QUEUE_SELECT 0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY 0x10
+#define VIRTIO_REG_DEVICE_STATUS 0x12
+#define VIRTIO_REG_ISR_STATUS 0x13
+#define VIRTIO_REG_CONFIG 0x14 // Device specific configuration (no MSI-X)
+
+// Device status bits
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER 0x02
+#define VIRTIO_STATUS_DRIVER_OK 0x04
+#define VIRTIO_STATUS_FAILED 0x80
+
+// Ring feature bits
+#define VIRTIO_RING_F_INDIRECT_DESC 28
+#define VIRTIO_RING_F_EVENT_IDX 29
+
+// Descriptor flags
+#define VIRTQ_DESC_F_NEXT 1
+#define VIRTQ_DESC_F_WRITE 2    // Device writes this buffer
+#define VIRTQ_DESC_F_INDIRECT 4 // Buffer is a table of descriptors
+
+// Ring flags
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 1
+#define VIRTQ_USED_F_NO_NOTIFY 1
+
+// Legacy rings are laid out on 4 KiB boundaries
+#define VIRTQ_ALIGN 4096
+#define VIRTQ_MAX_SIZE 256
+
+// Memory needed for a queue of VIRTQ_MAX_SIZE entries
+#define VIRTQ_MEMORY_SIZE (3 * VIRTQ_ALIGN + VIRTQ_MAX_SIZE * 16)
+
+// Descriptor
+typedef struct
+{
+    uint64_t address;
+    uint32_t length;
+    uint16_t flags;
+    uint16_t next;
+} virtq_desc_t;
+
+// Driver -> device ring; ring[size] holds used_event
+typedef struct
+{
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} virtq_avail_t;
+
+// Element of the used ring
+typedef struct
+{
+    uint32_t id; // Head descriptor of the finished chain
+    uint32_t length;
+} virtq_used_elem_t;
+
+// Device -> driver ring; followed by avail_event
+typedef struct
+{
+    uint16_t flags;
+    uint16_t idx;
+    virtq_used_elem_t ring[];
+} virtq_used_t;
+
+// Split virtqueue
+typedef struct
+{
+    uint16_t io_base;
+    uint16_t index;
+    uint16_t size;
+    bool event_idx; // VIRTIO_RING_F_EVENT_IDX negotiated
+
+    virtq_desc_t *desc;
+    virtq_avail_t *avail;
+    virtq_used_t *used;
+
+    uint16_t last_used;   // Next used entry to consume
+    uint16_t kicked_idx;  // avail->idx at the last notification
+} virtqueue_t;
+
+// Reset the device and acknowledge it; returns the offered features
+uint32_t virtio_begin_init(uint16_t io_base);
+
+// Accept a feature subset
+void virtio_set_features(uint16_t io_base, uint32_t features);
+
+// Tell the device the driver is ready
+void virtio_finish_init(uint16_t io_base);
+
+// Set up queue `index` in `memory` (VIRTQ_MEMORY_SIZE bytes, 4 KiB aligned)
+bool virtq_init(virtqueue_t *vq, uint16_t io_base, uint16_t index, void *memory, bool event_idx);
+
+// Make a descriptor chain available to the device (without notifying)
+void virtq_publish(virtqueue_t *vq, uint16_t head);
+
+// Notify the device of everything published since the last kick, unless
+// it asked not to be notified. Returns whether a notification was sent.
+bool virtq_kick(virtqueue_t *vq);
+
+// Take the next finished chain; returns false if there is none
+bool virtq_next_used(virtqueue_t *vq, uint16_t *head, uint32_t *length);
+
+// Ask for the next interrupt once `pending` more chains have finished.
+// Returns true if chains finished meanwhile and should be drained first.
+bool virtq_arm_interrupt(virtqueue_t *vq, uint16_t pending);
+
+#endif // VIRTIO_H
@@ -0,0 +1,269 @@
+#include "virtio_blk.h"
+#include "virtio.h"
+#include "interrupts.h" // For the device IRQ
+#include "pci.h"        // For driver registration
+#include "utils.h"      // For port I/O
+#include "string.h"     // For string operations
+#include <stddef.h>
+
+// Request header read by the device
+typedef struct
+{
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) virtio_blk_header_t;
+
+// Per-request state. With indirect descriptors each request occupies one
+// ring descriptor that points at its own table. A request larger than one
+// chain can carry is sent as consecutive parts through the same slot.
+typedef struct
+{
+    virtq_desc_t table[VIRTIO_BLK_MAX_SEGMENTS + 2];
+    virtio_blk_header_t header;
+    volatile uint8_t status;
+    bool used;
+    blockdev_request_t *req;
+    uint32_t offset; // Sectors of the request already transferred
+    uint32_t part;   // Sectors carried by the chain in flight
+} __attribute__((aligned(16))) virtio_blk_slot_t;
+
+static blockdev_t vblk_dev;
+static bool vblk_present = false;
+static uint16_t vblk_io = 0;
+static virtqueue_t vblk_queue;
+static bool vblk_indirect = false;
+static uint32_t vblk_size_max = 0; // 0 = no segment size limit
+static uint32_t vblk_seg_max = VIRTIO_BLK_MAX_SEGMENTS;
+static uint32_t vblk_slot_count = 0;
+static uint32_t vblk_pending = 0;
+
+static virtio_blk_slot_t vblk_slots[VIRTIO_BLK_MAX_INFLIGHT];
+static uint8_t vblk_ring_memory[VIRTQ_MEMORY_SIZE] __attribute__((aligned(VIRTQ_ALIGN)));
+
+// Fill in a descriptor
+static void vblk_set_desc(virtq_desc_t *desc, void *address, uint32_t length, uint16_t flags, uint16_t next)
+{
+    desc->address = (uint32_t)(uintptr_t)address; // Identity mapped
+    desc->length = length;
+    desc->flags = flags;
+    desc->next = next;
+}
+
+// Build the descriptor chain for the next part of a request in `table`,
+// linking entries starting at index `first`. The part is as large as the
+// segment limits allow. Returns the number of descriptors.
+static int vblk_build_chain(virtq_desc_t *table, uint16_t first, virtio_blk_slot_t *slot)
+{
+    blockdev_request_t *req = slot->req;
+    uint8_t *data = (uint8_t *)req->buffer + slot->offset * BLOCKDEV_SECTOR_SIZE;
+    uint32_t bytes = (req->count - slot->offset) * BLOCKDEV_SECTOR_SIZE;
+    uint16_t data_flags = req->write ? 0 : VIRTQ_DESC_F_WRITE;
+    uint32_t segment = vblk_size_max ? vblk_size_max : bytes;
+
+    // Without indirect tables a chain has room for a single data segment
+    uint32_t segments = vblk_indirect ? vblk_seg_max : 1;
+    if (bytes > segment * segments)
+    {
+        bytes = segment * segments;
+    }
+    slot->part = bytes / BLOCKDEV_SECTOR_SIZE;
+
+    int n = 0;
+    vblk_set_desc(&table[n], &slot->header, sizeof(slot->header), VIRTQ_DESC_F_NEXT, first + 1);
+    n++;
+
+    while (bytes > 0)
+    {
+        uint32_t length = bytes < segment ? bytes : segment;
+        vblk_set_desc(&table[n], data, length, data_flags | VIRTQ_DESC_F_NEXT, first + n + 1);
+        data += length;
+        bytes -= length;
+        n++;
+    }
+
+    vblk_set_desc(&table[n], (void *)&slot->status, 1, VIRTQ_DESC_F_WRITE, 0);
+    return n + 1;
+}
+
+// Publish the next part of a slot's request
+static void vblk_issue(uint32_t index)
+{
+    virtio_blk_slot_t *slot = &vblk_slots[index];
+    blockdev_request_t *req = slot->req;
+
+    slot->status = 0xFF;
+    slot->header.type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    slot->header.reserved = 0;
+    slot->header.sector = req->lba + slot->offset;
+
+    uint16_t head;
+    if (vblk_indirect)
+    {
+        // Slot i owns ring descriptor i, which points at the slot's table
+        head = index;
+        int n = vblk_build_chain(slot->table, 0, slot);
+        vblk_set_desc(&vblk_queue.desc[head], slot->table, n * sizeof(virtq_desc_t), VIRTQ_DESC_F_INDIRECT, 0);
+    }
+    else
+    {
+        // Slot i owns ring descriptors 3i .. 3i+2
+        head = index * 3;
+        vblk_build_chain(&vblk_queue.desc[head], head, slot);
+    }
+
+    vblk_pending++;
+    virtq_publish(&vblk_queue, head);
+}
+
+// Start a request (blockdev start callback)
+static void vblk_start(blockdev_t *dev, blockdev_request_t *req)
+{
+    (void)dev;
+
+    // queue_depth guarantees a free slot
+    uint32_t index = 0;
+    while (vblk_slots[index].used)
+    {
+        index++;
+    }
+
+    vblk_slots[index].used = true;
+    vblk_slots[index].req = req;
+    vblk_slots[index].offset = 0;
+    vblk_issue(index);
+}
+
+// Notify the device of the published batch (blockdev kick callback)
+static void vblk_kick(blockdev_t *dev)
+{
+    (void)dev;
+    virtq_kick(&vblk_queue);
+}
+
+// Complete every finished request
+static void vblk_drain(void)
+{
+    uint16_t head;
+    uint32_t length;
+
+    do
+    {
+        while (virtq_next_used(&vblk_queue, &head, &length))
+        {
+            uint32_t index = vblk_indirect ? head : head / 3;
+            virtio_blk_slot_t *slot = &vblk_slots[index];
+            blockdev_request_t *req = slot->req;
+            bool ok = slot->status == VIRTIO_BLK_S_OK;
+
+            vblk_pending--;
+            slot->offset += slot->part;
+            if (ok && slot->offset < req->count)
+            {
+                // Send the rest of a split request
+                vblk_issue(index);
+                virtq_kick(&vblk_queue);
+                continue;
+            }
+
+            slot->used = false;
+            slot->req = NULL;
+            blockdev_complete(&vblk_dev, req, ok);
+        }
+    } while (virtq_arm_interrupt(&vblk_queue, vblk_pending));
+}
+
+// Device interrupt handler
+static void vblk_irq(int irq)
+{
+    (void)irq;
+
+    // Reading the ISR register acknowledges the interrupt; bit 0 means the
+    // queue has new used entries (the line may be shared)
+    if (!(inb(vblk_io + VIRTIO_REG_ISR_STATUS) & 1))
+    {
+        return;
+    }
+    vblk_drain();
+}
+
+// Set up a matching function (PCI driver probe)
+static bool vblk_probe(pci_device_t *pdev)
+{
+    if (vblk_present || !pdev->bars[0].io)
+    {
+        return false; // Legacy devices expose an I/O BAR
+    }
+    vblk_io = pdev->bars[0].base;
+    pci_enable_device(pdev);
+
+    // Negotiate features. VIRTIO_BLK_F_FLUSH is deliberately not accepted,
+    // which keeps the device in write-through mode.
+    uint32_t offered = virtio_begin_init(vblk_io);
+    uint32_t wanted = (1u << VIRTIO_RING_F_INDIRECT_DESC) | (1u << VIRTIO_RING_F_EVENT_IDX) |
+                      (1u << VIRTIO_BLK_F_SIZE_MAX) | (1u << VIRTIO_BLK_F_SEG_MAX);
+    uint32_t features = offered & wanted;
+    virtio_set_features(vblk_io, features);
+
+    vblk_indirect = (features & (1u << VIRTIO_RING_F_INDIRECT_DESC)) != 0;
+    if (features & (1u << VIRTIO_BLK_F_SIZE_MAX))
+    {
+        vblk_size_max = inl(vblk_io + VIRTIO_REG_CONFIG + VIRTIO_BLK_CONFIG_SIZE_MAX);
+        vblk_size_max &= ~(BLOCKDEV_SECTOR_SIZE - 1);
+    }
+    if (features & (1u << VIRTIO_BLK_F_SEG_MAX))
+    {
+        uint32_t seg_max = inl(vblk_io + VIRTIO_REG_CONFIG + VIRTIO_BLK_CONFIG_SEG_MAX);
+        if (seg_max > 0 && seg_max < vblk_seg_max)
+        {
+            vblk_seg_max = seg_max;
+        }
+    }
+
+    if (!virtq_init(&vblk_queue, vblk_io, 0, vblk_ring_memory,
+                    (features & (1u << VIRTIO_RING_F_EVENT_IDX)) != 0))
+    {
+        outb(vblk_io + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+        return false;
+    }
+
+    // Without indirect tables every request takes three ring descriptors
+    vblk_slot_count = vblk_indirect ? vblk_queue.size : vblk_queue.size / 3;
+    if (vblk_slot_count > VIRTIO_BLK_MAX_INFLIGHT)
+    {
+        vblk_slot_count = VIRTIO_BLK_MAX_INFLIGHT;
+    }
+
+    uint32_t capacity_low = inl(vblk_io + VIRTIO_REG_CONFIG + VIRTIO_BLK_CONFIG_CAPACITY);
+    uint32_t capacity_high = inl(vblk_io + VIRTIO_REG_CONFIG + VIRTIO_BLK_CONFIG_CAPACITY + 4);
+
+    strcpy(vblk_dev.name, "vda");
+    vblk_dev.sector_count = capacity_high ? 0xFFFFFFFF : capacity_low;
+    vblk_dev.read = NULL;
+    vblk_dev.write = NULL;
+    vblk_dev.start = vblk_start;
+    vblk_dev.kick = vblk_kick;
+    vblk_dev.queue_depth = vblk_slot_count;
+    vblk_dev.driver_data = NULL;
+    blockdev_register(&vblk_dev);
+
+    irq_register(pdev->irq_line, vblk_irq);
+    virtio_finish_init(vblk_io);
+
+    vblk_present = true;
+    return true;
+}
+
+static const pci_driver_t vblk_driver = {
+    "virtio-blk", VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, PCI_ANY_ID, PCI_ANY_ID, vblk_probe,
+};
+
+// Register the virtio-blk PCI driver; the first device becomes "vda"
+blockdev_t *virtio_blk_init(void)
+{
+    if (!vblk_present)
+    {
+        pci_register_driver(&vblk_driver);
+    }
+    return vblk_present ? &vblk_dev : NULL;
+}
@@ -0,0 +1,34 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include "blockdev.h"
+
+// Transitional virtio-blk PCI device
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+
+// Feature bits
+#define VIRTIO_BLK_F_SIZE_MAX 1 // Largest single data segment in config
+#define VIRTIO_BLK_F_SEG_MAX 2  // Most data segments per request in config
+#define VIRTIO_BLK_F_RO 5
+
+// Device configuration, offsets from VIRTIO_REG_CONFIG
+#define VIRTIO_BLK_CONFIG_CAPACITY 0 // 64-bit sector count
+#define VIRTIO_BLK_CONFIG_SIZE_MAX 8
+#define VIRTIO_BLK_CONFIG_SEG_MAX 12
+
+// Request types
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+
+// Request status written by the device
+#define VIRTIO_BLK_S_OK 0
+
+// Requests in flight at once, and data segments per request
+#define VIRTIO_BLK_MAX_INFLIGHT 32
+#define VIRTIO_BLK_MAX_SEGMENTS 16
+
+// Register the virtio-blk PCI driver; the first device becomes "vda".
+// Returns NULL if there is none.
+blockdev_t *virtio_blk_init(void);
+
+#endif // VIRTIO_BLK_H
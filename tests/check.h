@@ -0,0 +1,26 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+// Minimal checks for the host-side tests. Each test program links the
+// kernel sources it needs with stubs.c and exits non-zero on a failure.
+// The kernel's own printf replaces the C library's, so output goes
+// through fprintf.
+
+#include <stdio.h>
+
+static int check_failures = 0;
+
+#define CHECK(condition)                                                                          \
+    do                                                                                            \
+    {                                                                                             \
+        if (!(condition))                                                                         \
+        {                                                                                         \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);         \
+            check_failures++;                                                                     \
+        }                                                                                         \
+    } while (0)
+
+// Report the result; the value is the test program's exit status
+#define CHECK_DONE() (fprintf(stdout, "%s: %s\n", __FILE__, check_failures ? "FAILED" : "ok"), check_failures != 0)
+
+#endif // CHECK_H
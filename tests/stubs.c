@@ -0,0 +1,60 @@
+// Stand-ins for the hardware-facing kernel pieces the host-side tests do
+// not link: interrupts, the timer, the disk drivers and the console.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "blockdev.h"
+
+// The timer only moves when a test advances it
+uint32_t test_ms = 0;
+
+uint32_t irq_save(void)
+{
+    return 0;
+}
+
+void irq_restore(uint32_t flags)
+{
+    (void)flags;
+}
+
+// Called while waiting, so a test device can complete queued requests
+void (*test_idle)(void) = NULL;
+
+void irq_wait_for(volatile bool *flag)
+{
+    while (!*flag && test_idle != NULL)
+    {
+        test_idle();
+    }
+}
+
+void timer_init(void)
+{
+}
+
+uint32_t timer_ms(void)
+{
+    return test_ms;
+}
+
+// No disks: the file system falls back to the RAM disk
+blockdev_t *ata_init(void)
+{
+    return NULL;
+}
+
+blockdev_t *virtio_blk_init(void)
+{
+    return NULL;
+}
+
+void printf(const char *format, ...)
+{
+    (void)format;
+}
+
+const char *get_current_username(void)
+{
+    return "test";
+}
@@ -0,0 +1,82 @@
+#include "check.h"
+#include "bcache.h"
+#include "string.h"
+
+#define TEST_SECTORS 256
+#define TEST_QUEUE 8
+
+extern void (*test_idle)(void);
+
+// Queued test device. Transfers happen when a request starts, but it only
+// completes when someone waits, so requests stay in flight meanwhile.
+static uint8_t disk[TEST_SECTORS][BLOCKDEV_SECTOR_SIZE];
+static blockdev_t test_dev;
+static blockdev_request_t *pending[TEST_QUEUE];
+static int pending_count = 0;
+
+// Run a request against the disk and leave it in flight
+static void test_start(blockdev_t *dev, blockdev_request_t *req)
+{
+    (void)dev;
+    if (req->write)
+    {
+        memcpy(disk[req->lba], req->buffer, req->count * BLOCKDEV_SECTOR_SIZE);
+    }
+    else
+    {
+        memcpy(req->buffer, disk[req->lba], req->count * BLOCKDEV_SECTOR_SIZE);
+    }
+    pending[pending_count++] = req;
+}
+
+// Complete the oldest request in flight
+static void test_complete(void)
+{
+    if (pending_count == 0)
+    {
+        return;
+    }
+    blockdev_request_t *req = pending[0];
+    pending_count--;
+    memmove(pending, pending + 1, pending_count * sizeof(pending[0]));
+    blockdev_complete(&test_dev, req, true);
+}
+
+// Fill `count` blocks of `data` with one byte value
+static void test_fill(uint8_t *data, uint32_t count, uint8_t value)
+{
+    memset(data, value, count * BLOCKDEV_SECTOR_SIZE);
+}
+
+// A write-around landing while readahead of the same blocks is still in
+// flight must not be overwritten by the old contents
+static void test_write_during_readahead(void)
+{
+    static uint8_t data[BCACHE_WRITE_AROUND * BLOCKDEV_SECTOR_SIZE];
+    static uint8_t check[BCACHE_WRITE_AROUND * BLOCKDEV_SECTOR_SIZE];
+    uint32_t block = 64;
+
+    test_fill(disk[block], BCACHE_WRITE_AROUND, 0xAA);
+    CHECK(bcache_prefetch(&test_dev, block, BCACHE_WRITE_AROUND) == BCACHE_WRITE_AROUND);
+    CHECK(pending_count > 0);
+
+    test_fill(data, BCACHE_WRITE_AROUND, 0x55);
+    CHECK(bcache_write(&test_dev, block, BCACHE_WRITE_AROUND, data));
+
+    CHECK(bcache_read(&test_dev, block, BCACHE_WRITE_AROUND, check));
+    CHECK(memcmp(check, data, sizeof(data)) == 0);
+    CHECK(memcmp(disk[block], data, sizeof(data)) == 0);
+}
+
+int main(void)
+{
+    strcpy(test_dev.name, "test0");
+    test_dev.sector_count = TEST_SECTORS;
+    test_dev.start = test_start;
+    test_dev.queue_depth = TEST_QUEUE;
+    blockdev_register(&test_dev);
+    test_idle = test_complete;
+
+    test_write_during_readahead();
+    return CHECK_DONE();
+}
@@ -0,0 +1,225 @@
+#include "check.h"
+
+// Included rather than linked, to reach the buffer and its undo log
+#include "editor.c"
+
+// The shell pieces the editor calls; the tests never run its key loop
+char get_keyboard_input(void)
+{
+    return 27;
+}
+
+bool confirm_action(const char *prompt)
+{
+    (void)prompt;
+    return false;
+}
+
+void clear_screen(void)
+{
+}
+
+// The text mode screen editor_display paints
+static uint16_t screen[VGA_WIDTH * VGA_HEIGHT];
+
+// Copy the current buffer's text out of the gap buffer
+static const char *test_text(void)
+{
+    static char text[EDITOR_BUFFER_SIZE + 1];
+    for (int i = 0; i < buffer->length; i++)
+    {
+        text[i] = editor_char_at(i);
+    }
+    text[buffer->length] = '\0';
+    return text;
+}
+
+// Check that the line index agrees with the text
+static bool test_lines_match(void)
+{
+    const char *text = test_text();
+    int line = 0;
+    for (int i = 0; i <= buffer->length; i++)
+    {
+        if (editor_line_of(i) != line)
+        {
+            return false;
+        }
+        if (text[i] == '\n')
+        {
+            line++;
+            if (editor_line_offset(line) != i + 1)
+            {
+                return false;
+            }
+        }
+    }
+    return buffer->line_total == line;
+}
+
+// Type a string at the cursor
+static void test_type(const char *text)
+{
+    while (*text != '\0')
+    {
+        editor_insert_char(*text++);
+    }
+}
+
+// Edits anywhere in the text move the gap there and keep the line index
+// right; undo and redo step through them a run or a line at a time
+static void test_edit_undo(void)
+{
+    editor_init();
+    test_type("hello\nworld");
+    CHECK(strcmp(test_text(), "hello\nworld") == 0);
+    CHECK(test_lines_match());
+
+    // Insert in the middle, then delete before it
+    window->cursor = 5;
+    test_type(", there");
+    CHECK(strcmp(test_text(), "hello, there\nworld") == 0);
+    window->cursor = 2;
+    editor_delete_char();
+    editor_delete_char();
+    CHECK(strcmp(test_text(), "llo, there\nworld") == 0);
+    CHECK(window->cursor == 0);
+    test_type("\n\n");
+    CHECK(strcmp(test_text(), "\n\nllo, there\nworld") == 0);
+    CHECK(test_lines_match());
+
+    // Each newline is undone on its own, then the deleted run, then the
+    // typed one, then the first line and the line before it
+    CHECK(editor_undo());
+    CHECK(strcmp(test_text(), "\nllo, there\nworld") == 0);
+    CHECK(editor_undo());
+    CHECK(strcmp(test_text(), "llo, there\nworld") == 0);
+    CHECK(editor_undo());
+    CHECK(strcmp(test_text(), "hello, there\nworld") == 0);
+    CHECK(window->cursor == 2);
+    CHECK(editor_undo());
+    CHECK(strcmp(test_text(), "hello\nworld") == 0);
+    CHECK(editor_undo());
+    CHECK(editor_undo());
+    CHECK(strcmp(test_text(), "") == 0);
+    CHECK(!editor_undo());
+    CHECK(test_lines_match());
+
+    // Redo replays them in order
+    for (int i = 0; i < 4; i++)
+    {
+        CHECK(editor_redo());
+    }
+    CHECK(strcmp(test_text(), "llo, there\nworld") == 0);
+    CHECK(test_lines_match());
+
+    // A new edit discards what could still be redone
+    window->cursor = buffer->length;
+    test_type("!");
+    CHECK(!editor_redo());
+    CHECK(strcmp(test_text(), "llo, there\nworld!") == 0);
+    CHECK(editor_undo());
+    CHECK(strcmp(test_text(), "llo, there\nworld") == 0);
+}
+
+// Text large enough to grow the buffer keeps its line index across many
+// gap moves
+static void test_large_edit(void)
+{
+    editor_init();
+    for (int i = 0; i < 3000; i++)
+    {
+        test_type(i % 10 == 9 ? "line\n" : "word ");
+    }
+    for (int pos = buffer->length - 7; pos > 0; pos -= 997)
+    {
+        window->cursor = pos;
+        test_type("\nnew\n");
+    }
+    CHECK(buffer->length == 3000 * 5 + 16 * 5);
+    CHECK(test_lines_match());
+}
+
+// Count the sectors written to the RAM disk by a save and the sync after it
+static uint32_t test_save_sectors(void)
+{
+    blockdev_t *ram = blockdev_find("ram0");
+    fs_sync();
+    uint32_t before = ram->sectors_written;
+    CHECK(editor_save_file());
+    fs_sync();
+    return ram->sectors_written - before;
+}
+
+// Check that a file holds what the buffer does
+static bool test_saved(const char *filename)
+{
+    int size = fs_get_file_size(filename);
+    static char content[FS_READ_BUFFER_SIZE + 1];
+    int fd = fs_open(filename, FS_O_READ);
+    bool ok = fd >= 0 && size == buffer->length && fs_read(fd, content, size) == size;
+    fs_close(fd);
+    content[size > 0 ? size : 0] = '\0';
+    return ok && strcmp(content, test_text()) == 0;
+}
+
+// Saving back to the file the text came from writes only what changed,
+// unless the file changed behind the editor's back
+static void test_partial_save(void)
+{
+    static char content[48 * FS_BLOCK_SIZE + 1];
+    uint32_t full = 48;
+    for (uint32_t i = 0; i < full * FS_BLOCK_SIZE; i++)
+    {
+        content[i] = i % 64 == 63 ? '\n' : 'a' + i % 26;
+    }
+    content[full * FS_BLOCK_SIZE] = '\0';
+    CHECK(fs_create_file("edit.bin", "test"));
+    CHECK(fs_write_file("edit.bin", content));
+
+    editor_init();
+    CHECK(editor_load_file("edit.bin"));
+    CHECK(strcmp(test_text(), content) == 0);
+
+    // The same length: only the changed block is written
+    window->cursor = 24 * FS_BLOCK_SIZE + 1;
+    editor_delete_char();
+    test_type("X");
+    CHECK(test_save_sectors() < full / 4);
+    CHECK(test_saved("edit.bin"));
+
+    // Longer: from the change to the end
+    window->cursor = 44 * FS_BLOCK_SIZE;
+    test_type("inserted");
+    CHECK(test_save_sectors() < full / 2);
+    CHECK(test_saved("edit.bin"));
+
+    // Shorter: the file is cut to the new length
+    window->cursor = buffer->length;
+    for (int i = 0; i < 2 * FS_BLOCK_SIZE; i++)
+    {
+        editor_delete_char();
+    }
+    CHECK(test_save_sectors() < full / 4);
+    CHECK(test_saved("edit.bin"));
+
+    // Changed by someone else: written whole
+    int fd = fs_open("edit.bin", FS_O_WRITE);
+    CHECK(fs_pwrite(fd, "ZZZZ", 4, 0) == 4);
+    CHECK(fs_close(fd) == 0);
+    window->cursor = buffer->length;
+    test_type("end");
+    CHECK(test_save_sectors() > full);
+    CHECK(test_saved("edit.bin"));
+    CHECK(!buffer->modified);
+}
+
+int main(void)
+{
+    terminal_buffer = screen;
+    fs_init();
+    test_edit_undo();
+    test_large_edit();
+    test_partial_save();
+    return CHECK_DONE();
+}
@@ -0,0 +1,443 @@
+#include "check.h"
+#include "fs.h"
+#include "journal.h"
+#include "ramdisk.h"
+#include "string.h"
+
+extern uint32_t test_ms;
+
+// A second disk holding what had reached the RAM disk at one moment.
+// Mounting it is what the next boot would see had the machine stopped
+// then; whatever was only cached is lost.
+static uint8_t snapshot[RAMDISK_SECTORS][BLOCKDEV_SECTOR_SIZE];
+static blockdev_t snapshot_dev;
+
+// Read from the snapshot disk
+static bool snapshot_read(blockdev_t *dev, uint32_t lba, uint32_t count, void *buffer)
+{
+    (void)dev;
+    memcpy(buffer, snapshot[lba], count * BLOCKDEV_SECTOR_SIZE);
+    return true;
+}
+
+// Write to the snapshot disk
+static bool snapshot_write(blockdev_t *dev, uint32_t lba, uint32_t count, const void *buffer)
+{
+    (void)dev;
+    memcpy(snapshot[lba], buffer, count * BLOCKDEV_SECTOR_SIZE);
+    return true;
+}
+
+// Copy the RAM disk as it is now, without syncing anything first
+static void test_snapshot(void)
+{
+    blockdev_t *ram = blockdev_find("ram0");
+    CHECK(blockdev_read(ram, 0, RAMDISK_SECTORS, snapshot));
+    strcpy(snapshot_dev.name, "snap0");
+    snapshot_dev.sector_count = RAMDISK_SECTORS;
+    snapshot_dev.read = snapshot_read;
+    snapshot_dev.write = snapshot_write;
+}
+
+// Mount the snapshot, replaying its journal as after a crash
+static bool test_crash(void)
+{
+    return fs_mount(&snapshot_dev);
+}
+
+// Go back to the RAM disk once a test is done with the snapshot
+static void test_resume(void)
+{
+    CHECK(fs_mount(blockdev_find("ram0")));
+}
+
+// Fill a file with `blocks` blocks of one character
+static bool test_fill(const char *filename, int blocks, char c)
+{
+    static char content[64 * FS_BLOCK_SIZE + 1];
+    memset(content, c, blocks * FS_BLOCK_SIZE);
+    content[blocks * FS_BLOCK_SIZE] = '\0';
+    return (fs_file_exists(filename) || fs_create_file(filename, "test")) &&
+           fs_write_file(filename, content);
+}
+
+// Check that a file holds `blocks` blocks of one character
+static bool test_filled(const char *filename, int blocks, char c)
+{
+    const char *content = fs_read_file(filename);
+    if (content == NULL || (int)strlen(content) != blocks * FS_BLOCK_SIZE)
+    {
+        return false;
+    }
+    for (int i = 0; i < blocks * FS_BLOCK_SIZE; i++)
+    {
+        if (content[i] != c)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check that every file's blocks match their checksums
+static bool test_scrub_clean(void)
+{
+    fs_scrub_result_t result;
+    return fs_scrub(&result, NULL) && result.bad_blocks == 0;
+}
+
+// Name of the n-th test file
+static void test_name(char *name, int n)
+{
+    strcpy(name, "del");
+    itoa(n, name + 3, 10);
+}
+
+// Deleting enough files to rebuild the name index must not bring any of
+// them back. The volume holds fewer files than that, so they are created
+// and deleted in rounds.
+static void test_delete_many(void)
+{
+    char name[16];
+    int before = fs_get_file_count();
+    int rounds = 3;
+    int files = 400; // rounds * files > FS_INDEX_SIZE / 4 tombstones
+
+    for (int round = 0; round < rounds; round++)
+    {
+        for (int n = 0; n < files; n++)
+        {
+            test_name(name, round * files + n);
+            CHECK(fs_create_file(name, "test"));
+        }
+        for (int n = 0; n < files; n++)
+        {
+            test_name(name, round * files + n);
+            CHECK(fs_delete_file(name));
+        }
+    }
+
+    CHECK(fs_get_file_count() == before);
+    for (int n = 0; n < rounds * files; n++)
+    {
+        test_name(name, n);
+        CHECK(!fs_file_exists(name));
+        CHECK(!fs_delete_file(name));
+    }
+    CHECK(fs_get_file_count() == before);
+
+    test_name(name, 0);
+    CHECK(fs_create_file(name, "test"));
+    CHECK(fs_file_exists(name));
+    CHECK(fs_get_file_count() == before + 1);
+}
+
+// Blocks freed by a delete must not take new data before the delete is
+// committed, or replay brings the old file back holding the new data
+static void test_delete_reuse_crash(void)
+{
+    CHECK(test_fill("x.bin", 20, 'A'));
+    fs_sync();
+    CHECK(fs_delete_file("x.bin"));
+    CHECK(test_fill("y.bin", 20, 'B'));
+    test_snapshot();
+
+    CHECK(test_crash());
+    CHECK(!fs_file_exists("x.bin") || test_filled("x.bin", 20, 'A'));
+    CHECK(!fs_file_exists("y.bin") || test_filled("y.bin", 20, 'B'));
+    CHECK(test_scrub_clean());
+    test_resume();
+
+    // Once committed, the freed blocks are used again
+    int free_before = fs_get_free_blocks();
+    CHECK(fs_delete_file("y.bin"));
+    fs_sync();
+    CHECK(fs_get_free_blocks() == free_before + 20);
+}
+
+// Fill a buffer with letters that do not compress
+static void test_noise(char *buffer, uint32_t len)
+{
+    uint32_t state = 12345;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        state = state * 1103515245u + 12345u;
+        buffer[i] = 'a' + (state >> 16) % 26;
+    }
+    buffer[len] = '\0';
+}
+
+// Fill the volume until only `keep` blocks are free
+static void test_fill_volume(int keep)
+{
+    int fd = fs_open("full.bin", FS_O_WRITE | FS_O_CREATE | FS_O_TRUNC);
+    CHECK(fd >= 0);
+    CHECK(fs_ftruncate(fd, (fs_get_free_blocks() - keep) * FS_BLOCK_SIZE) == 0);
+    CHECK(fs_close(fd) == 0);
+    CHECK(fs_get_free_blocks() == keep);
+}
+
+// Rewriting a packed file on a full volume must fail without losing the
+// content it had, in memory or on the device
+static void test_packed_rewrite_full(void)
+{
+    static char content[16 * FS_BLOCK_SIZE + 1];
+    test_noise(content, sizeof(content) - 1);
+
+    CHECK(test_fill("full.txt", 32, 'p'));
+    CHECK(fs_get_file_info("full.txt")->flags & FS_FLAG_PACKED);
+    fs_sync();
+    test_fill_volume(4);
+
+    CHECK(!fs_write_file("full.txt", content));
+    CHECK(test_filled("full.txt", 32, 'p'));
+    fs_sync();
+    test_snapshot();
+    CHECK(test_crash());
+    CHECK(test_filled("full.txt", 32, 'p'));
+    CHECK(test_scrub_clean());
+    test_resume();
+
+    CHECK(fs_delete_file("full.bin"));
+    CHECK(fs_delete_file("full.txt"));
+    fs_sync();
+}
+
+// Commit everything written to a file, leaving the home copies of its
+// metadata in the cache
+static void test_commit(const char *filename)
+{
+    int fd = fs_open(filename, FS_O_READ);
+    CHECK(fs_fsync(fd) == 0);
+    CHECK(fs_close(fd) == 0);
+}
+
+// Get the log position of the last transaction in the snapshot's journal
+static uint32_t test_last_transaction(void)
+{
+    const osfs_superblock_t *sb = (const osfs_superblock_t *)snapshot[0];
+    const osfs_journal_header_t *header = (const osfs_journal_header_t *)snapshot[sb->journal_start];
+    uint32_t pos = header->start;
+    uint32_t last = 0;
+    for (uint32_t sequence = header->sequence;; sequence++)
+    {
+        const osfs_journal_descriptor_t *desc =
+            (const osfs_journal_descriptor_t *)snapshot[sb->journal_start + pos];
+        if (desc->magic != OSFS_JOURNAL_MAGIC || desc->type != OSFS_JOURNAL_DESCRIPTOR ||
+            desc->sequence != sequence)
+        {
+            return last;
+        }
+        last = sb->journal_start + pos;
+        pos += desc->count + 2;
+    }
+}
+
+// Replay brings back what was committed and nothing that was not
+static void test_journal_replay(void)
+{
+    journal_stats_t stats;
+
+    CHECK(test_fill("j1.bin", 3, '1'));
+    test_commit("j1.bin");
+    CHECK(test_fill("j2.bin", 3, '2'));
+    test_snapshot();
+
+    CHECK(test_crash());
+    journal_get_stats(&stats);
+    CHECK(stats.replayed > 0);
+    CHECK(test_filled("j1.bin", 3, '1'));
+    CHECK(!fs_file_exists("j2.bin"));
+    CHECK(test_scrub_clean());
+    test_resume();
+}
+
+// A transaction that does not match its commit checksum, and everything
+// after it, is not replayed
+static void test_journal_checksum(void)
+{
+    journal_stats_t stats;
+
+    CHECK(test_fill("j3.bin", 3, '3'));
+    test_commit("j3.bin");
+    CHECK(test_fill("j4.bin", 3, '4'));
+    test_commit("j4.bin");
+    test_snapshot();
+    uint32_t last = test_last_transaction();
+    CHECK(last > 0);
+    snapshot[last + 1][100] ^= 0xFF;
+
+    CHECK(test_crash());
+    journal_get_stats(&stats);
+    CHECK(stats.replayed > 0);
+    CHECK(test_filled("j3.bin", 3, '3'));
+    CHECK(!fs_file_exists("j4.bin"));
+    CHECK(test_scrub_clean());
+    test_resume();
+}
+
+// Updates made close together share one commit, and replay applies them
+// all
+static void test_journal_group_commit(void)
+{
+    journal_stats_t before, after;
+    char name[16];
+
+    fs_sync();
+    journal_get_stats(&before);
+    for (int n = 0; n < 5; n++)
+    {
+        strcpy(name, "group");
+        itoa(n, name + 5, 10);
+        CHECK(test_fill(name, 1, 'a' + n));
+    }
+    journal_poll();
+    journal_get_stats(&after);
+    CHECK(after.commits == before.commits);
+
+    test_ms += JOURNAL_COMMIT_MS;
+    journal_poll();
+    journal_get_stats(&after);
+    CHECK(after.commits == before.commits + 1);
+    test_snapshot();
+
+    CHECK(test_crash());
+    for (int n = 0; n < 5; n++)
+    {
+        strcpy(name, "group");
+        itoa(n, name + 5, 10);
+        CHECK(test_filled(name, 1, 'a' + n));
+    }
+    CHECK(test_scrub_clean());
+    test_resume();
+}
+
+// Fill a buffer with text that compresses well, varying with `seed`
+static void test_text(char *buffer, uint32_t len, int seed)
+{
+    const char *line = "compressed content round trip line ";
+    uint32_t line_len = strlen(line);
+    for (uint32_t i = 0; i < len; i++)
+    {
+        buffer[i] = i % 100 == 99 ? (char)('0' + (i / 100 + seed) % 10) : line[i % line_len];
+    }
+    buffer[len] = '\0';
+}
+
+// Check that a file holds exactly `expected`, read whole and piecewise
+// across compression unit boundaries
+static bool test_holds(const char *filename, const char *expected)
+{
+    static char piece[FS_BLOCK_SIZE];
+    uint32_t len = strlen(expected);
+    const char *content = fs_read_file(filename);
+    if (content == NULL || strcmp(content, expected) != 0)
+    {
+        return false;
+    }
+
+    int fd = fs_open(filename, FS_O_READ);
+    bool ok = fd >= 0;
+    for (uint32_t offset = OSFS_CZ_UNIT - 100; ok && offset < len; offset += OSFS_CZ_UNIT)
+    {
+        uint32_t count = len - offset < sizeof(piece) ? len - offset : sizeof(piece);
+        ok = fs_pread(fd, piece, sizeof(piece), offset) == (int)count &&
+             memcmp(piece, expected + offset, count) == 0;
+    }
+    fs_close(fd);
+    return ok;
+}
+
+// Text files are packed on write and read back unchanged, also after a
+// crash
+static void test_compress_round_trip(void)
+{
+    static char content[5 * OSFS_CZ_UNIT + 1];
+    test_text(content, sizeof(content) - 1, 0);
+
+    CHECK(fs_create_file("cz.txt", "test"));
+    CHECK(fs_write_file("cz.txt", content));
+    CHECK(fs_get_file_info("cz.txt")->flags & FS_FLAG_PACKED);
+    CHECK(fs_get_file_blocks("cz.txt") < (int)(sizeof(content) - 1) / FS_BLOCK_SIZE / 2);
+    CHECK(test_holds("cz.txt", content));
+
+    // Appends go to the last unit and keep the file packed
+    CHECK(fs_append("cz.txt", "tail", 4) == 4);
+    strcat(content + sizeof(content) - 100, "tail");
+    CHECK(fs_get_file_info("cz.txt")->flags & FS_FLAG_PACKED);
+    CHECK(test_holds("cz.txt", content));
+
+    fs_sync();
+    test_snapshot();
+    CHECK(test_crash());
+    CHECK(test_holds("cz.txt", content));
+    CHECK(test_scrub_clean());
+    test_resume();
+}
+
+// A write into the middle of a packed file unpacks it; closing the file
+// packs it again
+static void test_compress_middle_write(void)
+{
+    static char content[4 * OSFS_CZ_UNIT + 1];
+    test_text(content, sizeof(content) - 1, 1);
+    CHECK(fs_create_file("mid.txt", "test"));
+    CHECK(fs_write_file("mid.txt", content));
+    CHECK(fs_get_file_info("mid.txt")->flags & FS_FLAG_PACKED);
+
+    int fd = fs_open("mid.txt", FS_O_RDWR);
+    CHECK(fd >= 0);
+    CHECK(fs_pwrite(fd, "MIDDLE", 6, OSFS_CZ_UNIT + 10) == 6);
+    memcpy(content + OSFS_CZ_UNIT + 10, "MIDDLE", 6);
+    CHECK(!(fs_get_file_info("mid.txt")->flags & FS_FLAG_PACKED));
+    CHECK(fs_get_file_blocks("mid.txt") == (int)(sizeof(content) - 1) / FS_BLOCK_SIZE);
+    CHECK(test_holds("mid.txt", content));
+
+    CHECK(fs_close(fd) == 0);
+    CHECK(fs_get_file_info("mid.txt")->flags & FS_FLAG_PACKED);
+    CHECK(test_holds("mid.txt", content));
+}
+
+// Compression can be turned on and off for any file; content that does
+// not compress is left plain
+static void test_set_compression(void)
+{
+    static char content[3 * OSFS_CZ_UNIT + 1];
+    int blocks = (sizeof(content) - 1) / FS_BLOCK_SIZE;
+    test_text(content, sizeof(content) - 1, 2);
+    CHECK(fs_create_file("cz.bin", "test"));
+    CHECK(fs_write_file("cz.bin", content));
+    CHECK(fs_get_file_info("cz.bin")->flags == 0);
+    CHECK(fs_get_file_blocks("cz.bin") == blocks);
+
+    CHECK(fs_set_compression("cz.bin", true));
+    CHECK(fs_get_file_info("cz.bin")->flags == (FS_FLAG_COMPRESS | FS_FLAG_PACKED));
+    CHECK(fs_get_file_blocks("cz.bin") < blocks);
+    CHECK(test_holds("cz.bin", content));
+
+    CHECK(fs_set_compression("cz.bin", false));
+    CHECK(fs_get_file_info("cz.bin")->flags == 0);
+    CHECK(fs_get_file_blocks("cz.bin") == blocks);
+    CHECK(test_holds("cz.bin", content));
+
+    test_noise(content, sizeof(content) - 1);
+    CHECK(fs_write_file("cz.bin", content));
+    CHECK(!fs_set_compression("cz.bin", true));
+    CHECK(fs_get_file_info("cz.bin")->flags == 0);
+    CHECK(test_holds("cz.bin", content));
+}
+
+int main(void)
+{
+    fs_init();
+    test_delete_many();
+    test_delete_reuse_crash();
+    test_packed_rewrite_full();
+    test_journal_replay();
+    test_journal_checksum();
+    test_journal_group_commit();
+    test_compress_round_trip();
+    test_compress_middle_write();
+    test_set_compression();
+    return CHECK_DONE();
+}
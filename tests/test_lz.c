@@ -0,0 +1,150 @@
+#include "check.h"
+#include "lz.h"
+#include "string.h"
+
+// Room for the worst case: a single run of literals with its length bytes
+#define TEST_BOUND(len) ((len) + (len) / 255 + 16)
+#define TEST_GUARD 16
+
+static uint8_t input[LZ_MAX_INPUT + 1];
+static uint8_t packed[TEST_BOUND(LZ_MAX_INPUT)];
+static uint8_t output[LZ_MAX_INPUT + TEST_GUARD];
+
+// Pseudo-random bytes, the same on every run
+static uint32_t test_random(void)
+{
+    static uint32_t state = 12345;
+    state = state * 1103515245u + 12345u;
+    return state >> 16;
+}
+
+// Decompress into exactly `capacity` bytes of the output buffer and check
+// that nothing past them was written
+static int test_decompress(const uint8_t *src, uint32_t len, uint32_t capacity)
+{
+    memset(output + capacity, 0xA5, TEST_GUARD);
+    int result = lz_decompress(src, len, output, capacity);
+    for (int i = 0; i < TEST_GUARD; i++)
+    {
+        CHECK(output[capacity + i] == 0xA5);
+    }
+    return result;
+}
+
+// Compress the first `len` input bytes, decompress them and compare
+static uint32_t test_round_trip(uint32_t len)
+{
+    uint32_t size = lz_compress(input, len, packed, TEST_BOUND(len));
+    CHECK(size > 0);
+    CHECK(test_decompress(packed, size, len) == (int)len);
+    CHECK(memcmp(input, output, len) == 0);
+    return size;
+}
+
+// Inputs of every kind come back unchanged; repetitive ones shrink
+static void test_inputs(void)
+{
+    // Empty and shorter than any match
+    CHECK(test_round_trip(0) == 1);
+    memcpy(input, "abc", 3);
+    test_round_trip(3);
+
+    // Text with long-range repeats
+    const char *line = "The quick brown fox jumps over the lazy dog. ";
+    uint32_t line_len = strlen(line);
+    for (uint32_t i = 0; i < LZ_MAX_INPUT; i++)
+    {
+        input[i] = line[i % line_len] + (i / 1000 % 2);
+    }
+    CHECK(test_round_trip(LZ_MAX_INPUT) < LZ_MAX_INPUT / 4);
+
+    // A run of one byte is copied from an offset of 1, overlapping itself
+    memset(input, 'z', 5000);
+    CHECK(test_round_trip(5000) < 64);
+
+    // Matches longer than a nibble with literals of every length between
+    uint32_t pos = 0;
+    for (uint32_t n = 0; pos + 2 * n + 300 < LZ_MAX_INPUT; n++)
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            input[pos++] = (uint8_t)test_random();
+        }
+        memset(input + pos, (uint8_t)n, 300);
+        pos += 300;
+    }
+    test_round_trip(pos);
+
+    // Random bytes do not compress, so a smaller capacity refuses them
+    for (uint32_t i = 0; i < LZ_MAX_INPUT; i++)
+    {
+        input[i] = (uint8_t)test_random();
+    }
+    test_round_trip(LZ_MAX_INPUT);
+    CHECK(lz_compress(input, LZ_MAX_INPUT, packed, LZ_MAX_INPUT - 1) == 0);
+}
+
+// Inputs over the limit and outputs over the capacity are refused
+static void test_limits(void)
+{
+    memset(input, 'q', sizeof(input));
+    CHECK(lz_compress(input, LZ_MAX_INPUT + 1, packed, sizeof(packed)) == 0);
+    CHECK(lz_compress(input, 100, packed, 4) == 0);
+
+    uint32_t size = lz_compress(input, 100, packed, sizeof(packed));
+    CHECK(size > 0);
+    CHECK(test_decompress(packed, size, 99) == -1);
+}
+
+// Malformed blocks are rejected without writing past the output
+static void test_corrupt(void)
+{
+    const char *line = "corrupt blocks must never escape their buffers; ";
+    uint32_t line_len = strlen(line);
+    uint32_t len = 4000;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        input[i] = line[i % line_len];
+    }
+    uint32_t size = lz_compress(input, len, packed, sizeof(packed));
+    CHECK(size > 0);
+
+    // A truncated block never decodes to the whole input
+    for (uint32_t cut = 0; cut < size; cut++)
+    {
+        CHECK(test_decompress(packed, cut, len) < (int)len);
+    }
+
+    // Match offsets of zero or before the start of the output
+    const uint8_t zero_offset[] = {0x10, 'a', 0x00, 0x00, 0x00};
+    CHECK(test_decompress(zero_offset, sizeof(zero_offset), 64) == -1);
+    const uint8_t far_offset[] = {0x10, 'a', 0x02, 0x00, 0x00};
+    CHECK(test_decompress(far_offset, sizeof(far_offset), 64) == -1);
+
+    // Length extensions that run off the end of the block
+    const uint8_t long_literals[] = {0xF0, 0xFF, 0xFF};
+    CHECK(test_decompress(long_literals, sizeof(long_literals), 64) == -1);
+    const uint8_t long_match[] = {0x1F, 'a', 0x01, 0x00, 0xFF};
+    CHECK(test_decompress(long_match, sizeof(long_match), 1024) == -1);
+
+    // Random damage either fails or stays within the output
+    for (int round = 0; round < 2000; round++)
+    {
+        static uint8_t damaged[sizeof(packed)];
+        memcpy(damaged, packed, size);
+        for (int flips = 1 + test_random() % 4; flips > 0; flips--)
+        {
+            damaged[test_random() % size] ^= (uint8_t)(1 + test_random() % 255);
+        }
+        int result = test_decompress(damaged, size, len);
+        CHECK(result >= -1 && result <= (int)len);
+    }
+}
+
+int main(void)
+{
+    test_inputs();
+    test_limits();
+    test_corrupt();
+    return CHECK_DONE();
+}
@@ -0,0 +1,117 @@
+#include "check.h"
+
+// Included rather than linked, to reach the command table
+#include "terminal.c"
+
+// Kernel state the shell refers to
+const char *SECRET_MESSAGE = "test";
+const char keyboard_map[128];
+const char keyboard_map_shifted[128];
+char command_buffer[256];
+int command_length;
+char command_history[COMMAND_HISTORY_SIZE][256];
+int history_count;
+int history_position;
+bool shift_pressed;
+bool caps_lock;
+bool ctrl_pressed;
+int system_state;
+
+void delay(uint32_t milliseconds)
+{
+    (void)milliseconds;
+}
+
+uint8_t inb(uint16_t port)
+{
+    (void)port;
+    return 0;
+}
+
+void pci_list_devices(void)
+{
+}
+
+bool restore_from_backup(void)
+{
+    return false;
+}
+
+// Text mode screen, with a spare row for the console to scroll from
+static uint16_t screen[VGA_WIDTH * (VGA_HEIGHT + 1)];
+
+// Check whether the screen shows `text` on one row
+static bool screen_shows(const char *text)
+{
+    int length = strlen(text);
+    for (int row = 0; row <= VGA_HEIGHT; row++)
+    {
+        for (int column = 0; column + length <= VGA_WIDTH; column++)
+        {
+            int i = 0;
+            while (i < length && (char)screen[row * VGA_WIDTH + column + i] == text[i])
+            {
+                i++;
+            }
+            if (i == length)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Drain that never takes anything
+static void stuck_drain(pipe_t *pipe, void *context)
+{
+    (void)pipe;
+    (void)context;
+}
+
+// The fixed seed must place every command name at the first attempt;
+// otherwise COMMAND_HASH_SEED is out of date
+static void test_command_seed(void)
+{
+    CHECK(commands_place(COMMAND_HASH_SEED));
+    commands_init();
+    CHECK(command_seed == COMMAND_HASH_SEED);
+}
+
+// Errors and usage lines reach the screen, not the pipe or the file
+static void test_errors_on_screen(void)
+{
+    execute_command("cat nosuch | cat > out.txt");
+    CHECK(screen_shows("cat: cannot read nosuch"));
+    CHECK(fs_get_file_size("out.txt") == 0);
+
+    execute_command("grep | cat >> out.txt");
+    CHECK(screen_shows("Usage: grep"));
+    CHECK(fs_get_file_size("out.txt") == 0);
+
+    execute_command("help me > out.txt");
+    CHECK(screen_shows("Usage: help"));
+    CHECK(fs_get_file_size("out.txt") == 0);
+}
+
+// A write into a pipe whose reader takes nothing comes back short
+static void test_pipe_short_write(void)
+{
+    static pipe_t pipe;
+    static char data[PIPE_SIZE + 100];
+
+    pipe_init(&pipe, stuck_drain, NULL);
+    CHECK(pipe_write(&pipe, data, sizeof(data)) == PIPE_SIZE);
+    CHECK(pipe_write(&pipe, data, 1) == 0);
+}
+
+int main(void)
+{
+    terminal_buffer = screen;
+    fs_init();
+
+    test_command_seed();
+    test_errors_on_screen();
+    test_pipe_short_write();
+    return CHECK_DONE();
+}
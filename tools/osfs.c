@@ -0,0 +1,476 @@
+// Host-side tool for OSFS disk images
+//
+//   osfs mkfs <image> <size-in-KiB> [label]   create a formatted image
+//   osfs info <image>                         print the superblock
+//   osfs ls   <image>                         list files
+//   osfs cat  <image> <name>                  print a file
+//   osfs put  <image> <host-file> [name]      copy a host file into the image
+//
+// Shares the on-disk layout with the kernel through src/fs_layout.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/fs_layout.h"
+#include "../src/crc32c.h"
+#include "../src/lz.h"
+
+static FILE *image;
+static osfs_superblock_t sb;
+
+// Read one block from the image
+static void read_block(uint32_t block, void *buffer)
+{
+    if (fseek(image, (long)block * OSFS_BLOCK_SIZE, SEEK_SET) != 0 ||
+        fread(buffer, OSFS_BLOCK_SIZE, 1, image) != 1)
+    {
+        fprintf(stderr, "osfs: cannot read block %u\n", block);
+        exit(1);
+    }
+}
+
+// Write one block to the image
+static void write_block(uint32_t block, const void *buffer)
+{
+    if (fseek(image, (long)block * OSFS_BLOCK_SIZE, SEEK_SET) != 0 ||
+        fwrite(buffer, OSFS_BLOCK_SIZE, 1, image) != 1)
+    {
+        fprintf(stderr, "osfs: cannot write block %u\n", block);
+        exit(1);
+    }
+}
+
+// Open an image and load its superblock
+static void open_image(const char *path, const char *mode)
+{
+    uint8_t block[OSFS_BLOCK_SIZE];
+
+    image = fopen(path, mode);
+    if (image == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    read_block(0, block);
+    memcpy(&sb, block, sizeof(sb));
+    if (sb.magic != OSFS_MAGIC || sb.version == 0 || sb.version > OSFS_VERSION)
+    {
+        fprintf(stderr, "osfs: %s is not an OSFS image\n", path);
+        exit(1);
+    }
+
+    // Fields added by later versions read as zero on older images
+    if (sb.version < 2)
+    {
+        sb.journal_start = 0;
+        sb.journal_blocks = 0;
+    }
+    if (sb.version < 3)
+    {
+        sb.csum_start = 0;
+        sb.csum_blocks = 0;
+    }
+}
+
+// Read inode i
+static void read_inode(uint32_t i, osfs_inode_t *inode)
+{
+    osfs_inode_t block[OSFS_INODES_PER_BLOCK];
+    read_block(sb.inode_start + i / OSFS_INODES_PER_BLOCK, block);
+    *inode = block[i % OSFS_INODES_PER_BLOCK];
+}
+
+// Read directory entry i
+static void read_dirent(uint32_t i, osfs_dirent_t *dirent)
+{
+    uint8_t block[OSFS_BLOCK_SIZE];
+    read_block(sb.dir_start + i / OSFS_DIRENTS_PER_BLOCK, block);
+    memcpy(dirent, block + (i % OSFS_DIRENTS_PER_BLOCK) * sizeof(osfs_dirent_t), sizeof(*dirent));
+}
+
+// Find a file by name; returns its inode number or -1
+static int find_file(const char *name, osfs_inode_t *inode)
+{
+    for (uint32_t i = 0; i < sb.inode_count; i++)
+    {
+        osfs_dirent_t dirent;
+        read_dirent(i, &dirent);
+        if (dirent.hash == osfs_name_hash(name) && strncmp(dirent.name, name, OSFS_MAX_NAME) == 0)
+        {
+            read_inode(i, inode);
+            if (inode->flags & OSFS_INODE_USED)
+            {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+// Create a formatted image
+static int cmd_mkfs(const char *path, const char *size_kib, const char *label)
+{
+    uint32_t total = (uint32_t)strtoul(size_kib, NULL, 10) * 1024 / OSFS_BLOCK_SIZE;
+    uint32_t inodes = total / 8 < 2048 ? total / 8 : 2048;
+    uint8_t block[OSFS_BLOCK_SIZE];
+
+    memset(&sb, 0, sizeof(sb));
+    if (osfs_compute_layout(&sb, total, inodes) < 0)
+    {
+        fprintf(stderr, "osfs: image too small\n");
+        return 1;
+    }
+    strncpy(sb.label, label, sizeof(sb.label) - 1);
+
+    image = fopen(path, "wb");
+    if (image == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+
+    // Zero the whole image so unused regions read back empty
+    memset(block, 0, sizeof(block));
+    for (uint32_t b = 0; b < total; b++)
+    {
+        write_block(b, block);
+    }
+
+    strcpy((char *)block, "system");
+    write_block(sb.owner_block, block);
+
+    // Empty journal: replay would start at the first log block
+    osfs_journal_header_t header = { OSFS_JOURNAL_MAGIC, sb.journal_blocks, 1, 1 };
+    memset(block, 0, sizeof(block));
+    memcpy(block, &header, sizeof(header));
+    write_block(sb.journal_start, block);
+
+    memset(block, 0, sizeof(block));
+    memcpy(block, &sb, sizeof(sb));
+    write_block(0, block);
+
+    fclose(image);
+    printf("%s: %u blocks, %u inodes, %u data blocks\n", path, sb.total_blocks, sb.inode_count, sb.data_blocks);
+    return 0;
+}
+
+// Print the superblock
+static int cmd_info(const char *path)
+{
+    open_image(path, "rb");
+    printf("label:        %.16s\n", sb.label);
+    printf("state:        %s\n", sb.state == OSFS_STATE_CLEAN ? "clean" : "dirty");
+    printf("mount count:  %u\n", sb.mount_count);
+    printf("blocks:       %u (%u bytes each)\n", sb.total_blocks, sb.block_size);
+    printf("inodes:       %u at block %u (%u blocks)\n", sb.inode_count, sb.inode_start, sb.inode_blocks);
+    printf("directory:    block %u (%u blocks)\n", sb.dir_start, sb.dir_blocks);
+    if (sb.journal_blocks > 0)
+    {
+        printf("journal:      block %u (%u blocks)\n", sb.journal_start, sb.journal_blocks);
+    }
+    printf("bitmap:       block %u (%u blocks)\n", sb.bitmap_start, sb.bitmap_blocks);
+    if (sb.csum_blocks > 0)
+    {
+        printf("checksums:    block %u (%u blocks)\n", sb.csum_start, sb.csum_blocks);
+    }
+    printf("data:         block %u (%u blocks, %u free)\n", sb.data_start, sb.data_blocks, sb.free_blocks);
+    printf("files:        %u\n", sb.file_count);
+    fclose(image);
+    return 0;
+}
+
+// List files
+static int cmd_ls(const char *path)
+{
+    open_image(path, "rb");
+    for (uint32_t i = 0; i < sb.inode_count; i++)
+    {
+        osfs_inode_t inode;
+        read_inode(i, &inode);
+        if (!(inode.flags & OSFS_INODE_USED))
+        {
+            continue;
+        }
+
+        osfs_dirent_t dirent;
+        read_dirent(i, &dirent);
+        printf("%-32.32s %8u  type %u  extents %u%s\n", dirent.name, inode.size, inode.type, inode.extent_count,
+               (inode.flags & OSFS_INODE_PACKED) ? "  packed" : "");
+    }
+    fclose(image);
+    return 0;
+}
+
+// Read a file's n-th data block
+static void read_file_block(const osfs_inode_t *inode, uint32_t n, void *buffer)
+{
+    for (int e = 0; e < inode->extent_count; e++)
+    {
+        if (n < inode->extents[e].count)
+        {
+            read_block(sb.data_start + inode->extents[e].start + n, buffer);
+            return;
+        }
+        n -= inode->extents[e].count;
+    }
+    memset(buffer, 0, OSFS_BLOCK_SIZE);
+}
+
+// Print a packed file: decompress its units in turn
+static int cat_packed(const osfs_inode_t *inode)
+{
+    uint16_t table[OSFS_CZ_MAX_UNITS];
+    uint8_t stored[OSFS_CZ_UNIT];
+    uint8_t unit_data[OSFS_CZ_UNIT];
+
+    read_file_block(inode, 0, table);
+    uint32_t block = 1;
+    for (uint32_t u = 0; u * OSFS_CZ_UNIT < inode->size; u++)
+    {
+        uint32_t size = inode->size - u * OSFS_CZ_UNIT;
+        size = size < OSFS_CZ_UNIT ? size : OSFS_CZ_UNIT;
+        uint32_t blocks = (table[u] + OSFS_BLOCK_SIZE - 1) / OSFS_BLOCK_SIZE;
+        if (table[u] == 0 || table[u] > size)
+        {
+            fprintf(stderr, "osfs: bad unit table\n");
+            return 1;
+        }
+        for (uint32_t b = 0; b < blocks; b++)
+        {
+            read_file_block(inode, block + b, stored + b * OSFS_BLOCK_SIZE);
+        }
+        block += blocks;
+
+        if (table[u] == size)
+        {
+            fwrite(stored, 1, size, stdout);
+        }
+        else if (lz_decompress(stored, table[u], unit_data, size) == (int)size)
+        {
+            fwrite(unit_data, 1, size, stdout);
+        }
+        else
+        {
+            fprintf(stderr, "osfs: corrupt compressed unit %u\n", u);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Print a file's content
+static int cmd_cat(const char *path, const char *name)
+{
+    osfs_inode_t inode;
+    uint8_t block[OSFS_BLOCK_SIZE];
+
+    open_image(path, "rb");
+    if (find_file(name, &inode) < 0)
+    {
+        fprintf(stderr, "osfs: %s: no such file\n", name);
+        return 1;
+    }
+
+    if (inode.flags & OSFS_INODE_PACKED)
+    {
+        int status = cat_packed(&inode);
+        fclose(image);
+        return status;
+    }
+
+    uint32_t left = inode.size;
+    for (int e = 0; e < inode.extent_count && left > 0; e++)
+    {
+        for (uint32_t b = 0; b < inode.extents[e].count && left > 0; b++)
+        {
+            uint32_t part = left < OSFS_BLOCK_SIZE ? left : OSFS_BLOCK_SIZE;
+            read_block(sb.data_start + inode.extents[e].start + b, block);
+            fwrite(block, 1, part, stdout);
+            left -= part;
+        }
+    }
+    fclose(image);
+    return 0;
+}
+
+// Copy a host file into the image as a single extent
+static int cmd_put(const char *path, const char *host_file, const char *name)
+{
+    uint8_t block[OSFS_BLOCK_SIZE];
+    osfs_inode_t inode;
+
+    if (strlen(name) >= OSFS_MAX_NAME)
+    {
+        fprintf(stderr, "osfs: %s: name too long\n", name);
+        return 1;
+    }
+
+    // Committed metadata may still be waiting in the journal; only the
+    // kernel replays it
+    open_image(path, "rb");
+    fclose(image);
+    if (sb.journal_blocks > 0 && sb.state != OSFS_STATE_CLEAN)
+    {
+        fprintf(stderr, "osfs: %s was not unmounted cleanly; mount it first\n", path);
+        return 1;
+    }
+
+    FILE *in = fopen(host_file, "rb");
+    if (in == NULL)
+    {
+        perror(host_file);
+        return 1;
+    }
+    fseek(in, 0, SEEK_END);
+    uint32_t size = (uint32_t)ftell(in);
+    fseek(in, 0, SEEK_SET);
+    uint32_t need = (size + OSFS_BLOCK_SIZE - 1) / OSFS_BLOCK_SIZE;
+
+    open_image(path, "r+b");
+    if (find_file(name, &inode) >= 0)
+    {
+        fprintf(stderr, "osfs: %s: already exists\n", name);
+        return 1;
+    }
+
+    // Load the bitmap and find a free run for the whole file
+    uint8_t *bitmap = calloc(sb.bitmap_blocks, OSFS_BLOCK_SIZE);
+    for (uint32_t b = 0; b < sb.bitmap_blocks; b++)
+    {
+        read_block(sb.bitmap_start + b, bitmap + b * OSFS_BLOCK_SIZE);
+    }
+
+    uint32_t start = 0, run = 0;
+    for (uint32_t b = 0; b < sb.data_blocks && run < need; b++)
+    {
+        if (bitmap[b / 8] & (1u << (b % 8)))
+        {
+            run = 0;
+            start = b + 1;
+        }
+        else
+        {
+            run++;
+        }
+    }
+    if (run < need || need > 0xFFFF)
+    {
+        fprintf(stderr, "osfs: no contiguous space for %u blocks\n", need);
+        return 1;
+    }
+
+    // Find a free inode
+    uint32_t slot = 0;
+    while (slot < sb.inode_count)
+    {
+        read_inode(slot, &inode);
+        if (!(inode.flags & OSFS_INODE_USED))
+        {
+            break;
+        }
+        slot++;
+    }
+    if (slot == sb.inode_count)
+    {
+        fprintf(stderr, "osfs: inode table full\n");
+        return 1;
+    }
+
+    // Data, recording each block's checksum
+    uint32_t csums[OSFS_CSUMS_PER_BLOCK];
+    for (uint32_t b = 0; b < need; b++)
+    {
+        memset(block, 0, sizeof(block));
+        if (fread(block, 1, OSFS_BLOCK_SIZE, in) == 0 && ferror(in))
+        {
+            perror(host_file);
+            return 1;
+        }
+        write_block(sb.data_start + start + b, block);
+        bitmap[(start + b) / 8] |= 1u << ((start + b) % 8);
+
+        if (sb.csum_blocks > 0)
+        {
+            uint32_t csum_block = sb.csum_start + (start + b) / OSFS_CSUMS_PER_BLOCK;
+            read_block(csum_block, csums);
+            csums[(start + b) % OSFS_CSUMS_PER_BLOCK] = crc32c(0, block, OSFS_BLOCK_SIZE);
+            write_block(csum_block, csums);
+        }
+    }
+    fclose(in);
+
+    for (uint32_t b = 0; b < sb.bitmap_blocks; b++)
+    {
+        write_block(sb.bitmap_start + b, bitmap + b * OSFS_BLOCK_SIZE);
+    }
+    free(bitmap);
+
+    // Inode, written with today's date left at zero
+    osfs_inode_t inodes[OSFS_INODES_PER_BLOCK];
+    read_block(sb.inode_start + slot / OSFS_INODES_PER_BLOCK, inodes);
+    osfs_inode_t *node = &inodes[slot % OSFS_INODES_PER_BLOCK];
+    memset(node, 0, sizeof(*node));
+    node->size = size;
+    node->permissions = 0x03; // Read and write
+    node->flags = OSFS_INODE_USED;
+    node->extent_count = need > 0 ? 1 : 0;
+    node->extents[0].start = (uint16_t)start;
+    node->extents[0].count = (uint16_t)need;
+    write_block(sb.inode_start + slot / OSFS_INODES_PER_BLOCK, inodes);
+
+    // Directory entry
+    read_block(sb.dir_start + slot / OSFS_DIRENTS_PER_BLOCK, block);
+    osfs_dirent_t *dirent = (osfs_dirent_t *)block + slot % OSFS_DIRENTS_PER_BLOCK;
+    memset(dirent, 0, sizeof(*dirent));
+    dirent->hash = osfs_name_hash(name);
+    strcpy(dirent->name, name);
+    write_block(sb.dir_start + slot / OSFS_DIRENTS_PER_BLOCK, block);
+
+    // Superblock counters
+    sb.free_blocks -= need;
+    sb.file_count++;
+    memset(block, 0, sizeof(block));
+    memcpy(block, &sb, sizeof(sb));
+    write_block(0, block);
+
+    fclose(image);
+    return 0;
+}
+
+// Print usage
+static int usage(void)
+{
+    fprintf(stderr,
+            "usage: osfs mkfs <image> <size-in-KiB> [label]\n"
+            "       osfs info <image>\n"
+            "       osfs ls   <image>\n"
+            "       osfs cat  <image> <name>\n"
+            "       osfs put  <image> <host-file> [name]\n");
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        return usage();
+    }
+
+    if (strcmp(argv[1], "mkfs") == 0 && argc >= 4)
+        return cmd_mkfs(argv[2], argv[3], argc >= 5 ? argv[4] : "osiris");
+    if (strcmp(argv[1], "info") == 0)
+        return cmd_info(argv[2]);
+    if (strcmp(argv[1], "ls") == 0)
+        return cmd_ls(argv[2]);
+    if (strcmp(argv[1], "cat") == 0 && argc >= 4)
+        return cmd_cat(argv[2], argv[3]);
+    if (strcmp(argv[1], "put") == 0 && argc >= 4)
+    {
+        const char *name = argc >= 5 ? argv[4] : argv[3];
+        const char *slash = strrchr(name, '/');
+        return cmd_put(argv[2], argv[3], slash != NULL && argc < 5 ? slash + 1 : name);
+    }
+
+    return usage();
+}